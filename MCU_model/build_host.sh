@@ -0,0 +1,43 @@
+#!/bin/sh
+# Builds the host-side tools in MCU_model
+# ARDUINOJSON_DIR: ArduinoJson src/ directory (defaults to the Grand Central PlatformIO copy)
+set -e
+cd "$(dirname "$0")"
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:-"-std=gnu++17 -O2 -Wall"}
+ARDUINOJSON_DIR=${ARDUINOJSON_DIR:-../gAItar_arduino/.pio/libdeps/adafruit_grandcentral_m4/ArduinoJson/src}
+BUILD=${BUILD:-build}
+mkdir -p $BUILD
+
+# The instruction framing and opcodes are shared by both boards as two copies of each file
+for f in instruction_frame.h instruction_frame.cpp instruction_ops.h instruction_ops.cpp; do
+    cmp -s ../gAItar_esp32/src/$f ../gAItar_arduino/src/$f || { echo "$f differs between the boards" >&2; exit 1; }
+done
+
+$CXX $CXXFLAGS -I../gAItar_esp32/src delta_bench.cpp ../gAItar_esp32/src/delta_sync.cpp -o $BUILD/delta_bench
+$CXX $CXXFLAGS -I../gAItar_arduino/src frame_fuzz.cpp ../gAItar_arduino/src/instruction_frame.cpp -o $BUILD/frame_fuzz
+$CXX $CXXFLAGS -I"$ARDUINOJSON_DIR" -I../gAItar_arduino/src command_bench.cpp ../gAItar_arduino/src/instruction_ops.cpp \
+    -o $BUILD/command_bench
+$CXX $CXXFLAGS -I../gAItar_esp32/src midi_bench.cpp ../gAItar_esp32/src/midi_convert.cpp -o $BUILD/midi_bench
+$CXX $CXXFLAGS -Iinclude -I../gAItar_esp32/src fret_opt.cpp ../gAItar_esp32/src/midi_convert.cpp -o $BUILD/fret_opt
+# -O3 so GCC vectorises the string loop
+$CXX $CXXFLAGS -O3 -Iinclude render_song.cpp -o $BUILD/render_song
+
+# transfer_bench links both boards' firmware; each side gets its own shim headers
+$CXX $CXXFLAGS -c sim/common/sim_core.cpp -o $BUILD/sim_core.o
+for f in sim/samd/sim_samd.cpp sim/samd/sim_sdfat.cpp sim/samd/sim_sd_server.cpp \
+         ../gAItar_arduino/src/uart_transfer.cpp ../gAItar_arduino/src/song_index.cpp \
+         ../gAItar_arduino/src/upload_qos.cpp ../gAItar_arduino/src/instruction_frame.cpp \
+         ../gAItar_arduino/src/instruction_ops.cpp; do
+    # Firmware printf formats assume the 32-bit size_t of both MCUs
+    $CXX $CXXFLAGS -Wno-format -Isim/common -Isim/samd -I"$ARDUINOJSON_DIR" -I../gAItar_arduino/src \
+        -c "$f" -o $BUILD/samd_$(basename "$f" .cpp).o
+done
+# instruction_frame.cpp and instruction_ops.cpp are linked once, from the Grand Central side
+for f in sim/esp32/sim_esp32.cpp ../gAItar_esp32/src/uart.cpp ../gAItar_esp32/src/delta_sync.cpp \
+         ../gAItar_esp32/src/globals.cpp ../gAItar_esp32/src/upload_stream.cpp ../gAItar_esp32/src/line_assembler.cpp \
+         ../gAItar_esp32/src/upload_queue.cpp ../gAItar_esp32/src/midi_convert.cpp; do
+    $CXX $CXXFLAGS -Wno-format -Isim/common -Isim/esp32 -I"$ARDUINOJSON_DIR" -I../gAItar_esp32/src \
+        -c "$f" -o $BUILD/esp32_$(basename "$f" .cpp).o
+done
+$CXX $CXXFLAGS transfer_bench.cpp $BUILD/sim_core.o $BUILD/samd_*.o $BUILD/esp32_*.o -o $BUILD/transfer_bench
@@ -0,0 +1,215 @@
+// Host measurement of Grand Central instruction parsing: the text commands
+// ("[Play]{json}", "List{json}") through ArduinoJson against the binary
+// instructions of instruction_ops.h read in place
+// Build: g++ -std=c++17 -O2 -I<ArduinoJson src> -I../gAItar_arduino/src command_bench.cpp ../gAItar_arduino/src/instruction_ops.cpp -o command_bench
+// Usage: ./command_bench [iterations]
+// Built against a stand-in without ARDUINOJSON_VERSION, only the binary form is measured
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <ArduinoJson.h>
+#include "instruction_ops.h"
+
+using namespace std;
+
+static const double UART_US_PER_BYTE = 10 * 1e6 / 115200;
+
+// What the Grand Central keeps from each command (mirrors uart_transfer.cpp)
+struct PlayRequest
+{
+    char path[128];
+};
+
+struct ListRequest
+{
+    uint8_t requestId;
+    uint16_t offset;
+    uint16_t limit;
+    char genre[32];
+    char artist[48];
+    char title[48];
+};
+
+static volatile size_t sink; // Keeps the parsed results alive
+
+static bool parseBinaryPlay(const uint8_t* payload, size_t length, PlayRequest& out)
+{
+    InstructionOpReader reader(payload, length);
+    InstructionArg arg;
+    const char* path = nullptr;
+    if (reader.op() != INSTRUCTION_OP_PLAY) return false;
+    while (reader.next(arg))
+    {
+        if (arg.type == INSTRUCTION_ARG_PATH && !arg.asString(path)) return false;
+    }
+    if (reader.malformed() || !path) return false;
+    strncpy(out.path, path, sizeof(out.path) - 1); // playSong() keeps the last request
+    return true;
+}
+
+static bool parseBinaryList(const uint8_t* payload, size_t length, ListRequest& out)
+{
+    InstructionOpReader reader(payload, length);
+    InstructionArg arg;
+    memset(&out, 0, sizeof(out));
+    out.limit = 50;
+    while (reader.next(arg))
+    {
+        const char* text;
+        switch (arg.type)
+        {
+        case INSTRUCTION_ARG_REQUEST_ID: arg.asU8(out.requestId); break;
+        case INSTRUCTION_ARG_OFFSET: arg.asU16(out.offset); break;
+        case INSTRUCTION_ARG_LIMIT: arg.asU16(out.limit); break;
+        case INSTRUCTION_ARG_GENRE:
+            if (arg.asString(text)) strncpy(out.genre, text, sizeof(out.genre) - 1);
+            break;
+        case INSTRUCTION_ARG_ARTIST:
+            if (arg.asString(text)) strncpy(out.artist, text, sizeof(out.artist) - 1);
+            break;
+        case INSTRUCTION_ARG_TITLE:
+            if (arg.asString(text)) strncpy(out.title, text, sizeof(out.title) - 1);
+            break;
+        }
+    }
+    return !reader.malformed();
+}
+
+#ifdef ARDUINOJSON_VERSION
+// Counts what a JsonDocument takes from the heap (the FreeRTOS heap on the board)
+struct CountingAllocator : ArduinoJson::Allocator
+{
+    size_t allocations = 0;
+    size_t bytes = 0;
+
+    void* allocate(size_t size) override
+    {
+        allocations++;
+        bytes += size;
+        return malloc(size);
+    }
+    void deallocate(void* ptr) override { free(ptr); }
+    void* reallocate(void* ptr, size_t size) override
+    {
+        allocations++;
+        return realloc(ptr, size);
+    }
+};
+
+static CountingAllocator allocator;
+
+static bool parseJsonPlay(const char* command, PlayRequest& out)
+{
+    JsonDocument doc(&allocator);
+    if (deserializeJson(doc, command + 6)) return false;
+    snprintf(out.path, sizeof(out.path), "/%s/%s/%s.bin", doc["genre"] | "", doc["artist"] | "",
+             doc["title"] | "");
+    return true;
+}
+
+static bool parseJsonList(const char* command, ListRequest& out)
+{
+    memset(&out, 0, sizeof(out));
+    JsonDocument doc(&allocator);
+    if (deserializeJson(doc, command + 4)) return false;
+    out.requestId = doc["id"] | 0;
+    out.offset = doc["offset"] | 0;
+    out.limit = doc["limit"] | 50;
+    strncpy(out.genre, doc["genre"] | "", sizeof(out.genre) - 1);
+    strncpy(out.artist, doc["artist"] | "", sizeof(out.artist) - 1);
+    strncpy(out.title, doc["title"] | "", sizeof(out.title) - 1);
+    return true;
+}
+#endif
+
+// Median ns per call over several timed runs
+template <typename F>
+static double timeNs(size_t iterations, F&& parse)
+{
+    vector<double> runs;
+    for (int run = 0; run < 7; run++)
+    {
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) parse();
+        runs.push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / iterations);
+    }
+    sort(runs.begin(), runs.end());
+    return runs[runs.size() / 2];
+}
+
+static void report(const char* label, size_t bytes, double ns, double allocations)
+{
+    printf("%-22s %4zu B  wire %7.1f us  parse %8.1f ns", label, bytes, bytes * UART_US_PER_BYTE, ns);
+    if (allocations >= 0) printf("  %.1f allocations", allocations);
+    printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+    size_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+
+    const char* genre = "Rock";
+    const char* artist = "Red_Hot_Chili_Peppers";
+    const char* title = "Under_the_Bridge";
+    string jsonPlay = string("[Play]{\"title\":\"") + title + "\",\"artist\":\"" + artist + "\",\"genre\":\"" +
+                      genre + "\"}";
+    string jsonList = "List{\"id\":7,\"offset\":150,\"limit\":50,\"artist\":\"Red\"}";
+
+    char path[128];
+    snprintf(path, sizeof(path), "/%s/%s/%s.bin", genre, artist, title);
+    uint8_t binaryPlay[160];
+    InstructionOpWriter play(binaryPlay, sizeof(binaryPlay), INSTRUCTION_OP_PLAY);
+    play.str(INSTRUCTION_ARG_PATH, path);
+    uint8_t binaryList[64];
+    InstructionOpWriter list(binaryList, sizeof(binaryList), INSTRUCTION_OP_LIST);
+    list.u8(INSTRUCTION_ARG_REQUEST_ID, 7);
+    list.u16(INSTRUCTION_ARG_OFFSET, 150);
+    list.u16(INSTRUCTION_ARG_LIMIT, 50);
+    list.str(INSTRUCTION_ARG_ARTIST, "Red");
+
+    PlayRequest playOut;
+    ListRequest listOut;
+    printf("%zu iterations per run, median of 7 runs; wire time at 115200 baud excludes framing\n", iterations);
+
+    double ns = timeNs(iterations, [&] {
+        parseBinaryPlay(binaryPlay, play.length(), playOut);
+        sink += playOut.path[1];
+    });
+    report("play binary", play.length(), ns, 0);
+    ns = timeNs(iterations, [&] {
+        parseBinaryList(binaryList, list.length(), listOut);
+        sink += listOut.offset;
+    });
+    report("list binary", list.length(), ns, 0);
+
+#ifdef ARDUINOJSON_VERSION
+    allocator.allocations = 0;
+    ns = timeNs(iterations, [&] {
+        parseJsonPlay(jsonPlay.c_str(), playOut);
+        sink += playOut.path[1];
+    });
+    report("play json", jsonPlay.size(), ns, (double)allocator.allocations / (iterations * 7));
+    allocator.allocations = 0;
+    ns = timeNs(iterations, [&] {
+        parseJsonList(jsonList.c_str(), listOut);
+        sink += listOut.offset;
+    });
+    report("list json", jsonList.size(), ns, (double)allocator.allocations / (iterations * 7));
+#else
+    report("play json", jsonPlay.size(), 0, -1);
+    report("list json", jsonList.size(), 0, -1);
+    printf("(no ArduinoJson: set ARDUINOJSON_DIR to its src/ directory to time the JSON form)\n");
+#endif
+
+    PlayRequest check;
+    if (!parseBinaryPlay(binaryPlay, play.length(), check) || strcmp(check.path, path) != 0)
+    {
+        printf("binary play did not round-trip\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,190 @@
+// Host measurement of delta uploads on realistic edits to song event streams
+// Build: g++ -std=c++17 -O2 -I../gAItar_esp32/src delta_bench.cpp ../gAItar_esp32/src/delta_sync.cpp -o delta_bench
+// Usage: ./delta_bench [song.bin]   (synthetic song when no file is given)
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include "delta_sync.h"
+
+using namespace std;
+
+struct Event
+{
+    uint32_t time;
+    uint8_t string;
+    int8_t fret;
+};
+
+// Song .bin layout: duration (4 BE) + event count (2 BE) + 5 bytes per event
+static vector<uint8_t> serialize(const vector<Event>& events)
+{
+    uint32_t duration = events.empty() ? 0 : events.back().time;
+    vector<uint8_t> out = {
+        uint8_t(duration >> 24), uint8_t(duration >> 16), uint8_t(duration >> 8), uint8_t(duration),
+        uint8_t(events.size() >> 8), uint8_t(events.size())};
+    for (const Event& e : events)
+    {
+        uint8_t fret = e.fret < 0 ? 31 : e.fret;
+        out.insert(out.end(), {uint8_t(e.time >> 24), uint8_t(e.time >> 16), uint8_t(e.time >> 8),
+                               uint8_t(e.time), uint8_t((e.string << 5) | fret)});
+    }
+    return out;
+}
+
+static vector<Event> parse(const vector<uint8_t>& bin)
+{
+    vector<Event> events;
+    for (size_t p = 6; p + 5 <= bin.size(); p += 5)
+    {
+        uint32_t t = (bin[p] << 24) | (bin[p + 1] << 16) | (bin[p + 2] << 8) | bin[p + 3];
+        uint8_t fret = bin[p + 4] & 0x1F;
+        events.push_back({t, uint8_t(bin[p + 4] >> 5), int8_t(fret == 31 ? -1 : fret)});
+    }
+    return events;
+}
+
+// Note-on / note-off pairs on random strings, roughly 4 notes per second
+static vector<Event> synthSong(mt19937& rng, size_t notes)
+{
+    vector<Event> events;
+    uint32_t t = 0;
+    for (size_t i = 0; i < notes; i++)
+    {
+        t += 150 + rng() % 200;
+        uint8_t s = 1 + rng() % 6;
+        events.push_back({t, s, int8_t(rng() % 13)});
+        events.push_back({t + 100 + uint32_t(rng() % 300), s, -1});
+    }
+    stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.time < b.time; });
+    return events;
+}
+
+// Receiver side: block sums over the stored file (full blocks only)
+static vector<DeltaBlockSum> blockSums(const vector<uint8_t>& old)
+{
+    vector<DeltaBlockSum> sums;
+    for (size_t p = 0; p + DELTA_BLOCK_SIZE <= old.size(); p += DELTA_BLOCK_SIZE)
+    {
+        sums.push_back({deltaWeakSum(&old[p], DELTA_BLOCK_SIZE), deltaStrongSum(&old[p], DELTA_BLOCK_SIZE)});
+    }
+    return sums;
+}
+
+// Receiver side: assemble the new file the way the Grand Central does
+static vector<uint8_t> apply(const vector<uint8_t>& old, const vector<uint8_t>& fresh, const vector<DeltaOp>& ops)
+{
+    vector<uint8_t> out;
+    for (const DeltaOp& op : ops)
+    {
+        if (op.type == DELTA_COPY)
+        {
+            out.insert(out.end(), old.begin() + op.start * DELTA_BLOCK_SIZE,
+                       old.begin() + (op.start + op.length) * DELTA_BLOCK_SIZE);
+        }
+        else
+        {
+            out.insert(out.end(), fresh.begin() + op.start, fresh.begin() + op.start + op.length);
+        }
+    }
+    return out;
+}
+
+static bool runCase(const string& name, const vector<uint8_t>& old, const vector<uint8_t>& fresh)
+{
+    vector<DeltaBlockSum> sums = blockSums(old);
+    vector<DeltaOp> ops(deltaMaxOps(fresh.size()));
+
+    auto t0 = chrono::steady_clock::now();
+    size_t count = deltaPlan(fresh.data(), fresh.size(), sums.data(), sums.size(), ops.data(), ops.size());
+    auto t1 = chrono::steady_clock::now();
+    ops.resize(count);
+
+    // Same fallback as the ESP32: a plan no cheaper than the whole file is sent as one literal run
+    DeltaOp whole = {DELTA_LITERAL, 0, (uint32_t)fresh.size()};
+    size_t fullWire = deltaWireBytes(&whole, 1, 64);
+    bool fallback = count == 0 || deltaWireBytes(ops.data(), ops.size(), 64) >= fullWire;
+    if (fallback) ops.assign(1, whole);
+
+    bool ok = apply(old, fresh, ops) == fresh;
+    size_t literal = deltaLiteralBytes(ops.data(), ops.size());
+    size_t deltaWire = sums.size() * sizeof(DeltaBlockSum) + deltaWireBytes(ops.data(), ops.size(), 64) +
+                       strlen("ACK:DELTA:OK\n");
+    double baud = 115200.0 / 10.0; // bytes per second
+
+    printf("%-22s %7zu B  literal %6zu B  ops %4zu  wire %6zu vs %6zu B  (%5.1f%%)  %6.2f s vs %6.2f s  plan %6.1f us  %s\n",
+           name.c_str(), fresh.size(), literal, ops.size(), deltaWire, fullWire,
+           100.0 * deltaWire / fullWire, deltaWire / baud, fullWire / baud,
+           chrono::duration<double, micro>(t1 - t0).count(), !ok ? "MISMATCH" : fallback ? "ok (whole file)" : "ok");
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    mt19937 rng(2025);
+    vector<Event> base;
+
+    if (argc > 1)
+    {
+        ifstream in(argv[1], ios::binary);
+        vector<uint8_t> bin((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        base = parse(bin);
+        cout << "Base song: " << argv[1] << " (" << base.size() << " events)" << endl;
+    }
+    else
+    {
+        base = synthSong(rng, 1500);
+        cout << "Base song: synthetic (" << base.size() << " events)" << endl;
+    }
+    if (base.size() < 100)
+    {
+        cout << "Song too short for meaningful edits" << endl;
+        return 1;
+    }
+
+    vector<uint8_t> old = serialize(base);
+    bool ok = true;
+
+    ok &= runCase("identical", old, old);
+
+    vector<Event> tweak = base;
+    for (int i = 0; i < 10; i++)
+    {
+        Event& e = tweak[rng() % tweak.size()];
+        if (e.fret >= 0) e.fret = (e.fret + 2) % 13;
+    }
+    ok &= runCase("10 fret tweaks", old, serialize(tweak));
+
+    vector<Event> inserted = base;
+    size_t mid = inserted.size() / 2;
+    vector<Event> phrase(inserted.begin() + mid, inserted.begin() + mid + 20);
+    inserted.insert(inserted.begin() + mid, phrase.begin(), phrase.end());
+    ok &= runCase("insert 20 events", old, serialize(inserted));
+
+    vector<Event> removed = base;
+    removed.erase(removed.begin() + removed.size() / 3, removed.begin() + removed.size() / 3 + 50);
+    ok &= runCase("delete 50 events", old, serialize(removed));
+
+    vector<Event> regen(base.begin(), base.begin() + base.size() * 3 / 4);
+    vector<Event> tail = synthSong(rng, base.size() / 8);
+    for (Event& e : tail) e.time += regen.back().time;
+    regen.insert(regen.end(), tail.begin(), tail.end());
+    ok &= runCase("regenerate last 25%", old, serialize(regen));
+
+    vector<Event> appended = base;
+    vector<Event> coda = synthSong(rng, 40);
+    for (Event& e : coda) e.time += appended.back().time;
+    appended.insert(appended.end(), coda.begin(), coda.end());
+    ok &= runCase("append 80 events", old, serialize(appended));
+
+    vector<Event> tempo = base;
+    for (Event& e : tempo) e.time = e.time * 105 / 100;
+    ok &= runCase("tempo +5% (worst)", old, serialize(tempo));
+
+    return ok ? 0 : 1;
+}
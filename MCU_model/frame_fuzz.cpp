@@ -0,0 +1,278 @@
+// Host fuzzing of the ESP32 -> Grand Central instruction framing (instruction_frame.h)
+// against the previous 0xAA length payload framing, on streams with injected line noise
+// Build: g++ -std=c++17 -O2 -I../gAItar_arduino/src frame_fuzz.cpp ../gAItar_arduino/src/instruction_frame.cpp -o frame_fuzz
+// Usage: ./frame_fuzz [frames] [seed]
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "instruction_frame.h"
+
+using namespace std;
+
+// Mirrors uart_tasks.h on the ESP32
+#define INSTRUCTION_ACK_TIMEOUT_MS 100
+#define INSTRUCTION_ACK_RETRIES 3
+
+static const double BAUD_BYTES_PER_MS = 115200 / 10 / 1000.0;
+
+// Instructions as the ESP32 sends them: play with song metadata, pause, list pages
+static string randomCommand(mt19937& rng)
+{
+    switch (rng() % 4)
+    {
+    case 0:
+        return "Pause";
+    case 1:
+        return "List" + to_string(rng() % 40);
+    default:
+    {
+        string title(8 + rng() % 60, 'a');
+        for (char& c : title) c = 'a' + rng() % 26;
+        return "[Play]{\"title\":\"" + title + "\",\"artist\":\"Artist " + to_string(rng() % 100) +
+               "\",\"genre\":\"Rock\"}";
+    }
+    }
+}
+
+static void appendFrame(vector<uint8_t>& out, const string& payload, uint8_t flags, uint8_t seq)
+{
+    uint8_t header[INSTRUCTION_FRAME_HEADER_SIZE];
+    uint16_t crc = instructionFrameHeader(header, flags, seq, payload.size());
+    crc = instructionCrc16((const uint8_t*)payload.data(), payload.size(), crc);
+    out.insert(out.end(), header, header + sizeof(header));
+    out.insert(out.end(), payload.begin(), payload.end());
+    out.push_back(crc);
+    out.push_back(crc >> 8);
+}
+
+static void appendLegacyFrame(vector<uint8_t>& out, const string& payload)
+{
+    out.push_back(0xAA);
+    out.push_back(payload.size());
+    out.insert(out.end(), payload.begin(), payload.end());
+}
+
+// Bit flips, dropped bytes and inserted garbage, each at rate per byte
+static vector<uint8_t> addNoise(const vector<uint8_t>& in, double rate, mt19937& rng)
+{
+    uniform_real_distribution<double> uni(0, 1);
+    vector<uint8_t> out;
+    out.reserve(in.size() + in.size() / 8);
+    for (uint8_t b : in)
+    {
+        double r = uni(rng);
+        if (r < rate) continue;                                 // Dropped
+        if (r < 2 * rate) b ^= 1 << (rng() % 8);                // Flipped
+        out.push_back(b);
+        if (uni(rng) < rate) out.push_back(rng() & 0xFF);        // Inserted
+    }
+    return out;
+}
+
+struct Collector : InstructionFrameHandler
+{
+    vector<string> received;
+
+    void onFrame(uint8_t, uint8_t, char* payload, uint16_t length) override
+    {
+        received.emplace_back(payload, length);
+    }
+};
+
+// The receiver before framing: 0xAA, length byte, that many bytes, no check
+static vector<string> legacyDecode(const vector<uint8_t>& stream)
+{
+    vector<string> received;
+    enum { WAIT_FOR_HEADER, WAIT_FOR_LENGTH, WAIT_FOR_PAYLOAD } state = WAIT_FOR_HEADER;
+    string payload;
+    size_t length = 0;
+    for (uint8_t b : stream)
+    {
+        switch (state)
+        {
+        case WAIT_FOR_HEADER:
+            if (b == 0xAA) state = WAIT_FOR_LENGTH;
+            break;
+        case WAIT_FOR_LENGTH:
+            length = b;
+            payload.clear();
+            state = b ? WAIT_FOR_PAYLOAD : WAIT_FOR_HEADER;
+            break;
+        case WAIT_FOR_PAYLOAD:
+            payload.push_back(b);
+            if (payload.size() == length)
+            {
+                received.push_back(payload);
+                state = WAIT_FOR_HEADER;
+            }
+            break;
+        }
+    }
+    return received;
+}
+
+struct Tally
+{
+    size_t delivered = 0;   // Sent commands received intact
+    size_t falseAccepts = 0; // Received commands that were never sent
+};
+
+static Tally tally(const vector<string>& sent, const vector<string>& received)
+{
+    Tally t;
+    size_t next = 0;
+    for (const string& r : received)
+    {
+        // Delivered frames arrive in order; anything else is a corrupt accept
+        size_t i = next;
+        while (i < sent.size() && i < next + 64 && sent[i] != r) i++;
+        if (i < sent.size() && sent[i] == r)
+        {
+            t.delivered++;
+            next = i + 1;
+        }
+        else
+        {
+            t.falseAccepts++;
+        }
+    }
+    return t;
+}
+
+static void noiseRun(const vector<string>& commands, double rate, mt19937& rng)
+{
+    vector<uint8_t> framed, legacy;
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+        appendFrame(framed, commands[i], INSTRUCTION_FLAG_ACK, i);
+        appendLegacyFrame(legacy, commands[i]);
+    }
+    vector<uint8_t> noisyFramed = addNoise(framed, rate, rng);
+    vector<uint8_t> noisyLegacy = addNoise(legacy, rate, rng);
+
+    InstructionFrameDecoder decoder;
+    Collector collector;
+    for (uint8_t b : noisyFramed) decoder.push(b, collector);
+    decoder.abandon(collector);
+    Tally framedTally = tally(commands, collector.received);
+    Tally legacyTally = tally(commands, legacyDecode(noisyLegacy));
+
+    printf("noise %6.4f%%  framed: delivered %6.2f%%  false accepts %4zu  header errors %5u  crc errors %5u  |"
+           "  legacy: delivered %6.2f%%  false accepts %4zu\n",
+           rate * 100, 100.0 * framedTally.delivered / commands.size(), framedTally.falseAccepts,
+           decoder.headerErrors, decoder.crcErrors, 100.0 * legacyTally.delivered / commands.size(),
+           legacyTally.falseAccepts);
+}
+
+// Frames lost to a lone stray start byte ahead of them
+static void resyncRun(const vector<string>& commands, mt19937& rng)
+{
+    size_t trials = 2000, framedLost = 0, legacyLost = 0;
+    for (size_t t = 0; t < trials; t++)
+    {
+        // A stray 0xAA just ahead of three frames, as line noise before a command
+        vector<uint8_t> framed = {0xAA}, legacy = {0xAA};
+        vector<string> sent;
+        for (int i = 0; i < 3; i++)
+        {
+            const string& c = commands[rng() % commands.size()];
+            sent.push_back(c);
+            appendFrame(framed, c, 0, i);
+            appendLegacyFrame(legacy, c);
+        }
+        InstructionFrameDecoder decoder;
+        Collector collector;
+        for (uint8_t b : framed) decoder.push(b, collector);
+        framedLost += sent.size() - tally(sent, collector.received).delivered;
+        legacyLost += sent.size() - tally(sent, legacyDecode(legacy)).delivered;
+    }
+    printf("stray start byte before 3 frames (%zu trials): framed lost %zu frames, legacy lost %zu frames\n",
+           trials, framedLost, legacyLost);
+}
+
+static void throughputRun(const vector<string>& commands)
+{
+    vector<uint8_t> framed;
+    for (size_t i = 0; i < commands.size(); i++) appendFrame(framed, commands[i], 0, i);
+    InstructionFrameDecoder decoder;
+    Collector collector;
+    collector.received.reserve(commands.size() * 20);
+    auto start = chrono::steady_clock::now();
+    for (int pass = 0; pass < 20; pass++)
+        for (uint8_t b : framed) decoder.push(b, collector);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("clean decode: %.1f MB/s (%u frames), UART at 115200 baud is %.3f MB/s\n",
+           framed.size() * 20 / seconds / 1e6, decoder.frames, BAUD_BYTES_PER_MS / 1000);
+}
+
+// Stop-and-wait delivery over a noisy link as the ESP32 TX task runs it
+static void ackRun(const vector<string>& commands, double rate, mt19937& rng)
+{
+    uniform_real_distribution<double> uni(0, 1);
+    size_t delivered = 0, duplicates = 0, failed = 0, attempts = 0;
+    double elapsedMs = 0;
+    int lastSeq = -1;
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+        uint8_t seq = i;
+        bool acked = false;
+        for (int attempt = 0; attempt <= INSTRUCTION_ACK_RETRIES && !acked; attempt++)
+        {
+            attempts++;
+            uint8_t flags = INSTRUCTION_FLAG_ACK | (attempt ? INSTRUCTION_FLAG_RETRY : 0);
+            vector<uint8_t> frame;
+            appendFrame(frame, commands[i], flags, seq);
+            elapsedMs += frame.size() / BAUD_BYTES_PER_MS;
+
+            InstructionFrameDecoder decoder;
+            Collector collector;
+            for (uint8_t b : addNoise(frame, rate, rng)) decoder.push(b, collector);
+            if (collector.received.empty())
+            {
+                elapsedMs += INSTRUCTION_ACK_TIMEOUT_MS;
+                continue;
+            }
+            if (attempt && seq == lastSeq) duplicates++;
+            else delivered++;
+            lastSeq = seq;
+
+            // The reply crosses the same link
+            uint8_t reply[INSTRUCTION_ACK_SIZE];
+            instructionAckReply(reply, seq, INSTRUCTION_ACK_OK);
+            vector<uint8_t> noisyReply = addNoise(vector<uint8_t>(reply, reply + sizeof(reply)), rate, rng);
+            acked = noisyReply.size() == INSTRUCTION_ACK_SIZE && instructionAckValid(noisyReply.data()) &&
+                    noisyReply[1] == seq;
+            elapsedMs += acked ? INSTRUCTION_ACK_SIZE / BAUD_BYTES_PER_MS : INSTRUCTION_ACK_TIMEOUT_MS;
+        }
+        if (!acked) failed++;
+    }
+    printf("ack noise %6.4f%%: delivered %6.2f%%  duplicates suppressed %3zu  given up %3zu  "
+           "attempts/instruction %.3f  avg %.2f ms/instruction\n",
+           rate * 100, 100.0 * delivered / commands.size(), duplicates, failed,
+           (double)attempts / commands.size(), elapsedMs / commands.size());
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+    mt19937 rng(argc > 2 ? strtoul(argv[2], nullptr, 10) : 1);
+
+    vector<string> commands;
+    for (size_t i = 0; i < count; i++) commands.push_back(randomCommand(rng));
+
+    for (double rate : {0.0, 0.00001, 0.0001, 0.001, 0.01})
+    {
+        noiseRun(commands, rate, rng);
+    }
+    resyncRun(commands, rng);
+    throughputRun(commands);
+    for (double rate : {0.0, 0.0001, 0.001, 0.01})
+    {
+        ackRun(commands, rate, rng);
+    }
+    return 0;
+}
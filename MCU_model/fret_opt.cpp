@@ -0,0 +1,171 @@
+// Assigns strings and frets to the notes of .mid files with the dynamic
+// programming optimiser (include/fret_optimizer.hpp) and compares it with
+// the backend's greedy assignment on the same cost model
+// Build: g++ -std=c++17 -O2 -Iinclude -I../gAItar_esp32/src fret_opt.cpp ../gAItar_esp32/src/midi_convert.cpp -o fret_opt
+// Usage: ./fret_opt [--repick ms] [--legato ms] [--out <dir>] <file.mid | dir>...
+//        (--out writes <name>.bin for each file, ready for /upload-binary)
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <deque>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "midi_convert.h"
+#include "fret_optimizer.hpp"
+#include "parser.hpp"
+
+using namespace std;
+
+static const int TIMING_RUNS = 10;
+
+struct NoteReader
+{
+    vector<Note> notes;
+    deque<size_t> sounding[128]; // Open notes per pitch, oldest first
+    uint32_t lastTime = 0;
+};
+
+static bool collectNote(uint32_t timeMs, uint8_t pitch, bool on, void* context)
+{
+    NoteReader& reader = *(NoteReader*)context;
+    reader.lastTime = timeMs;
+    pitch &= 0x7F;
+    if (on)
+    {
+        reader.sounding[pitch].push_back(reader.notes.size());
+        reader.notes.push_back({timeMs, timeMs, pitch});
+    }
+    else if (!reader.sounding[pitch].empty())
+    {
+        reader.notes[reader.sounding[pitch].front()].end = timeMs;
+        reader.sounding[pitch].pop_front();
+    }
+    return true;
+}
+
+static bool readNotes(const vector<uint8_t>& midi, vector<Note>& notes, MidiConvertError& error)
+{
+    NoteReader reader;
+    if (!midiReadNotes(midi.data(), midi.size(), collectNote, &reader, error)) return false;
+    for (const deque<size_t>& open : reader.sounding)
+    {
+        for (size_t i : open) reader.notes[i].end = reader.lastTime; // Never turned off
+    }
+    notes.swap(reader.notes);
+    return true;
+}
+
+static string baseName(const string& path)
+{
+    size_t slash = path.find_last_of('/');
+    string name = slash == string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    return dot == string::npos ? name : name.substr(0, dot);
+}
+
+static vector<string> midiFiles(const vector<string>& args)
+{
+    vector<string> files;
+    for (const string& arg : args)
+    {
+        struct stat st;
+        if (stat(arg.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        {
+            files.push_back(arg);
+            continue;
+        }
+        vector<string> found;
+        if (DIR* dir = opendir(arg.c_str()))
+        {
+            while (dirent* entry = readdir(dir))
+            {
+                string name = entry->d_name;
+                if (name.size() > 4 && name.compare(name.size() - 4, 4, ".mid") == 0) found.push_back(arg + "/" + name);
+            }
+            closedir(dir);
+        }
+        sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    }
+    return files;
+}
+
+static void printScore(const char* label, const FretScore& s)
+{
+    printf("  %-9s %7u %7u %7u %9u %9u %9u %10.0f\n", label, s.notes - s.dropped, s.dropped, s.shifted,
+           s.collisions, s.restrikes, s.solenoidSwitches, s.cost);
+}
+
+int main(int argc, char** argv)
+{
+    FretCosts costs;
+    string outDir;
+    vector<string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--repick") && i + 1 < argc) costs.minRepickMs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--legato") && i + 1 < argc) costs.legatoGapMs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) outDir = argv[++i];
+        else args.push_back(argv[i]);
+    }
+    if (args.empty()) args.push_back("../Python/midi_tracks");
+
+    printf("re-pick %u ms, legato gap %u ms, %d frets\n", costs.minRepickMs, costs.legatoGapMs, NUM_FRETS);
+    printf("  %-9s %7s %7s %7s %9s %9s %9s %10s\n", "", "played", "dropped", "shifted", "collided", "restrikes",
+           "solenoid", "cost");
+    FretScore greedyTotal, optimizedTotal;
+    for (const string& path : midiFiles(args))
+    {
+        string name = baseName(path);
+        ifstream in(path, ios::binary);
+        vector<uint8_t> midi((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        vector<Note> notes;
+        MidiConvertError error;
+        if (!readNotes(midi, notes, error))
+        {
+            printf("%s: %s\n", name.c_str(), midiConvertErrorText(error));
+            continue;
+        }
+
+        vector<FretPlacement> greedy = greedyFrets(notes);
+        vector<FretPlacement> optimized;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < TIMING_RUNS; i++) optimized = optimizeFrets(notes, costs);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / TIMING_RUNS;
+
+        FretScore g = scoreFrets(notes, greedy, costs);
+        FretScore o = scoreFrets(notes, optimized, costs);
+        vector<SongEvent> events = placementEvents(notes, optimized, costs);
+        printf("%s: %zu notes, %zu events, optimised in %.2f ms\n", name.c_str(), notes.size(), events.size(), ms);
+        printScore("greedy", g);
+        printScore("optimised", o);
+        if (events.size() > 0xFFFF)
+        {
+            printf("  too many events for one song, not written\n");
+        }
+        else if (!outDir.empty() && !writeSongFile(outDir + "/" + name + ".bin", events))
+        {
+            printf("  could not write %s/%s.bin\n", outDir.c_str(), name.c_str());
+        }
+
+        for (auto [total, s] : {make_pair(&greedyTotal, &g), make_pair(&optimizedTotal, &o)})
+        {
+            total->notes += s->notes;
+            total->dropped += s->dropped;
+            total->shifted += s->shifted;
+            total->collisions += s->collisions;
+            total->restrikes += s->restrikes;
+            total->solenoidSwitches += s->solenoidSwitches;
+            total->cost += s->cost;
+        }
+    }
+    printf("all files\n");
+    printScore("greedy", greedyTotal);
+    printScore("optimised", optimizedTotal);
+    return 0;
+}
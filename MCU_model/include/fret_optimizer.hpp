@@ -0,0 +1,402 @@
+// String and fret assignment by dynamic programming over chord voicings
+// Notes starting at the same time form a slice; each slice has a set of
+// candidate voicings (every note on a string that reaches it, moved by octaves
+// if no string does, or dropped) and the Viterbi pass picks the voicing
+// sequence with the lowest total cost. Besides the previous voicing, each
+// state carries the per-string history of its best path (last strike, note
+// end, frets held), so costs that reach back further than one slice are
+// still charged against the path that is actually kept.
+#ifndef FRET_OPTIMIZER_HPP
+#define FRET_OPTIMIZER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+#include "parser.hpp"
+
+#define NUM_FRETS 12            // Mirrors gAItar_arduino/src/globals.h
+#define MIN_REPICK_MS 80        // Shortest time between two strikes of one string servo
+#define LEGATO_GAP_MS 30        // Longest rest over which a string keeps its frets held into the next note
+#define MAX_VOICINGS 64         // Voicings kept per slice, cheapest first (one per set of strings struck)
+#define MAX_VOICING_SEARCH 4096 // Voicings looked at per slice (chords of many notes)
+
+static const uint8_t OPEN_NOTES[7] = {0, 64, 59, 55, 50, 45, 40}; // Index = string, 6 = low E2
+
+struct Note
+{
+    uint32_t start;
+    uint32_t end;
+    uint8_t pitch;
+};
+
+struct FretCosts
+{
+    double solenoid = 1;    // Per solenoid press or release
+    // A restrike the servo cannot make or a note that cuts the last one short is worse than
+    // leaving the note out, so both weigh more than a drop
+    double restrike = 250;  // Per strike within minRepickMs of the last one on that string
+    double collision = 200; // Per note started on a string that is still sounding (cuts it short)
+    double octave = 30;     // Per octave a note is moved to fit on the neck
+    double drop = 100;      // Per note left out
+    uint32_t minRepickMs = MIN_REPICK_MS;
+    uint32_t legatoGapMs = LEGATO_GAP_MS;
+};
+
+struct FretPlacement
+{
+    uint8_t string; // 0 = dropped
+    uint8_t fret;
+    int8_t octaves; // Added to the pitch to reach fret
+};
+
+struct FretScore
+{
+    uint32_t notes = 0;
+    uint32_t dropped = 0;
+    uint32_t shifted = 0;           // Moved by octaves
+    uint32_t collisions = 0;        // Started on a sounding string
+    uint32_t restrikes = 0;         // Struck under the re-pick interval
+    uint32_t solenoidSwitches = 0;  // Presses and releases, as the Grand Central drives them
+    double cost = 0;
+};
+
+/**
+ * What one string holds on a path: its last note and the frets pressed since
+ * the last string off. Shared by the search, the event emission and the score,
+ * so all three agree on when the off before a note can be left out
+ */
+struct StringHistory
+{
+    bool used = false;
+    uint32_t lastStrike = 0;
+    uint32_t end = 0;
+    uint16_t held = 0; // Bit per pressed fret
+
+    int topFret() const
+    {
+        return held ? 31 - __builtin_clz(held) : 0;
+    }
+
+    // Next note keeps the frets: a short rest, and a fret that is not below a held one
+    bool legato(uint32_t start, uint8_t fret, uint32_t gapMs) const
+    {
+        return used && start <= end + gapMs && (fret == 0 || fret >= topFret());
+    }
+
+    // Cost of striking the next note here; counts the events into score if given
+    double cost(uint32_t start, uint8_t fret, const FretCosts& costs, FretScore* score = nullptr) const
+    {
+        double total = 0;
+        if (used && start - lastStrike < costs.minRepickMs)
+        {
+            total += costs.restrike;
+            if (score) score->restrikes++;
+        }
+        if (used && start < end)
+        {
+            total += costs.collision;
+            if (score) score->collisions++;
+        }
+        // Each press is released again later, so it costs two switches
+        bool kept = legato(start, fret, costs.legatoGapMs) && (held >> fret & 1);
+        if (fret > 0 && !kept) total += 2 * costs.solenoid;
+        return total;
+    }
+
+    void strike(uint32_t start, uint32_t noteEnd, uint8_t fret, uint32_t gapMs)
+    {
+        if (!legato(start, fret, gapMs) || fret == 0) held = 0;
+        if (fret > 0) held |= 1 << fret;
+        used = true;
+        lastStrike = start;
+        end = noteEnd;
+    }
+};
+
+struct StringHistories
+{
+    StringHistory strings[7];
+};
+
+inline std::vector<std::pair<uint8_t, uint8_t>> stringsForPitch(int pitch)
+{
+    std::vector<std::pair<uint8_t, uint8_t>> out;
+    for (uint8_t s = 6; s >= 1; s--)
+    {
+        int fret = pitch - OPEN_NOTES[s];
+        if (fret >= 0 && fret <= NUM_FRETS) out.push_back({s, uint8_t(fret)});
+    }
+    return out;
+}
+
+// Placements for one note, cheapest first, ending with the drop
+inline void noteCandidates(uint8_t pitch, const FretCosts& costs, std::vector<FretPlacement>& out,
+                           std::vector<double>& outCost)
+{
+    int shifted = pitch;
+    int8_t octaves = 0;
+    while (shifted < OPEN_NOTES[6]) { shifted += 12; octaves++; }
+    while (shifted > OPEN_NOTES[1] + NUM_FRETS) { shifted -= 12; octaves--; }
+    for (auto [string, fret] : stringsForPitch(shifted))
+    {
+        out.push_back({string, fret, octaves});
+        outCost.push_back(std::abs(octaves) * costs.octave);
+    }
+    out.push_back({0, 0, 0});
+    outCost.push_back(costs.drop);
+}
+
+struct VoicingSearch
+{
+    const std::vector<std::vector<FretPlacement>>* candidates;
+    const std::vector<std::vector<double>>* candidateCosts;
+    std::vector<FretPlacement> current;
+    std::vector<FretPlacement> placements; // Voicing after voicing, one placement per note
+    std::vector<double> costs;
+    size_t leaves = 0;
+
+    void search(size_t note, uint8_t usedStrings, double cost)
+    {
+        if (leaves >= MAX_VOICING_SEARCH) return;
+        if (note == current.size())
+        {
+            placements.insert(placements.end(), current.begin(), current.end());
+            costs.push_back(cost);
+            leaves++;
+            return;
+        }
+        const std::vector<FretPlacement>& options = (*candidates)[note];
+        for (size_t i = 0; i < options.size(); i++)
+        {
+            uint8_t bit = options[i].string ? 1 << options[i].string : 0;
+            if (usedStrings & bit) continue;
+            current[note] = options[i];
+            search(note + 1, usedStrings | bit, cost + (*candidateCosts)[note][i]);
+        }
+    }
+};
+
+/**
+ * Picks a placement for every note
+ *
+ * @param notes Sorted by start
+ * @param totalCost Receives the cost of the chosen path if given
+ * @return One placement per note
+ */
+inline std::vector<FretPlacement> optimizeFrets(const std::vector<Note>& notes, const FretCosts& costs,
+                                                double* totalCost = nullptr)
+{
+    std::vector<FretPlacement> result(notes.size(), FretPlacement{0, 0, 0});
+
+    // Slices and their voicings
+    struct Slice
+    {
+        size_t first, count;
+        std::vector<FretPlacement> placements;
+        std::vector<double> localCost;
+        std::vector<uint32_t> back; // Best previous voicing per voicing
+    };
+    std::vector<Slice> slices;
+    std::vector<std::vector<FretPlacement>> candidates;
+    std::vector<std::vector<double>> candidateCosts;
+    for (size_t first = 0; first < notes.size();)
+    {
+        size_t count = 1;
+        while (first + count < notes.size() && notes[first + count].start == notes[first].start) count++;
+        candidates.assign(count, {});
+        candidateCosts.assign(count, {});
+        for (size_t i = 0; i < count; i++)
+        {
+            noteCandidates(notes[first + i].pitch, costs, candidates[i], candidateCosts[i]);
+        }
+        VoicingSearch search;
+        search.candidates = &candidates;
+        search.candidateCosts = &candidateCosts;
+        search.current.resize(count);
+        search.search(0, 0, 0);
+
+        // Keep the cheapest voicing per set of strings struck, so voicings that drop a note to
+        // spare a string are not pushed out by cheaper ones that strike it; the path decides
+        // whether that string is free
+        int cheapest[1 << 7];
+        std::fill(std::begin(cheapest), std::end(cheapest), -1);
+        for (size_t i = 0; i < search.costs.size(); i++)
+        {
+            uint8_t mask = 0;
+            for (size_t n = 0; n < count; n++) mask |= 1 << search.placements[i * count + n].string;
+            mask &= ~1; // Dropped notes
+            if (cheapest[mask] < 0 || search.costs[i] < search.costs[cheapest[mask]]) cheapest[mask] = i;
+        }
+        std::vector<uint32_t> order;
+        for (int i : cheapest)
+        {
+            if (i >= 0) order.push_back(i);
+        }
+        size_t kept = std::min(order.size(), (size_t)MAX_VOICINGS);
+        std::partial_sort(order.begin(), order.begin() + kept, order.end(),
+                          [&](uint32_t a, uint32_t b) { return search.costs[a] < search.costs[b]; });
+        Slice slice{first, count, {}, {}, {}};
+        for (size_t k = 0; k < kept; k++)
+        {
+            const FretPlacement* v = &search.placements[order[k] * count];
+            slice.placements.insert(slice.placements.end(), v, v + count);
+            slice.localCost.push_back(search.costs[order[k]]);
+        }
+        slices.push_back(std::move(slice));
+        first += count;
+    }
+
+    // Viterbi pass
+    std::vector<double> pathCost(1, 0), nextCost;
+    std::vector<StringHistories> histories(1), nextHistories;
+    for (Slice& slice : slices)
+    {
+        size_t voicings = slice.localCost.size();
+        nextCost.assign(voicings, std::numeric_limits<double>::infinity());
+        nextHistories.resize(voicings);
+        slice.back.assign(voicings, 0);
+        for (size_t v = 0; v < voicings; v++)
+        {
+            const FretPlacement* voicing = &slice.placements[v * slice.count];
+            for (size_t u = 0; u < pathCost.size(); u++)
+            {
+                double cost = pathCost[u] + slice.localCost[v];
+                for (size_t i = 0; i < slice.count && cost < nextCost[v]; i++)
+                {
+                    if (!voicing[i].string) continue;
+                    const Note& note = notes[slice.first + i];
+                    cost += histories[u].strings[voicing[i].string].cost(note.start, voicing[i].fret, costs);
+                }
+                if (cost < nextCost[v])
+                {
+                    nextCost[v] = cost;
+                    slice.back[v] = u;
+                }
+            }
+            nextHistories[v] = histories[slice.back[v]];
+            for (size_t i = 0; i < slice.count; i++)
+            {
+                if (!voicing[i].string) continue;
+                const Note& note = notes[slice.first + i];
+                nextHistories[v].strings[voicing[i].string].strike(note.start, note.end, voicing[i].fret,
+                                                                  costs.legatoGapMs);
+            }
+        }
+        pathCost.swap(nextCost);
+        histories.swap(nextHistories);
+    }
+
+    // Back to the start along the cheapest path
+    size_t best = std::min_element(pathCost.begin(), pathCost.end()) - pathCost.begin();
+    if (totalCost) *totalCost = pathCost[best];
+    for (size_t k = slices.size(); k-- > 0;)
+    {
+        const Slice& slice = slices[k];
+        std::copy_n(&slice.placements[best * slice.count], slice.count, &result[slice.first]);
+        best = slice.back[best];
+    }
+    return result;
+}
+
+/**
+ * The backend's assignment for comparison: each note on the lowest free
+ * string that reaches it without moving it, else dropped
+ */
+inline std::vector<FretPlacement> greedyFrets(const std::vector<Note>& notes)
+{
+    std::vector<FretPlacement> result(notes.size(), FretPlacement{0, 0, 0});
+    uint32_t busyUntil[7] = {0};
+    bool busy[7] = {false};
+    for (size_t i = 0; i < notes.size(); i++)
+    {
+        for (auto [string, fret] : stringsForPitch(notes[i].pitch))
+        {
+            if (busy[string] && busyUntil[string] > notes[i].start) continue;
+            result[i] = {string, fret, 0};
+            busy[string] = true;
+            busyUntil[string] = notes[i].end;
+            break;
+        }
+    }
+    return result;
+}
+
+/**
+ * Song events for placed notes
+ * A string off follows each note unless the next note on that string keeps
+ * its frets (StringHistory::legato()); a note cut short by the next one on
+ * its string is turned off just before it
+ */
+inline std::vector<SongEvent> placementEvents(const std::vector<Note>& notes,
+                                              const std::vector<FretPlacement>& placements, const FretCosts& costs)
+{
+    std::vector<SongEvent> events;
+    for (uint8_t s = 1; s <= 6; s++)
+    {
+        StringHistory history;
+        for (size_t i = 0; i < notes.size(); i++)
+        {
+            if (placements[i].string != s) continue;
+            const Note& note = notes[i];
+            uint8_t fret = placements[i].fret;
+            if (history.used && !history.legato(note.start, fret, costs.legatoGapMs))
+            {
+                events.push_back({std::min(history.end, note.start), s, -1});
+            }
+            events.push_back({note.start, s, int8_t(fret)});
+            history.strike(note.start, note.end, fret, costs.legatoGapMs);
+        }
+        if (history.used) events.push_back({history.end, s, -1});
+    }
+    // Stable, so each string's events stay in order at equal times
+    std::stable_sort(events.begin(), events.end(),
+                     [](const SongEvent& a, const SongEvent& b) { return a.time < b.time; });
+    return events;
+}
+
+/**
+ * Counts what an assignment costs on the guitar
+ * Solenoid switches come from replaying the events the way processGuitarEvent() does
+ */
+inline FretScore scoreFrets(const std::vector<Note>& notes, const std::vector<FretPlacement>& placements,
+                            const FretCosts& costs)
+{
+    FretScore score;
+    score.notes = notes.size();
+    StringHistory history[7];
+    for (size_t i = 0; i < notes.size(); i++)
+    {
+        const FretPlacement& p = placements[i];
+        if (!p.string)
+        {
+            score.dropped++;
+            continue;
+        }
+        if (p.octaves) score.shifted++;
+        score.cost += std::abs(p.octaves) * costs.octave;
+        history[p.string].cost(notes[i].start, p.fret, costs, &score);
+        history[p.string].strike(notes[i].start, notes[i].end, p.fret, costs.legatoGapMs);
+    }
+
+    uint16_t held[7] = {0};
+    for (const SongEvent& e : placementEvents(notes, placements, costs))
+    {
+        if (e.fret > 0)
+        {
+            if (!(held[e.string] >> e.fret & 1)) score.solenoidSwitches++;
+            held[e.string] |= 1 << e.fret;
+        }
+        else
+        {
+            score.solenoidSwitches += __builtin_popcount(held[e.string]);
+            held[e.string] = 0;
+        }
+    }
+    score.cost += score.dropped * costs.drop + score.restrikes * costs.restrike + score.collisions * costs.collision +
+                  score.solenoidSwitches * costs.solenoid;
+    return score;
+}
+
+#endif
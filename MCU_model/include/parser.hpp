@@ -0,0 +1,74 @@
+// Song .bin files as playGuitarRTOS_Binary reads them: duration (4 BE) +
+// event count (2 BE) + 5 bytes per event (time 4 BE, string << 5 | fret, fret 31 = off)
+#ifndef PARSER_HPP
+#define PARSER_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+struct SongEvent
+{
+    uint32_t time;
+    uint8_t string; // 1-6, 1 = high E
+    int8_t fret;    // -1 = string off
+};
+
+struct Song
+{
+    uint32_t duration = 0;
+    std::vector<SongEvent> events;
+};
+
+inline bool parseSong(const std::vector<uint8_t>& bin, Song& song)
+{
+    if (bin.size() < 6) return false;
+    song.duration = uint32_t(bin[0]) << 24 | uint32_t(bin[1]) << 16 | uint32_t(bin[2]) << 8 | bin[3];
+    size_t count = size_t(bin[4]) << 8 | bin[5];
+    if (bin.size() < 6 + count * 5) return false;
+    song.events.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint8_t* p = &bin[6 + i * 5];
+        uint8_t fret = p[4] & 0x1F;
+        song.events[i] = {uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3],
+                          uint8_t(p[4] >> 5), int8_t(fret == 31 ? -1 : fret)};
+    }
+    return true;
+}
+
+// Duration is the last event time cut to whole seconds, as the backend writes it
+inline std::vector<uint8_t> serializeSong(const std::vector<SongEvent>& events)
+{
+    uint32_t duration = events.empty() ? 0 : events.back().time / 1000 * 1000;
+    std::vector<uint8_t> out = {
+        uint8_t(duration >> 24), uint8_t(duration >> 16), uint8_t(duration >> 8), uint8_t(duration),
+        uint8_t(events.size() >> 8), uint8_t(events.size())};
+    out.reserve(6 + events.size() * 5);
+    for (const SongEvent& e : events)
+    {
+        uint8_t fret = e.fret < 0 ? 31 : e.fret;
+        out.insert(out.end(), {uint8_t(e.time >> 24), uint8_t(e.time >> 16), uint8_t(e.time >> 8),
+                               uint8_t(e.time), uint8_t(e.string << 5 | fret)});
+    }
+    return out;
+}
+
+inline bool readSongFile(const std::string& path, Song& song)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::vector<uint8_t> bin((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return parseSong(bin, song);
+}
+
+inline bool writeSongFile(const std::string& path, const std::vector<SongEvent>& events)
+{
+    std::vector<uint8_t> bin = serializeSong(events);
+    std::ofstream out(path, std::ios::binary);
+    return out.write((const char*)bin.data(), bin.size()).good();
+}
+
+#endif
@@ -0,0 +1,234 @@
+// Plucked-string preview of song .bin files (Karplus-Strong), written as WAV
+// The six strings are kept in structure-of-arrays form: one contiguous delay
+// line per string sharing a write position, and the loop filter coefficients
+// of all strings side by side. Blocks are no longer than the shortest string
+// period, so every output sample of a block only reads samples from before
+// the block; each string's block is then a 3-tap filter over its own line
+// that compilers vectorise without gathers (GCC from -O3).
+#ifndef SOUND_GEN_HPP
+#define SOUND_GEN_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "parser.hpp"
+
+#define SOUND_SAMPLE_RATE 44100
+#define SOUND_STRINGS 6
+#define SOUND_MAX_FRET 12         // NUM_FRETS; the Grand Central ignores higher frets
+#define SOUND_BLOCK 64            // Samples per block, below the shortest period (E5 at 44.1 kHz: 66)
+#define SOUND_MAX_PERIOD 1200     // Longest delay (E2 at 96 kHz: 1164)
+#define SOUND_LINE_SIZE 8192      // Delay line length; history is moved to the front when the end is reached
+#define SOUND_RING_S 3.0f         // Time for a plucked string to fall by 60 dB
+#define SOUND_DAMPED_S 0.08f      // Same after a string off (the servo damps it)
+#define SOUND_TAIL_MS 2000        // Rendered after the last event
+#define SOUND_SILENCE_CHECK 16    // Blocks between checks for a string that has died away
+#define SOUND_SILENCE 1e-5f       // -100 dB against a full pluck
+
+static const uint8_t SOUND_OPEN_NOTES[SOUND_STRINGS + 1] = {0, 64, 59, 55, 50, 45, 40}; // Index = string
+
+class GuitarSynth
+{
+public:
+    explicit GuitarSynth(uint32_t sampleRate = SOUND_SAMPLE_RATE) : rate(sampleRate)
+    {
+        lines.assign(SOUND_STRINGS * SOUND_LINE_SIZE, 0.0f);
+        write = SOUND_MAX_PERIOD + 2;
+        std::fill(std::begin(active), std::end(active), false);
+    }
+
+    /**
+     * Longest block process() takes at this rate
+     */
+    size_t blockSize() const
+    {
+        return std::min<size_t>(SOUND_BLOCK, rate / 660 - 1);
+    }
+
+    // string 1-6; fret 0 = open
+    void pluck(uint8_t string, uint8_t fret, float level = 0.5f)
+    {
+        if (fret > SOUND_MAX_FRET) return; // Also keeps the period above the block size
+        int s = string - 1;
+        double frequency = 440.0 * std::pow(2.0, (SOUND_OPEN_NOTES[string] + fret - 69) / 12.0);
+        // The two-point average in the loop adds half a sample of delay
+        double delay = std::min<double>(rate / frequency - 0.5, SOUND_MAX_PERIOD);
+        period[s] = uint32_t(delay);
+        fraction[s] = float(delay - period[s]);
+        this->frequency[s] = float(frequency);
+        setDecay(s, SOUND_RING_S);
+
+        // Low-passed noise burst over the samples the next period reads
+        float* line = &lines[s * SOUND_LINE_SIZE];
+        float smooth = 0;
+        for (uint32_t i = write - period[s] - 2; i < write; i++)
+        {
+            noise = noise * 1664525u + 1013904223u;
+            float white = int32_t(noise) * (1.0f / 2147483648.0f);
+            smooth += 0.5f * (white - smooth);
+            line[i] = level * smooth;
+        }
+        active[s] = true;
+        blocksSinceCheck[s] = 0;
+    }
+
+    void damp(uint8_t string)
+    {
+        int s = string - 1;
+        if (active[s]) setDecay(s, SOUND_DAMPED_S);
+    }
+
+    /**
+     * Adds n samples of all strings to out
+     * n must not exceed blockSize()
+     */
+    void process(float* out, size_t n)
+    {
+        if (write + n > SOUND_LINE_SIZE)
+        {
+            // Keep the history the next reads need at the front of every line
+            for (int s = 0; s < SOUND_STRINGS; s++)
+            {
+                float* line = &lines[s * SOUND_LINE_SIZE];
+                memmove(line, line + write - (SOUND_MAX_PERIOD + 2), (SOUND_MAX_PERIOD + 2) * sizeof(float));
+            }
+            write = SOUND_MAX_PERIOD + 2;
+        }
+        for (int s = 0; s < SOUND_STRINGS; s++)
+        {
+            if (!active[s]) continue;
+            float* y = &lines[s * SOUND_LINE_SIZE + write];
+            loopFilter(y, y - period[s], out, n, c0[s], c1[s], c2[s]);
+            if (++blocksSinceCheck[s] >= SOUND_SILENCE_CHECK)
+            {
+                blocksSinceCheck[s] = 0;
+                active[s] = !silent(y + n - (period[s] + 2), period[s] + 2);
+            }
+        }
+        write += n;
+    }
+
+private:
+    uint32_t rate;
+    std::vector<float> lines; // SOUND_STRINGS lines of SOUND_LINE_SIZE
+    uint32_t write;           // Shared write position
+
+    // Per string
+    uint32_t period[SOUND_STRINGS] = {0};
+    float fraction[SOUND_STRINGS] = {0};
+    float frequency[SOUND_STRINGS] = {0};
+    float c0[SOUND_STRINGS] = {0}, c1[SOUND_STRINGS] = {0}, c2[SOUND_STRINGS] = {0};
+    bool active[SOUND_STRINGS];
+    uint32_t blocksSinceCheck[SOUND_STRINGS] = {0};
+    uint32_t noise = 22222;
+
+    // One block of one string; the reads end before the block starts, so the line does not alias itself
+    static void loopFilter(float* __restrict y, const float* __restrict r, float* __restrict mix, size_t n,
+                           float a, float b, float c)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            float v = a * r[i] + b * r[i - 1] + c * r[i - 2];
+            y[i] = v;
+            mix[i] += v;
+        }
+    }
+
+    // A string whose last period is this quiet stays quiet until plucked again
+    static bool silent(const float* samples, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            if (std::fabs(samples[i]) >= SOUND_SILENCE) return false;
+        }
+        return true;
+    }
+
+    // Loop gain for a 60 dB fall in seconds, folded with the fractional delay and the two-point average:
+    // y[n] = g/2 ((1-f) y[n-D] + y[n-D-1] + f y[n-D-2])
+    void setDecay(int s, float seconds)
+    {
+        float g = std::pow(10.0f, -3.0f / (seconds * frequency[s]));
+        c0[s] = 0.5f * g * (1 - fraction[s]);
+        c1[s] = 0.5f * g;
+        c2[s] = 0.5f * g * fraction[s];
+    }
+};
+
+/**
+ * Renders a song from its first event to SOUND_TAIL_MS after the last
+ * Every note is plucked, a string off damps the string
+ */
+inline std::vector<float> renderSong(const Song& song, uint32_t sampleRate = SOUND_SAMPLE_RATE)
+{
+    uint32_t endMs = (song.events.empty() ? 0 : song.events.back().time) + SOUND_TAIL_MS;
+    size_t total = size_t(uint64_t(endMs) * sampleRate / 1000);
+    std::vector<float> out(total, 0.0f);
+    GuitarSynth synth(sampleRate);
+    size_t block = synth.blockSize();
+    size_t next = 0, pos = 0;
+    while (pos < total)
+    {
+        // Events due at pos, then up to the next event or a whole block
+        size_t eventAt = total;
+        while (next < song.events.size())
+        {
+            const SongEvent& e = song.events[next];
+            size_t at = size_t(uint64_t(e.time) * sampleRate / 1000);
+            if (at > pos)
+            {
+                eventAt = at;
+                break;
+            }
+            if (e.string >= 1 && e.string <= SOUND_STRINGS)
+            {
+                if (e.fret < 0) synth.damp(e.string);
+                else synth.pluck(e.string, e.fret);
+            }
+            next++;
+        }
+        size_t n = std::min({block, total - pos, eventAt - pos});
+        synth.process(&out[pos], n);
+        pos += n;
+    }
+    return out;
+}
+
+/**
+ * Writes 16-bit mono PCM, scaled so the loudest sample sits at peak
+ */
+inline bool writeWav(const std::string& path, const std::vector<float>& samples, uint32_t sampleRate,
+                     float peak = 0.9f)
+{
+    float loudest = 0;
+    for (float v : samples) loudest = std::max(loudest, std::fabs(v));
+    float scale = loudest > 0 ? peak * 32767 / loudest : 0;
+
+    std::vector<int16_t> pcm(samples.size());
+    for (size_t i = 0; i < samples.size(); i++) pcm[i] = int16_t(std::lrint(samples[i] * scale));
+
+    uint32_t dataSize = pcm.size() * 2;
+    auto le32 = [](std::ofstream& out, uint32_t v) { out.write((const char*)&v, 4); };
+    auto le16 = [](std::ofstream& out, uint16_t v) { out.write((const char*)&v, 2); };
+    std::ofstream out(path, std::ios::binary);
+    out.write("RIFF", 4);
+    le32(out, 36 + dataSize);
+    out.write("WAVEfmt ", 8);
+    le32(out, 16);
+    le16(out, 1); // PCM
+    le16(out, 1); // Mono
+    le32(out, sampleRate);
+    le32(out, sampleRate * 2);
+    le16(out, 2);
+    le16(out, 16);
+    out.write("data", 4);
+    le32(out, dataSize);
+    out.write((const char*)pcm.data(), dataSize);
+    return out.good();
+}
+
+#endif
@@ -0,0 +1,151 @@
+// Host measurement of the ESP32 MIDI conversion (midi_convert.h) on real .mid files,
+// checked byte for byte against the backend's output written by midi_reference.py
+// Build: g++ -std=c++17 -O2 -I../gAItar_esp32/src midi_bench.cpp ../gAItar_esp32/src/midi_convert.cpp -o midi_bench
+// Usage: ./midi_bench [--ref <dir of .bin>] [--out <dir>] <file.mid | dir>...
+//        (python3 midi_reference.py <dir> ../Python/midi_tracks writes the references)
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "midi_convert.h"
+
+using namespace std;
+
+static const int TIMING_RUNS = 20;
+
+static bool readFile(const string& path, vector<uint8_t>& out)
+{
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+    out.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    return true;
+}
+
+static string baseName(const string& path)
+{
+    size_t slash = path.find_last_of('/');
+    string name = slash == string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    return dot == string::npos ? name : name.substr(0, dot);
+}
+
+static vector<string> midiFiles(const vector<string>& args)
+{
+    vector<string> files;
+    for (const string& arg : args)
+    {
+        struct stat st;
+        if (stat(arg.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        {
+            files.push_back(arg);
+            continue;
+        }
+        vector<string> found;
+        if (DIR* dir = opendir(arg.c_str()))
+        {
+            while (dirent* entry = readdir(dir))
+            {
+                string name = entry->d_name;
+                if (name.size() > 4 && name.compare(name.size() - 4, 4, ".mid") == 0) found.push_back(arg + "/" + name);
+            }
+            closedir(dir);
+        }
+        sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    }
+    return files;
+}
+
+static bool appendOutput(const uint8_t* data, size_t len, void* context)
+{
+    vector<uint8_t>* out = (vector<uint8_t>*)context;
+    out->insert(out->end(), data, data + len);
+    return true;
+}
+
+// Describes the first difference from the reference
+static string compare(const vector<uint8_t>& ours, const vector<uint8_t>& ref)
+{
+    if (ours == ref) return "identical";
+    size_t common = min(ours.size(), ref.size());
+    size_t at = mismatch(ours.begin(), ours.begin() + common, ref.begin()).first - ours.begin();
+    char text[96];
+    if (at < MIDI_CONVERT_HEADER_SIZE)
+    {
+        snprintf(text, sizeof(text), "DIFFERS in header (%zu vs %zu bytes)", ours.size(), ref.size());
+    }
+    else
+    {
+        snprintf(text, sizeof(text), "DIFFERS from event %zu (%zu vs %zu bytes)",
+                 (at - MIDI_CONVERT_HEADER_SIZE) / MIDI_CONVERT_EVENT_SIZE, ours.size(), ref.size());
+    }
+    return text;
+}
+
+int main(int argc, char** argv)
+{
+    string refDir, outDir;
+    vector<string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--ref") && i + 1 < argc) refDir = argv[++i];
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) outDir = argv[++i];
+        else args.push_back(argv[i]);
+    }
+    if (args.empty()) args.push_back("../Python/midi_tracks");
+
+    int checked = 0, identical = 0;
+    printf("%-40s %7s %6s %7s %8s %6s %9s  %s\n", "file", "midi B", "tracks", "events", "dropped", "secs",
+           "convert", "reference");
+    for (const string& path : midiFiles(args))
+    {
+        string name = baseName(path);
+        vector<uint8_t> midi;
+        if (!readFile(path, midi))
+        {
+            printf("%-40s cannot read\n", name.c_str());
+            continue;
+        }
+
+        vector<uint8_t> bin;
+        MidiConvertResult result;
+        if (!midiConvert(midi.data(), midi.size(), appendOutput, &bin, result))
+        {
+            printf("%-40s %7zu  %s\n", name.c_str(), midi.size(), midiConvertErrorText(result.error));
+            continue;
+        }
+
+        // Both passes, as on the ESP32, writing to memory
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < TIMING_RUNS; i++)
+        {
+            vector<uint8_t> scratch;
+            scratch.reserve(bin.size());
+            midiConvert(midi.data(), midi.size(), appendOutput, &scratch, result);
+        }
+        double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / TIMING_RUNS;
+
+        string verdict = "-";
+        vector<uint8_t> ref;
+        if (!refDir.empty() && readFile(refDir + "/" + name + ".bin", ref))
+        {
+            verdict = compare(bin, ref);
+            checked++;
+            identical += bin == ref;
+        }
+        if (!outDir.empty())
+        {
+            ofstream(outDir + "/" + name + ".bin", ios::binary).write((const char*)bin.data(), bin.size());
+        }
+        printf("%-40s %7zu %6u %7u %8u %6u %7.0fus  %s\n", name.substr(0, 40).c_str(), midi.size(),
+               result.tracks, result.events, result.notesDropped, result.durationMs / 1000, us, verdict.c_str());
+    }
+    if (!refDir.empty()) printf("%d of %d match the backend output\n", identical, checked);
+    return checked == identical ? 0 : 1;
+}
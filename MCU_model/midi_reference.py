@@ -0,0 +1,71 @@
+# Writes the backend's .bin for each .mid, as reference output for midi_bench
+# The conversion functions are taken from gAItar_api/backend/main.py unchanged,
+# without importing the rest of the backend (torch, tensorflow, ...)
+# Needs: pip install mido
+# Usage: python3 midi_reference.py <out dir> <file.mid | dir>...
+import ast
+import os
+import struct
+import sys
+from io import BytesIO
+
+import mido
+from mido import MidiFile, MidiTrack, merge_tracks
+
+BACKEND = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "gAItar_api", "backend", "main.py")
+FUNCTIONS = {
+    "extract_global_meta_messages",
+    "is_melodic_track",
+    "strip_non_melodic_and_preserve_tempo",
+    "process_midi_to_guitar_from_midi",
+    "serialize_guitar_events_micro",
+}
+
+
+def load_backend():
+    with open(BACKEND) as f:
+        tree = ast.parse(f.read(), BACKEND)
+    body = [node for node in tree.body if isinstance(node, ast.FunctionDef) and node.name in FUNCTIONS]
+    missing = FUNCTIONS - {node.name for node in body}
+    if missing:
+        sys.exit(f"{BACKEND} no longer defines {', '.join(sorted(missing))}")
+    scope = {"mido": mido, "MidiFile": MidiFile, "MidiTrack": MidiTrack, "merge_tracks": merge_tracks,
+             "BytesIO": BytesIO, "struct": struct}
+    exec(compile(ast.Module(body=body, type_ignores=[]), BACKEND, "exec"), scope)
+    return scope
+
+
+def midi_files(paths):
+    for path in paths:
+        if os.path.isdir(path):
+            for name in sorted(os.listdir(path)):
+                if name.endswith(".mid"):
+                    yield os.path.join(path, name)
+        else:
+            yield path
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit("usage: midi_reference.py <out dir> <file.mid | dir>...")
+    out_dir = sys.argv[1]
+    os.makedirs(out_dir, exist_ok=True)
+    backend = load_backend()
+    for path in midi_files(sys.argv[2:]):
+        with open(path, "rb") as f:
+            data = f.read()
+        try:
+            # Same max_frets as /upload-midi-binary
+            ir = backend["process_midi_to_guitar_from_midi"](data, max_frets=12)
+            binary = backend["serialize_guitar_events_micro"](ir)
+        except Exception as e:
+            print(f"{os.path.basename(path)}: not converted ({e})")
+            continue
+        name = os.path.splitext(os.path.basename(path))[0] + ".bin"
+        with open(os.path.join(out_dir, name), "wb") as f:
+            f.write(binary)
+        print(f"{name}: {len(ir['events'])} events, {len(binary)} bytes")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,109 @@
+// Renders song .bin files to WAV with the plucked-string model (include/sound_gen.hpp)
+// to audition a library before it is uploaded
+// Build: g++ -std=c++17 -O3 -Iinclude render_song.cpp -o render_song
+// Usage: ./render_song [--rate hz] [--out <dir>] <song.bin | dir>...
+//        (WAVs go next to each song unless --out is given; fret_opt --out and
+//        midi_bench --out write .bin files from .mid)
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "parser.hpp"
+#include "sound_gen.hpp"
+
+using namespace std;
+
+static vector<string> songFiles(const vector<string>& args)
+{
+    vector<string> files;
+    for (const string& arg : args)
+    {
+        struct stat st;
+        if (stat(arg.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        {
+            files.push_back(arg);
+            continue;
+        }
+        vector<string> found;
+        if (DIR* dir = opendir(arg.c_str()))
+        {
+            while (dirent* entry = readdir(dir))
+            {
+                string name = entry->d_name;
+                if (name.size() > 4 && name.compare(name.size() - 4, 4, ".bin") == 0) found.push_back(arg + "/" + name);
+            }
+            closedir(dir);
+        }
+        sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    }
+    return files;
+}
+
+static string wavPath(const string& song, const string& outDir)
+{
+    string path = song.size() > 4 && song.compare(song.size() - 4, 4, ".bin") == 0 ? song.substr(0, song.size() - 4) : song;
+    if (!outDir.empty())
+    {
+        size_t slash = path.find_last_of('/');
+        path = outDir + "/" + (slash == string::npos ? path : path.substr(slash + 1));
+    }
+    return path + ".wav";
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t rate = SOUND_SAMPLE_RATE;
+    string outDir;
+    vector<string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--rate") && i + 1 < argc) rate = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) outDir = argv[++i];
+        else args.push_back(argv[i]);
+    }
+    if (args.empty() || rate < 22050 || rate > 96000)
+    {
+        fprintf(stderr, "usage: %s [--rate 22050-96000] [--out <dir>] <song.bin | dir>...\n", argv[0]);
+        return 1;
+    }
+
+    double audioTotal = 0, renderTotal = 0;
+    printf("%-40s %7s %8s %9s %9s\n", "song", "events", "audio s", "render ms", "x realtime");
+    for (const string& path : songFiles(args))
+    {
+        Song song;
+        if (!readSongFile(path, song))
+        {
+            printf("%-40s not a song file\n", path.c_str());
+            continue;
+        }
+        auto start = chrono::steady_clock::now();
+        vector<float> samples = renderSong(song, rate);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        double seconds = double(samples.size()) / rate;
+
+        string wav = wavPath(path, outDir);
+        if (!writeWav(wav, samples, rate))
+        {
+            printf("%-40s could not write %s\n", path.c_str(), wav.c_str());
+            continue;
+        }
+        size_t slash = wav.find_last_of('/');
+        printf("%-40s %7zu %8.1f %9.1f %9.0f\n", wav.substr(slash == string::npos ? 0 : slash + 1).substr(0, 40).c_str(),
+               song.events.size(), seconds, ms, seconds * 1000 / ms);
+        audioTotal += seconds;
+        renderTotal += ms;
+    }
+    if (renderTotal > 0)
+    {
+        printf("%.0f s of audio in %.0f ms, %.0fx real time\n", audioTotal, renderTotal, audioTotal * 1000 / renderTotal);
+    }
+    return 0;
+}
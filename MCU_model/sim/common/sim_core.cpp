@@ -0,0 +1,264 @@
+#include "sim_core.h"
+
+// ---- Virtual clock ----
+static uint64_t nowUs = 0;
+
+uint64_t simNowUs() { return nowUs; }
+
+void simAdvanceTo(uint64_t us)
+{
+    if (us > nowUs) nowUs = us;
+}
+
+void simAdvanceBy(uint64_t us) { nowUs += us; }
+
+void (*simWaitHook)() = nullptr;
+uint64_t simWaitStepUs = 100;
+
+void simWaitUntil(uint64_t us)
+{
+    if (!simWaitHook)
+    {
+        simAdvanceTo(us);
+        return;
+    }
+    while (nowUs < us)
+    {
+        simAdvanceTo(std::min(us, nowUs + simWaitStepUs));
+        simWaitHook();
+    }
+}
+
+unsigned long millis() { return (unsigned long)(nowUs / 1000); }
+unsigned long micros() { return (unsigned long)nowUs; }
+void delay(unsigned long ms) { simWaitUntil(nowUs + (uint64_t)ms * 1000); }
+void delayMicroseconds(unsigned int us) { simAdvanceBy(us); }
+void yield() {}
+
+// ---- Print / Stream ----
+size_t Print::printf(const char* fmt, ...)
+{
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n < 0) return 0;
+    if (n >= (int)sizeof(buf)) n = sizeof(buf) - 1;
+    return write((const uint8_t*)buf, n);
+}
+
+int Stream::timedRead()
+{
+    return available() ? read() : -1;
+}
+
+size_t Stream::readBytes(uint8_t* buf, size_t n)
+{
+    size_t count = 0;
+    while (count < n)
+    {
+        int c = timedRead();
+        if (c < 0) break;
+        buf[count++] = (uint8_t)c;
+    }
+    return count;
+}
+
+size_t Stream::readBytesUntil(char terminator, char* buf, size_t n)
+{
+    size_t count = 0;
+    while (count < n)
+    {
+        int c = timedRead();
+        if (c < 0 || c == terminator) break;
+        buf[count++] = (char)c;
+    }
+    return count;
+}
+
+String Stream::readStringUntil(char terminator)
+{
+    std::string out;
+    int c = timedRead();
+    while (c >= 0 && c != terminator)
+    {
+        out += (char)c;
+        c = timedRead();
+    }
+    return String(out);
+}
+
+String Stream::readString()
+{
+    std::string out;
+    int c = timedRead();
+    while (c >= 0)
+    {
+        out += (char)c;
+        c = timedRead();
+    }
+    return String(out);
+}
+
+// ---- Debug console ----
+SimConsole Serial;
+
+size_t SimConsole::write(uint8_t b)
+{
+    if (echo) fputc(b, stdout);
+    return 1;
+}
+
+// ---- Simulated UART ----
+int SimSerial::available()
+{
+    if (link) link->deliver();
+    return (int)rx.size();
+}
+
+int SimSerial::read()
+{
+    if (!available()) return -1;
+    uint8_t b = rx.front();
+    rx.pop_front();
+    return b;
+}
+
+int SimSerial::peek()
+{
+    return available() ? rx.front() : -1;
+}
+
+int SimSerial::timedRead()
+{
+    // Wait (in virtual time) for bytes already on the wire, up to the stream timeout
+    uint64_t deadline = simNowUs() + (uint64_t)timeoutMs * 1000;
+    while (!available())
+    {
+        if (simNowUs() >= deadline) return -1;
+        uint64_t arrival;
+        if (!simWaitHook && link && link->nextArrival(this, arrival) && arrival <= deadline)
+        {
+            simAdvanceTo(arrival);
+        }
+        else
+        {
+            // With a scheduler the peer may still send, so step through the wait
+            simWaitUntil(simWaitHook ? std::min(deadline, simNowUs() + simWaitStepUs) : deadline);
+        }
+    }
+    return read();
+}
+
+size_t SimSerial::write(uint8_t b)
+{
+    if (!link) return 1;
+    // A full TX buffer blocks the writer until the wire catches up
+    uint64_t capacityUs = (uint64_t)(txCapacity * link->byteTimeUs());
+    uint64_t backlog = link->txBacklogUs(this);
+    if (backlog > capacityUs)
+    {
+        simWaitUntil(simNowUs() + backlog - capacityUs);
+    }
+    link->send(this, b);
+    return 1;
+}
+
+int SimSerial::availableForWrite()
+{
+    return (int)txCapacity;
+}
+
+void SimSerial::flush()
+{
+    if (link) simWaitUntil(simNowUs() + link->txBacklogUs(this));
+}
+
+SimLink::SimLink(SimSerial& a, SimSerial& b, const SimLinkConfig& config)
+    : a(&a), b(&b), config(config), rngState(config.seed ? config.seed : 1)
+{
+    aToB.dst = &b;
+    bToA.dst = &a;
+    byteUs = 10.0 * 1e6 / config.baud; // 8N1: start + 8 data + stop bits
+    a.link = this;
+    b.link = this;
+}
+
+SimLink::~SimLink()
+{
+    if (a->link == this) a->link = nullptr;
+    if (b->link == this) b->link = nullptr;
+}
+
+SimLink::Lane& SimLink::laneFrom(SimSerial* from) { return from == a ? aToB : bToA; }
+const SimLink::Lane& SimLink::laneFrom(SimSerial* from) const { return from == a ? aToB : bToA; }
+
+double SimLink::uniform()
+{
+    // xorshift64* - deterministic across platforms for repeatable runs
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return (double)((rngState * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+void SimLink::send(SimSerial* from, uint8_t byte)
+{
+    if (tap) tap(from, byte, tapContext);
+
+    Lane& lane = laneFrom(from);
+    double start = std::max(lane.wireFreeUs, (double)simNowUs());
+    lane.wireFreeUs = start + byteUs;
+    lane.stats.bytesSent++;
+
+    if (config.lossRate > 0 && uniform() < config.lossRate)
+    {
+        lane.stats.bytesLost++;
+        return;
+    }
+    if (config.corruptRate > 0 && uniform() < config.corruptRate)
+    {
+        byte ^= (uint8_t)(1u << (int)(uniform() * 8));
+        lane.stats.bytesCorrupted++;
+    }
+    lane.inFlight.push_back({(uint64_t)lane.wireFreeUs + config.latencyUs, byte});
+}
+
+void SimLink::deliver()
+{
+    for (Lane* lane : {&aToB, &bToA})
+    {
+        while (!lane->inFlight.empty() && lane->inFlight.front().first <= simNowUs())
+        {
+            if (lane->dst->rx.size() < lane->dst->rxCapacity)
+            {
+                lane->dst->rx.push_back(lane->inFlight.front().second);
+            }
+            else
+            {
+                lane->dst->rxOverflows++;
+            }
+            lane->inFlight.pop_front();
+        }
+    }
+}
+
+bool SimLink::nextArrival(SimSerial* to, uint64_t& arrivalUs) const
+{
+    const Lane& lane = (to == b) ? aToB : bToA;
+    if (lane.inFlight.empty()) return false;
+    arrivalUs = lane.inFlight.front().first;
+    return true;
+}
+
+uint64_t SimLink::txBacklogUs(SimSerial* from) const
+{
+    double freeAt = laneFrom(from).wireFreeUs;
+    return freeAt > simNowUs() ? (uint64_t)(freeAt - simNowUs()) : 0;
+}
+
+const SimLaneStats& SimLink::stats(SimSerial* from) const
+{
+    return laneFrom(from).stats;
+}
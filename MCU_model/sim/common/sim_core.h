@@ -0,0 +1,291 @@
+#ifndef SIM_CORE_H
+#define SIM_CORE_H
+
+// Host-side stand-ins for the Arduino core shared by the ESP32 and Grand Central shims.
+// Time is virtual: millis()/micros() read the simulation clock, and blocking UART reads
+// advance it while waiting for bytes that are already in flight on a SimLink.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include <cctype>
+#include <cmath>
+#include <string>
+#include <deque>
+#include <algorithm>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define LSBFIRST 0
+#define MSBFIRST 1
+#define PI 3.14159265358979323846
+
+using std::min;
+using std::max;
+
+// ---- Virtual clock ----
+uint64_t simNowUs();
+void simAdvanceTo(uint64_t us);
+void simAdvanceBy(uint64_t us);
+
+// Called while a board is blocked in a UART read or write so the other board keeps
+// running; the harness installs a scheduler here. Waits advance in steps of at most
+// simWaitStepUs between calls.
+extern void (*simWaitHook)();
+extern uint64_t simWaitStepUs;
+void simWaitUntil(uint64_t us);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+inline int digitalRead(int) { return LOW; }
+inline void shiftOut(int, int, int, uint8_t) {}
+inline bool isPrintable(int c) { return isprint(c); }
+inline long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+template <typename T, typename L, typename H>
+T constrain(T x, L lo, H hi) { return x < lo ? lo : (x > hi ? hi : x); }
+
+// ---- Arduino String (std::string backed) ----
+class String
+{
+public:
+    String() {}
+    String(const char* c) : s(c ? c : "") {}
+    String(const std::string& x) : s(x) {}
+    explicit String(char c) : s(1, c) {}
+    String(int v) : s(std::to_string(v)) {}
+    String(unsigned int v) : s(std::to_string(v)) {}
+    String(long v) : s(std::to_string(v)) {}
+    String(unsigned long v) : s(std::to_string(v)) {}
+    String(long long v) : s(std::to_string(v)) {}
+    String(unsigned long long v) : s(std::to_string(v)) {}
+    String(double v, unsigned int decimals = 2)
+    {
+        char buf[48];
+        snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+        s = buf;
+    }
+
+    const char* c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.size(); }
+    bool isEmpty() const { return s.empty(); }
+    bool reserve(unsigned int n) { s.reserve(n); return true; }
+    char charAt(unsigned int i) const { return i < s.size() ? s[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+
+    int indexOf(char c, unsigned int from = 0) const { return found(s.find(c, from)); }
+    int indexOf(const String& x, unsigned int from = 0) const { return found(s.find(x.s, from)); }
+    int lastIndexOf(char c) const { return found(s.rfind(c)); }
+    String substring(unsigned int from) const { return from >= s.size() ? String() : String(s.substr(from)); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from > to) std::swap(from, to);
+        return from >= s.size() ? String() : String(s.substr(from, to - from));
+    }
+    long toInt() const { return atol(s.c_str()); }
+    float toFloat() const { return atof(s.c_str()); }
+    void trim()
+    {
+        size_t a = s.find_first_not_of(" \t\r\n");
+        size_t b = s.find_last_not_of(" \t\r\n");
+        s = (a == std::string::npos) ? "" : s.substr(a, b - a + 1);
+    }
+    bool startsWith(const String& x) const { return s.compare(0, x.s.size(), x.s) == 0; }
+    bool endsWith(const String& x) const
+    {
+        return s.size() >= x.s.size() && s.compare(s.size() - x.s.size(), x.s.size(), x.s) == 0;
+    }
+    bool equals(const String& x) const { return s == x.s; }
+
+    bool concat(const String& x) { s += x.s; return true; }
+    bool concat(const char* x, unsigned int n) { s.append(x, n); return true; }
+    bool concat(char c) { s += c; return true; }
+    String& operator+=(const String& x) { s += x.s; return *this; }
+    String& operator+=(const char* x) { s += x; return *this; }
+    String& operator+=(char c) { s += c; return *this; }
+
+    friend String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+    friend String operator+(const String& a, const char* b) { return String(a.s + b); }
+    friend String operator+(const char* a, const String& b) { return String(a + b.s); }
+    bool operator==(const String& x) const { return s == x.s; }
+    bool operator==(const char* x) const { return s == x; }
+    bool operator!=(const String& x) const { return s != x.s; }
+    bool operator!=(const char* x) const { return s != x; }
+    bool operator<(const String& x) const { return s < x.s; }
+
+private:
+    static int found(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+    std::string s;
+};
+
+// ---- Print / Stream ----
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t* buf, size_t n)
+    {
+        size_t done = 0;
+        while (n--) done += write(*buf++);
+        return done;
+    }
+    size_t write(const char* str) { return write((const uint8_t*)str, strlen(str)); }
+    size_t write(const char* buf, size_t n) { return write((const uint8_t*)buf, n); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const char* str) { return write(str); }
+    size_t print(const String& str) { return write(str.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v) { return printf("%d", v); }
+    size_t print(unsigned int v) { return printf("%u", v); }
+    size_t print(long v) { return printf("%ld", v); }
+    size_t print(unsigned long v) { return printf("%lu", v); }
+    size_t print(double v, int decimals = 2) { return printf("%.*f", decimals, v); }
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T& v) { return print(v) + println(); }
+    size_t println(double v, int decimals) { return print(v, decimals) + println(); }
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    void setTimeout(unsigned long ms) { timeoutMs = ms; }
+
+    size_t readBytes(uint8_t* buf, size_t n);
+    size_t readBytes(char* buf, size_t n) { return readBytes((uint8_t*)buf, n); }
+    size_t readBytesUntil(char terminator, char* buf, size_t n);
+    size_t readBytesUntil(char terminator, uint8_t* buf, size_t n) { return readBytesUntil(terminator, (char*)buf, n); }
+    String readStringUntil(char terminator);
+    String readString();
+
+protected:
+    // Blocking single-byte read honouring the stream timeout, -1 on timeout
+    virtual int timedRead();
+    unsigned long timeoutMs = 1000;
+};
+
+// ---- Debug console (both boards' Serial) ----
+class SimConsole : public Stream
+{
+public:
+    size_t write(uint8_t b) override;
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    void begin(unsigned long) {}
+    operator bool() const { return true; }
+    bool echo = false; // Mirror firmware debug output to stdout
+};
+extern SimConsole Serial;
+
+// ---- Simulated UART ----
+class SimLink;
+
+class SimSerial : public Stream
+{
+public:
+    explicit SimSerial(size_t rxCapacity = 256, size_t txCapacity = 128)
+        : rxCapacity(rxCapacity), txCapacity(txCapacity) {}
+
+    void begin(unsigned long) {}
+    void end() {}
+    operator bool() const { return true; }
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t b) override;
+    using Print::write;
+    int availableForWrite() override;
+    void flush() override;
+
+    size_t rxCapacity;
+    size_t txCapacity;
+    std::deque<uint8_t> rx;
+    SimLink* link = nullptr;
+    uint64_t rxOverflows = 0;
+
+protected:
+    int timedRead() override;
+};
+
+struct SimLinkConfig
+{
+    uint32_t baud = 115200;
+    uint32_t latencyUs = 0;    // One-way propagation delay
+    double lossRate = 0.0;     // Probability a byte is dropped
+    double corruptRate = 0.0;  // Probability a byte has one bit flipped
+    uint32_t seed = 1;
+};
+
+struct SimLaneStats
+{
+    uint64_t bytesSent = 0;
+    uint64_t bytesLost = 0;
+    uint64_t bytesCorrupted = 0;
+};
+
+// Full-duplex 8N1 link between two simulated UARTs
+class SimLink
+{
+public:
+    SimLink(SimSerial& a, SimSerial& b, const SimLinkConfig& config);
+    ~SimLink();
+
+    void send(SimSerial* from, uint8_t byte);
+    void deliver();                              // Move arrived bytes into RX buffers
+    bool nextArrival(SimSerial* to, uint64_t& arrivalUs) const;
+    uint64_t txBacklogUs(SimSerial* from) const; // Time until the sender's TX queue drains
+    const SimLaneStats& stats(SimSerial* from) const;
+    double byteTimeUs() const { return byteUs; }
+
+    // Optional tap on every byte written by either side (before loss/corruption)
+    void (*tap)(SimSerial* from, uint8_t byte, void* ctx) = nullptr;
+    void* tapContext = nullptr;
+
+private:
+    struct Lane
+    {
+        SimSerial* dst;
+        std::deque<std::pair<uint64_t, uint8_t>> inFlight;
+        double wireFreeUs = 0;
+        SimLaneStats stats;
+    };
+    Lane& laneFrom(SimSerial* from);
+    const Lane& laneFrom(SimSerial* from) const;
+    double uniform();
+
+    SimSerial* a;
+    SimSerial* b;
+    Lane aToB;
+    Lane bToA;
+    SimLinkConfig config;
+    double byteUs;
+    uint64_t rngState;
+};
+
+#endif // SIM_CORE_H
@@ -0,0 +1,30 @@
+#ifndef SIM_ESP32_ARDUINO_H
+#define SIM_ESP32_ARDUINO_H
+
+// ESP32 flavour of the simulated Arduino core
+#include "sim_core.h"
+
+#define SERIAL_8N1 0x800001c
+
+// Default ESP32 driver buffers: 256-byte RX ring, 128-byte hardware TX FIFO
+class HardwareSerial : public SimSerial
+{
+public:
+    HardwareSerial() : SimSerial(256, 128) {}
+    using SimSerial::begin;
+    void begin(unsigned long, uint32_t, int8_t, int8_t) {}
+    size_t setRxBufferSize(size_t n) { return rxCapacity = n; }
+};
+
+// FreeRTOS critical sections; the host runs one board at a time, so they only mark the spots
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+
+extern HardwareSerial simEspSerial1;
+extern HardwareSerial simEspSerial2;
+#define Serial1 simEspSerial1
+#define Serial2 simEspSerial2
+
+#endif // SIM_ESP32_ARDUINO_H
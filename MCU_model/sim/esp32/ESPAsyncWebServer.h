@@ -0,0 +1,15 @@
+#ifndef SIM_ESPASYNCWEBSERVER_H
+#define SIM_ESPASYNCWEBSERVER_H
+
+// Declarations only: the harness links the UART code, not the web server
+#include "Arduino.h"
+
+class AsyncWebServerRequest;
+
+class AsyncWebServer
+{
+public:
+    explicit AsyncWebServer(uint16_t) {}
+};
+
+#endif // SIM_ESPASYNCWEBSERVER_H
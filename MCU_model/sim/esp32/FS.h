@@ -0,0 +1,61 @@
+#ifndef SIM_FS_H
+#define SIM_FS_H
+
+// In-memory flash filesystem with the subset of the ESP32 FS API the firmware uses
+#include "Arduino.h"
+#include <map>
+#include <memory>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs
+{
+enum SeekMode { SeekSet, SeekCur, SeekEnd };
+
+class File : public Stream
+{
+public:
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t read(uint8_t* buf, size_t n);
+    size_t write(uint8_t b) override { return write(&b, 1); }
+    size_t write(const uint8_t* buf, size_t n) override;
+    using Print::write;
+    bool seek(uint32_t to, SeekMode mode = SeekSet);
+    size_t position() const { return pos; }
+    size_t size() const { return data ? data->size() : 0; }
+    void close() { data.reset(); pos = 0; }
+    operator bool() const { return data != nullptr; }
+
+private:
+    friend class FS;
+    std::shared_ptr<std::vector<uint8_t>> data;
+    size_t pos = 0;
+    bool writable = false;
+};
+
+class FS
+{
+public:
+    File open(const char* path, const char* mode = FILE_READ, bool create = false);
+    File open(const String& path, const char* mode = FILE_READ, bool create = false)
+    {
+        return open(path.c_str(), mode, create);
+    }
+    bool exists(const char* path) { return files.count(path) != 0; }
+    bool exists(const String& path) { return exists(path.c_str()); }
+    bool remove(const char* path) { return files.erase(path) != 0; }
+    bool remove(const String& path) { return remove(path.c_str()); }
+
+    std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+};
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+
+#endif // SIM_FS_H
@@ -0,0 +1,13 @@
+#ifndef SIM_SPIFFS_H
+#define SIM_SPIFFS_H
+
+#include "FS.h"
+
+class SPIFFSFS : public fs::FS
+{
+public:
+    bool begin(bool = false) { return true; }
+};
+extern SPIFFSFS SPIFFS;
+
+#endif // SIM_SPIFFS_H
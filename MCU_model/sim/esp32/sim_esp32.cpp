@@ -0,0 +1,212 @@
+// ESP32 side of the harness: SPIFFS staging, the web-server hooks and the upload loop over the upload queue
+#include <Arduino.h>
+#include "SPIFFS.h"
+#include "uart.h"
+#include "esp_server.h"
+#include "song_cache.h"
+#include "song_search.h"
+#include "upload_stream.h"
+#include "upload_queue.h"
+#include "uart_tasks.h"
+#include "../sim_glue.h"
+#include <map>
+#include <set>
+
+HardwareSerial simEspSerial1;
+HardwareSerial simEspSerial2;
+SPIFFSFS SPIFFS;
+
+namespace fs
+{
+int File::available() { return data ? (int)(data->size() - pos) : 0; }
+
+int File::read()
+{
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int File::peek() { return data && pos < data->size() ? (*data)[pos] : -1; }
+
+size_t File::read(uint8_t* buf, size_t n)
+{
+    if (!data) return 0;
+    size_t count = std::min(n, data->size() - pos);
+    memcpy(buf, data->data() + pos, count);
+    pos += count;
+    return count;
+}
+
+size_t File::write(const uint8_t* buf, size_t n)
+{
+    if (!data || !writable) return 0;
+    if (pos + n > data->size()) data->resize(pos + n);
+    memcpy(data->data() + pos, buf, n);
+    pos += n;
+    return n;
+}
+
+bool File::seek(uint32_t to, SeekMode mode)
+{
+    if (!data) return false;
+    size_t base = mode == SeekSet ? 0 : (mode == SeekCur ? pos : data->size());
+    if (base + to > data->size()) return false;
+    pos = base + to;
+    return true;
+}
+
+File FS::open(const char* path, const char* mode, bool create)
+{
+    File file;
+    auto it = files.find(path);
+    bool write = mode[0] == 'w' || mode[0] == 'a';
+    if (it == files.end())
+    {
+        if (!write && !create) return file;
+        it = files.emplace(path, std::make_shared<std::vector<uint8_t>>()).first;
+    }
+    if (mode[0] == 'w') it->second->clear();
+    file.data = it->second;
+    file.writable = write;
+    file.pos = mode[0] == 'a' ? it->second->size() : 0;
+    return file;
+}
+} // namespace fs
+
+static std::set<uint16_t> completedJobs;
+static uint16_t lastJob = 0;
+static std::string lastMessage;
+static std::map<uint16_t, std::string> jobMessages; // Latest status of each job
+
+void notifyProgress(const char* stage, int percentage, const char* message, uint16_t job)
+{
+    lastMessage = message;
+    jobMessages[job] = message;
+    // Both the normal CLEANUP path and a content-addressed skip end at 100%
+    if (strcmp(stage, "complete") == 0 || (percentage == 100 && strstr(message, "skipped")))
+    {
+        completedJobs.insert(job);
+    }
+}
+
+void notifyPlaybackStatus(const char*) {}
+void completeSongList(uint8_t, const JsonDocument*) {}
+
+// Library cache hooks (the harness has no web server to serve it from)
+void songCacheInvalidate() {}
+void songCacheBeginPage(uint8_t, uint16_t) {}
+void songCacheAddEntry(const uint8_t*, size_t) {}
+void songCacheEndPage(uint16_t, uint32_t) {}
+void songCacheAbortPage() {}
+void songSearchAdd(const String&, uint32_t, uint16_t) {}
+
+// No TX task in the harness; frames go straight to the instruction UART without an ACK wait
+bool queueInstructionFrame(const FrameSegment* segments, size_t count, uint8_t flags)
+{
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++) length += segments[i].length;
+    if (length > INSTRUCTION_MAX_PAYLOAD) return false;
+
+    uint8_t header[INSTRUCTION_FRAME_HEADER_SIZE];
+    uint16_t crc = instructionFrameHeader(header, flags & ~INSTRUCTION_FLAG_ACK, 0, length);
+    instruction_uart.write(header, sizeof(header));
+    for (size_t i = 0; i < count; i++)
+    {
+        instruction_uart.write(segments[i].data, segments[i].length);
+        crc = instructionCrc16(segments[i].data, segments[i].length, crc);
+    }
+    uint8_t trailer[] = {(uint8_t)crc, (uint8_t)(crc >> 8)};
+    instruction_uart.write(trailer, sizeof(trailer));
+    return true;
+}
+
+void instructionAckReceived(uint8_t, uint8_t) {}
+
+SimSerial& espUploadUart() { return upload_uart; }
+
+uint16_t espStartUpload(const char* path, const std::vector<uint8_t>& data)
+{
+    // What the web server does for a staged upload: add the job, write its body, mark it ready
+    char staging[UPLOAD_QUEUE_STAGING_SIZE];
+    lastJob = uploadQueueAdd(path, false, staging);
+    File file = SPIFFS.open(staging, FILE_WRITE);
+    file.write(data.data(), data.size());
+    file.close();
+    uploadQueueReady(lastJob, path);
+    return lastJob;
+}
+
+// Stands in for the HTTP request that owns the stream
+static const int streamRequest = 0;
+
+// Body bytes whose TCP ACKs the web server holds; they shrink the client's window
+// until the upload task resumes the writer
+static size_t streamHeld = 0;
+
+static void resumeStream()
+{
+    streamHeld = 0;
+}
+
+bool espStartStream(const char* path, size_t size)
+{
+    if (!uploadQueueEmpty() || !uploadStreamBegin(&streamRequest, size, resumeStream)) return false;
+    streamHeld = 0;
+    char staging[UPLOAD_QUEUE_STAGING_SIZE];
+    lastJob = uploadQueueAdd(path, true, staging);
+    return true;
+}
+
+size_t espStreamWindow()
+{
+    return UPLOAD_STREAM_TCP_WINDOW - std::min(streamHeld, (size_t)UPLOAD_STREAM_TCP_WINDOW);
+}
+
+void espStreamSegment(const uint8_t* data, size_t len)
+{
+    // What the file part handler does with each TCP segment
+    if (!uploadStreamWrite(&streamRequest, data, len)) return; // Discarded; the upload fails
+    if (uploadStreamHoldAcks(&streamRequest)) streamHeld += len;
+}
+
+void espStreamEnd()
+{
+    uploadStreamEnd(&streamRequest);
+}
+
+void espPoll()
+{
+    uploadToSAMD_state();
+}
+
+bool espUploadBusy()
+{
+    return uploadQueueActive();
+}
+
+int espUploadResult()
+{
+    if (uploadQueueActive()) return 0;
+    return completedJobs.count(lastJob) ? 1 : -1; // Every abort path frees the job without "complete"
+}
+
+size_t espUploadsCompleted()
+{
+    return completedJobs.size();
+}
+
+const char* espLastMessage()
+{
+    return lastMessage.c_str();
+}
+
+bool espJobCompleted(uint16_t job)
+{
+    return completedJobs.count(job) > 0;
+}
+
+const char* espJobStatus(uint16_t job)
+{
+    auto it = jobMessages.find(job);
+    return it == jobMessages.end() ? "not started" : it->second.c_str();
+}
@@ -0,0 +1,26 @@
+#ifndef SIM_SAMD_ARDUINO_H
+#define SIM_SAMD_ARDUINO_H
+
+// Grand Central flavour of the simulated Arduino core
+#include "sim_core.h"
+
+#define A10 64
+#define A11 65
+#define A12 66
+#define A13 67
+#define A14 68
+#define A15 69
+
+// SERCOM UARTs on the Grand Central buffer 350 bytes each way
+class Uart : public SimSerial
+{
+public:
+    Uart() : SimSerial(350, 350) {}
+};
+
+extern Uart simSamdSerial1;
+extern Uart simSamdSerial4;
+#define Serial1 simSamdSerial1
+#define Serial4 simSamdSerial4
+
+#endif // SIM_SAMD_ARDUINO_H
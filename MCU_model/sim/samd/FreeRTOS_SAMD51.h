@@ -0,0 +1,25 @@
+#ifndef SIM_FREERTOS_SAMD51_H
+#define SIM_FREERTOS_SAMD51_H
+
+// The harness runs the receiver task inline, so mutexes always succeed
+#include <cstdint>
+
+typedef void* SemaphoreHandle_t;
+typedef void* TaskHandle_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffffu
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(x) (x)
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return (SemaphoreHandle_t)1; }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+void vTaskDelay(TickType_t ticks);
+
+#endif // SIM_FREERTOS_SAMD51_H
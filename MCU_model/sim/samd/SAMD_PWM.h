@@ -0,0 +1,11 @@
+#ifndef SIM_SAMD_PWM_H
+#define SIM_SAMD_PWM_H
+
+class SAMD_PWM
+{
+public:
+    SAMD_PWM(int, float, float) {}
+    bool setPWM(int, float, float) { return true; }
+};
+
+#endif // SIM_SAMD_PWM_H
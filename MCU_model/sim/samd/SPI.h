@@ -0,0 +1,4 @@
+#ifndef SIM_SPI_H
+#define SIM_SPI_H
+// SD access is simulated in memory; nothing to declare
+#endif // SIM_SPI_H
@@ -0,0 +1,87 @@
+#ifndef SIM_SDFAT_H
+#define SIM_SDFAT_H
+
+// In-memory SD card with the subset of the SdFat API the firmware uses
+#include "Arduino.h"
+#include <map>
+#include <memory>
+#include <vector>
+
+typedef int oflag_t;
+#define O_RDONLY 0x00
+#define O_WRONLY 0x01
+#define O_RDWR 0x02
+#define O_ACCMODE 0x03
+#define O_APPEND 0x08
+#define O_CREAT 0x10
+#define O_TRUNC 0x20
+#define O_READ O_RDONLY
+#define O_WRITE O_WRONLY
+// Card timing model: writes and flushes advance the virtual clock (0 = free)
+extern uint32_t simSdByteNs;   // Per byte written
+extern uint32_t simSdFlushUs;  // Per flush (directory entry and FAT update)
+
+#define FILE_READ O_RDONLY
+#define FILE_WRITE (O_RDWR | O_CREAT | O_APPEND)
+#define SD_SCK_MHZ(x) (x)
+
+struct SimSdNode
+{
+    bool dir = false;
+    std::vector<uint8_t> data;
+};
+
+class FsFile : public Stream
+{
+public:
+    bool open(const char* path, oflag_t flags = O_RDONLY);
+    bool openNext(FsFile* dir, oflag_t flags = O_RDONLY);
+    bool close();
+    bool isOpen() const { return node != nullptr; }
+    bool isDir() const { return node && node->dir; }
+    size_t getName(char* name, size_t size);
+    uint64_t size() const { return node ? node->data.size() : 0; }
+    uint64_t fileSize() const { return size(); }
+    uint64_t position() const { return pos; }
+    bool seek(uint64_t to);
+    void rewind() { pos = 0; cursor.clear(); }
+
+    int read(void* buf, size_t n);
+    int read() override;
+    int peek() override;
+    int available() override;
+    size_t write(uint8_t b) override { return write(&b, 1); }
+    size_t write(const void* buf, size_t n) { return write((const uint8_t*)buf, n); }
+    size_t write(const uint8_t* buf, size_t n) override;
+    size_t write(const char* str) { return write((const uint8_t*)str, strlen(str)); }
+    void flush() override;
+    operator bool() const { return isOpen(); }
+
+private:
+    friend class SdFat;
+    std::shared_ptr<SimSdNode> node;
+    std::string path;
+    size_t pos = 0;
+    oflag_t flags = 0;
+    std::string cursor; // Last child returned by openNext()
+};
+typedef FsFile File;
+typedef FsFile SdFile;
+
+class SdFat
+{
+public:
+    bool begin(int, int) { return true; }
+    bool exists(const char* path);
+    bool mkdir(const char* path, bool pFlag = true);
+    bool remove(const char* path);
+    bool rename(const char* from, const char* to);
+    FsFile open(const char* path, oflag_t flags = O_RDONLY);
+
+    // Harness access to the card contents
+    void simFormat();
+    bool simRead(const char* path, std::vector<uint8_t>& out);
+    std::map<std::string, std::shared_ptr<SimSdNode>> nodes;
+};
+
+#endif // SIM_SDFAT_H
@@ -0,0 +1,11 @@
+#ifndef SIM_SERVO_H
+#define SIM_SERVO_H
+
+class Servo
+{
+public:
+    void attach(int) {}
+    void write(int) {}
+};
+
+#endif // SIM_SERVO_H
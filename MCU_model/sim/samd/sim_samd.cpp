@@ -0,0 +1,82 @@
+// Grand Central side of the harness: globals the receiver expects from main.cpp/globals.cpp
+#include <Arduino.h>
+#include <SdFat.h>
+#include <FreeRTOS_SAMD51.h>
+#include "uart_transfer.h"
+#include "song_index.h"
+#include "upload_qos.h"
+#include "../sim_glue.h"
+
+Uart simSamdSerial1;
+Uart simSamdSerial4;
+Uart &dataUart = Serial1;
+Uart &instructionUart = Serial4;
+SdFat sd;
+
+volatile bool isPlaying = false;
+volatile bool isPaused = false;
+volatile bool newSongRequested = false;
+char currentSongPath[128] = "";
+size_t currentEventIndex = 0;
+unsigned long startTime = 0;
+unsigned long pauseOffset = 0;
+SemaphoreHandle_t playbackSemaphore = xSemaphoreCreateMutex();
+SemaphoreHandle_t instructionTxSemaphore = xSemaphoreCreateMutex();
+
+// Playback clock from translate.cpp; the harness does not play songs
+unsigned long playbackPosition() { return 0; }
+void setPlaybackPosition(unsigned long) {}
+bool setPlaybackRate(uint16_t) { return true; }
+uint16_t playbackRate() { return 100; }
+void pausePlayback() { isPaused = true; }
+void resumePlayback() { isPaused = false; }
+
+// Blocks like the RTOS would, so the peer and the playback model keep running
+void vTaskDelay(TickType_t ticks)
+{
+    simWaitUntil(simNowUs() + (uint64_t)ticks * 1000);
+}
+
+SimSerial& samdDataUart() { return dataUart; }
+
+void samdReset()
+{
+    sd.simFormat();
+    songIndexBegin();
+}
+
+void samdPoll()
+{
+    fileReceiverRTOS_char(dataUart);
+}
+
+bool samdReadFile(const char* path, std::vector<uint8_t>& out)
+{
+    if (sd.simRead(path, out)) return true;
+    const char* stored = songIndexResolve(path); // Deduplicated uploads live at another path
+    return stored && sd.simRead(stored, out);
+}
+
+void samdSetSdTiming(uint32_t byteNs, uint32_t flushUs)
+{
+    simSdByteNs = byteNs;
+    simSdFlushUs = flushUs;
+}
+
+void samdSetUploadQos(bool enabled, bool slackWait)
+{
+    uploadQosEnabled = enabled;
+    uploadQosSlackWait = slackWait;
+}
+
+void samdPlaybackNext(unsigned long dueMs) { qosNextEvent(dueMs); }
+void samdPlaybackEvent(unsigned long dueMs) { qosRecordEvent(dueMs); }
+void samdPlaybackStop() { qosPlaybackStopped(); }
+
+void samdTakeDeadlines(uint32_t& events, uint32_t& missed, uint32_t& maxLateMs)
+{
+    QosDeadlineStats stats = qosTakeDeadlineStats();
+    events = stats.events;
+    missed = stats.missed;
+    maxLateMs = stats.maxLateMs;
+}
@@ -0,0 +1,40 @@
+// Grand Central side of the harness: the SD server runs requests inline on the
+// calling "task", since the harness has a single thread and nothing to preempt
+#include <Arduino.h>
+#include <SdFat.h>
+#include "sd_server.h"
+
+extern SdFat sd;
+
+bool sdServerBegin() { return true; }
+
+bool sdOpen(SdPriority, File& file, const char* path, oflag_t oflag)
+{
+    if (file) file.close();
+    file = sd.open(path, oflag);
+    return file;
+}
+
+void sdClose(SdPriority, File& file)
+{
+    if (file) file.close();
+}
+
+int sdRead(SdPriority, File& file, void* buffer, size_t len, int32_t position)
+{
+    if (!file || (position >= 0 && !file.seek(position))) return -1;
+    return file.read(buffer, len);
+}
+
+size_t sdWrite(SdPriority, File& file, const void* buffer, size_t len, bool flush)
+{
+    if (!file) return 0;
+    size_t written = file.write((const uint8_t*)buffer, len);
+    if (flush) file.flush();
+    return written;
+}
+
+bool sdExists(SdPriority, const char* path) { return sd.exists(path); }
+bool sdMkdir(SdPriority, const char* path) { return sd.mkdir(path); }
+bool sdCall(SdPriority, bool (*fn)(void* ctx), void* ctx) { return fn(ctx); }
+void sdServerReportStats(Print&) {}
@@ -0,0 +1,189 @@
+#include "SdFat.h"
+
+uint32_t simSdByteNs = 0;
+uint32_t simSdFlushUs = 0;
+
+// Absolute, slash-separated path without a trailing slash ("/" for the root)
+static std::string normalize(const char* path)
+{
+    std::string p = path && path[0] == '/' ? path : std::string("/") + (path ? path : "");
+    while (p.size() > 1 && p.back() == '/') p.pop_back();
+    return p;
+}
+
+static std::string parentOf(const std::string& p)
+{
+    size_t slash = p.rfind('/');
+    return slash == 0 ? "/" : p.substr(0, slash);
+}
+
+void SdFat::simFormat()
+{
+    nodes.clear();
+    nodes["/"] = std::make_shared<SimSdNode>();
+    nodes["/"]->dir = true;
+}
+
+bool SdFat::simRead(const char* path, std::vector<uint8_t>& out)
+{
+    auto it = nodes.find(normalize(path));
+    if (it == nodes.end() || it->second->dir) return false;
+    out = it->second->data;
+    return true;
+}
+
+bool SdFat::exists(const char* path)
+{
+    if (nodes.empty()) simFormat();
+    return nodes.count(normalize(path)) != 0;
+}
+
+bool SdFat::mkdir(const char* path, bool pFlag)
+{
+    if (nodes.empty()) simFormat();
+    std::string p = normalize(path);
+    if (nodes.count(p)) return false;
+    std::string parent = parentOf(p);
+    if (!nodes.count(parent))
+    {
+        if (!pFlag || !mkdir(parent.c_str(), true)) return false;
+    }
+    if (!nodes[parent]->dir) return false;
+    nodes[p] = std::make_shared<SimSdNode>();
+    nodes[p]->dir = true;
+    return true;
+}
+
+bool SdFat::remove(const char* path)
+{
+    auto it = nodes.find(normalize(path));
+    if (it == nodes.end() || it->second->dir) return false;
+    nodes.erase(it);
+    return true;
+}
+
+bool SdFat::rename(const char* from, const char* to)
+{
+    std::string src = normalize(from);
+    std::string dst = normalize(to);
+    auto it = nodes.find(src);
+    if (it == nodes.end() || it->second->dir || nodes.count(dst)) return false;
+    auto parent = nodes.find(parentOf(dst));
+    if (parent == nodes.end() || !parent->second->dir) return false;
+    nodes[dst] = it->second;
+    nodes.erase(src);
+    return true;
+}
+
+FsFile SdFat::open(const char* path, oflag_t flags)
+{
+    FsFile file;
+    file.open(path, flags);
+    return file;
+}
+
+extern SdFat sd;
+
+bool FsFile::open(const char* filePath, oflag_t openFlags)
+{
+    close();
+    if (sd.nodes.empty()) sd.simFormat();
+    std::string p = normalize(filePath);
+    auto it = sd.nodes.find(p);
+    if (it == sd.nodes.end())
+    {
+        auto parent = sd.nodes.find(parentOf(p));
+        if (!(openFlags & O_CREAT) || parent == sd.nodes.end() || !parent->second->dir) return false;
+        it = sd.nodes.emplace(p, std::make_shared<SimSdNode>()).first;
+    }
+    if (it->second->dir && (openFlags & O_ACCMODE) != O_RDONLY) return false;
+    node = it->second;
+    path = p;
+    flags = openFlags;
+    pos = 0;
+    if (openFlags & O_TRUNC) node->data.clear();
+    if (openFlags & O_APPEND) pos = node->data.size();
+    return true;
+}
+
+bool FsFile::openNext(FsFile* dir, oflag_t openFlags)
+{
+    close();
+    if (!dir || !dir->isDir()) return false;
+    std::string prefix = dir->path == "/" ? "/" : dir->path + "/";
+    auto it = dir->cursor.empty() ? sd.nodes.upper_bound(prefix) : sd.nodes.upper_bound(dir->cursor);
+    for (; it != sd.nodes.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+    {
+        if (it->first.find('/', prefix.size()) != std::string::npos) continue; // Grandchild
+        dir->cursor = it->first;
+        return open(it->first.c_str(), openFlags);
+    }
+    return false;
+}
+
+bool FsFile::close()
+{
+    node.reset();
+    path.clear();
+    cursor.clear();
+    pos = 0;
+    return true;
+}
+
+size_t FsFile::getName(char* name, size_t size)
+{
+    if (!node || size == 0) return 0;
+    std::string base = path == "/" ? "/" : path.substr(path.rfind('/') + 1);
+    size_t n = std::min(base.size(), size - 1);
+    memcpy(name, base.data(), n);
+    name[n] = '\0';
+    return n;
+}
+
+bool FsFile::seek(uint64_t to)
+{
+    if (!node || to > node->data.size()) return false;
+    pos = to;
+    return true;
+}
+
+int FsFile::read(void* buf, size_t n)
+{
+    if (!node || node->dir || (flags & O_ACCMODE) == O_WRONLY) return -1;
+    size_t count = std::min(n, node->data.size() - pos);
+    memcpy(buf, node->data.data() + pos, count);
+    pos += count;
+    return (int)count;
+}
+
+int FsFile::read()
+{
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int FsFile::peek()
+{
+    return node && pos < node->data.size() ? node->data[pos] : -1;
+}
+
+int FsFile::available()
+{
+    return node ? (int)(node->data.size() - pos) : 0;
+}
+
+size_t FsFile::write(const uint8_t* buf, size_t n)
+{
+    if (!node || node->dir || (flags & O_ACCMODE) == O_RDONLY) return 0;
+    simAdvanceBy((uint64_t)n * simSdByteNs / 1000);
+    if (flags & O_APPEND) pos = node->data.size();
+    if (pos + n > node->data.size()) node->data.resize(pos + n);
+    memcpy(node->data.data() + pos, buf, n);
+    pos += n;
+    return n;
+}
+
+void FsFile::flush()
+{
+    if (node) simAdvanceBy(simSdFlushUs);
+}
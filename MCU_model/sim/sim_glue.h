@@ -0,0 +1,37 @@
+#ifndef SIM_GLUE_H
+#define SIM_GLUE_H
+
+// Board-neutral entry points the host programs use to drive the linked firmware
+#include "common/sim_core.h"
+#include <vector>
+
+// Grand Central
+SimSerial& samdDataUart();
+void samdReset();   // Blank SD card and reload the song index
+void samdPoll();    // One pass of the file receiver task body
+bool samdReadFile(const char* path, std::vector<uint8_t>& out); // Follows index aliases
+void samdSetSdTiming(uint32_t byteNs, uint32_t flushUs);         // Card write cost model
+void samdSetUploadQos(bool enabled, bool slackWait = true); // slackWait off: batched writes only
+
+// Playback deadline model standing in for the playback task
+void samdPlaybackNext(unsigned long dueMs);   // Next event loaded
+void samdPlaybackEvent(unsigned long dueMs);  // Event executed now
+void samdPlaybackStop();
+void samdTakeDeadlines(uint32_t& events, uint32_t& missed, uint32_t& maxLateMs);
+
+// ESP32
+SimSerial& espUploadUart();
+uint16_t espStartUpload(const char* path, const std::vector<uint8_t>& data); // Queue a job staged in SPIFFS; returns its id
+bool espStartStream(const char* path, size_t size); // Streamed upload (queue must be empty); the body follows through espStreamSegment
+size_t espStreamWindow(); // Client's TCP window: bytes it may send before the next ACK
+void espStreamSegment(const uint8_t* data, size_t len); // One TCP segment of the body, at most espStreamWindow()
+void espStreamEnd();
+void espPoll();     // One pass of loop()'s upload state machine
+bool espUploadBusy();  // A queued job is still to be sent
+int espUploadResult(); // Latest job: 1 complete, -1 failed, 0 still running
+size_t espUploadsCompleted(); // Jobs completed since start
+const char* espLastMessage();
+bool espJobCompleted(uint16_t job);
+const char* espJobStatus(uint16_t job); // Last progress message of one job
+
+#endif // SIM_GLUE_H
@@ -0,0 +1,420 @@
+// Host simulation of the ESP32 -> Grand Central upload protocol
+// Links the real uploadToSAMD_state() and fileReceiverRTOS_char() state machines against
+// simulated UARTs on a virtual clock, and reports goodput, retries and time-to-complete.
+// The "play", "buffer" and "qos" rows upload while a song plays (one event every --event-ms) and
+// count the events that fire late: flushed writes, writes batched in the QoS buffer but committed
+// whenever due, and batched writes committed only in playback slack. buffer vs play isolates the
+// fewer flushes, qos vs buffer the slack admission.
+// The "staged" and "stream" rows time a new song from the first HTTP body byte (arriving at
+// --http-bps): staged in SPIFFS first and then sent, or streamed to the UART as it arrives.
+// The "batch" row queues ten songs at once and sends them back to back through the upload queue.
+// Build: ./build_host.sh (outputs to build/)   Usage: ./transfer_bench [--baud N] [--latency-us N] [--loss P]
+//        [--corrupt P] [--sizes a,b,c] [--samd-period-us N] [--esp-period-us N] [--seed N]
+//        [--sd-byte-ns N] [--sd-flush-us N] [--event-ms N] [--http-bps N] [--verbose]
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <set>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include "sim/sim_glue.h"
+
+using namespace std;
+
+static const size_t BATCH_SONGS = 10;
+
+struct Options
+{
+    SimLinkConfig link;
+    vector<size_t> sizes = {1024, 4096, 16384, 65536};
+    uint64_t samdPeriodUs = 5000; // fileReceiverTask's vTaskDelay(5)
+    uint64_t espPeriodUs = 100;   // loop() pass with an idle web server
+    uint32_t sdByteNs = 500;      // SPI transfer of the written data
+    uint32_t sdFlushUs = 5000;    // Directory entry/FAT update and card busy time
+    uint64_t eventMs = 20;        // Playback event spacing for the play/buffer/qos rows
+    uint32_t httpBps = 60000;     // Upload body rate into the ESP32 (WiFi into SPIFFS)
+    bool verbose = false;
+};
+
+// Counts retransmissions by watching the ESP32's outgoing line protocol
+struct WireTap
+{
+    string line;
+    size_t skip = 0;        // Raw chunk payload bytes still to pass
+    set<string> seen;       // "CHUNK:<id>" / "COPY:<id>" already sent
+    set<string> started;    // "START:<path>" already sent
+    int retries = 0;
+
+    void reset() { *this = WireTap(); }
+
+    void onByte(uint8_t b)
+    {
+        if (skip)
+        {
+            skip--;
+            return;
+        }
+        if (b != '\n')
+        {
+            if (line.size() < 128) line += (char)b;
+            return;
+        }
+        if (line.compare(0, 6, "START:") == 0)
+        {
+            if (!started.insert(line.substr(0, line.find(":SIZE:"))).second) retries++;
+            seen.clear(); // A fresh header restarts chunk numbering
+        }
+        else if (line.compare(0, 6, "CHUNK:") == 0 || line.compare(0, 5, "COPY:") == 0)
+        {
+            size_t idEnd = line.find(':', line.find(':') + 1);
+            if (!seen.insert(line.substr(0, idEnd)).second) retries++;
+            size_t sizePos = line.find(":SIZE:");
+            if (sizePos != string::npos) skip = strtoul(line.c_str() + sizePos + 6, nullptr, 10);
+        }
+        line.clear();
+    }
+};
+
+static WireTap tap;
+
+static void tapByte(SimSerial* from, uint8_t b, void*)
+{
+    if (from == &espUploadUart()) tap.onByte(b);
+}
+
+struct RunResult
+{
+    bool completed;
+    bool verified;
+    double seconds;
+    uint64_t wireBytes; // Both directions, including lost bytes
+    int retries;
+    uint32_t events;    // Playback events during the upload (play/buffer/qos rows)
+    uint32_t missed;
+    uint32_t maxLateMs;
+    vector<string> jobs; // Batch row: verdict and final status of each song
+};
+
+// Cooperative scheduler: each board runs when its next poll is due. Also installed as
+// simWaitHook so the peer keeps running while one board blocks on its UART.
+static uint64_t espPeriodUs, samdPeriodUs;
+static uint64_t nextEsp, nextSamd;
+static bool inEsp, inSamd;
+
+// Playback model: the playback task fires one event every eventPeriodUs while playing
+static uint64_t eventPeriodUs;
+static uint64_t nextEventUs = UINT64_MAX;
+
+static void startPlayback()
+{
+    nextEventUs = simNowUs() + eventPeriodUs;
+    samdPlaybackNext(nextEventUs / 1000);
+}
+
+static void stopPlayback()
+{
+    nextEventUs = UINT64_MAX;
+    samdPlaybackStop();
+}
+
+static uint64_t nextWake() { return min(min(nextEsp, nextSamd), nextEventUs); }
+
+// HTTP body model for streamed uploads: bytes arrive at httpBps in TCP segments, and
+// only as far as the window the ESP32 leaves open (it holds ACKs while its ring is full)
+static const size_t tcpSegment = 1436; // lwIP TCP_MSS on the ESP32
+static double httpBytesPerUs;
+static const vector<uint8_t>* streamBody;
+static size_t streamPos;
+static double streamCredit;
+static uint64_t streamLastUs;
+
+static void feedStream()
+{
+    if (!streamBody || streamPos >= streamBody->size()) return;
+    uint64_t now = simNowUs();
+    streamCredit = min(streamCredit + (now - streamLastUs) * httpBytesPerUs, (double)tcpSegment);
+    streamLastUs = now;
+    size_t want = min({(size_t)streamCredit, streamBody->size() - streamPos, espStreamWindow()});
+    if (!want || (want < tcpSegment && streamPos + want < streamBody->size())) return; // Whole segments only
+    espStreamSegment(streamBody->data() + streamPos, want);
+    streamPos += want;
+    streamCredit -= want;
+    if (streamPos == streamBody->size()) espStreamEnd();
+}
+
+static void schedule()
+{
+    // Runs at the highest priority, but only when the card is free (between SD calls)
+    if (simNowUs() >= nextEventUs)
+    {
+        samdPlaybackEvent(nextEventUs / 1000);
+        nextEventUs += eventPeriodUs;
+        samdPlaybackNext(nextEventUs / 1000);
+    }
+    if (!inEsp && simNowUs() >= nextEsp)
+    {
+        inEsp = true;
+        feedStream();
+        espPoll();
+        nextEsp = simNowUs() + espPeriodUs;
+        inEsp = false;
+    }
+    if (!inSamd && simNowUs() >= nextSamd)
+    {
+        inSamd = true;
+        samdPoll();
+        nextSamd = simNowUs() + samdPeriodUs;
+        inSamd = false;
+    }
+}
+
+// Polls both boards until the upload finishes, then lets the Grand Central settle
+static RunResult runUpload(SimLink& link, const string& path, const vector<uint8_t>& data, bool play = false,
+                           bool stream = false)
+{
+    const uint64_t limitUs = 600ULL * 1000000;
+    SimLaneStats up0 = link.stats(&espUploadUart());
+    SimLaneStats down0 = link.stats(&samdDataUart());
+    tap.reset();
+
+    uint64_t start = simNowUs();
+    if (stream)
+    {
+        if (!espStartStream(path.c_str(), data.size())) return RunResult{};
+        streamBody = &data;
+        streamPos = 0;
+        streamCredit = 0;
+        streamLastUs = start;
+    }
+    else
+    {
+        espStartUpload(path.c_str(), data);
+    }
+    nextEsp = nextSamd = start;
+    if (play) startPlayback();
+
+    while (espUploadBusy() && simNowUs() - start < limitUs)
+    {
+        schedule();
+        simAdvanceTo(nextWake());
+    }
+    uint64_t end = simNowUs();
+    if (play) stopPlayback();
+    streamBody = nullptr;
+
+    RunResult r;
+    samdTakeDeadlines(r.events, r.missed, r.maxLateMs);
+
+    // The receiver answers DONE and may still be finalising; also lets a failed
+    // session hit its 5 s timeout so the next run starts from PARSE_HEADER
+    for (uint64_t until = simNowUs() + 6000000; simNowUs() < until; simAdvanceTo(min(nextEsp, nextSamd)))
+    {
+        schedule();
+    }
+
+    r.completed = espUploadResult() == 1;
+    vector<uint8_t> stored;
+    r.verified = r.completed && samdReadFile(path.c_str(), stored) && stored == data;
+    r.seconds = (end - start) / 1e6;
+    r.wireBytes = link.stats(&espUploadUart()).bytesSent - up0.bytesSent +
+                  link.stats(&samdDataUart()).bytesSent - down0.bytesSent;
+    r.retries = tap.retries;
+    return r;
+}
+
+// Queues a playlist at once, as POST /upload-binary does for uploads arriving during a
+// transfer, and lets the upload task send the jobs back to back
+static RunResult runBatch(SimLink& link, const vector<string>& paths, const vector<vector<uint8_t>>& songs)
+{
+    const uint64_t limitUs = 600ULL * 1000000;
+    SimLaneStats up0 = link.stats(&espUploadUart());
+    SimLaneStats down0 = link.stats(&samdDataUart());
+    size_t completed0 = espUploadsCompleted();
+    tap.reset();
+
+    uint64_t start = simNowUs();
+    vector<uint16_t> ids;
+    for (size_t i = 0; i < songs.size(); i++) ids.push_back(espStartUpload(paths[i].c_str(), songs[i]));
+    nextEsp = nextSamd = start;
+    while (espUploadBusy() && simNowUs() - start < limitUs)
+    {
+        schedule();
+        simAdvanceTo(nextWake());
+    }
+    uint64_t end = simNowUs();
+    for (uint64_t until = simNowUs() + 6000000; simNowUs() < until; simAdvanceTo(min(nextEsp, nextSamd)))
+    {
+        schedule();
+    }
+
+    RunResult r{};
+    r.completed = espUploadsCompleted() - completed0 == songs.size();
+    r.verified = r.completed;
+    for (size_t i = 0; i < songs.size(); i++)
+    {
+        vector<uint8_t> stored;
+        bool stores = samdReadFile(paths[i].c_str(), stored) && stored == songs[i];
+        r.verified = r.verified && stores;
+        const char* verdict = !espJobCompleted(ids[i]) ? "FAILED  " : (stores ? "ok      " : "MISMATCH");
+        r.jobs.push_back(string(verdict) + "  " + espJobStatus(ids[i]));
+    }
+    r.seconds = (end - start) / 1e6;
+    r.wireBytes = link.stats(&espUploadUart()).bytesSent - up0.bytesSent +
+                  link.stats(&samdDataUart()).bytesSent - down0.bytesSent;
+    r.retries = tap.retries;
+    return r;
+}
+
+static void report(const char* mode, size_t size, const RunResult& r)
+{
+    double goodput = r.completed && r.seconds > 0 ? size / r.seconds : 0;
+    printf("%-6s %8zu B  %8.3f s  %8.0f B/s  wire %8llu B (%6.1f%%)  retries %3d  %s\n", mode, size,
+           r.seconds, goodput, (unsigned long long)r.wireBytes, 100.0 * r.wireBytes / size, r.retries,
+           !r.completed ? "FAILED" : (r.verified ? "ok" : "MISMATCH"));
+    if (r.events)
+    {
+        printf("       playback %u events, %u missed (%.1f%%), worst %u ms late\n", r.events, r.missed,
+               100.0 * r.missed / r.events, r.maxLateMs);
+    }
+    for (size_t i = 0; i < r.jobs.size(); i++) printf("       song %zu  %s\n", i, r.jobs[i].c_str());
+    if (!r.verified && r.jobs.empty()) printf("       last status: %s\n", espLastMessage());
+}
+
+static bool parseArgs(int argc, char** argv, Options& opt)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (arg == "--verbose")
+        {
+            opt.verbose = true;
+            continue;
+        }
+        if (!value) return false;
+        i++;
+        if (arg == "--baud") opt.link.baud = strtoul(value, nullptr, 10);
+        else if (arg == "--latency-us") opt.link.latencyUs = strtoul(value, nullptr, 10);
+        else if (arg == "--loss") opt.link.lossRate = atof(value);
+        else if (arg == "--corrupt") opt.link.corruptRate = atof(value);
+        else if (arg == "--samd-period-us") opt.samdPeriodUs = strtoull(value, nullptr, 10);
+        else if (arg == "--esp-period-us") opt.espPeriodUs = strtoull(value, nullptr, 10);
+        else if (arg == "--seed") opt.link.seed = strtoul(value, nullptr, 10);
+        else if (arg == "--sd-byte-ns") opt.sdByteNs = strtoul(value, nullptr, 10);
+        else if (arg == "--sd-flush-us") opt.sdFlushUs = strtoul(value, nullptr, 10);
+        else if (arg == "--event-ms") opt.eventMs = strtoull(value, nullptr, 10);
+        else if (arg == "--http-bps") opt.httpBps = strtoul(value, nullptr, 10);
+        else if (arg == "--sizes")
+        {
+            opt.sizes.clear();
+            for (char* p = argv[i]; *p;)
+            {
+                opt.sizes.push_back(strtoul(p, &p, 10));
+                if (*p == ',') p++;
+                else if (*p) return false;
+            }
+        }
+        else return false;
+    }
+    return opt.link.baud > 0 && opt.samdPeriodUs > 0 && opt.espPeriodUs > 0 && opt.eventMs > 0 &&
+           opt.httpBps > 0;
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    if (!parseArgs(argc, argv, opt))
+    {
+        cerr << "usage: " << argv[0] << " [--baud N] [--latency-us N] [--loss P] [--corrupt P]"
+             << " [--sizes a,b,c] [--samd-period-us N] [--esp-period-us N] [--seed N]"
+             << " [--sd-byte-ns N] [--sd-flush-us N] [--event-ms N] [--http-bps N] [--verbose]" << endl;
+        return 2;
+    }
+    Serial.echo = opt.verbose;
+
+    SimLink link(espUploadUart(), samdDataUart(), opt.link);
+    link.tap = tapByte;
+    espPeriodUs = opt.espPeriodUs;
+    samdPeriodUs = opt.samdPeriodUs;
+    eventPeriodUs = opt.eventMs * 1000;
+    httpBytesPerUs = opt.httpBps / 1e6;
+    samdSetSdTiming(opt.sdByteNs, opt.sdFlushUs);
+    simWaitHook = schedule;
+
+    printf("baud %u  latency %u us  loss %.4f  corrupt %.4f  SAMD poll %llu us  ESP poll %llu us\n",
+           (unsigned)opt.link.baud, (unsigned)opt.link.latencyUs, opt.link.lossRate, opt.link.corruptRate,
+           (unsigned long long)opt.samdPeriodUs, (unsigned long long)opt.espPeriodUs);
+    printf("line rate %.0f B/s  SD %u ns/B + %u us/flush  playback event every %llu ms  HTTP %u B/s\n\n",
+           opt.link.baud / 10.0, (unsigned)opt.sdByteNs, (unsigned)opt.sdFlushUs, (unsigned long long)opt.eventMs,
+           (unsigned)opt.httpBps);
+
+    mt19937 rng(opt.link.seed);
+    int rows = 0, bad = 0;
+    for (size_t size : opt.sizes)
+    {
+        samdReset();
+        vector<uint8_t> song(size);
+        for (uint8_t& b : song) b = (uint8_t)rng();
+
+        string path = "/Bench/Artist/song_" + to_string(size) + ".bin";
+        RunResult full = runUpload(link, path, song);
+        report("full", size, full);
+
+        // Same content under another title: answered from the content index
+        RunResult dedup = runUpload(link, "/Bench/Other/copy_" + to_string(size) + ".bin", song);
+        report("dedup", size, dedup);
+
+        // Small edit to the stored song: only changed blocks cross the link
+        for (int i = 0; i < 5; i++) song[rng() % size] ^= 0x01;
+        RunResult delta = runUpload(link, path, song);
+        report("delta", size, delta);
+
+        // New songs while another plays: plain flushed writes, batched writes, then batches
+        // committed only in playback slack
+        for (uint8_t& b : song) b = (uint8_t)rng();
+        samdSetUploadQos(false);
+        RunResult play = runUpload(link, "/Bench/Live/plain_" + to_string(size) + ".bin", song, true);
+        report("play", size, play);
+        for (uint8_t& b : song) b = (uint8_t)rng();
+        samdSetUploadQos(true, false);
+        RunResult buffer = runUpload(link, "/Bench/Live/buffer_" + to_string(size) + ".bin", song, true);
+        report("buffer", size, buffer);
+        for (uint8_t& b : song) b = (uint8_t)rng();
+        samdSetUploadQos(true);
+        RunResult qos = runUpload(link, "/Bench/Live/qos_" + to_string(size) + ".bin", song, true);
+        report("qos", size, qos);
+
+        // New song from the first HTTP byte: SPIFFS staging adds the whole body time up front
+        for (uint8_t& b : song) b = (uint8_t)rng();
+        RunResult staged = runUpload(link, "/Bench/New/staged_" + to_string(size) + ".bin", song);
+        staged.seconds += (double)size / opt.httpBps;
+        report("staged", size, staged);
+        for (uint8_t& b : song) b = (uint8_t)rng();
+        RunResult stream = runUpload(link, "/Bench/New/stream_" + to_string(size) + ".bin", song, false, true);
+        report("stream", size, stream);
+
+        // A playlist queued at once: one job after another with no gap between them
+        vector<string> paths;
+        vector<vector<uint8_t>> songs(BATCH_SONGS, vector<uint8_t>(size));
+        for (size_t i = 0; i < songs.size(); i++)
+        {
+            for (uint8_t& b : songs[i]) b = (uint8_t)rng();
+            paths.push_back("/Bench/Playlist/song" + to_string(i) + "_" + to_string(size) + ".bin");
+        }
+        RunResult batch = runBatch(link, paths, songs);
+        report("batch", size * songs.size(), batch);
+        printf("       %zu songs back to back, %.3f s per song\n", songs.size(), batch.seconds / songs.size());
+
+        for (const RunResult* r : {&full, &dedup, &delta, &play, &buffer, &qos, &staged, &stream, &batch})
+        {
+            rows++;
+            bad += !r->verified;
+        }
+        printf("\n");
+    }
+    // FAILED and MISMATCH rows both fail the run
+    printf("%d of %d rows stored the song intact\n", rows - bad, rows);
+    return bad ? 1 : 0;
+}
@@ -9,8 +9,28 @@ import VoiceToMIDI from './components/VoiceToMIDI';
 import VoiceControl from './components/VoiceControl'; // Add this import
 import { esp32 } from './api'; // Import the API instance
 
+const PAGE_SIZE = 50;
+
+// Same rules Upload uses to build SD card paths, so filters compare against stored names
+const sanitize = (str) => str.trim().replace(/\s+/g, '_').replace(/[^a-zA-Z0-9_]/g, '');
+const unsanitize = (str) => str.replace(/_/g, ' ')
+                               .replace(/[\r\n\t\f\v]/g, ' ')
+                               .replace(/\s+/g, ' ')
+                               .trim();
+
+// Song entries of one /existing-songs or /search page, with names as the UI shows them
+const parsePage = (page) => page.songs
+  .filter(song => song.genre && song.artist && song.title)
+  .map(song => ({
+    title: unsanitize(song.title),
+    artist: unsanitize(song.artist),
+    genre: unsanitize(song.genre),
+  }))
+  .filter(song => song.genre && song.artist && song.title);
+
 const App = () => {
-  const [songs, setSongs] = useState([]);
+  const [songs, setSongs] = useState([]); // Library pages loaded so far
+  const [songTotal, setSongTotal] = useState(0);
   const [query, setQuery] = useState('');
   const [suggestions, setSuggestions] = useState([]);
   const [selectedArtist, setSelectedArtist] = useState('');
@@ -42,68 +62,22 @@ const App = () => {
     
     try {
       console.log(`Attempting to fetch songs (attempt ${retryCount + 1}/${maxRetries + 1})`);
-      const response = await esp32.get('/existing-songs');
-      console.log('Fetched songs from ESP32:', response.data);
-      
-      if (response.data === '' || !response.data) {
-        console.log('No songs found on SD card, will retry...');
-        if (retryCount < maxRetries) {
-          setTimeout(() => fetchSongs(retryCount + 1), retryDelay);
-          return;
-        } else {
-          console.error('No songs found after maximum retries');
-          return;
-        }
-      }
 
-      // Split the response string into an array of paths
-      const paths = response.data.split('\n').filter((path) => path.trim() !== '');
-
-      if (Array.isArray(paths) && paths.length > 0) {
-        const parsedSongs = paths.map((path) => {
-          // Split the path into parts
-          const parts = path.split('/');
-          const genreRaw = parts[1] || null;
-          const artistRaw = parts[2] || null;
-          const titleWithExtension = parts[3] || null;
-          
-          if (!genreRaw || !artistRaw || !titleWithExtension) {
-            return null;
-          }
-          
-          const titleRaw = titleWithExtension.replace('.bin', '')
-
-          const unsanitize = (str) => {
-            return str.replace(/_/g, ' ')
-                     .replace(/[\r\n\t\f\v]/g, ' ')
-                     .replace(/\s+/g, ' ')
-                     .trim();
-          };
-
-          const genre = unsanitize(genreRaw);
-          const artist = unsanitize(artistRaw);
-          const title = unsanitize(titleRaw);
-
-          if (!genre || !artist || !title) {
-            return null;
-          }
+      // Only the first page; Playlist loads the rest on demand
+      const response = await esp32.get('/existing-songs', { params: { offset: 0, limit: PAGE_SIZE } });
+      const page = response.data;
+      const parsedSongs = page && Array.isArray(page.songs) ? parsePage(page) : [];
 
-          return { title, artist, genre };
-        }).filter(song => song !== null);
-
-        if (parsedSongs.length > 0) {
-          setSongs(parsedSongs);
-          console.log(`Successfully loaded ${parsedSongs.length} songs`);
-        } else {
-          console.log('No valid songs parsed, will retry...');
-          if (retryCount < maxRetries) {
-            setTimeout(() => fetchSongs(retryCount + 1), retryDelay);
-          }
-        }
+      if (parsedSongs.length > 0) {
+        setSongs(parsedSongs);
+        setSongTotal(page.total);
+        console.log(`Loaded ${parsedSongs.length} of ${page.total} songs`);
       } else {
-        console.log('Invalid response format, will retry...');
+        console.log('No songs found on SD card, will retry...');
         if (retryCount < maxRetries) {
           setTimeout(() => fetchSongs(retryCount + 1), retryDelay);
+        } else {
+          console.error('No songs found after maximum retries');
         }
       }
     } catch (error) {
@@ -122,31 +96,39 @@ const App = () => {
     fetchSongs();
   }
 }, []); // Empty dependency array ensures this runs only once
-  useEffect(() => {
-    // Filter songs based on the query, selected artist, and selected genre
-    const matchingSuggestions = songs.filter((song) => {
-      const matchesQuery = query ? song.title.toLowerCase().includes(query.toLowerCase()) : true;
-      const matchesArtist = selectedArtist ? song.artist === selectedArtist : true;
-      const matchesGenre = selectedGenre ? song.genre === selectedGenre : true;
-      return matchesQuery && matchesArtist && matchesGenre;
-    });
 
-    setSuggestions(matchingSuggestions);
-  }, [query, selectedArtist, selectedGenre, songs]); // Dependencies ensure this runs whenever these states change
+  // Next library page, appended to what is loaded
+  const loadMoreSongs = async () => {
+    try {
+      const response = await esp32.get('/existing-songs', { params: { offset: songs.length, limit: PAGE_SIZE } });
+      // Uploads made since the first page may already be in the list
+      setSongs(prev => [...prev, ...parsePage(response.data).filter(song => !prev.some(known =>
+        known.title === song.title && known.artist === song.artist && known.genre === song.genre))]);
+      setSongTotal(response.data.total);
+    } catch (error) {
+      console.error('Error loading more songs:', error);
+    }
+  };
+
+  // Suggestions come from the ESP32's search index, so songs not loaded yet are found too
+  const searchRequest = useRef(0);
+  useEffect(() => {
+    const request = ++searchRequest.current;
+    const params = { offset: 0, limit: PAGE_SIZE };
+    if (query) params.q = sanitize(query);
+    if (selectedArtist) params.artist = sanitize(selectedArtist);
+    if (selectedGenre) params.genre = sanitize(selectedGenre);
+
+    esp32.get('/search', { params })
+      .then(response => {
+        // A reply to an older query may arrive after a newer one
+        if (request === searchRequest.current) setSuggestions(parsePage(response.data));
+      })
+      .catch(error => console.error('Error searching songs:', error));
+  }, [query, selectedArtist, selectedGenre]);
 
   const handleInputChange = (e) => {
-    const value = e.target.value;
-    setQuery(value);
-
-    // Update suggestions dynamically as the user types
-    const filteredSuggestions = songs.filter((song) => {
-      const matchesQuery = value ? song.title.toLowerCase().includes(value.toLowerCase()) : true;
-      const matchesArtist = selectedArtist ? song.artist === selectedArtist : true;
-      const matchesGenre = selectedGenre ? song.genre === selectedGenre : true;
-      return matchesQuery && matchesArtist && matchesGenre;
-    });
-
-    setSuggestions(filteredSuggestions);
+    setQuery(e.target.value);
   };
 
   const handleFilterChange = (filterType, value) => {
@@ -156,15 +138,6 @@ const App = () => {
       setSelectedGenre(value);
     }
     setDropdownActive(true);
-
-    const filteredSuggestions = songs.filter((song) => {
-      const matchesQuery = song.title.toLowerCase().includes(query.toLowerCase());
-      const matchesArtist = filterType === 'artist' ? value === song.artist : selectedArtist ? song.artist === selectedArtist : true;
-      const matchesGenre = filterType === 'genre' ? value === song.genre : selectedGenre ? song.genre === selectedGenre : true;
-      return matchesQuery && matchesArtist && matchesGenre;
-    });
-
-    setSuggestions(filteredSuggestions);
   };
 
   const handleSuggestionClick = (suggestion) => {
@@ -177,7 +150,7 @@ const App = () => {
   const handleAddToPlaylist = () => {
     if (!query || query.trim() === '') return;
 
-    const matchingSong = songs.find(
+    const matchingSong = [...suggestions, ...songs].find(
       (song) =>
         song.title.toLowerCase() === query.toLowerCase() &&
         (!selectedArtist || song.artist === selectedArtist) &&
@@ -601,6 +574,9 @@ const sanitizeTrackForESP32 = (track) => {
             <Playlist 
               currentPlaylist={currentPlaylist} 
               setCurrentPlaylist={setCurrentPlaylist}
+              library={songs}
+              libraryTotal={songTotal}
+              onLoadMore={loadMoreSongs}
               selectPlaylist={(track) => {
                 setCurrentTrack(track);
                 setIsPlaying(false);
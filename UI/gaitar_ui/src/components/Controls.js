@@ -1,7 +1,7 @@
 // src/components/Controls.js
 import React, { forwardRef, useImperativeHandle } from 'react';
 import { FaPlay, FaPause, FaStepForward, FaStepBackward, FaRandom } from 'react-icons/fa';
-import { esp32 } from '../api';
+import { playOnESP32, pauseOnESP32 } from '../espCommands';
 
 const Controls = forwardRef(({ 
   currentTrack, 
@@ -41,7 +41,7 @@ const Controls = forwardRef(({
       const sanitizedTrack = sanitizeTrackForESP32(currentTrack);
       console.log('Sending sanitized track to ESP32:', sanitizedTrack);
       
-      esp32.post('/play', sanitizedTrack)
+      playOnESP32(sanitizedTrack)
         .then(response => {
           console.log('Playing track on ESP32:', response.data);
           setIsPlaying(true); // Set to playing
@@ -55,7 +55,7 @@ const Controls = forwardRef(({
   const handlePause = () => {
     if (currentTrack) {
       console.log('Pause:', currentTrack.title);
-      esp32.post('/pause')
+      pauseOnESP32()
         .then(response => {
           console.log('Paused on ESP32:', response.data);
           setIsPlaying(false); // Set to paused
@@ -77,7 +77,7 @@ const Controls = forwardRef(({
       const sanitizedTrack = sanitizeTrackForESP32(nextTrack);
       console.log('Sending sanitized track to ESP32:', sanitizedTrack);
       
-      esp32.post('/play', sanitizedTrack)
+      playOnESP32(sanitizedTrack)
         .then(response => {
           console.log('Playing next track on ESP32:', response.data);
           setIsPlaying(true); // Set to playing
@@ -99,7 +99,7 @@ const Controls = forwardRef(({
       const sanitizedTrack = sanitizeTrackForESP32(prevTrack);
       console.log('Sending sanitized track to ESP32:', sanitizedTrack);
       
-      esp32.post('/play', sanitizedTrack)
+      playOnESP32(sanitizedTrack)
         .then(response => {
           console.log('Playing previous track on ESP32:', response.data);
           setIsPlaying(true); // Set to playing
@@ -126,7 +126,7 @@ const Controls = forwardRef(({
       const sanitizedTrack = sanitizeTrackForESP32(nextTrack);
       console.log('Sending sanitized track to ESP32:', sanitizedTrack);
 
-      esp32.post('/play', sanitizedTrack)
+      playOnESP32(sanitizedTrack)
         .then(response => {
           console.log('Playing shuffled track on ESP32:', response.data);
           setIsPlaying(true); // Set to playing
@@ -145,7 +145,7 @@ const Controls = forwardRef(({
       const sanitizedTrack = sanitizeTrackForESP32(track);
       console.log('Controls: Sending specific track to ESP32:', sanitizedTrack);
       
-      esp32.post('/play', sanitizedTrack)
+      playOnESP32(sanitizedTrack)
         .then(response => {
           console.log('Controls: Successfully started playing specific track on ESP32:', response.data);
           setIsPlaying(true);
@@ -1,5 +1,19 @@
 import React, { useState, useEffect, useRef } from 'react';
 
+// Binary frames from the ESP32: 'S' currentTime(u32) totalTime(u32) timestamp(u32), little-endian
+const decodeBinaryMessage = (buffer) => {
+  const view = new DataView(buffer);
+  if (view.byteLength >= 13 && view.getUint8(0) === 0x53) {
+    return {
+      type: 'playback_status',
+      currentTime: view.getUint32(1, true),
+      totalTime: view.getUint32(5, true),
+      timestamp: view.getUint32(9, true),
+    };
+  }
+  return {}; // Upload progress, not shown here
+};
+
 const PlaybackInfo = ({ currentTrack }) => {
   const [progress, setProgress] = useState(0); // current playback time from ESP32 in milliseconds
   const [totalDuration, setTotalDuration] = useState(180000); // total track duration from ESP32 in milliseconds
@@ -14,7 +28,7 @@ const PlaybackInfo = ({ currentTrack }) => {
   const lastProgressRef = useRef(0);
   const progressCheckTimeoutRef = useRef(null);
   const lastUpdateTimeRef = useRef(0);
-  const UPDATE_THROTTLE = 1000; // Only update every 1 second
+  const UPDATE_THROTTLE = 30; // The ESP32 interpolates the position at up to 30 updates a second
 
   // WebSocket connection for real-time playback updates
   useEffect(() => {
@@ -26,9 +40,12 @@ const PlaybackInfo = ({ currentTrack }) => {
 
         console.log('PlaybackInfo: Connecting to WebSocket...');
         wsRef.current = new WebSocket('ws://192.168.113.200/ws');
+        wsRef.current.binaryType = 'arraybuffer';
         
         wsRef.current.onopen = () => {
           console.log('PlaybackInfo: WebSocket connected');
+          // Status as 13-byte binary frames instead of JSON
+          wsRef.current.send('format:binary');
           setWsConnected(true);
           reconnectAttemptsRef.current = 0;
           
@@ -40,7 +57,9 @@ const PlaybackInfo = ({ currentTrack }) => {
         
         wsRef.current.onmessage = (event) => {
           try {
-            const data = JSON.parse(event.data);
+            const data = event.data instanceof ArrayBuffer
+              ? decodeBinaryMessage(event.data)
+              : JSON.parse(event.data);
             
             // Handle playback status updates
             if (data.type === 'playback_status') {
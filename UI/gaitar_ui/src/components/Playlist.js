@@ -1,8 +1,9 @@
 // src/components/Playlist.js
 import React, { useState } from 'react';
-import { FaTimes, FaGripVertical } from 'react-icons/fa';
+import { FaTimes, FaGripVertical, FaPlus } from 'react-icons/fa';
 
-const Playlist = ({ currentPlaylist, setCurrentPlaylist, selectPlaylist }) => {
+// library holds the pages loaded so far; onLoadMore fetches the next one
+const Playlist = ({ currentPlaylist, setCurrentPlaylist, selectPlaylist, library = [], libraryTotal = 0, onLoadMore }) => {
   const [draggedIndex, setDraggedIndex] = useState(null);
   const [dragOverIndex, setDragOverIndex] = useState(null);
 
@@ -54,6 +55,12 @@ const Playlist = ({ currentPlaylist, setCurrentPlaylist, selectPlaylist }) => {
     setCurrentPlaylist(newPlaylist);
   };
 
+  const addTrack = (track) => {
+    if (!currentPlaylist.some((item) => item.title === track.title && item.artist === track.artist)) {
+      setCurrentPlaylist([...currentPlaylist, track]);
+    }
+  };
+
   const handleTrackClick = (track) => {
     if (selectPlaylist) {
       selectPlaylist(track);
@@ -101,6 +108,34 @@ const Playlist = ({ currentPlaylist, setCurrentPlaylist, selectPlaylist }) => {
       {currentPlaylist.length === 0 && (
         <p className="empty-playlist">No tracks in playlist</p>
       )}
+      <h3>Library</h3>
+      <ul className="playlist-items">
+        {library.map((track, index) => (
+          <li key={`${track.genre}-${track.artist}-${track.title}-${index}`} className="playlist-item">
+            <div className="playlist-item-content">
+              <div
+                className="track-info"
+                onClick={() => handleTrackClick(track)}
+              >
+                <span className="track-title">{track.title}</span>
+                <span className="track-details">by {track.artist} ({track.genre})</span>
+              </div>
+              <button
+                className="add-button"
+                onClick={() => addTrack(track)}
+                title="Add to playlist"
+              >
+                <FaPlus />
+              </button>
+            </div>
+          </li>
+        ))}
+      </ul>
+      {onLoadMore && library.length < libraryTotal && (
+        <button onClick={onLoadMore} className="load-more-button">
+          Load more ({library.length} of {libraryTotal})
+        </button>
+      )}
     </div>
   );
 };
@@ -1,23 +1,58 @@
 import React, { useState } from 'react';
+import { esp32 } from '../api';
+
+const PAGE_SIZE = 50;
+
+// Same rules Upload uses to build SD card paths, so filters compare against stored names
+const sanitize = (str) => str.trim().replace(/\s+/g, '_').replace(/[^a-zA-Z0-9_]/g, '');
+const unsanitize = (str) => str.replace(/_/g, ' ').trim();
 
 const Search = ({ songs, onPlay, onAddToPlaylist }) => {
   const [query, setQuery] = useState('');
   const [selectedArtist, setSelectedArtist] = useState('');
   const [selectedGenre, setSelectedGenre] = useState('');
   const [results, setResults] = useState([]);
+  const [total, setTotal] = useState(0);
+  const [searchError, setSearchError] = useState('');
   const [suggestions, setSuggestions] = useState([]);
 
   const uniqueArtists = [...new Set(songs.map(song => song.artist))];
   const uniqueGenres = [...new Set(songs.map(song => song.genre))];
 
+  // Matching happens on the ESP32's search index; each request returns one page of matches
+  // (the query matches the start of any word in a title or artist)
+  const fetchResults = async (offset) => {
+    const params = { offset, limit: PAGE_SIZE };
+    if (query) params.q = sanitize(query);
+    if (selectedArtist) params.artist = sanitize(selectedArtist);
+    if (selectedGenre) params.genre = sanitize(selectedGenre);
+
+    try {
+      const response = await esp32.get('/search', { params });
+      const page = response.data;
+      const pageSongs = page.songs
+        .filter(song => song.genre && song.artist && song.title)
+        .map(song => ({
+          title: unsanitize(song.title),
+          artist: unsanitize(song.artist),
+          genre: unsanitize(song.genre),
+        }));
+      setResults(prev => (offset === 0 ? pageSongs : [...prev, ...pageSongs]));
+      setTotal(page.total);
+      setSearchError('');
+    } catch (error) {
+      console.error('Error searching songs:', error);
+      setSearchError('Search failed, please try again');
+    }
+  };
+
   const handleSearch = () => {
-    const filteredSongs = songs.filter(song => {
-      const matchesQuery = song.title.toLowerCase().includes(query.toLowerCase());
-      const matchesArtist = selectedArtist ? song.artist === selectedArtist : true;
-      const matchesGenre = selectedGenre ? song.genre === selectedGenre : true;
-      return matchesQuery && matchesArtist && matchesGenre;
-    });
-    setResults(filteredSongs);
+    setSuggestions([]);
+    fetchResults(0);
+  };
+
+  const handleLoadMore = () => {
+    fetchResults(results.length);
   };
 
   const handleInputChange = (e) => {
@@ -86,6 +121,7 @@ const Search = ({ songs, onPlay, onAddToPlaylist }) => {
         ))}
       </select>
       <button onClick={handleSearch} className="search-button">Search</button>
+      {searchError && <p className="search-error">{searchError}</p>}
       <ul className="search-results">
         {results.map((song, index) => (
           <li key={index} className="search-result-item">
@@ -95,6 +131,11 @@ const Search = ({ songs, onPlay, onAddToPlaylist }) => {
           </li>
         ))}
       </ul>
+      {results.length < total && (
+        <button onClick={handleLoadMore} className="load-more-button">
+          Load more ({results.length} of {total})
+        </button>
+      )}
     </div>
   );
 };
@@ -312,14 +312,16 @@ const handleUpload = async () => {
     const binaryBlob = new Blob([binaryData], { type: 'application/octet-stream' });
     
     // Create FormData for ESP32 upload
+    // Fields go before the file so the ESP32 knows the path and size when the file
+    // part starts and can stream it to the guitar as it arrives
     const espData = new FormData();
-    espData.append('data', binaryBlob, 'guitar_events.bin'); // Binary file
     espData.append('artist', sanitizedArtist);
     espData.append('title', sanitizedTitle);
     espData.append('genre', sanitizedGenre);
     espData.append('duration', binaryMetadata.duration_formatted);
-    espData.append('file_size', binaryMetadata.file_size);
+    espData.append('file_size', String(binaryBlob.size));
     espData.append('event_count', binaryMetadata.event_count);
+    espData.append('data', binaryBlob, 'guitar_events.bin'); // Binary file
 
     console.log('ESP32 FormData prepared with binary file:', binaryBlob.size, 'bytes');
     setUploadPercentage(40);
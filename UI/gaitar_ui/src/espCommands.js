@@ -0,0 +1,99 @@
+import { esp32 } from './api';
+
+// Transport commands over the ESP32 websocket instead of one HTTP POST each
+// Frames: op(u8) id(u8) payload; the ESP32 answers 'A' id result once the
+// instruction is queued for the Grand Central (see ws_commands.h)
+const WS_URL = `${esp32.defaults.baseURL.replace(/^http/, 'ws')}/ws`; // Same host as the HTTP routes
+const ACK_TIMEOUT_MS = 1000;
+const LATENCY_SAMPLES = 20;
+
+const OP_PLAY = 'P'.charCodeAt(0);
+const OP_PAUSE = 'p'.charCodeAt(0);
+const REPLY_ACK = 'A'.charCodeAt(0);
+const RESULTS = ['ok', 'unknown command', 'too long', 'busy'];
+
+let socket = null;
+let nextId = 0;
+const pending = new Map(); // id -> { resolve, reject, sentAt, timer }
+const latencies = [];
+
+const connect = () => {
+  if (socket && socket.readyState <= WebSocket.OPEN) return;
+  socket = new WebSocket(WS_URL);
+  socket.binaryType = 'arraybuffer';
+  socket.onopen = () => socket.send('format:binary'); // Keep notifications on this socket small
+  socket.onmessage = (event) => {
+    if (!(event.data instanceof ArrayBuffer)) return;
+    const reply = new Uint8Array(event.data);
+    if (reply.length < 3 || reply[0] !== REPLY_ACK) return;
+    const request = pending.get(reply[1]);
+    if (!request) return;
+    pending.delete(reply[1]);
+    clearTimeout(request.timer);
+    if (reply[2] !== 0) {
+      request.reject(new Error(`ESP32 rejected command: ${RESULTS[reply[2]] || reply[2]}`));
+      return;
+    }
+    const latency = performance.now() - request.sentAt;
+    latencies.push(latency);
+    if (latencies.length > LATENCY_SAMPLES) latencies.shift();
+    request.resolve({ data: `Acknowledged in ${latency.toFixed(1)} ms` });
+  };
+  socket.onclose = () => {
+    socket = null;
+    pending.forEach((request) => {
+      clearTimeout(request.timer);
+      request.reject(new Error('Command socket closed'));
+    });
+    pending.clear();
+  };
+};
+
+const sendCommand = (op, payload = '') => new Promise((resolve, reject) => {
+  if (!socket || socket.readyState !== WebSocket.OPEN) {
+    connect();
+    const error = new Error('Command socket not connected');
+    error.notSent = true;
+    reject(error);
+    return;
+  }
+  const body = new TextEncoder().encode(payload);
+  const id = nextId;
+  nextId = (nextId + 1) & 0xff;
+  const frame = new Uint8Array(2 + body.length);
+  frame[0] = op;
+  frame[1] = id;
+  frame.set(body, 2);
+  const timer = setTimeout(() => {
+    pending.delete(id);
+    reject(new Error('No acknowledgement from ESP32'));
+  }, ACK_TIMEOUT_MS);
+  pending.set(id, { resolve, reject, sentAt: performance.now(), timer });
+  socket.send(frame);
+});
+
+// Button press to ESP32 acknowledgement, over the last LATENCY_SAMPLES commands
+export const getCommandLatency = () => {
+  if (latencies.length === 0) return null;
+  const total = latencies.reduce((sum, latency) => sum + latency, 0);
+  return { average: total / latencies.length, max: Math.max(...latencies), samples: latencies.length };
+};
+
+// Falls back to the HTTP route only for a command that never left the browser; after a
+// timeout or rejection the ESP32 may already have queued it, so resending could repeat it
+const withFallback = (command, fallback) => command.catch((error) => {
+  if (error.notSent) return fallback();
+  throw error;
+});
+
+// The payload is the song's SD card path with its terminator, so the ESP32 forwards it without
+// parsing; the track names are already sanitized the way POST /play builds the same path
+export const playOnESP32 = (track) => {
+  const { title, artist, genre } = track;
+  return withFallback(sendCommand(OP_PLAY, `/${genre}/${artist}/${title}.bin\0`),
+    () => esp32.post('/play', track));
+};
+
+export const pauseOnESP32 = () => withFallback(sendCommand(OP_PAUSE), () => esp32.post('/pause'));
+
+connect();
@@ -0,0 +1,88 @@
+#include "instruction_ops.h"
+#include <string.h>
+
+InstructionOpWriter::InstructionOpWriter(uint8_t* buffer, size_t capacity, uint8_t op)
+    : buffer(buffer), capacity(capacity), used(0) {
+  if (capacity == 0) {
+    overflow = true;
+    return;
+  }
+  buffer[used++] = op;
+}
+
+uint8_t* InstructionOpWriter::put(uint8_t type, size_t length) {
+  if (overflow || length > 255 || used + 2 + length > capacity) {
+    overflow = true;
+    return nullptr;
+  }
+  buffer[used++] = type;
+  buffer[used++] = length;
+  uint8_t* value = buffer + used;
+  used += length;
+  return value;
+}
+
+void InstructionOpWriter::u8(uint8_t type, uint8_t value) {
+  uint8_t* out = put(type, 1);
+  if (out) out[0] = value;
+}
+
+void InstructionOpWriter::u16(uint8_t type, uint16_t value) {
+  uint8_t* out = put(type, 2);
+  if (!out) return;
+  out[0] = value;
+  out[1] = value >> 8;
+}
+
+void InstructionOpWriter::u32(uint8_t type, uint32_t value) {
+  uint8_t* out = put(type, 4);
+  if (!out) return;
+  for (int i = 0; i < 4; i++) out[i] = value >> (8 * i);
+}
+
+void InstructionOpWriter::str(uint8_t type, const char* value) {
+  size_t length = strlen(value) + 1;
+  uint8_t* out = put(type, length);
+  if (out) memcpy(out, value, length);
+}
+
+bool InstructionArg::asU8(uint8_t& out) const {
+  if (length != 1) return false;
+  out = value[0];
+  return true;
+}
+
+bool InstructionArg::asU16(uint16_t& out) const {
+  if (length != 2) return false;
+  out = value[0] | (value[1] << 8);
+  return true;
+}
+
+bool InstructionArg::asU32(uint32_t& out) const {
+  if (length != 4) return false;
+  out = value[0] | (value[1] << 8) | ((uint32_t)value[2] << 16) | ((uint32_t)value[3] << 24);
+  return true;
+}
+
+bool InstructionArg::asString(const char*& out) const {
+  // The terminator is part of the value, so the string needs no copy
+  if (length == 0 || value[length - 1] != '\0') return false;
+  out = (const char*)value;
+  return true;
+}
+
+InstructionOpReader::InstructionOpReader(const uint8_t* payload, size_t length)
+    : payload(payload), length(length) {}
+
+bool InstructionOpReader::next(InstructionArg& arg) {
+  if (bad || position >= length) return false;
+  if (position + 2 > length || position + 2 + payload[position + 1] > length) {
+    bad = true;
+    return false;
+  }
+  arg.type = payload[position];
+  arg.length = payload[position + 1];
+  arg.value = payload + position + 2;
+  position += 2 + arg.length;
+  return true;
+}
@@ -10,6 +10,8 @@
 #include "globals.h"
 #include "translate.h"
 #include "uart_transfer.h"
+#include "song_index.h"
+#include "sd_server.h"
 
 volatile bool isPlaying = false;
 volatile bool isPaused = false;
@@ -20,7 +22,7 @@ unsigned long startTime = 0;
 unsigned long pauseOffset = 0;
 
 SemaphoreHandle_t playbackSemaphore;
-SemaphoreHandle_t sdSemaphore;
+SemaphoreHandle_t instructionTxSemaphore; // Keeps STATUS lines out of multi-part responses
 
 TaskHandle_t instructionTaskHandle;
 TaskHandle_t playbackTaskHandle;
@@ -84,22 +86,30 @@ void setup() {
     }
 
     listFilesOnSD();
+    songIndexBegin(); // Load song catalog (rebuilt from the card if missing)
 
     delay(100);
 
 
     
     playbackSemaphore = xSemaphoreCreateMutex();
-    sdSemaphore = xSemaphoreCreateMutex();
-    if (sdSemaphore == NULL) {
-        Serial.println("Failed to create sdSemaphore!");
-        while (1); // Halt if semaphore creation fails
-    }
     if (playbackSemaphore == NULL) {
         Serial.println("Failed to create playbackSemaphore!");
         while (1); // Halt if semaphore creation fails
     }
 
+    instructionTxSemaphore = xSemaphoreCreateMutex();
+    if (instructionTxSemaphore == NULL) {
+        Serial.println("Failed to create instructionTxSemaphore!");
+        while (1); // Halt if semaphore creation fails
+    }
+
+    // All SD access from tasks goes through the SD server from here on
+    if (!sdServerBegin()) {
+        Serial.println("Failed to start SD server!");
+        while (1); // Halt - no task can reach the card without it
+    }
+
     BaseType_t result = xTaskCreate(
         instructionTask, // Function to implement the task
         "Instruction Task", // Name of the task
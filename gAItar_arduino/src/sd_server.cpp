@@ -0,0 +1,243 @@
+#include "sd_server.h"
+#include "globals.h"
+#include <FreeRTOS_SAMD51.h>
+
+#define SD_QUEUE_DEPTH 4   // Outstanding requests per class (one per client task in practice)
+
+enum SdOp {
+    SD_OP_OPEN,
+    SD_OP_CLOSE,
+    SD_OP_READ,
+    SD_OP_WRITE,
+    SD_OP_EXISTS,
+    SD_OP_MKDIR,
+    SD_OP_CALL
+};
+
+/**
+ * One request, allocated on the client's stack for the duration of the call
+ */
+struct SdRequest {
+    SdOp op;
+    File* file;
+    const char* path;
+    void* buffer;
+    size_t len;
+    int32_t position;     // Seek target for reads, or open flags
+    bool flush;
+    bool (*fn)(void*);
+    void* ctx;
+    int32_t result;
+    TaskHandle_t client;  // Notified when the request is complete
+    uint32_t queuedAt;    // micros() when submitted
+};
+
+/**
+ * Queue-wait statistics for one request class
+ */
+struct SdWaitStats {
+    uint32_t count;
+    uint32_t totalUs;
+    uint32_t maxUs;
+};
+
+static const char* const priorityNames[SD_PRIORITY_COUNT] = {"playback", "instruction", "upload"};
+
+static QueueHandle_t queues[SD_PRIORITY_COUNT];
+static SemaphoreHandle_t pendingRequests;   // Counts requests across all queues
+static SemaphoreHandle_t statsSemaphore;
+static SdWaitStats waitStats[SD_PRIORITY_COUNT];
+static TaskHandle_t sdServerTaskHandle;
+
+static void executeRequest(SdRequest& req) {
+    switch (req.op) {
+        case SD_OP_OPEN:
+            if (*req.file) req.file->close();
+            *req.file = sd.open(req.path, (oflag_t)req.position);
+            req.result = *req.file ? 1 : 0;
+            break;
+        case SD_OP_CLOSE:
+            if (*req.file) req.file->close();
+            req.result = 1;
+            break;
+        case SD_OP_READ:
+            if (!*req.file || (req.position >= 0 && !req.file->seek(req.position))) {
+                req.result = -1;
+            } else {
+                req.result = req.file->read(req.buffer, req.len);
+            }
+            break;
+        case SD_OP_WRITE:
+            req.result = *req.file ? req.file->write((const uint8_t*)req.buffer, req.len) : 0;
+            if (req.flush && *req.file) req.file->flush();
+            break;
+        case SD_OP_EXISTS:
+            req.result = sd.exists(req.path) ? 1 : 0;
+            break;
+        case SD_OP_MKDIR:
+            req.result = sd.mkdir(req.path) ? 1 : 0;
+            break;
+        case SD_OP_CALL:
+            req.result = req.fn(req.ctx) ? 1 : 0;
+            break;
+    }
+}
+
+/**
+ * Takes the next request from the highest-priority non-empty queue
+ */
+static SdRequest* nextRequest(SdPriority& priority) {
+    SdRequest* req = nullptr;
+    for (int p = 0; p < SD_PRIORITY_COUNT; p++) {
+        if (xQueueReceive(queues[p], &req, 0) == pdTRUE) {
+            priority = (SdPriority)p;
+            return req;
+        }
+    }
+    return nullptr;
+}
+
+static void recordWait(SdPriority priority, uint32_t waitUs) {
+    if (xSemaphoreTake(statsSemaphore, portMAX_DELAY)) {
+        SdWaitStats& stats = waitStats[priority];
+        stats.count++;
+        stats.totalUs += waitUs;
+        if (waitUs > stats.maxUs) stats.maxUs = waitUs;
+        xSemaphoreGive(statsSemaphore);
+    }
+}
+
+static void sdServerTask(void* pvParameters) {
+    unsigned long lastReport = millis();
+    bool served = false;
+
+    for (;;) {
+        if (xSemaphoreTake(pendingRequests, pdMS_TO_TICKS(SD_SERVER_REPORT_MS)) == pdTRUE) {
+            SdPriority priority;
+            SdRequest* req = nextRequest(priority);
+            if (req) {
+                recordWait(priority, micros() - req->queuedAt);
+                executeRequest(*req);
+                xTaskNotifyGive(req->client);
+                served = true;
+            }
+        }
+
+        if (served && millis() - lastReport >= SD_SERVER_REPORT_MS) {
+            sdServerReportStats(Serial);
+            lastReport = millis();
+            served = false;
+        }
+    }
+}
+
+/**
+ * Queues a request and blocks the calling task until the server completes it
+ */
+static int32_t submit(SdPriority priority, SdRequest& req) {
+    req.client = xTaskGetCurrentTaskHandle();
+    req.queuedAt = micros();
+    req.result = 0;
+
+    SdRequest* ptr = &req;
+    if (xQueueSend(queues[priority], &ptr, portMAX_DELAY) != pdTRUE) {
+        return 0;
+    }
+    xSemaphoreGive(pendingRequests);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return req.result;
+}
+
+bool sdServerBegin() {
+    for (int p = 0; p < SD_PRIORITY_COUNT; p++) {
+        queues[p] = xQueueCreate(SD_QUEUE_DEPTH, sizeof(SdRequest*));
+        if (queues[p] == NULL) return false;
+    }
+    pendingRequests = xSemaphoreCreateCounting(SD_QUEUE_DEPTH * SD_PRIORITY_COUNT, 0);
+    statsSemaphore = xSemaphoreCreateMutex();
+    if (pendingRequests == NULL || statsSemaphore == NULL) return false;
+
+    BaseType_t result = xTaskCreate(
+        sdServerTask,
+        "SD Server",
+        SD_SERVER_STACK,
+        NULL,
+        SD_SERVER_PRIORITY,
+        &sdServerTaskHandle);
+    return result == pdPASS;
+}
+
+bool sdOpen(SdPriority priority, File& file, const char* path, oflag_t oflag) {
+    SdRequest req = {};
+    req.op = SD_OP_OPEN;
+    req.file = &file;
+    req.path = path;
+    req.position = oflag;
+    return submit(priority, req) == 1;
+}
+
+void sdClose(SdPriority priority, File& file) {
+    SdRequest req = {};
+    req.op = SD_OP_CLOSE;
+    req.file = &file;
+    submit(priority, req);
+}
+
+int sdRead(SdPriority priority, File& file, void* buffer, size_t len, int32_t position) {
+    SdRequest req = {};
+    req.op = SD_OP_READ;
+    req.file = &file;
+    req.buffer = buffer;
+    req.len = len;
+    req.position = position;
+    return submit(priority, req);
+}
+
+size_t sdWrite(SdPriority priority, File& file, const void* buffer, size_t len, bool flush) {
+    SdRequest req = {};
+    req.op = SD_OP_WRITE;
+    req.file = &file;
+    req.buffer = (void*)buffer;
+    req.len = len;
+    req.flush = flush;
+    int32_t written = submit(priority, req);
+    return written > 0 ? written : 0;
+}
+
+bool sdExists(SdPriority priority, const char* path) {
+    SdRequest req = {};
+    req.op = SD_OP_EXISTS;
+    req.path = path;
+    return submit(priority, req) == 1;
+}
+
+bool sdMkdir(SdPriority priority, const char* path) {
+    SdRequest req = {};
+    req.op = SD_OP_MKDIR;
+    req.path = path;
+    return submit(priority, req) == 1;
+}
+
+bool sdCall(SdPriority priority, bool (*fn)(void* ctx), void* ctx) {
+    SdRequest req = {};
+    req.op = SD_OP_CALL;
+    req.fn = fn;
+    req.ctx = ctx;
+    return submit(priority, req) == 1;
+}
+
+void sdServerReportStats(Print& out) {
+    SdWaitStats snapshot[SD_PRIORITY_COUNT];
+    if (!xSemaphoreTake(statsSemaphore, portMAX_DELAY)) return;
+    memcpy(snapshot, waitStats, sizeof(snapshot));
+    memset(waitStats, 0, sizeof(waitStats));
+    xSemaphoreGive(statsSemaphore);
+
+    out.print("SD queue wait (us):");
+    for (int p = 0; p < SD_PRIORITY_COUNT; p++) {
+        const SdWaitStats& stats = snapshot[p];
+        out.printf(" %s n=%lu avg=%lu max=%lu", priorityNames[p], (unsigned long)stats.count,
+                   (unsigned long)(stats.count ? stats.totalUs / stats.count : 0), (unsigned long)stats.maxUs);
+    }
+    out.println();
+}
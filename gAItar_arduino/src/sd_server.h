@@ -0,0 +1,99 @@
+#ifndef SD_SERVER_H
+#define SD_SERVER_H
+
+#include <Arduino.h>
+#include <SdFat.h>
+
+/**
+ * SD card I/O server
+ * A single high-priority task owns the sd object and every open File; other
+ * tasks submit requests and block until the server has completed them
+ * Pending requests are served strictly by class, so a playback read never
+ * waits behind queued upload writes (only behind the one operation in progress)
+ *
+ * All request functions must be called from tasks after sdServerBegin() and
+ * vTaskStartScheduler(); setup() code before that may use sd directly
+ */
+
+#define SD_SERVER_PRIORITY 4          // Above every client task
+#define SD_SERVER_STACK 2048          // Words - catalog rebuild recurses through directories
+#define SD_SERVER_REPORT_MS 10000     // Queue-wait statistics interval on Serial
+
+/**
+ * Request classes, highest priority first
+ */
+enum SdPriority {
+    SD_PRIORITY_PLAYBACK = 0,   // Song header and event reads
+    SD_PRIORITY_INSTRUCTION,    // Play lookups, listings, rescans
+    SD_PRIORITY_UPLOAD,         // File receiver writes and catalog updates
+    SD_PRIORITY_COUNT
+};
+
+/**
+ * Creates the request queues and the server task
+ * Called once from setup() before the scheduler starts
+ *
+ * @return true if the server task was created
+ */
+bool sdServerBegin();
+
+/**
+ * Opens a file
+ *
+ * @param priority Request class
+ * @param file File object to open (owned by the caller, used only through the server)
+ * @param path File path
+ * @param oflag SdFat open flags
+ * @return true if the file is open
+ */
+bool sdOpen(SdPriority priority, File& file, const char* path, oflag_t oflag);
+
+/**
+ * Closes a file if it is open
+ */
+void sdClose(SdPriority priority, File& file);
+
+/**
+ * Reads from an open file, optionally seeking first
+ *
+ * @param position Absolute position to seek to, or -1 to read from the current position
+ * @return Bytes read, or -1 on a seek or read error
+ */
+int sdRead(SdPriority priority, File& file, void* buffer, size_t len, int32_t position = -1);
+
+/**
+ * Writes to an open file
+ *
+ * @param flush Flush the file to the card after writing
+ * @return Bytes written
+ */
+size_t sdWrite(SdPriority priority, File& file, const void* buffer, size_t len, bool flush = false);
+
+/**
+ * Checks whether a path exists
+ */
+bool sdExists(SdPriority priority, const char* path);
+
+/**
+ * Creates a single directory
+ */
+bool sdMkdir(SdPriority priority, const char* path);
+
+/**
+ * Runs a compound operation (several SD calls or catalog updates) on the
+ * server task, so it is atomic with respect to all other SD requests
+ *
+ * @param fn Operation to run, receives ctx
+ * @param ctx Caller-owned argument and result storage
+ * @return Value returned by fn
+ */
+bool sdCall(SdPriority priority, bool (*fn)(void* ctx), void* ctx);
+
+/**
+ * Prints queue-wait latency per request class since the last report
+ *
+ * @param out Destination, usually Serial
+ */
+void sdServerReportStats(Print& out);
+
+#endif // SD_SERVER_H
@@ -0,0 +1,661 @@
+#include "song_index.h"
+#include "globals.h"
+#include "sd_server.h"
+
+#define SONG_INDEX_MAGIC 0x54414347UL  // "GCAT"
+#define SONG_INDEX_VERSION 1
+#define SONG_INDEX_NO_TARGET 0xFFFF
+#define SONG_INDEX_PREVIOUS_PATH "/.catalog.old" // Catalog being replaced by a rebuild
+#define SONG_PATH_TABLE_SIZE 1024   // Open-addressing buckets, power of two >= 2x SONG_INDEX_MAX_ENTRIES
+#define SONG_PATH_EMPTY 0xFFFF      // Bucket never used (ends a probe sequence)
+#define SONG_PATH_DELETED 0xFFFE    // Bucket freed by a removal (probing continues past it)
+
+/**
+ * Catalog file header, followed by fixed-size records
+ */
+struct SongIndexHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+};
+
+/**
+ * On-card record layout (fixed size so entries can be rewritten in place)
+ * Genre, artist and title are the components of "/genre/artist/title.bin"
+ * within path, stored as lengths so no strings are duplicated
+ * A record with size == 0 is a free slot
+ */
+struct SongIndexRecord {
+    uint64_t hash;        // FNV-1a 64-bit content hash
+    uint32_t size;        // Content size in bytes
+    uint32_t duration;    // Song length in ms from the song header
+    uint16_t eventCount;  // Number of events from the song header
+    uint16_t target;      // Slot holding the bytes, SONG_INDEX_NO_TARGET if path itself does
+    uint8_t genreLen;     // Lengths of the path components (0 if path is not in the usual layout)
+    uint8_t artistLen;
+    uint8_t titleLen;
+    uint8_t reserved;
+    char path[128];       // Path the song is known by
+};
+
+/**
+ * Hash-only record written by the previous index format
+ */
+struct SongIndexLegacyRecord {
+    uint64_t hash;
+    uint32_t size;
+    uint32_t reserved;
+    char path[128];
+    char target[128];
+};
+
+/**
+ * RAM mirror of each record used to avoid SD reads on lookups
+ * Path keys are 64-bit hashes of "/genre/artist/title.bin", so a key match
+ * identifies the song without reading the record back from the card
+ */
+struct SongIndexSlot {
+    uint64_t hash;
+    uint64_t pathKey;
+    uint32_t size;
+    uint16_t target;
+    uint16_t dirIndex;  // Directory entry, SONG_INDEX_NO_DIR_INDEX until the song is opened
+};
+
+static SongIndexSlot slots[SONG_INDEX_MAX_ENTRIES];
+static uint16_t slotCount = 0;
+
+// Changes whenever a record is written; starts from a fingerprint of the
+// loaded catalog so a reboot with different contents never reuses a number
+static volatile uint32_t catalogGeneration = 0;
+
+/**
+ * Open-addressing (linear probing) table from path key to slot index
+ * Kept in step with slots[] by mirrorRecord()
+ */
+static uint16_t pathTable[SONG_PATH_TABLE_SIZE];
+static uint16_t pathTableDeleted = 0;
+
+uint64_t songHashUpdate(uint64_t hash, const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * 64-bit FNV-1a hash of a path string used as the RAM lookup key
+ */
+static uint64_t pathKey(const char* path) {
+    return songHashUpdate(SONG_HASH_SEED, (const uint8_t*)path, strlen(path));
+}
+
+static uint16_t pathBucket(uint64_t key) {
+    return (uint16_t)(key ^ (key >> 32)) & (SONG_PATH_TABLE_SIZE - 1);
+}
+
+/**
+ * Finds the slot holding a path key
+ *
+ * @param key Path key to search for
+ * @return Slot index or -1 if no live slot has this key
+ */
+static int pathTableFind(uint64_t key) {
+    uint16_t bucket = pathBucket(key);
+    for (uint16_t probes = 0; probes < SONG_PATH_TABLE_SIZE; probes++) {
+        uint16_t index = pathTable[bucket];
+        if (index == SONG_PATH_EMPTY) return -1;
+        if (index != SONG_PATH_DELETED && slots[index].size && slots[index].pathKey == key) return index;
+        bucket = (bucket + 1) & (SONG_PATH_TABLE_SIZE - 1);
+    }
+    return -1;
+}
+
+static void pathTableInsert(uint16_t index) {
+    uint16_t bucket = pathBucket(slots[index].pathKey);
+    while (pathTable[bucket] != SONG_PATH_EMPTY && pathTable[bucket] != SONG_PATH_DELETED) {
+        bucket = (bucket + 1) & (SONG_PATH_TABLE_SIZE - 1);
+    }
+    if (pathTable[bucket] == SONG_PATH_DELETED) pathTableDeleted--;
+    pathTable[bucket] = index;
+}
+
+/**
+ * Refills the table from slots[], dropping deleted markers
+ */
+static void pathTableRebuild() {
+    for (uint16_t i = 0; i < SONG_PATH_TABLE_SIZE; i++) pathTable[i] = SONG_PATH_EMPTY;
+    pathTableDeleted = 0;
+    for (uint16_t i = 0; i < slotCount; i++) {
+        if (slots[i].size) pathTableInsert(i);
+    }
+}
+
+static void pathTableRemove(uint16_t index) {
+    uint16_t bucket = pathBucket(slots[index].pathKey);
+    for (uint16_t probes = 0; probes < SONG_PATH_TABLE_SIZE; probes++) {
+        if (pathTable[bucket] == SONG_PATH_EMPTY) return;
+        if (pathTable[bucket] == index) {
+            pathTable[bucket] = SONG_PATH_DELETED;
+            pathTableDeleted++;
+            return;
+        }
+        bucket = (bucket + 1) & (SONG_PATH_TABLE_SIZE - 1);
+    }
+}
+
+static uint32_t recordOffset(uint16_t index) {
+    return sizeof(SongIndexHeader) + (uint32_t)index * sizeof(SongIndexRecord);
+}
+
+static void mirrorRecord(uint16_t index, const SongIndexRecord& rec) {
+    SongIndexSlot& slot = slots[index];
+    if (index < slotCount && slot.size) pathTableRemove(index);
+
+    slot.hash = rec.hash;
+    slot.size = rec.size;
+    slot.pathKey = rec.size ? pathKey(rec.path) : 0;
+    slot.target = rec.size ? rec.target : SONG_INDEX_NO_TARGET;
+    slot.dirIndex = SONG_INDEX_NO_DIR_INDEX; // The file may have been replaced
+    if (index >= slotCount) slotCount = index + 1;
+
+    // Deleted markers lengthen probes for misses; clear them out once they pile up
+    if (pathTableDeleted > SONG_PATH_TABLE_SIZE / 4) {
+        pathTableRebuild();
+    } else if (rec.size) {
+        pathTableInsert(index);
+    }
+}
+
+static bool readRecord(uint16_t index, SongIndexRecord& rec) {
+    File file = sd.open(SONG_INDEX_PATH, O_RDONLY);
+    if (!file) return false;
+    bool ok = file.seek(recordOffset(index)) &&
+              file.read(&rec, sizeof(rec)) == (int)sizeof(rec);
+    file.close();
+    return ok;
+}
+
+static bool writeRecord(uint16_t index, const SongIndexRecord& rec) {
+    File file = sd.open(SONG_INDEX_PATH, O_RDWR | O_CREAT);
+    if (!file) {
+        Serial.println("Failed to open song catalog for writing");
+        return false;
+    }
+    bool ok = file.seek(recordOffset(index)) &&
+              file.write(&rec, sizeof(rec)) == sizeof(rec);
+    file.close();
+
+    mirrorRecord(index, rec);
+    catalogGeneration++;
+    return ok;
+}
+
+static void clearRecord(uint16_t index) {
+    SongIndexRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    writeRecord(index, rec);
+}
+
+static uint8_t clampLength(size_t len) {
+    return len > 255 ? 255 : len;
+}
+
+/**
+ * Fills in path and the genre/artist/title component lengths
+ */
+static void setRecordPath(SongIndexRecord& rec, const char* path) {
+    strncpy(rec.path, path, sizeof(rec.path) - 1);
+    rec.path[sizeof(rec.path) - 1] = '\0';
+    rec.genreLen = rec.artistLen = rec.titleLen = 0;
+
+    // Expect "/genre/artist/title.bin"
+    const char* genre = rec.path + 1;
+    const char* artist = strchr(genre, '/');
+    const char* title = artist ? strchr(artist + 1, '/') : nullptr;
+    if (rec.path[0] != '/' || !title || strchr(title + 1, '/')) return;
+    const char* ext = strrchr(title + 1, '.');
+    const char* titleEnd = ext ? ext : title + 1 + strlen(title + 1);
+
+    rec.genreLen = clampLength(artist - genre);
+    rec.artistLen = clampLength(title - artist - 1);
+    rec.titleLen = clampLength(titleEnd - title - 1);
+}
+
+/**
+ * Reads duration and event count from the song header (4 + 2 bytes, big-endian)
+ */
+static void readSongHeader(const char* path, SongIndexRecord& rec) {
+    uint8_t header[6];
+    rec.duration = 0;
+    rec.eventCount = 0;
+    File file = sd.open(path, O_RDONLY);
+    if (!file) return;
+    if (file.read(header, sizeof(header)) == (int)sizeof(header)) {
+        rec.duration = ((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16) |
+                       ((uint32_t)header[2] << 8) | header[3];
+        rec.eventCount = ((uint16_t)header[4] << 8) | header[5];
+    }
+    file.close();
+}
+
+/**
+ * Finds the slot recorded for a path
+ *
+ * @param path Song path to search for
+ * @param rec Receives the matching record
+ * @return Slot index or -1 if the path is not catalogued
+ */
+static int findPathSlot(const char* path, SongIndexRecord& rec) {
+    int index = pathTableFind(pathKey(path));
+    if (index < 0 || !readRecord(index, rec) || strcmp(rec.path, path) != 0) return -1;
+    return index;
+}
+
+static int findFreeSlot() {
+    for (uint16_t i = 0; i < slotCount; i++) {
+        if (slots[i].size == 0) return i;
+    }
+    return slotCount < SONG_INDEX_MAX_ENTRIES ? slotCount : -1;
+}
+
+/**
+ * Creates an empty catalog file containing only the header
+ */
+static bool resetCatalog() {
+    slotCount = 0;
+    catalogGeneration++;
+    pathTableRebuild();
+    File file = sd.open(SONG_INDEX_PATH, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!file) {
+        Serial.println("Failed to create song catalog");
+        return false;
+    }
+    SongIndexHeader header = {SONG_INDEX_MAGIC, SONG_INDEX_VERSION, sizeof(SongIndexRecord)};
+    bool ok = file.write(&header, sizeof(header)) == sizeof(header);
+    file.close();
+    return ok;
+}
+
+/**
+ * Hashes a song file and appends it to the catalog
+ */
+static void catalogFile(const char* path) {
+    static uint8_t buffer[512];
+    File file = sd.open(path, O_RDONLY);
+    if (!file) return;
+
+    uint64_t hash = SONG_HASH_SEED;
+    uint32_t size = 0;
+    int n;
+    while ((n = file.read(buffer, sizeof(buffer))) > 0) {
+        hash = songHashUpdate(hash, buffer, n);
+        size += n;
+    }
+    file.close();
+
+    if (size > 0) {
+        songIndexAdd(hash, size, path, nullptr);
+    }
+}
+
+/**
+ * Recursive directory walk used only to rebuild the catalog
+ * Skips hidden entries (catalog, delta scratch file) and system directories
+ */
+static void catalogDirectory(SdFile& dir, const char* basePath) {
+    SdFile entry;
+    char name[64];
+
+    while (entry.openNext(&dir, O_RDONLY)) {
+        entry.getName(name, sizeof(name));
+        bool isDir = entry.isDir();
+        if (name[0] == '.' || strcmp(name, "System Volume Information") == 0) {
+            entry.close();
+            continue;
+        }
+
+        char path[128];
+        snprintf(path, sizeof(path), "%s%s", basePath, name);
+        if (isDir) {
+            strncat(path, "/", sizeof(path) - strlen(path) - 1);
+            catalogDirectory(entry, path);
+            entry.close();
+        } else {
+            entry.close();
+            catalogFile(path);
+        }
+    }
+}
+
+/**
+ * Carries aliases over from the hash-only index of earlier firmware
+ */
+static void importLegacyAliases() {
+    File file = sd.open(SONG_INDEX_LEGACY_PATH, O_RDONLY);
+    if (!file) return;
+
+    SongIndexLegacyRecord legacy;
+    uint16_t imported = 0;
+    while (file.read(&legacy, sizeof(legacy)) == (int)sizeof(legacy)) {
+        if (!legacy.size || !legacy.target[0]) continue;
+        legacy.path[sizeof(legacy.path) - 1] = '\0';
+        legacy.target[sizeof(legacy.target) - 1] = '\0';
+        if (songIndexAdd(legacy.hash, legacy.size, legacy.path, legacy.target)) {
+            imported++;
+        }
+    }
+    file.close();
+    sd.remove(SONG_INDEX_LEGACY_PATH);
+    Serial.printf("Imported %u aliases from legacy song index\n", imported);
+}
+
+/**
+ * Carries aliases over from the catalog being replaced, as they exist only
+ * as records and would otherwise be lost by a rebuild
+ */
+static void importPreviousAliases() {
+    File file = sd.open(SONG_INDEX_PREVIOUS_PATH, O_RDONLY);
+    if (!file) return;
+
+    SongIndexHeader header;
+    SongIndexRecord rec;
+    SongIndexRecord targetRec;
+    uint16_t imported = 0;
+    if (file.read(&header, sizeof(header)) == (int)sizeof(header) &&
+        header.magic == SONG_INDEX_MAGIC && header.recordSize == sizeof(SongIndexRecord)) {
+        uint32_t offset = sizeof(header);
+        while (file.seek(offset) && file.read(&rec, sizeof(rec)) == (int)sizeof(rec)) {
+            offset += sizeof(rec);
+            if (!rec.size || rec.target == SONG_INDEX_NO_TARGET) continue;
+            if (!file.seek(recordOffset(rec.target)) ||
+                file.read(&targetRec, sizeof(targetRec)) != (int)sizeof(targetRec)) continue;
+            if (songIndexAdd(rec.hash, rec.size, rec.path, targetRec.path)) {
+                imported++;
+            }
+        }
+    }
+    file.close();
+    sd.remove(SONG_INDEX_PREVIOUS_PATH);
+    Serial.printf("Kept %u aliases from previous catalog\n", imported);
+}
+
+void songIndexBegin() {
+    slotCount = 0;
+    pathTableRebuild();
+    File file = sd.open(SONG_INDEX_PATH, O_RDONLY);
+    SongIndexHeader header;
+    bool valid = file && file.read(&header, sizeof(header)) == (int)sizeof(header) &&
+                 header.magic == SONG_INDEX_MAGIC && header.version == SONG_INDEX_VERSION &&
+                 header.recordSize == sizeof(SongIndexRecord);
+
+    if (!valid) {
+        if (file) file.close();
+        Serial.println("Song catalog missing or outdated, rebuilding from card");
+        songIndexRebuild();
+    } else {
+        SongIndexRecord rec;
+        while (slotCount < SONG_INDEX_MAX_ENTRIES && file.read(&rec, sizeof(rec)) == (int)sizeof(rec)) {
+            mirrorRecord(slotCount, rec);
+        }
+        file.close();
+        Serial.printf("Song catalog loaded: %u slots\n", slotCount);
+    }
+
+    catalogGeneration = (uint32_t)songHashUpdate(SONG_HASH_SEED, (const uint8_t*)slots,
+                                                 slotCount * sizeof(SongIndexSlot));
+}
+
+uint16_t songIndexRebuild() {
+    if (sd.exists(SONG_INDEX_PREVIOUS_PATH)) {
+        sd.remove(SONG_INDEX_PREVIOUS_PATH);
+    }
+    if (sd.exists(SONG_INDEX_PATH)) {
+        sd.rename(SONG_INDEX_PATH, SONG_INDEX_PREVIOUS_PATH);
+    }
+    if (!resetCatalog()) return 0;
+
+    SdFile root;
+    if (root.open("/")) {
+        catalogDirectory(root, "/");
+        root.close();
+    }
+    importLegacyAliases();
+    importPreviousAliases();
+
+    Serial.printf("Song catalog rebuilt: %u entries\n", slotCount);
+    return slotCount;
+}
+
+bool songIndexFindContent(uint64_t hash, uint32_t size, char* outPath, size_t outLen) {
+    SongIndexRecord rec;
+    for (uint16_t i = 0; i < slotCount; i++) {
+        if (slots[i].size != size || slots[i].hash != hash) continue;
+        if (slots[i].target != SONG_INDEX_NO_TARGET) continue; // Check the primary copy
+        if (!readRecord(i, rec)) continue;
+
+        // Confirm the bytes are still where the catalog says they are
+        File file = sd.open(rec.path, O_RDONLY);
+        bool valid = file && file.size() == size;
+        if (file) file.close();
+
+        if (valid) {
+            strncpy(outPath, rec.path, outLen - 1);
+            outPath[outLen - 1] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+bool songIndexAdd(uint64_t hash, uint32_t size, const char* path, const char* target) {
+    SongIndexRecord rec;
+    int index = findPathSlot(path, rec);
+    if (index < 0) index = findFreeSlot();
+    if (index < 0) {
+        Serial.println("Song catalog full");
+        return false;
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.hash = hash;
+    rec.size = size;
+    rec.target = SONG_INDEX_NO_TARGET;
+    if (target) {
+        SongIndexRecord targetRec;
+        int targetIndex = findPathSlot(target, targetRec);
+        if (targetIndex < 0 || targetRec.target != SONG_INDEX_NO_TARGET) {
+            Serial.print("Alias target not catalogued: ");
+            Serial.println(target);
+            return false;
+        }
+        rec.target = targetIndex;
+        rec.duration = targetRec.duration;
+        rec.eventCount = targetRec.eventCount;
+    } else {
+        readSongHeader(path, rec);
+    }
+    setRecordPath(rec, path);
+    return writeRecord(index, rec);
+}
+
+void songIndexForget(const char* path) {
+    SongIndexRecord own;
+    int ownIndex = findPathSlot(path, own);
+    if (ownIndex < 0) return;
+
+    clearRecord(ownIndex);
+    if (own.target != SONG_INDEX_NO_TARGET) return; // Alias entry - no bytes depend on it
+
+    // Aliases of this path would lose their content once it is overwritten,
+    // so hand the existing file over to the first alias via a FAT rename
+    int newHome = -1;
+    SongIndexRecord rec;
+
+    for (uint16_t i = 0; i < slotCount; i++) {
+        if (!slots[i].size || slots[i].target != ownIndex) continue;
+        if (!readRecord(i, rec)) continue;
+
+        if (newHome < 0) {
+            if (sd.rename(path, rec.path)) {
+                newHome = i;
+                rec.target = SONG_INDEX_NO_TARGET;
+                Serial.print("Moved deduplicated song to alias: ");
+                Serial.println(rec.path);
+            } else {
+                Serial.print("Failed to move song for alias: ");
+                Serial.println(rec.path);
+                clearRecord(i);
+                continue;
+            }
+        } else {
+            rec.target = newHome;
+        }
+        writeRecord(i, rec);
+    }
+}
+
+uint32_t songIndexGeneration() {
+    return catalogGeneration;
+}
+
+const char* songIndexResolve(const char* path) {
+    static char resolved[128];
+    int index = pathTableFind(pathKey(path));
+    if (index < 0) return nullptr;
+
+    if (slots[index].target == SONG_INDEX_NO_TARGET) {
+        snprintf(resolved, sizeof(resolved), "%s", path);
+    } else {
+        // Alias: the stored path is only on the card
+        SongIndexRecord rec;
+        if (!readRecord(slots[index].target, rec)) return nullptr;
+        snprintf(resolved, sizeof(resolved), "%s", rec.path);
+    }
+    return resolved;
+}
+
+SongLookup songIndexLookup(const char* path) {
+    int index = pathTableFind(pathKey(path));
+    if (index < 0) return SONG_LOOKUP_MISSING;
+    return slots[index].target == SONG_INDEX_NO_TARGET ? SONG_LOOKUP_STORED : SONG_LOOKUP_ALIAS;
+}
+
+uint16_t songIndexDirIndex(const char* path) {
+    int index = pathTableFind(pathKey(path));
+    return index < 0 ? SONG_INDEX_NO_DIR_INDEX : slots[index].dirIndex;
+}
+
+void songIndexSetDirIndex(const char* path, uint32_t dirIndex) {
+    int index = pathTableFind(pathKey(path));
+    if (index >= 0 && dirIndex < SONG_INDEX_NO_DIR_INDEX) slots[index].dirIndex = dirIndex;
+}
+
+const char* songIndexPath(uint16_t id) {
+    static char path[128];
+    if (id >= slotCount || slots[id].size == 0) return nullptr;
+
+    SongIndexRecord rec;
+    if (!readRecord(id, rec) || rec.size == 0) return nullptr;
+    strncpy(path, rec.path, sizeof(path) - 1);
+    path[sizeof(path) - 1] = '\0';
+    return path;
+}
+
+/**
+ * Checks a catalog record against the query filters
+ */
+static bool recordMatches(const SongIndexRecord& rec, const SongQuery& query) {
+    if (!query.genre[0] && !query.artist[0] && !query.title[0]) return true;
+    if (!rec.genreLen) return false; // Path outside the genre/artist/title layout
+
+    const char* genre = rec.path + 1;
+    const char* artist = genre + rec.genreLen + 1;
+    const char* title = artist + rec.artistLen + 1;
+    size_t genreLen = strlen(query.genre);
+    size_t artistLen = strlen(query.artist);
+    size_t titleLen = strlen(query.title);
+
+    return (!genreLen || (genreLen <= rec.genreLen && strncasecmp(genre, query.genre, genreLen) == 0)) &&
+           (!artistLen || (artistLen <= rec.artistLen && strncasecmp(artist, query.artist, artistLen) == 0)) &&
+           (!titleLen || (titleLen <= rec.titleLen && strncasecmp(title, query.title, titleLen) == 0));
+}
+
+static void writeU16(Uart& uart, uint16_t value) {
+    uart.write((uint8_t)(value & 0xFF));
+    uart.write((uint8_t)(value >> 8));
+}
+
+static void writeU32(Uart& uart, uint32_t value) {
+    writeU16(uart, (uint16_t)value);
+    writeU16(uart, (uint16_t)(value >> 16));
+}
+
+static void writeListEntry(Uart& uart, const SongIndexRecord& rec) {
+    size_t pathLen = strnlen(rec.path, sizeof(rec.path));
+    uint8_t head[10] = {
+        (uint8_t)(9 + pathLen),
+        (uint8_t)rec.duration, (uint8_t)(rec.duration >> 8),
+        (uint8_t)(rec.duration >> 16), (uint8_t)(rec.duration >> 24),
+        (uint8_t)rec.eventCount, (uint8_t)(rec.eventCount >> 8),
+        rec.genreLen, rec.artistLen, rec.titleLen
+    };
+    uart.write(head, sizeof(head));
+    uart.write((const uint8_t*)rec.path, pathLen);
+}
+
+/**
+ * A run of consecutive catalog records read by one SD server request
+ */
+struct SongIndexBatch {
+    uint32_t offset;
+    int count;
+    SongIndexRecord records[8];
+};
+
+static bool readBatch(void* ctx) {
+    SongIndexBatch* batch = (SongIndexBatch*)ctx;
+    batch->count = 0;
+    File file = sd.open(SONG_INDEX_PATH, O_RDONLY);
+    if (file && file.seek(batch->offset)) {
+        int n = file.read(batch->records, sizeof(batch->records));
+        batch->count = n > 0 ? n / (int)sizeof(SongIndexRecord) : 0;
+    }
+    if (file) file.close();
+    return batch->count > 0;
+}
+
+void songIndexList(Uart& uart, const SongQuery& query) {
+    static SongIndexBatch batch;
+    uint16_t limit = query.limit ? query.limit : SONG_LIST_DEFAULT_LIMIT;
+    if (limit > SONG_LIST_MAX_LIMIT) limit = SONG_LIST_MAX_LIMIT;
+    uint16_t matched = 0;
+    uint32_t generation = songIndexGeneration(); // Any change during the scan bumps it again
+    batch.offset = sizeof(SongIndexHeader);
+
+    uart.write((uint8_t)SONG_LIST_START);
+    uart.write((uint8_t)'L');
+    uart.write(query.requestId);
+    writeU16(uart, query.offset);
+
+    while (true) {
+        // Read the next few records as one request, so playback reads interleave
+        if (!sdCall(SD_PRIORITY_INSTRUCTION, readBatch, &batch)) break;
+        batch.offset += batch.count * sizeof(SongIndexRecord);
+
+        for (int i = 0; i < batch.count; i++) {
+            const SongIndexRecord& rec = batch.records[i];
+            if (!rec.size || !recordMatches(rec, query)) continue;
+            if (matched >= query.offset && matched - query.offset < limit) {
+                writeListEntry(uart, rec);
+            }
+            matched++;
+        }
+    }
+
+    uart.write((uint8_t)0); // End of list
+    writeU16(uart, matched);
+    writeU32(uart, generation);
+    uart.flush();
+}
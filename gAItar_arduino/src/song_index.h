@@ -0,0 +1,182 @@
+#ifndef SONG_INDEX_H
+#define SONG_INDEX_H
+
+#include <Arduino.h>
+
+/**
+ * Song catalog stored on the SD card
+ * One fixed-size binary record per song (genre, artist, title, path, duration,
+ * event count and 64-bit content hash) kept up to date by the upload path, so
+ * listings and lookups never walk the directory tree
+ * Records that point at another record act as aliases (metadata-only copies),
+ * which lets re-uploads of an existing song be acknowledged without a transfer
+ *
+ * songIndexBegin() runs from setup() before the scheduler starts; songIndexList()
+ * submits its own SD server requests; songIndexLookup() reads RAM only; all
+ * other functions must run on the SD server task (through sdCall())
+ */
+
+#define SONG_INDEX_PATH "/.catalog"          // Catalog file location on SD card
+#define SONG_INDEX_LEGACY_PATH "/.songidx"   // Hash-only index, imported on rebuild
+#define SONG_INDEX_MAX_ENTRIES 512           // Entries mirrored in RAM
+#define SONG_HASH_SEED 0xcbf29ce484222325ULL // FNV-1a 64-bit offset basis
+#define SONG_INDEX_NO_DIR_INDEX 0xFFFF       // Directory entry not seen yet
+
+enum SongLookup : uint8_t {
+    SONG_LOOKUP_MISSING,  // Not in the catalog
+    SONG_LOOKUP_STORED,   // The path itself stores the song
+    SONG_LOOKUP_ALIAS     // Points at another record (songIndexResolve())
+};
+
+/**
+ * Incremental FNV-1a 64-bit content hash
+ * Start with SONG_HASH_SEED and feed data in any chunking
+ *
+ * @param hash Running hash value
+ * @param data Bytes to add to the hash
+ * @param len Number of bytes
+ * @return Updated hash value
+ */
+uint64_t songHashUpdate(uint64_t hash, const uint8_t* data, size_t len);
+
+/**
+ * Loads the catalog into RAM, rebuilding it from the card if it is missing
+ * Called once from setup() after the SD card is mounted (before the scheduler starts)
+ */
+void songIndexBegin();
+
+/**
+ * Recreates the catalog by walking the card and hashing every song file
+ * Aliases from the previous catalog (or a legacy hash index) are carried over
+ * when their target still exists
+ * Slow (reads every song) - only run at first boot or on explicit request
+ *
+ * @return Number of catalog entries written
+ */
+uint16_t songIndexRebuild();
+
+/**
+ * Looks up a path that already stores content with the given hash and size
+ * Verifies the stored file still exists with the expected size
+ *
+ * @param hash Content hash announced in the START header
+ * @param size File size in bytes
+ * @param outPath Buffer receiving the path that holds the content
+ * @param outLen Size of outPath
+ * @return true if identical content is already on the card
+ */
+bool songIndexFindContent(uint64_t hash, uint32_t size, char* outPath, size_t outLen);
+
+/**
+ * Records content stored at a path, or an alias pointing at existing content
+ * Duration and event count are read from the song header (or the alias target)
+ * Any previous entry for the same path is replaced
+ *
+ * @param hash Content hash
+ * @param size File size in bytes
+ * @param path Path the song is known by
+ * @param target Path that physically holds the bytes, nullptr if path itself does
+ * @return true if the entry was written to the catalog
+ */
+bool songIndexAdd(uint64_t hash, uint32_t size, const char* path, const char* target);
+
+/**
+ * Removes the entry for a path that is about to be overwritten
+ * Aliases that depended on the old bytes are preserved by renaming the file
+ * to the first alias path and retargeting the remaining aliases
+ *
+ * @param path Path about to receive new content
+ */
+void songIndexForget(const char* path);
+
+/**
+ * Resolves a catalogued path to the path that physically stores the song
+ * Answered from an in-RAM hash table keyed on the path; only aliases read
+ * their target's record from the card
+ *
+ * @param path Requested song path
+ * @return Static buffer with the stored path (path itself unless it is an alias),
+ *         or nullptr if the path is not in the catalog
+ */
+const char* songIndexResolve(const char* path);
+
+/**
+ * RAM-only part of songIndexResolve(), safe to call from any task
+ * A lookup racing a catalog update on the SD server may miss; callers fall
+ * back to songIndexResolve() for anything but SONG_LOOKUP_STORED
+ *
+ * @param path Requested song path
+ */
+SongLookup songIndexLookup(const char* path);
+
+/**
+ * Directory entry index of a catalogued song, as last recorded by
+ * songIndexSetDirIndex(); the entry can have been reused since, so a file
+ * opened by it must be checked by name
+ *
+ * @param path Stored song path
+ * @return Entry index in the song's directory, or SONG_INDEX_NO_DIR_INDEX
+ */
+uint16_t songIndexDirIndex(const char* path);
+
+/**
+ * Remembers where a catalogued song's directory entry is (RAM only)
+ *
+ * @param path Stored song path
+ * @param dirIndex Entry index in the song's directory
+ */
+void songIndexSetDirIndex(const char* path, uint32_t dirIndex);
+
+/**
+ * Path of the song in a catalog slot, as listed (aliases are not followed)
+ * Slot numbers change when the catalog is rebuilt; check songIndexGeneration()
+ *
+ * @param id Catalog slot
+ * @return Static buffer with the path, or nullptr for a free or unknown slot
+ */
+const char* songIndexPath(uint16_t id);
+
+/**
+ * Catalog generation number, changed by every catalog update (uploads,
+ * aliases, removals, rebuilds); reported in STATUS lines and List replies
+ * so the ESP32 knows when its cached copy of the library is stale
+ * Safe to read from any task
+ */
+uint32_t songIndexGeneration();
+
+#define SONG_LIST_START 0xAB          // First byte of a List response frame
+#define SONG_LIST_DEFAULT_LIMIT 50    // Page size when the request does not give one
+#define SONG_LIST_MAX_LIMIT 200       // Upper bound on songs per response
+
+/**
+ * Library listing request carried by the List command
+ * Each non-empty filter must be a case-insensitive prefix of the matching
+ * path component (names as stored on the card, spaces replaced by '_')
+ */
+struct SongQuery {
+    uint8_t requestId;   // Echoed in the response so the requester can match it
+    uint16_t offset;     // Matching songs to skip
+    uint16_t limit;      // Songs to return
+    char genre[32];
+    char artist[48];
+    char title[48];
+};
+
+/**
+ * Transmits one page of catalogued songs matching a query over UART
+ * Reads the catalog sequentially in small batches, one SD server request
+ * each, so playback is not held off during the transmission
+ *
+ * Response frame (multi-byte fields little-endian):
+ *   0xAB 'L' requestId(u8) offset(u16)
+ *   per song: len(u8) duration(u32) events(u16) genreLen(u8) artistLen(u8)
+ *             titleLen(u8) path(len - 9 bytes, "/genre/artist/title.bin")
+ *   end of list: len 0 followed by total(u16), the number of matching songs,
+ *                and generation(u32), songIndexGeneration() when the scan started
+ *
+ * @param uart UART interface for the response (caller holds it for the whole frame)
+ * @param query Page and filters
+ */
+void songIndexList(Uart& uart, const SongQuery& query);
+
+#endif // SONG_INDEX_H
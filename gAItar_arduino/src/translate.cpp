@@ -2,6 +2,9 @@
 #include <SdFat.h>
 #include <FreeRTOS_SAMD51.h>
 #include "uart_transfer.h"
+#include "sd_server.h"
+#include "upload_qos.h"
+#include "song_index.h"
 
 // External global playback state variables
 extern volatile bool isPlaying;
@@ -12,7 +15,79 @@ extern size_t currentEventIndex;
 extern unsigned long startTime;
 extern unsigned long pauseOffset;
 extern SemaphoreHandle_t playbackSemaphore;
-extern SemaphoreHandle_t sdSemaphore;
+extern SemaphoreHandle_t instructionTxSemaphore;
+
+static uint16_t ratePercent = PLAYBACK_RATE_NORMAL;
+static bool seekPending = false; // Event index needs to follow a clock change
+
+/**
+ * Converts a song duration to wall-clock ms at the current rate
+ */
+static unsigned long songToRealMs(unsigned long songMs) {
+    return (uint64_t)songMs * PLAYBACK_RATE_NORMAL / ratePercent;
+}
+
+unsigned long playbackPosition() {
+    if (isPaused) return pauseOffset;
+    if (!isPlaying) return 0;
+    return (uint64_t)(millis() - startTime) * ratePercent / PLAYBACK_RATE_NORMAL;
+}
+
+void setPlaybackPosition(unsigned long positionMs) {
+    if (isPaused) {
+        pauseOffset = positionMs;
+    } else {
+        startTime = millis() - songToRealMs(positionMs);
+    }
+    seekPending = true;
+}
+
+bool setPlaybackRate(uint16_t percent) {
+    if (percent < PLAYBACK_RATE_MIN || percent > PLAYBACK_RATE_MAX) return false;
+    unsigned long position = playbackPosition();
+    ratePercent = percent;
+    if (isPlaying && !isPaused) {
+        startTime = millis() - songToRealMs(position);
+    }
+    return true;
+}
+
+uint16_t playbackRate() {
+    return ratePercent;
+}
+
+void pausePlayback() {
+    pauseOffset = playbackPosition();
+    isPaused = true;
+}
+
+void resumePlayback() {
+    isPaused = false;
+    isPlaying = true;
+    startTime = millis() - songToRealMs(pauseOffset);
+}
+
+/**
+ * Finds the first event at or after a song position
+ * Binary search over the event timestamps, one 4-byte read per step
+ *
+ * @return Event index, eventCount if the position is past the last event
+ */
+static size_t findEventAt(File& file, uint16_t eventCount, unsigned long positionMs) {
+    size_t low = 0, high = eventCount;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        uint8_t time[4];
+        if (sdRead(SD_PRIORITY_PLAYBACK, file, time, 4, 6 + mid * 5) != 4) break;
+        unsigned long eventTime = ((unsigned long)time[0] << 24) | (time[1] << 16) | (time[2] << 8) | time[3];
+        if (eventTime < positionMs) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
 
 /**
  * Hardware control function for processing individual guitar events
@@ -128,29 +203,80 @@ void processGuitarEvent(int string, int fret, bool moveServo) {
  * Transmits current playback status over UART interface
  * Sends JSON-formatted status information for external monitoring systems
  * Uses static buffer allocation to prevent dynamic memory fragmentation
+ * Never waits for the UART: while a List response is being transmitted the
+ * status is skipped so it cannot land inside the binary frame
  * 
  * @param instrUart UART interface for status transmission
  * @param totalTime Total song duration in milliseconds
+ * @return true if the status was sent, false if the UART was busy
  */
-void sendPlaybackStatusSafe(Uart &instrUart, unsigned long totalTime) {
-    unsigned long currentPlayTime;
-    
-    // Calculate current playback position based on system state
-    if (isPaused) {
-        currentPlayTime = pauseOffset; // Use saved position when paused
-    } else if (isPlaying) {
-        currentPlayTime = millis() - startTime; // Calculate elapsed time during playback
-    } else {
-        currentPlayTime = 0; // No playback active
-    }
+bool sendPlaybackStatusSafe(Uart &instrUart, unsigned long totalTime) {
+    // Saved position when paused, 0 when stopped
+    unsigned long currentPlayTime = playbackPosition();
     
     // Format status message using static buffer (no heap allocation)
-    char statusBuffer[64];
+    // gen lets the ESP32 notice catalog changes (see songIndexGeneration())
+    char statusBuffer[96];
     snprintf(statusBuffer, sizeof(statusBuffer), 
-             "STATUS:{\"currentTime\":%lu,\"totalTime\":%lu}\n",
-             currentPlayTime, totalTime);
+             "STATUS:{\"currentTime\":%lu,\"totalTime\":%lu,\"gen\":%lu}\n",
+             currentPlayTime, totalTime, (unsigned long)songIndexGeneration());
     
+    if (xSemaphoreTake(instructionTxSemaphore, 0) != pdTRUE) {
+        return false;
+    }
     instrUart.print(statusBuffer);
+    xSemaphoreGive(instructionTxSemaphore);
+    return true;
+}
+
+// Directory of the last song opened, kept open so songs in it open by entry index
+static File songDir;
+static char songDirPath[128] = "";
+
+struct SongOpen {
+    File* file;
+    const char* path;
+};
+
+/**
+ * Runs on the SD server task: opens a song through its cached parent directory
+ * A directory entry index recorded in the catalog opens the file without
+ * scanning the directory; the entry is checked by name, since it may have
+ * been reused, and a song found by name has its index recorded
+ *
+ * @param ctx SongOpen request
+ * @return true if the song is open for reading
+ */
+static bool openSongFile(void* ctx) {
+    SongOpen* req = (SongOpen*)ctx;
+    if (*req->file) req->file->close();
+    const char* name = strrchr(req->path, '/');
+    if (!name) return false;
+    size_t dirLength = name - req->path;
+    name++;
+
+    if (!songDir.isOpen() || strncmp(songDirPath, req->path, dirLength) != 0 || songDirPath[dirLength] != '\0') {
+        songDir.close();
+        songDirPath[0] = '\0';
+        char dirPath[sizeof(songDirPath)];
+        snprintf(dirPath, sizeof(dirPath), "%.*s", (int)(dirLength ? dirLength : 1), req->path);
+        if (!songDir.open(dirPath, O_RDONLY)) return false;
+        snprintf(songDirPath, sizeof(songDirPath), "%.*s", (int)dirLength, req->path);
+    }
+
+    uint16_t dirIndex = songIndexDirIndex(req->path);
+    if (dirIndex != SONG_INDEX_NO_DIR_INDEX && req->file->open(&songDir, dirIndex, O_RDONLY)) {
+        char entryName[128];
+        req->file->getName(entryName, sizeof(entryName));
+        if (strcmp(entryName, name) == 0) return true;
+        req->file->close();
+    }
+    if (!req->file->open(&songDir, name, O_RDONLY)) {
+        songDir.close(); // Reopened next time, in case the card was swapped
+        return false;
+    }
+    songIndexSetDirIndex(req->path, req->file->dirIndex());
+    return true;
 }
 
 /**
@@ -194,8 +320,10 @@ void playGuitarRTOS_Binary(const char* filePath) {
 
     // Handle non-playing states (paused or stopped)
     if (!isPlaying || isPaused) {
-        if (shouldSendStatus) {
-            sendPlaybackStatusSafe(instructionUart, totalDurationMs);
+        qosPlaybackStopped(); // Uploads may write to the card immediately
+
+        if (shouldSendStatus && !sendPlaybackStatusSafe(instructionUart, totalDurationMs)) {
+            lastStatus = 0; // UART busy - retry on the next pass
         }
 
         // Clear hardware state once when playback stops
@@ -210,141 +338,141 @@ void playGuitarRTOS_Binary(const char* filePath) {
 
     // File loading and header parsing (occurs once per song or on song change)
     if (!fileLoaded || newSongRequested) {
-        if (xSemaphoreTake(sdSemaphore, portMAX_DELAY)) {
-            // Close any existing file handle to prevent resource leaks
-            if (file) {
-                file.close();
-            }
-            
-            // Reset parsing state for new songs
-            if (newSongRequested) {
-                totalDurationMs = 0;
-                eventCount = 0;
-                currentEventTime = 0;
-                currentString = 0;
-                currentFret = 0;
-                eventReady = false;
-            }
-            
-            // Open binary song file
-            file = sd.open(currentSongPath, FILE_READ);
-            if (!file) {
-                xSemaphoreGive(sdSemaphore);
-                Serial.println("Failed to open binary file for reading");
-                isPlaying = false;
-                fileLoaded = false;
-                return;
-            }
-            
-            // Validate minimum file size (6-byte header)
-            size_t fileSize = file.size();
-            if (fileSize < 6) {
-                Serial.println("ERROR: Binary file too small");
-                file.close();
-                xSemaphoreGive(sdSemaphore);
-                isPlaying = false;
-                fileLoaded = false;
-                currentSongPath[0] = '\0';
+        // Close any existing file handle to prevent resource leaks
+        sdClose(SD_PRIORITY_PLAYBACK, file);
+
+        // Reset parsing state for new songs
+        if (newSongRequested) {
+            totalDurationMs = 0;
+            eventCount = 0;
+            currentEventTime = 0;
+            currentString = 0;
+            currentFret = 0;
+            eventReady = false;
+        }
+
+        // Open binary song file
+        SongOpen songOpen = {&file, currentSongPath};
+        if (!sdCall(SD_PRIORITY_PLAYBACK, openSongFile, &songOpen)) {
+            Serial.println("Failed to open binary file for reading");
+            isPlaying = false;
+            fileLoaded = false;
+            return;
+        }
+
+        // Validate minimum file size (6-byte header)
+        size_t fileSize = file.size();
+        if (fileSize < 6) {
+            Serial.println("ERROR: Binary file too small");
+            sdClose(SD_PRIORITY_PLAYBACK, file);
+            isPlaying = false;
+            fileLoaded = false;
+            currentSongPath[0] = '\0';
+            if (xSemaphoreTake(instructionTxSemaphore, 0) == pdTRUE) {
                 instructionUart.println("ERROR:Invalid binary file");
-                return;
+                xSemaphoreGive(instructionTxSemaphore);
             }
+            return;
+        }
 
-            // Read 6-byte header: duration (4 bytes) + event count (2 bytes)
-            uint8_t header[6];
-            if (file.read(header, 6) != 6) {
-                Serial.println("ERROR: Failed to read binary header");
-                file.close();
-                xSemaphoreGive(sdSemaphore);
-                isPlaying = false;
-                fileLoaded = false;
-                return;
-            }
+        // Read 6-byte header: duration (4 bytes) + event count (2 bytes)
+        uint8_t header[6];
+        if (sdRead(SD_PRIORITY_PLAYBACK, file, header, 6) != 6) {
+            Serial.println("ERROR: Failed to read binary header");
+            sdClose(SD_PRIORITY_PLAYBACK, file);
+            isPlaying = false;
+            fileLoaded = false;
+            return;
+        }
 
-            // Parse header using big-endian byte order
-            totalDurationMs = (header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
-            eventCount = (header[4] << 8) | header[5];
-            
-            Serial.printf("Binary file loaded: %u events, duration: %lu ms\n", eventCount, totalDurationMs);
-            
-            // Validate file size matches expected event count
-            size_t expectedSize = 6 + (eventCount * 5); // 6 byte header + 5 bytes per event
-            if (fileSize != expectedSize) {
-                Serial.printf("ERROR: File size mismatch. Expected: %u, Actual: %u\n", expectedSize, fileSize);
-                file.close();
-                xSemaphoreGive(sdSemaphore);
-                isPlaying = false;
-                fileLoaded = false;
-                return;
-            }
+        // Parse header using big-endian byte order
+        totalDurationMs = (header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+        eventCount = (header[4] << 8) | header[5];
 
-            fileLoaded = true;
-            
-            // Set up timing for new songs vs. resume operations
-            if (newSongRequested) {
-                currentEventIndex = 0;  // Start from beginning for new songs
-                startTime = millis();
-                pauseOffset = 0;
-                newSongRequested = false;
-            } else {
-                // Resume from pause - maintain timing continuity
-                startTime = millis() - pauseOffset;
-            }
-            
-            xSemaphoreGive(sdSemaphore);
-        } else {
-            Serial.println("Failed to take SD semaphore");
+        Serial.printf("Binary file loaded: %u events, duration: %lu ms\n", eventCount, totalDurationMs);
+
+        // Validate file size matches expected event count
+        size_t expectedSize = 6 + (eventCount * 5); // 6 byte header + 5 bytes per event
+        if (fileSize != expectedSize) {
+            Serial.printf("ERROR: File size mismatch. Expected: %u, Actual: %u\n", expectedSize, fileSize);
+            sdClose(SD_PRIORITY_PLAYBACK, file);
+            isPlaying = false;
+            fileLoaded = false;
             return;
         }
+
+        fileLoaded = true;
+
+        // Set up timing for new songs vs. resume operations
+        if (newSongRequested) {
+            currentEventIndex = 0;  // Start from beginning for new songs
+            startTime = millis();
+            pauseOffset = 0;
+            newSongRequested = false;
+            seekPending = false;
+        } else {
+            // Resume from pause - maintain timing continuity
+            startTime = millis() - songToRealMs(pauseOffset);
+        }
+    }
+
+    // Seek: continue from the first event at the new position
+    if (seekPending && fileLoaded) {
+        unsigned long position = playbackPosition();
+        currentEventIndex = findEventAt(file, eventCount, position);
+        eventReady = false;
+        clearAllFrets(); // Held frets belong to the old position
+        setPlaybackPosition(position); // Search time does not count against the song
+        seekPending = false;
     }
 
     // Send periodic status updates to external systems
-    if (shouldSendStatus && fileLoaded) {
-        sendPlaybackStatusSafe(instructionUart, totalDurationMs);
+    if (shouldSendStatus && fileLoaded && !sendPlaybackStatusSafe(instructionUart, totalDurationMs)) {
+        lastStatus = 0; // UART busy - retry on the next pass
     }
 
     // Event streaming: Load next event data when needed
     if (!eventReady && currentEventIndex < eventCount && fileLoaded) {
-        if (xSemaphoreTake(sdSemaphore, portMAX_DELAY)) {
-            // Calculate file position for current event (skip 6-byte header)
-            size_t eventPosition = 6 + (currentEventIndex * 5);
-            
-            if (file && file.seek(eventPosition)) {
-                uint8_t eventData[5];
-                if (file.read(eventData, 5) == 5) {
-                    // Parse 5-byte event: timestamp (4 bytes) + packed data (1 byte)
-                    currentEventTime = (eventData[0] << 24) | (eventData[1] << 16) | 
-                                     (eventData[2] << 8) | eventData[3];
-                    uint8_t packedByte = eventData[4];
-                    
-                    // Unpack string and fret data from single byte
-                    // Format: [SSS][FFFFF] where S=string bits, F=fret bits
-                    currentString = (packedByte >> 5) & 0x07; // Upper 3 bits for string (1-6)
-                    uint8_t fretValue = packedByte & 0x1F;    // Lower 5 bits for fret (0-31)
-                    
-                    // Convert fret encoding: 31 = string off (-1), otherwise direct value
-                    currentFret = (fretValue == 31) ? -1 : (int8_t)fretValue;
-                    
-                    eventReady = true;
-                } else {
-                    Serial.println("ERROR: Failed to read event data");
-                    isPlaying = false;
-                    fileLoaded = false;
-                }
-            } else {
-                Serial.println("ERROR: Failed to seek to event position or invalid file");
-                isPlaying = false;
-                fileLoaded = false;
-            }
-            
-            xSemaphoreGive(sdSemaphore);
+        // Calculate file position for current event (skip 6-byte header)
+        size_t eventPosition = 6 + (currentEventIndex * 5);
+        uint8_t eventData[5];
+        int got = sdRead(SD_PRIORITY_PLAYBACK, file, eventData, 5, eventPosition);
+
+        if (got == 5) {
+            // Parse 5-byte event: timestamp (4 bytes) + packed data (1 byte)
+            currentEventTime = (eventData[0] << 24) | (eventData[1] << 16) | 
+                             (eventData[2] << 8) | eventData[3];
+            uint8_t packedByte = eventData[4];
+
+            // Unpack string and fret data from single byte
+            // Format: [SSS][FFFFF] where S=string bits, F=fret bits
+            currentString = (packedByte >> 5) & 0x07; // Upper 3 bits for string (1-6)
+            uint8_t fretValue = packedByte & 0x1F;    // Lower 5 bits for fret (0-31)
+
+            // Convert fret encoding: 31 = string off (-1), otherwise direct value
+            currentFret = (fretValue == 31) ? -1 : (int8_t)fretValue;
+
+            eventReady = true;
+        } else if (got < 0) {
+            Serial.println("ERROR: Failed to seek to event position or invalid file");
+            isPlaying = false;
+            fileLoaded = false;
         } else {
-            Serial.println("Failed to take SD semaphore for event reading");
-            return;
+            Serial.println("ERROR: Failed to read event data");
+            isPlaying = false;
+            fileLoaded = false;
         }
     }
 
+    // Publish the next deadline so upload commits stay out of its way
+    if (eventReady) {
+        qosNextEvent(startTime + songToRealMs(currentEventTime));
+    }
+
     // Event execution: Process current event when its time arrives
-    if (eventReady && (millis() - startTime >= currentEventTime)) {
+    if (eventReady && playbackPosition() >= currentEventTime) {
+        qosRecordEvent(startTime + songToRealMs(currentEventTime));
+
         // Validate string number range
         if (currentString >= 1 && currentString <= 6) {
             // Determine if servo actuation is needed (for fretted notes)
@@ -364,17 +492,12 @@ void playGuitarRTOS_Binary(const char* filePath) {
     // Song completion handling
     if (currentEventIndex >= eventCount && fileLoaded) {
         // Send final status update
-        if (shouldSendStatus) {
-            sendPlaybackStatusSafe(instructionUart, totalDurationMs);
+        if (shouldSendStatus && !sendPlaybackStatusSafe(instructionUart, totalDurationMs)) {
+            lastStatus = 0; // UART busy - retry on the next pass
         }
         
         // Clean up file resources
-        if (xSemaphoreTake(sdSemaphore, portMAX_DELAY)) {
-            if (file) {
-                file.close();
-            }
-            xSemaphoreGive(sdSemaphore);
-        }
+        sdClose(SD_PRIORITY_PLAYBACK, file);
         
         // Reset all playback state for next song
         currentSongPath[0] = '\0';
@@ -383,6 +506,8 @@ void playGuitarRTOS_Binary(const char* filePath) {
         newSongRequested = true;
         currentEventIndex = 0;
         
+        qosPlaybackStopped();
         Serial.println("Binary playback finished");
+        qosReportDeadlines(Serial);
     }
 }
\ No newline at end of file
@@ -11,14 +11,62 @@
  * Handles real-time binary file parsing and hardware control for automated guitar playing
  */
 
+#define PLAYBACK_RATE_NORMAL 100   // Playback rate in percent of the song's own tempo
+#define PLAYBACK_RATE_MIN 25
+#define PLAYBACK_RATE_MAX 400
+
+/**
+ * Playback clock control
+ * startTime is the millis() the song would have started at under the current
+ * rate and pauseOffset is the song position while paused, both in song ms
+ * All of these must be called with playbackSemaphore held
+ */
+
+/**
+ * Current song position in ms (0 when stopped)
+ */
+unsigned long playbackPosition();
+
+/**
+ * Moves the playback clock to a song position
+ * The playback task resynchronises its event index on its next pass
+ *
+ * @param positionMs Song position in ms
+ */
+void setPlaybackPosition(unsigned long positionMs);
+
+/**
+ * Changes the playback rate, keeping the current song position
+ *
+ * @param percent PLAYBACK_RATE_MIN..PLAYBACK_RATE_MAX
+ * @return false if the rate is out of range
+ */
+bool setPlaybackRate(uint16_t percent);
+
+/**
+ * Playback rate in percent
+ */
+uint16_t playbackRate();
+
+/**
+ * Stops the clock at the current position
+ */
+void pausePlayback();
+
+/**
+ * Restarts the clock from the paused position
+ */
+void resumePlayback();
+
 /**
  * Sends playback status information over UART interface
  * Used for synchronizing external control systems with current playback state
  * 
  * @param instrUart UART interface for status transmission
  * @param totalTime Total song duration in milliseconds
+ * @return false if the UART was busy with another response and nothing was sent
  */
-void sendPlaybackStatusSafe(Uart &instrUart, unsigned long totalTime);
+bool sendPlaybackStatusSafe(Uart &instrUart, unsigned long totalTime);
 
 /**
  * Main binary guitar playback engine
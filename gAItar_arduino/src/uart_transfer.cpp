@@ -3,6 +3,11 @@
 #include <SPI.h>
 #include <ArduinoJson.h>
 #include "globals.h"
+#include "song_index.h"
+#include "sd_server.h"
+#include "upload_qos.h"
+#include "instruction_frame.h"
+#include "instruction_ops.h"
 #include <FreeRTOS_SAMD51.h>
 
 // External global playback state variables
@@ -14,263 +19,393 @@ extern size_t currentEventIndex;
 extern unsigned long startTime;
 extern unsigned long pauseOffset;
 extern SemaphoreHandle_t playbackSemaphore;
-extern SemaphoreHandle_t sdSemaphore;
+extern SemaphoreHandle_t instructionTxSemaphore;
 
-// Command caching variables for resume functionality
-char prevTitle[64] = "";
-char prevArtist[64] = "";
-char prevGenre[64] = "";
+// Path of the last song requested, so playing the paused song again resumes it
+static char prevRequestPath[128] = "";
+
+// Instructions run since boot, by form
+static uint32_t binaryInstructions = 0;
+static uint32_t textInstructions = 0;
+static uint32_t rejectedInstructions = 0;
+
+static InstructionFrameDecoder instructionDecoder;
 
 /**
- * File search implementation using hierarchical directory structure
- * Constructs paths in format: /genre/artist/title.bin
- * Thread-safe with semaphore protection for SD card access
- * 
- * @param title Song title for filename construction
- * @param artist Artist name for directory path
- * @param genre Genre category for top-level directory
- * @return Static buffer containing full file path or nullptr if not found
+ * Runs on the SD server task: catalog lookup, falling back to the card
+ * for songs copied on without an upload
+ *
+ * @param ctx Path buffer, replaced by the stored path when found
+ * @return true if the song exists
  */
-const char* findFileSimple(const char* title, const char* artist, const char* genre) {
-    static char matchingFilePath[128];
-    
-    // Construct the full file path: /genre/artist/title.bin
-    snprintf(matchingFilePath, sizeof(matchingFilePath), "/%s/%s/%s.bin", 
-             genre, artist, title);
+static bool resolveSongPath(void* ctx) {
+    char* path = (char*)ctx;
+    const char* storedPath = songIndexResolve(path);
+    if (storedPath) {
+        strncpy(path, storedPath, 127);
+        path[127] = '\0';
+        return true;
+    }
+    return sd.exists(path);
+}
 
-    // Debug output for file search tracking
-    Serial.print("Checking if file exists: ");
-    Serial.println(matchingFilePath);
+/**
+ * Sends one List response frame
+ * Holds the UART for the whole frame; playback skips its STATUS line meanwhile
+ */
+static void sendSongList(Uart& uart, const SongQuery& query) {
+    if (xSemaphoreTake(instructionTxSemaphore, portMAX_DELAY)) {
+        songIndexList(uart, query);
+        xSemaphoreGive(instructionTxSemaphore);
+    }
+}
+
+/**
+ * UART file listing interface for remote file system browsing
+ * Served from the song catalog rather than a directory walk
+ * Request arguments are an optional JSON object following "List":
+ * {"id":1,"offset":0,"limit":50,"genre":"","artist":"","title":""}
+ * The id is echoed in the response frame for request/response matching
+ * 
+ * @param uart UART interface for file list transmission
+ * @param args JSON arguments, empty for the first page of the whole library
+ */
+void listFilesOnSDUart(Uart& uart, const char* args) {
+    static SongQuery query;
+    memset(&query, 0, sizeof(query));
+    query.limit = SONG_LIST_DEFAULT_LIMIT;
 
-    // Thread-safe SD card access with semaphore protection
-    if (!xSemaphoreTake(sdSemaphore, portMAX_DELAY)) {
-        Serial.println("Failed to take SD semaphore");
-        return nullptr;
+    if (args[0] == '{') {
+        JsonDocument doc;
+        DeserializationError error = deserializeJson(doc, args);
+        if (error) {
+            Serial.print("Invalid List arguments: ");
+            Serial.println(error.c_str());
+        } else {
+            query.requestId = doc["id"] | 0;
+            query.offset = doc["offset"] | 0;
+            query.limit = doc["limit"] | SONG_LIST_DEFAULT_LIMIT;
+            strncpy(query.genre, doc["genre"] | "", sizeof(query.genre) - 1);
+            strncpy(query.artist, doc["artist"] | "", sizeof(query.artist) - 1);
+            strncpy(query.title, doc["title"] | "", sizeof(query.title) - 1);
+        }
+        doc.clear();
     }
+    sendSongList(uart, query);
+}
 
-    // Check file existence on SD card
-    bool fileExists = sd.exists(matchingFilePath);
-    
-    xSemaphoreGive(sdSemaphore);
+// Rescan handler, run on the SD server task
+static bool rebuildCatalog(void* ctx) {
+    return songIndexRebuild() > 0;
+}
+
+/**
+ * Starts a song, or resumes it if it is the paused song requested last
+ * Caller holds playbackSemaphore
+ *
+ * @param requestPath Path the song was requested by ("/genre/artist/title.bin")
+ */
+static void playSong(const char* requestPath) {
+    if (strcmp(requestPath, prevRequestPath) == 0 && isPaused && !newSongRequested) {
+        resumePlayback();
+        Serial.println("Resuming previous song (same request)");
+        return;
+    }
+    strncpy(prevRequestPath, requestPath, sizeof(prevRequestPath) - 1);
+    prevRequestPath[sizeof(prevRequestPath) - 1] = '\0';
 
-    if (fileExists) {
-        Serial.print("File found: ");
-        Serial.println(matchingFilePath);
-        return matchingFilePath;
-    } else {
+    // Uploaded songs resolve from the RAM path table without waiting for the
+    // SD server; aliases (their stored path is only on the card) and songs
+    // copied on without an upload are resolved there
+    static char filePath[128];
+    strcpy(filePath, prevRequestPath);
+    if (songIndexLookup(filePath) != SONG_LOOKUP_STORED &&
+        !sdCall(SD_PRIORITY_INSTRUCTION, resolveSongPath, filePath)) {
         Serial.print("File not found: ");
-        Serial.println(matchingFilePath);
-        return nullptr;
+        Serial.println(requestPath);
+        return;
     }
+    Serial.print("Found file: ");
+    Serial.println(filePath);
+
+    // Initialize new song playback state
+    strncpy(currentSongPath, filePath, sizeof(currentSongPath) - 1);
+    currentSongPath[sizeof(currentSongPath) - 1] = '\0';
+    newSongRequested = true;
+    isPlaying = true;
+    isPaused = false;
+    startTime = millis();
+    pauseOffset = 0; // Reset pause state for new song
+    Serial.println("Starting new song (interrupting current if any)");
+}
+
+// Play by catalog id, run on the SD server task
+struct SongIdLookup {
+    uint16_t id;
+    char path[128];
+};
+
+static bool lookupSongId(void* ctx) {
+    SongIdLookup* lookup = (SongIdLookup*)ctx;
+    const char* path = songIndexPath(lookup->id);
+    if (!path) return false;
+    strncpy(lookup->path, path, sizeof(lookup->path) - 1);
+    lookup->path[sizeof(lookup->path) - 1] = '\0';
+    return true;
 }
 
 /**
- * Recursive directory traversal for file listing over UART
- * Transmits file paths and handles nested directory structures
- * Filters out system directories and hidden files
- * 
- * @param dir Directory handle for traversal
- * @param uart UART interface for file list transmission
- * @param basePath Current directory path for recursive calls
+ * Answers INSTRUCTION_OP_STATS with one line:
+ * STATS:{"binary":n,"text":n,"rejected":n,"frames":n,"headerErrors":n,"crcErrors":n,"rate":pct,"position":ms}
  */
-void listFilesRecursiveUart(SdFile& dir, Uart& uart, const char* basePath = "/") {
-    SdFile entry;
-    char name[64];
-    
-    while (entry.openNext(&dir, O_RDONLY)) {
-        entry.getName(name, sizeof(name));
-        if (entry.isDir()) {
-            // Skip system and hidden directories
-            if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0 && strcmp(name, "System Volume Information") != 0) {
-                // Construct subdirectory path for recursive traversal
-                char subDirPath[256];
-                snprintf(subDirPath, sizeof(subDirPath), "%s%s/", basePath, name);
-                listFilesRecursiveUart(entry, uart, subDirPath);
+static void sendInstructionStats(Uart& uart) {
+    const InstructionFrameDecoder& decoder = instructionDecoder;
+    char line[192];
+    snprintf(line, sizeof(line),
+             "STATS:{\"binary\":%lu,\"text\":%lu,\"rejected\":%lu,\"frames\":%lu,\"headerErrors\":%lu,"
+             "\"crcErrors\":%lu,\"rate\":%u,\"position\":%lu}\n",
+             (unsigned long)binaryInstructions, (unsigned long)textInstructions,
+             (unsigned long)rejectedInstructions, (unsigned long)decoder.frames,
+             (unsigned long)decoder.headerErrors, (unsigned long)decoder.crcErrors,
+             playbackRate(), playbackPosition());
+    if (xSemaphoreTake(instructionTxSemaphore, portMAX_DELAY)) {
+        uart.print(line);
+        xSemaphoreGive(instructionTxSemaphore);
+    }
+}
+
+/**
+ * Runs one binary instruction (instruction_ops.h), reading its arguments in place
+ *
+ * @return false if it was malformed or unknown
+ */
+static bool runBinaryInstruction(const uint8_t* payload, uint16_t length) {
+    InstructionOpReader reader(payload, length);
+    InstructionArg arg;
+    uint8_t op = reader.op();
+
+    if (op == INSTRUCTION_OP_LIST) {
+        static SongQuery query;
+        memset(&query, 0, sizeof(query));
+        query.limit = SONG_LIST_DEFAULT_LIMIT;
+        while (reader.next(arg)) {
+            const char* text;
+            switch (arg.type) {
+                case INSTRUCTION_ARG_REQUEST_ID: arg.asU8(query.requestId); break;
+                case INSTRUCTION_ARG_OFFSET: arg.asU16(query.offset); break;
+                case INSTRUCTION_ARG_LIMIT: arg.asU16(query.limit); break;
+                case INSTRUCTION_ARG_GENRE:
+                    if (arg.asString(text)) strncpy(query.genre, text, sizeof(query.genre) - 1);
+                    break;
+                case INSTRUCTION_ARG_ARTIST:
+                    if (arg.asString(text)) strncpy(query.artist, text, sizeof(query.artist) - 1);
+                    break;
+                case INSTRUCTION_ARG_TITLE:
+                    if (arg.asString(text)) strncpy(query.title, text, sizeof(query.title) - 1);
+                    break;
+            }
+        }
+        if (reader.malformed()) return false;
+        sendSongList(instructionUart, query);
+        return true;
+    }
+    if (op == INSTRUCTION_OP_RESCAN) {
+        Serial.println("Rebuilding song catalog");
+        sdCall(SD_PRIORITY_INSTRUCTION, rebuildCatalog, nullptr);
+        return true;
+    }
+    if (op == INSTRUCTION_OP_STATS) {
+        sendInstructionStats(instructionUart);
+        return true;
+    }
+
+    // Playback instructions: collect the arguments before taking the semaphore
+    const char* path = nullptr;
+    static SongIdLookup lookup;
+    bool hasId = false;
+    bool hasGeneration = false;
+    uint32_t generation = 0;
+    uint32_t position = 0;
+    uint16_t rate = 0;
+    bool valid = true;
+    while (reader.next(arg)) {
+        switch (arg.type) {
+            case INSTRUCTION_ARG_PATH: valid &= arg.asString(path); break;
+            case INSTRUCTION_ARG_SONG_ID: hasId = arg.asU16(lookup.id); valid &= hasId; break;
+            case INSTRUCTION_ARG_GENERATION: hasGeneration = arg.asU32(generation); valid &= hasGeneration; break;
+            case INSTRUCTION_ARG_POSITION: valid &= arg.asU32(position); break;
+            case INSTRUCTION_ARG_RATE: valid &= arg.asU16(rate); break;
+        }
+    }
+    if (!valid || reader.malformed()) return false;
+
+    if (op == INSTRUCTION_OP_PLAY && !path) {
+        // Catalog ids are slot numbers, only meaningful for the generation they were listed in
+        if (!hasId || (hasGeneration && generation != songIndexGeneration())) {
+            Serial.println("Play: no path, or catalog id from another generation");
+            return false;
+        }
+        if (!sdCall(SD_PRIORITY_INSTRUCTION, lookupSongId, &lookup)) {
+            Serial.printf("Play: no song with catalog id %u\n", lookup.id);
+            return false;
+        }
+        path = lookup.path;
+    }
+
+    bool ok = true;
+    if (xSemaphoreTake(playbackSemaphore, portMAX_DELAY)) {
+        switch (op) {
+            case INSTRUCTION_OP_PLAY:
+                playSong(path);
+                break;
+            case INSTRUCTION_OP_PAUSE:
+                pausePlayback();
+                Serial.println("Paused: isPaused true");
+                break;
+            case INSTRUCTION_OP_RESUME:
+                if (isPaused && currentSongPath[0]) resumePlayback();
+                break;
+            case INSTRUCTION_OP_SEEK:
+                if (isPlaying || isPaused) setPlaybackPosition(position);
+                break;
+            case INSTRUCTION_OP_RATE:
+                ok = setPlaybackRate(rate);
+                break;
+            default:
+                Serial.printf("Unknown instruction opcode 0x%02x\n", op);
+                ok = false;
+                break;
+        }
+        xSemaphoreGive(playbackSemaphore);
+    }
+    return ok;
+}
+
+/**
+ * Runs one text instruction: "[Play]{json}", "Pause", "List{json}" or "Rescan"
+ * Kept for senders that predate the binary instructions
+ *
+ * @param command NUL-terminated instruction payload
+ */
+static void runTextInstruction(char* command) {
+    Serial.print("Received command: ");
+    Serial.println(command);
+
+    // Handle List command (read-only SD operations)
+    if (strncmp(command, "List", 4) == 0) {
+        Serial.println("Processing file list request");
+        listFilesOnSDUart(instructionUart, command + 4); // Reads the catalog in batches through the SD server
+    }
+    // Handle Rescan command (rebuild catalog after editing the card offline)
+    else if (strncmp(command, "Rescan", 6) == 0) {
+        Serial.println("Rebuilding song catalog");
+        sdCall(SD_PRIORITY_INSTRUCTION, rebuildCatalog, nullptr);
+    }
+    // Handle Play and Pause commands (require playback state synchronization)
+    else if (xSemaphoreTake(playbackSemaphore, portMAX_DELAY)) {
+        if (strncmp(command, "[Play]", 6) == 0) {
+            // Parse JSON metadata with memory-safe document
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, command + 6);
+            if (error) {
+                Serial.println("Failed to parse command JSON");
+                Serial.print("Error: ");
+                Serial.println(error.c_str());
+            } else {
+                // Construct the full file path: /genre/artist/title.bin
+                char requestPath[128];
+                snprintf(requestPath, sizeof(requestPath), "/%s/%s/%s.bin",
+                         doc["genre"] | "", doc["artist"] | "", doc["title"] | "");
+                playSong(requestPath);
             }
+            doc.clear(); // Release JSON document memory
+        } else if (strncmp(command, "Pause", 5) == 0) {
+            // Handle pause command - save current playback position
+            pausePlayback();
+            Serial.println("Paused: isPaused true");
         } else {
-            // Transmit file information over UART
-            char filePath[256];
-            snprintf(filePath, sizeof(filePath), "%s%s", basePath, name);
-            
-            uart.print(filePath);
-            uart.print("\r\n");
-            uart.flush();
-            
-            // Mirror output to Serial for debugging
-            Serial.print(filePath);
-            Serial.print("\r\n");
-            Serial.flush();
+            Serial.println("Invalid command prefix");
+            rejectedInstructions++;
         }
-        entry.close();
+        
+        xSemaphoreGive(playbackSemaphore);
     }
 }
 
 /**
- * UART file listing interface for remote file system browsing
- * Provides complete directory structure over UART for external systems
- * 
- * @param uart UART interface for file list transmission
+ * Answers an instruction frame on the instruction UART
+ * Waits briefly for a STATUS line in progress; a skipped reply is made up
+ * for when the ESP32 retransmits
  */
-void listFilesOnSDUart(Uart& uart) {
-    SdFile root;
-    if (!root.open("/")) {
-        return; // Silent failure - root directory access failed
+static void sendInstructionAck(Uart& uart, uint8_t seq, uint8_t status) {
+    uint8_t reply[INSTRUCTION_ACK_SIZE];
+    instructionAckReply(reply, seq, status);
+    if (xSemaphoreTake(instructionTxSemaphore, pdMS_TO_TICKS(INSTRUCTION_ACK_WAIT_MS))) {
+        uart.write(reply, sizeof(reply));
+        xSemaphoreGive(instructionTxSemaphore);
     }
-    listFilesRecursiveUart(root, uart, "/");
-    root.close();
 }
 
 /**
- * Binary protocol instruction receiver with state machine implementation
- * Handles three-stage protocol: header detection, length parsing, payload processing
- * Supports play, pause, and list commands with JSON payload parsing
- * Thread-safe with semaphore protection for shared resources
- * 
- * Protocol format:
- * - Header: 0xAA (start byte)
- * - Length: 1 byte payload length
- * - Payload: Variable length command data
+ * Acknowledges decoded instruction frames and runs each instruction once
+ */
+struct InstructionRunner : InstructionFrameHandler {
+    Uart* uart = nullptr;
+    int lastSeq = -1; // Seq of the last instruction run
+
+    void onFrame(uint8_t flags, uint8_t seq, char* payload, uint16_t length) override {
+        // Acknowledged before running, so a long List reply does not hold it up
+        if (flags & INSTRUCTION_FLAG_ACK) {
+            sendInstructionAck(*uart, seq, INSTRUCTION_ACK_OK);
+        }
+        if ((flags & INSTRUCTION_FLAG_RETRY) && seq == lastSeq) {
+            Serial.println("Retransmitted instruction already run, skipping");
+            return;
+        }
+        lastSeq = seq;
+        if (flags & INSTRUCTION_FLAG_BINARY) {
+            binaryInstructions++;
+            if (!runBinaryInstruction((const uint8_t*)payload, length)) {
+                Serial.println("Rejected binary instruction");
+                rejectedInstructions++;
+            }
+        } else {
+            textInstructions++;
+            runTextInstruction(payload);
+        }
+    }
+
+    void onCorruptFrame(uint8_t flags, uint8_t seq) override {
+        Serial.println("Instruction frame failed CRC");
+        if (flags & INSTRUCTION_FLAG_ACK) {
+            sendInstructionAck(*uart, seq, INSTRUCTION_NACK_CRC);
+        }
+    }
+};
+
+/**
+ * Instruction receiver for the framed protocol in instruction_frame.h
+ * The decoder checks every frame (header CRC-8, payload CRC-16) and
+ * resynchronises on the next frame after line noise; a frame that stops
+ * arriving for INSTRUCTION_FRAME_BYTE_TIMEOUT ms is dropped
  * 
  * @param instrUart UART interface for command reception
  */
 void instructionReceiverRTOS(Uart &instrUart) {
-    // State machine states for reliable packet parsing
-    static enum { WAIT_FOR_HEADER, WAIT_FOR_LENGTH, WAIT_FOR_PAYLOAD } state = WAIT_FOR_HEADER;
-    static uint8_t length = 0;
-    static uint8_t receivedBytes = 0;
-    static uint8_t buffer[256];
-
-    if (instrUart.available()) {
-        uint8_t incomingByte = instrUart.read();
-
-        switch (state) {
-            case WAIT_FOR_HEADER:
-                // Look for protocol start byte
-                if (incomingByte == 0xAA) {
-                    state = WAIT_FOR_LENGTH;
-                    length = 0;
-                    receivedBytes = 0;
-                    Serial.println("Start byte received");
-                }
-                break;
-
-            case WAIT_FOR_LENGTH:
-                // Validate payload length
-                if (incomingByte > 0 && incomingByte <= sizeof(buffer)) {
-                    length = incomingByte;
-                    receivedBytes = 0;
-                    state = WAIT_FOR_PAYLOAD;
-                    Serial.print("Payload length: ");
-                    Serial.println(length);
-                } else {
-                    Serial.println("Invalid length, resetting");
-                    state = WAIT_FOR_HEADER;
-                }
-                break;
+    InstructionFrameDecoder& decoder = instructionDecoder;
+    static InstructionRunner runner;
+    static unsigned long lastByteTime = 0;
+    runner.uart = &instrUart;
 
-            case WAIT_FOR_PAYLOAD:
-                // Accumulate payload bytes
-                buffer[receivedBytes++] = incomingByte;
-                if (receivedBytes == length) {
-                    // Complete command received - process based on command type
-                    buffer[length] = '\0'; // Null-terminate for string operations
-                    Serial.print("Received command: ");
-                    Serial.println((char*)buffer);
-
-                    // Handle List command (read-only SD operations)
-                    if (strncmp((char*)buffer, "List", 4) == 0) {
-                        Serial.println("Processing file list request");
-                        if (xSemaphoreTake(sdSemaphore, portMAX_DELAY)) {
-                            listFilesOnSDUart(instructionUart);
-                            xSemaphoreGive(sdSemaphore);
-                        } else {
-                            Serial.println("Failed to take sdSemaphore in instructionReceiverRTOS");
-                        }
-                    }
-                    // Handle Play and Pause commands (require playback state synchronization)
-                    else if (xSemaphoreTake(playbackSemaphore, portMAX_DELAY)) {
-                        if (strncmp((char*)buffer, "[Play]", 6) == 0) {
-                            // Extract JSON payload from play command
-                            const char* jsonPart = (char*)buffer + 6;
-                        
-                            // Parse JSON metadata with memory-safe document
-                            JsonDocument doc;
-                            DeserializationError error = deserializeJson(doc, jsonPart);
-                            if (error) {
-                                Serial.println("Failed to parse command JSON");
-                                Serial.print("Error: ");
-                                Serial.println(error.c_str());
-                                doc.clear();
-                                state = WAIT_FOR_HEADER;
-                                xSemaphoreGive(playbackSemaphore);
-                                return;
-                            }
-                        
-                            // Extract song metadata from JSON
-                            const char* rawTitle = doc["title"];
-                            const char* rawArtist = doc["artist"];
-                            const char* rawGenre = doc["genre"];
-
-                            // Check if this matches the previously requested song
-                            bool isSameSong = (strcmp(rawTitle, prevTitle) == 0 &&
-                                                strcmp(rawArtist, prevArtist) == 0 &&
-                                                strcmp(rawGenre, prevGenre) == 0);
-
-                            if (isSameSong && isPaused && !newSongRequested) {
-                                // Resume previously paused song
-                                startTime = millis() - pauseOffset;
-                                isPlaying = true;
-                                isPaused = false;
-                                Serial.println("Resuming previous song (metadata matched)");
-                            }
-                            else {
-                                // Handle new song request or song change
-                                // Update metadata cache for future resume operations
-                                strncpy(prevTitle, rawTitle, sizeof(prevTitle) - 1);
-                                strncpy(prevArtist, rawArtist, sizeof(prevArtist) - 1);
-                                strncpy(prevGenre, rawGenre, sizeof(prevGenre) - 1);
-                                prevTitle[sizeof(prevTitle) - 1] = '\0';
-                                prevArtist[sizeof(prevArtist) - 1] = '\0';
-                                prevGenre[sizeof(prevGenre) - 1] = '\0';
-
-                                // Locate song file using metadata
-                                const char* filePath = findFileSimple(prevTitle, prevArtist, prevGenre);
-                                if (filePath) {
-                                    Serial.print("Found file: ");
-                                    Serial.println(filePath);
-
-                                    // Initialize new song playback state
-                                    strncpy(currentSongPath, filePath, sizeof(currentSongPath) - 1);
-                                    currentSongPath[sizeof(currentSongPath) - 1] = '\0';
-                                    newSongRequested = true;
-                                    isPlaying = true;
-                                    isPaused = false;
-                                    startTime = millis();
-                                    pauseOffset = 0; // Reset pause state for new song
-
-                                    Serial.println("Starting new song (interrupting current if any)");
-                                } else {
-                                    Serial.println("File not found with matching metadata");
-                                }
-                            }
-                            doc.clear(); // Release JSON document memory
-                        } else if (strncmp((char*)buffer, "Pause", 5) == 0) {
-                            // Handle pause command - save current playback position
-                            isPaused = true;
-                            pauseOffset = millis() - startTime;
-                            Serial.println("Paused: isPaused true");
-                        } else {
-                            Serial.println("Invalid command prefix");
-                        }
-                        
-                        xSemaphoreGive(playbackSemaphore);
-                    }
+    if (decoder.inFrame() && millis() - lastByteTime > INSTRUCTION_FRAME_BYTE_TIMEOUT) {
+        Serial.println("Instruction frame timed out, resynchronising");
+        decoder.abandon(runner);
+    }
 
-                    // Reset state machine for next message
-                    state = WAIT_FOR_HEADER;
-                }
-                break;
-        }
+    // Drain everything buffered so a command is not spread over many task periods
+    while (instrUart.available()) {
+        lastByteTime = millis();
+        decoder.push(instrUart.read(), runner);
     }
 }
 
@@ -325,6 +460,9 @@ void listFilesOnSD() {
  * File transfer protocol state enumeration
  * Defines stages of binary file reception process
  */
+#define DELTA_BLOCK_SIZE 128              // Block size for delta uploads
+#define DELTA_TEMP_PATH "/.delta.tmp"     // Assembly file for delta uploads
+
 enum ReceiveState{
     PARSE_HEADER,       // Waiting for transfer initiation
     OPEN_FILE,          // Creating file and directory structure
@@ -333,9 +471,55 @@ enum ReceiveState{
     DONE                // Transfer completion
 };
 
+#define DIR_CACHE_SIZE 128   // Known-directory slots, power of two
+
 /**
- * Thread-safe directory creation with incremental path building
+ * Set of directories known to exist, keyed by a 64-bit hash of the path
+ * Open addressing with linear probing; 0 marks an empty slot
+ * Only the file receiver task creates directories, and the firmware never
+ * removes them, so entries stay valid until reboot
+ */
+static uint64_t knownDirs[DIR_CACHE_SIZE];
+static uint16_t knownDirCount = 0;
+
+static uint64_t dirKey(const char* path) {
+    uint64_t key = songHashUpdate(SONG_HASH_SEED, (const uint8_t*)path, strlen(path));
+    return key ? key : 1;
+}
+
+static bool dirKnown(const char* path) {
+    uint64_t key = dirKey(path);
+    for (uint16_t i = 0, slot = key & (DIR_CACHE_SIZE - 1); i < DIR_CACHE_SIZE; i++) {
+        if (knownDirs[slot] == key) return true;
+        if (knownDirs[slot] == 0) return false;
+        slot = (slot + 1) & (DIR_CACHE_SIZE - 1);
+    }
+    return false;
+}
+
+// Drops every entry, e.g. after the card changed underneath the cache
+static void forgetKnownDirs() {
+    memset(knownDirs, 0, sizeof(knownDirs));
+    knownDirCount = 0;
+}
+
+static void rememberDir(const char* path) {
+    if (knownDirCount >= DIR_CACHE_SIZE * 3 / 4) return; // Keep probes short; uncached dirs still work
+    uint64_t key = dirKey(path);
+    uint16_t slot = key & (DIR_CACHE_SIZE - 1);
+    while (knownDirs[slot] != 0) {
+        if (knownDirs[slot] == key) return;
+        slot = (slot + 1) & (DIR_CACHE_SIZE - 1);
+    }
+    knownDirs[slot] = key;
+    knownDirCount++;
+}
+
+/**
+ * Directory creation with incremental path building
  * Creates nested directory structure as needed for file storage
+ * Directories already seen are answered from an in-RAM cache, so uploads
+ * into an existing genre/artist do no directory I/O
  * Uses static buffers to avoid dynamic memory allocation
  * 
  * @param fullPath Complete file path including directory hierarchy
@@ -359,6 +543,11 @@ bool createDirectoriesRTOS_static(const char* fullPath) {
     strncpy(dirPath, fullPath, dirLen);
     dirPath[dirLen] = '\0';
 
+    // Common case: the whole directory chain was created or seen before
+    if (dirKnown(dirPath)) {
+        return true;
+    }
+
     // Build directory path incrementally
     char tempPath[128] = "";
     char* token;
@@ -382,19 +571,13 @@ bool createDirectoriesRTOS_static(const char* fullPath) {
         strcat(tempPath, token);
 
         // Create directory if it doesn't exist
-        if (xSemaphoreTake(sdSemaphore, portMAX_DELAY)) {
-            if (!sd.exists(tempPath)) {
-                if (!sd.mkdir(tempPath)) {
-                    Serial.print("Failed to create: ");
-                    Serial.println(tempPath);
-                    xSemaphoreGive(sdSemaphore);
-                    return false;
-                }
+        if (!dirKnown(tempPath)) {
+            if (!sdExists(SD_PRIORITY_UPLOAD, tempPath) && !sdMkdir(SD_PRIORITY_UPLOAD, tempPath)) {
+                Serial.print("Failed to create: ");
+                Serial.println(tempPath);
+                return false;
             }
-            xSemaphoreGive(sdSemaphore);
-        } else {
-            Serial.println("Failed to take sdSemaphore in createDirectoriesRTOS_static");
-            return false;
+            rememberDir(tempPath);
         }
 
         token = strtok_r(NULL, "/", &saveptr);
@@ -403,16 +586,227 @@ bool createDirectoriesRTOS_static(const char* fullPath) {
     return true;
 }
 
+/**
+ * Block checksums for delta uploads (must match delta_sync.cpp on the ESP32)
+ * Weak sum is the rsync rolling checksum, strong sum is FNV-1a 32-bit
+ */
+static uint32_t deltaWeakSum(const uint8_t* data, size_t len) {
+    uint32_t a = 0, b = 0;
+    for (size_t i = 0; i < len; i++) {
+        a += data[i];
+        b += (uint32_t)(len - i) * data[i];
+    }
+    return (a & 0xffff) | (b << 16);
+}
+
+static uint32_t deltaStrongSum(const uint8_t* data, size_t len) {
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+/**
+ * Streams per-block checksums of the file currently stored at a path
+ * Replies ACK:START:DELTA:<size>:<blocks> followed by 8 raw bytes per block
+ * (weak sum, strong sum, little-endian)
+ *
+ * @param fileUart UART interface to the uploader
+ * @param path Path of the existing file
+ * @param newSize Size of the incoming file
+ * @return true if checksums were sent and the transfer continues in delta mode
+ */
+static bool sendBlockSums(Uart &fileUart, const char* path, size_t newSize) {
+    static uint8_t block[DELTA_BLOCK_SIZE];
+    File oldFile;
+    uint32_t blocks = 0;
+
+    if (sdOpen(SD_PRIORITY_UPLOAD, oldFile, path, O_RDONLY)) {
+        blocks = oldFile.size() / DELTA_BLOCK_SIZE;
+    }
+
+    if (blocks == 0) {
+        sdClose(SD_PRIORITY_UPLOAD, oldFile);
+        return false;
+    }
+
+    fileUart.printf("ACK:START:DELTA:%u:%lu\n", newSize, (unsigned long)blocks);
+    for (uint32_t i = 0; i < blocks; i++) {
+        int got = sdRead(SD_PRIORITY_UPLOAD, oldFile, block, DELTA_BLOCK_SIZE);
+        // A short read still produces a (non-matching) entry to keep the count
+        uint32_t weak = got == DELTA_BLOCK_SIZE ? deltaWeakSum(block, DELTA_BLOCK_SIZE) : 0;
+        uint32_t strong = got == DELTA_BLOCK_SIZE ? deltaStrongSum(block, DELTA_BLOCK_SIZE) : 0;
+        uint8_t packed[8] = {
+            (uint8_t)weak, (uint8_t)(weak >> 8), (uint8_t)(weak >> 16), (uint8_t)(weak >> 24),
+            (uint8_t)strong, (uint8_t)(strong >> 8), (uint8_t)(strong >> 16), (uint8_t)(strong >> 24)
+        };
+        fileUart.write(packed, sizeof(packed));
+    }
+
+    sdClose(SD_PRIORITY_UPLOAD, oldFile);
+    Serial.printf("Delta transfer: sent %lu block sums\n", (unsigned long)blocks);
+    return true;
+}
+
+/**
+ * Content lookup arguments for the catalog operations run on the SD server
+ */
+struct ContentMatch {
+    const char* path;
+    uint64_t hash;
+    uint32_t size;
+    char storedPath[128];
+};
+
+static bool findStoredContent(void* ctx) {
+    ContentMatch* c = (ContentMatch*)ctx;
+    return songIndexFindContent(c->hash, c->size, c->storedPath, sizeof(c->storedPath));
+}
+
+static bool addContentAlias(void* ctx) {
+    ContentMatch* c = (ContentMatch*)ctx;
+    songIndexForget(c->path);
+    if (sd.exists(c->path)) {
+        sd.remove(c->path); // Stale bytes would shadow the alias
+    }
+    return songIndexAdd(c->hash, c->size, c->path, c->storedPath);
+}
+
+/**
+ * Deduplication check for an announced upload
+ * Acknowledges content that is already on the card, recording an alias
+ * entry when it is stored under a different path
+ *
+ * @param path Destination path announced in the START header
+ * @param hash Announced content hash
+ * @param size Announced content size
+ * @return true if the upload can be skipped
+ */
+static bool acceptExistingContent(const char* path, uint64_t hash, uint32_t size) {
+    static ContentMatch content;
+    content.path = path;
+    content.hash = hash;
+    content.size = size;
+
+    if (!sdCall(SD_PRIORITY_UPLOAD, findStoredContent, &content)) return false;
+    if (strcmp(content.storedPath, path) == 0) return true;
+
+    // Directories are created so the alias can later be promoted with a rename
+    if (!createDirectoriesRTOS_static(path)) {
+        return false;
+    }
+
+    return sdCall(SD_PRIORITY_UPLOAD, addContentAlias, &content);
+}
+
+/**
+ * Catalog and file operations of the receiver, run on the SD server task
+ * so each sequence is atomic with respect to other SD users
+ */
+struct UploadTarget {
+    File* file;
+    File* oldFile;
+    const char* path;
+    uint64_t hash;
+    size_t size;
+    bool verified;
+};
+
+// Drops the old catalog entry (existing content is replaced, not appended to) and creates the file
+static bool openUploadFile(void* ctx) {
+    UploadTarget* t = (UploadTarget*)ctx;
+    songIndexForget(t->path);
+    *t->file = sd.open(t->path, O_WRONLY | O_CREAT | O_TRUNC);
+    return *t->file;
+}
+
+static bool finishUpload(void* ctx) {
+    UploadTarget* t = (UploadTarget*)ctx;
+    if (*t->file) t->file->close();
+    return songIndexAdd(t->hash, t->size, t->path, nullptr);
+}
+
+// Removes a received file whose content does not match the announced hash
+static bool discardUpload(void* ctx) {
+    UploadTarget* t = (UploadTarget*)ctx;
+    if (*t->file) t->file->close();
+    return sd.remove(t->path);
+}
+
+// Swaps the assembled delta file in only if it matches the announced content
+static bool finishDeltaUpload(void* ctx) {
+    UploadTarget* t = (UploadTarget*)ctx;
+    if (*t->file) t->file->close();
+    if (*t->oldFile) t->oldFile->close();
+    if (!t->verified) {
+        sd.remove(DELTA_TEMP_PATH);
+        return false;
+    }
+    songIndexForget(t->path);
+    if (sd.exists(t->path)) {
+        sd.remove(t->path);
+    }
+    if (!sd.rename(DELTA_TEMP_PATH, t->path)) return false;
+    songIndexAdd(t->hash, t->size, t->path, nullptr);
+    return true;
+}
+
+/**
+ * Splits the :CRC:<hex> field off an upload line
+ * The CRC-16 (instructionCrc16()) covers the line text before the field and
+ * continues over the data that follows a CHUNK line
+ *
+ * @param crc Receives the CRC-16 of the text before the field
+ * @param expected Receives the CRC the uploader sent
+ * @return false if the line has no CRC field
+ */
+static bool splitLineCrc(char* line, uint16_t& crc, uint16_t& expected) {
+    char* field = strstr(line, ":CRC:");
+    if (!field) return false;
+    expected = strtoul(field + 5, NULL, 16);
+    crc = instructionCrc16((const uint8_t*)line, field - line);
+    *field = '\0';
+    return true;
+}
+
+// True if an upload line without data is intact; the CRC field is removed
+static bool lineCrcOk(char* line) {
+    uint16_t crc, expected;
+    return splitLineCrc(line, crc, expected) && crc == expected;
+}
+
 /**
  * Binary file receiver with chunked protocol implementation
  * Implements reliable file transfer with acknowledgment and retry mechanisms
  * Handles large files through chunked transmission with timeout protection
  * 
+ * Every line the uploader sends ends in :CRC:<hex> (splitLineCrc()); a line
+ * that fails it is ignored and the uploader's reply timeout resends it
+ *
  * Protocol stages:
- * 1. Header parsing: START:<filepath>:<size>
+ * 1. Header parsing: START:<filepath>:SIZE:<size>[:HASH:<hex>]
+ *    If the announced content hash is already indexed the receiver replies
+ *    ACK:START:HAVE:<size> and no chunks are sent
  * 2. File creation with directory structure
- * 3. Chunk reception: CHUNK:<id>:<size> followed by binary data
- * 4. Completion with file closure and cleanup
+ * 3. Chunk reception: CHUNK:<id>:SIZE:<size> followed by binary data,
+ *    answered by ACK:CHUNK:<id> once the data is written or deferred (the
+ *    uploader sends the next chunk only then, so a blocked write throttles
+ *    it). A chunk whose data fails the CRC is dropped unacknowledged
+ *    A header without a hash (streamed upload) is followed by HASH:<hex>
+ *    once the last chunk is acknowledged
+ * 4. Completion: the file is indexed and ACK:DONE sent only if the received
+ *    content matches the hash; otherwise it is removed and the reply is
+ *    ERROR:HASH_MISMATCH, so the uploader can send it again
+ *    If the last chunk's ACK is lost, the resent chunk gets its ACK and the
+ *    verdict again
+ *
+ * Delta mode (header carries :DELTA and a file already exists at the path):
+ * the receiver streams block sums, then accepts COPY:<id>:<block>:<count>
+ * ops that reuse old blocks interleaved with CHUNK literals. The new file is
+ * assembled in DELTA_TEMP_PATH and replaces the old one once its content hash
+ * matches the announced hash (ACK:DELTA:OK, otherwise ERROR:DELTA_MISMATCH)
  * 
  * @param fileUart UART interface for file data reception
  */
@@ -426,23 +820,35 @@ void fileReceiverRTOS_char(Uart &fileUart){
     static uint16_t chunkId = 0;
     static size_t receivedBytes = 0;
     static File file;
+    static File oldFile;                 // Existing file read by COPY ops in delta mode
+    static bool deltaMode = false;
     static unsigned long lastByteTime = 0;
     static const unsigned long TIMEOUT = 5000; // 5 second timeout
     
     // Chunk accumulation counter (function scope for proper state management)
     static size_t bytesAccumulated = 0;
+    static uint16_t chunkCrc = 0;          // CRC-16 of the chunk line, continued over its data
+    static uint16_t chunkCrcExpected = 0;
 
-    // State reset helper function for error recovery
-    auto resetState = [&]() {
-        // Clean up file handle with thread safety
-        if (xSemaphoreTake(sdSemaphore, portMAX_DELAY)) {
-            if (file) {
-                file.close();
-            }
-            xSemaphoreGive(sdSemaphore);
-        }
+    // Content hash tracking for the song index
+    static uint64_t contentHash = SONG_HASH_SEED;
+    static uint64_t announcedHash = 0;
+    static bool hashAnnounced = false;
+
+    // Verdict of the last finished transfer and its last chunk id
+    static char verdict[24] = "";
+    static uint16_t verdictChunk = 0;
+
+    // State reset helper, after an error or a finished transfer
+    // A finished transfer keeps the input: the uploader sends the next
+    // queued file's header right after the last chunk ACK
+    auto resetState = [&](bool dropInput) {
+        // Drop deferred writes, then clean up file handles through the SD server
+        qosDiscard();
+        sdClose(SD_PRIORITY_UPLOAD, file);
+        sdClose(SD_PRIORITY_UPLOAD, oldFile);
         // Clear UART buffer of any remaining data
-        while (fileUart.available()) {
+        while (dropInput && fileUart.available()) {
             fileUart.read();
         }
         // Reset all state variables
@@ -452,9 +858,22 @@ void fileReceiverRTOS_char(Uart &fileUart){
         filePath[0] = '\0';
         chunkSize = 0;
         bytesAccumulated = 0;
+        contentHash = SONG_HASH_SEED;
+        hashAnnounced = false;
+        deltaMode = false;
+        verdict[0] = '\0';
         state = PARSE_HEADER;
     };
 
+    // Ends a transfer; the verdict is kept for a resent last chunk
+    auto sendVerdict = [&](const char* reply) {
+        uint16_t lastChunk = chunkId - 1;
+        fileUart.println(reply);
+        resetState(false);
+        snprintf(verdict, sizeof(verdict), "%s", reply);
+        verdictChunk = lastChunk;
+    };
+
     // Timeout protection for stalled transfers
     if (state != PARSE_HEADER && millis() - lastByteTime > TIMEOUT) {
         Serial.println("Transfer timeout");
@@ -462,7 +881,14 @@ void fileReceiverRTOS_char(Uart &fileUart){
         while (fileUart.available()) {
             fileUart.read(); // Clear buffer
         }
-        resetState();
+        resetState(true);
+        return;
+    }
+
+    // Commit deferred chunk data when playback leaves enough slack
+    if ((state == PARSE_CHUNK_HEADER || state == READ_CHUNK) && !qosPoll(file)) {
+        fileUart.println("ERROR:WRITE_FAILED");
+        resetState(true);
         return;
     }
 
@@ -482,8 +908,21 @@ void fileReceiverRTOS_char(Uart &fileUart){
                 }
                 
                 lastByteTime = millis();
+
+                // Last chunk or hash of the finished transfer again: its reply was lost
+                if (verdict[0] && (strncmp(headerBuffer, "CHUNK:", 6) == 0 || strncmp(headerBuffer, "COPY:", 5) == 0 ||
+                                   strncmp(headerBuffer, "HASH:", 5) == 0)) {
+                    const char* id = strchr(headerBuffer, ':') + 1;
+                    if (headerBuffer[0] != 'H') {
+                        if (strtoul(id, NULL, 10) != verdictChunk) break;
+                        fileUart.printf("ACK:CHUNK:%u\n", verdictChunk);
+                    }
+                    fileUart.println(verdict);
+                    break;
+                }
                 
-                if (strncmp(headerBuffer, "START:", 6) == 0){
+                if (strncmp(headerBuffer, "START:", 6) == 0 && lineCrcOk(headerBuffer)){
+                    verdict[0] = '\0'; // A new transfer supersedes it
                     // Parse START:<filepath>:<size> format
                     char* firstColon = strchr(headerBuffer + 6, ':');
                     char* secondColon = firstColon ? strchr(firstColon + 1, ':') : nullptr;
@@ -498,13 +937,29 @@ void fileReceiverRTOS_char(Uart &fileUart){
                         
                         // Extract and validate file size
                         fileSize = strtoul(secondColon + 1, NULL, 10);
+
+                        // Optional content hash for deduplication
+                        const char* hashField = strstr(secondColon + 1, ":HASH:");
+                        hashAnnounced = (hashField != nullptr);
+                        announcedHash = hashAnnounced ? strtoull(hashField + 6, NULL, 16) : 0;
+                        bool deltaRequested = hashAnnounced && strstr(secondColon + 1, ":DELTA") != nullptr;
                         
                         if (fileSize > 0 && fileSize < 10485760) { // 10MB limit
+                            if (hashAnnounced && acceptExistingContent(filePath, announcedHash, fileSize)) {
+                                Serial.printf("Transfer skipped, content already stored: %s\n", filePath);
+                                fileUart.printf("ACK:START:HAVE:%u\n", fileSize);
+                                hashAnnounced = false;
+                                break;
+                            }
                             Serial.printf("Transfer start: %s (%u bytes)\n", filePath, fileSize);
-                            fileUart.printf("ACK:START:SIZE:%u\n", fileSize);
+                            deltaMode = deltaRequested && sendBlockSums(fileUart, filePath, fileSize);
+                            if (!deltaMode) {
+                                fileUart.printf("ACK:START:SIZE:%u\n", fileSize);
+                            }
                             receivedBytes = 0;
                             chunkId = 0;
                             bytesAccumulated = 0;
+                            contentHash = SONG_HASH_SEED;
                             state = OPEN_FILE;
                         } else {
                             fileUart.println("ERROR:INVALID_SIZE");
@@ -517,29 +972,46 @@ void fileReceiverRTOS_char(Uart &fileUart){
             break;
 
         case OPEN_FILE:
+            // Delta mode assembles into a temp file while reading the old one
+            if (deltaMode) {
+                if (sdOpen(SD_PRIORITY_UPLOAD, oldFile, filePath, O_RDONLY) &&
+                    sdOpen(SD_PRIORITY_UPLOAD, file, DELTA_TEMP_PATH, O_WRONLY | O_CREAT | O_TRUNC)) {
+                    lastByteTime = millis();
+                    state = PARSE_CHUNK_HEADER;
+                } else {
+                    fileUart.println("ERROR:FILE_OPEN_FAILED");
+                    resetState(true);
+                }
+                break;
+            }
+
             // Create directory structure and open file for writing
             if (!createDirectoriesRTOS_static(filePath)){
-                resetState();
+                resetState(true);
                 return;
             }
             
-            if (xSemaphoreTake(sdSemaphore, portMAX_DELAY)){
-                file = sd.open(filePath, FILE_WRITE);
-                if(file){
+            {
+                UploadTarget target = {&file, &oldFile, filePath, 0, 0, false};
+                bool opened = sdCall(SD_PRIORITY_UPLOAD, openUploadFile, &target);
+                if (!opened && knownDirCount > 0) {
+                    // A cached directory may be gone (card replaced) - check the path again
+                    forgetKnownDirs();
+                    opened = createDirectoriesRTOS_static(filePath) &&
+                             sdCall(SD_PRIORITY_UPLOAD, openUploadFile, &target);
+                }
+                if (opened) {
                     lastByteTime = millis();
                     state = PARSE_CHUNK_HEADER;
                 } else {
                     fileUart.println("ERROR:FILE_OPEN_FAILED");
-                    resetState();
+                    resetState(true);
                 }
-                xSemaphoreGive(sdSemaphore);
-            } else {
-                resetState();
             }
             break;
 
         case PARSE_CHUNK_HEADER:
-            // Parse chunk metadata: CHUNK:<id>:<size>
+            // Parse chunk metadata: CHUNK:<id>:SIZE:<size>:CRC:<hex>
             if (fileUart.available()){
                 lastByteTime = millis();
                 
@@ -560,18 +1032,33 @@ void fileReceiverRTOS_char(Uart &fileUart){
                     break;
                 }
                 
+                uint16_t lineCrc = 0, lineCrcExpected = 0;
+                if (!splitLineCrc(chunkHeaderBuffer, lineCrc, lineCrcExpected)) break;
+                bool lineOk = lineCrc == lineCrcExpected;
+
+                // Content hash of a streamed upload, after its last chunk
+                if (strncmp(chunkHeaderBuffer, "HASH:", 5) == 0) {
+                    if (lineOk && receivedBytes >= fileSize) {
+                        announcedHash = strtoull(chunkHeaderBuffer + 5, NULL, 16);
+                        hashAnnounced = true;
+                        state = DONE;
+                    }
+                    break;
+                }
+
                 if (strncmp(chunkHeaderBuffer, "CHUNK:", 6) == 0){
-                    // Parse CHUNK:<id>:<size> format
+                    // Parse CHUNK:<id>:SIZE:<size> format (CRC field split off above)
                     char* firstColon = strchr(chunkHeaderBuffer + 6, ':');
                     char* secondColon = firstColon ? strchr(firstColon + 1, ':') : nullptr;
                     
                     if (firstColon && secondColon){
                         uint16_t receivedId = strtoul(chunkHeaderBuffer + 6, NULL, 10);
                         chunkSize = strtoul(secondColon + 1, NULL, 10);
+                        chunkCrc = lineCrc;
+                        chunkCrcExpected = lineCrcExpected;
                         
                         if (receivedId == chunkId && chunkSize > 0 && chunkSize <= 128){
-                            // Expected chunk received
-                            fileUart.printf("ACK:CHUNK:%u\n", chunkId);
+                            // Expected chunk - acknowledged once its data is written
                             bytesAccumulated = 0;
                             state = READ_CHUNK;
                         } else if (receivedId < chunkId) {
@@ -579,6 +1066,47 @@ void fileReceiverRTOS_char(Uart &fileUart){
                             fileUart.printf("ACK:CHUNK:%u\n", receivedId);
                         } 
                     }
+                } else if (deltaMode && lineOk && strncmp(chunkHeaderBuffer, "COPY:", 5) == 0) {
+                    // Parse COPY:<id>:<block>:<count> - reuse blocks of the old file
+                    char* idEnd = nullptr;
+                    uint16_t receivedId = strtoul(chunkHeaderBuffer + 5, &idEnd, 10);
+                    char* blockEnd = nullptr;
+                    uint32_t block = (idEnd && *idEnd == ':') ? strtoul(idEnd + 1, &blockEnd, 10) : 0;
+                    uint32_t count = (blockEnd && *blockEnd == ':') ? strtoul(blockEnd + 1, NULL, 10) : 0;
+
+                    if (receivedId < chunkId) {
+                        fileUart.printf("ACK:CHUNK:%u\n", receivedId);
+                        break;
+                    }
+                    if (receivedId != chunkId || count == 0 ||
+                        receivedBytes + (size_t)count * DELTA_BLOCK_SIZE > fileSize) {
+                        break; // Ignored - the uploader retransmits on timeout
+                    }
+
+                    bool copyOk = true;
+                    for (uint32_t i = 0; i < count && copyOk; i++) {
+                        // One request per block so queued playback reads go first
+                        copyOk = sdRead(SD_PRIORITY_UPLOAD, oldFile, buffer, DELTA_BLOCK_SIZE,
+                                        (block + i) * DELTA_BLOCK_SIZE) == DELTA_BLOCK_SIZE &&
+                                 qosWrite(file, buffer, DELTA_BLOCK_SIZE, false) == DELTA_BLOCK_SIZE;
+                        if (copyOk) {
+                            contentHash = songHashUpdate(contentHash, buffer, DELTA_BLOCK_SIZE);
+                        }
+                    }
+                    lastByteTime = millis();
+
+                    if (!copyOk) {
+                        fileUart.println("ERROR:WRITE_FAILED");
+                        resetState(true);
+                        break;
+                    }
+
+                    fileUart.printf("ACK:CHUNK:%u\n", chunkId);
+                    chunkId++;
+                    receivedBytes += (size_t)count * DELTA_BLOCK_SIZE;
+                    if (receivedBytes >= fileSize) {
+                        state = DONE;
+                    }
                 }
             }
             break;
@@ -590,27 +1118,28 @@ void fileReceiverRTOS_char(Uart &fileUart){
                 lastByteTime = millis();
             }
             
-            if (bytesAccumulated >= chunkSize){
-                // Complete chunk received - write to file
-                bool writeSuccess = false;
-                
-                if (xSemaphoreTake(sdSemaphore, portMAX_DELAY)){
-                    size_t written = file.write(buffer, chunkSize);
-                    file.flush(); // Ensure data is written to SD card
-                    xSemaphoreGive(sdSemaphore);
-                    
-                    writeSuccess = (written == chunkSize);
-                }
+            if (bytesAccumulated >= chunkSize && instructionCrc16(buffer, chunkSize, chunkCrc) != chunkCrcExpected){
+                // Corrupted on the line - no ACK, the uploader resends this chunk
+                Serial.printf("Chunk %u failed CRC, dropped\n", chunkId);
+                bytesAccumulated = 0;
+                state = PARSE_CHUNK_HEADER;
+            } else if (bytesAccumulated >= chunkSize){
+                // Complete chunk received - write and flush, or defer while playing
+                // (the only ACK of this chunk waits for this, which throttles the uploader)
+                bool writeSuccess = qosWrite(file, buffer, chunkSize, true) == chunkSize;
+                lastByteTime = millis();
                 
                 if (writeSuccess) {
                     // Successful write - acknowledge and advance
+                    contentHash = songHashUpdate(contentHash, buffer, chunkSize);
                     fileUart.printf("ACK:CHUNK:%u\n", chunkId);
                     chunkId++;
                     bytesAccumulated = 0;
                     receivedBytes += chunkSize;
                     
                     if (receivedBytes >= fileSize){
-                        state = DONE; // Transfer complete
+                        // Transfer complete; a streamed upload still sends its hash
+                        state = hashAnnounced ? DONE : PARSE_CHUNK_HEADER;
                     } else {
                         state = PARSE_CHUNK_HEADER; // Continue with next chunk
                     }
@@ -618,21 +1147,44 @@ void fileReceiverRTOS_char(Uart &fileUart){
                     // Write failure - reset and report error
                     bytesAccumulated = 0;
                     fileUart.println("ERROR:WRITE_FAILED");
-                    resetState();
+                    resetState(true);
                 }
             }
             break;
 
         case DONE:
-            // Transfer completion - cleanup and reset
-            if (xSemaphoreTake(sdSemaphore, portMAX_DELAY)){
-                if (file) file.close();
-                xSemaphoreGive(sdSemaphore);
+            // Transfer completion - cleanup, index content and reset
+            if (!qosCommit(file)) {
+                fileUart.println("ERROR:WRITE_FAILED");
+                resetState(true);
+                break;
             }
-            
+
+            if (deltaMode) {
+                // Swap the assembled file in only if it matches the announced content
+                UploadTarget target = {&file, &oldFile, filePath, contentHash, receivedBytes,
+                                       contentHash == announcedHash};
+                bool verified = sdCall(SD_PRIORITY_UPLOAD, finishDeltaUpload, &target);
+                Serial.printf("Delta transfer %s: %s\n", verified ? "complete" : "failed", filePath);
+                sendVerdict(verified ? "ACK:DELTA:OK" : "ERROR:DELTA_MISMATCH");
+                break;
+            }
+
+            {
+                // Only content that matches the announced hash is indexed
+                UploadTarget target = {&file, &oldFile, filePath, contentHash, receivedBytes,
+                                       contentHash == announcedHash};
+                if (!target.verified) {
+                    sdCall(SD_PRIORITY_UPLOAD, discardUpload, &target);
+                    Serial.printf("Transfer failed, content hash mismatch: %s\n", filePath);
+                    sendVerdict("ERROR:HASH_MISMATCH");
+                    break;
+                }
+                sdCall(SD_PRIORITY_UPLOAD, finishUpload, &target);
+            }
+
             Serial.printf("Transfer complete: %s (%u bytes)\n", filePath, receivedBytes);
-            
-            resetState();
+            sendVerdict("ACK:DONE");
             break;
     }   
 }
\ No newline at end of file
@@ -3,6 +3,9 @@
 
 #include <Arduino.h>
 
+#define INSTRUCTION_FRAME_BYTE_TIMEOUT 50  // Gap that drops an instruction frame in progress (ms)
+#define INSTRUCTION_ACK_WAIT_MS 20         // Longest an ACK waits for the instruction UART
+
 /**
  * UART Communication System for Guitar Control Interface
  * Handles file transfer, command processing, and SD card file management
@@ -16,37 +19,31 @@
 void listFilesOnSD();
 
 /**
- * Lists all files on SD card over specified UART interface
+ * Lists one page of songs on SD card over specified UART interface
  * Used for remote file system browsing via UART commands
+ * Served from the song catalog, so files copied onto the card
+ * without an upload appear only after a Rescan command
+ * Response format is documented with songIndexList()
  * 
  * @param uart UART interface for file list transmission
+ * @param args Optional JSON paging/filter arguments following the List command
  */
-void listFilesOnSDUart(Uart& uart);
+void listFilesOnSDUart(Uart& uart, const char* args);
 
 /**
  * Main instruction receiver for real-time command processing
- * Handles binary protocol messages for play, pause, and list commands
- * Implements state machine for reliable packet parsing
+ * Handles framed messages (instruction_frame.h), acknowledging each frame
+ * that asks for it: binary instructions (instruction_ops.h) parsed in place,
+ * and the text commands ("[Play]{json}", "Pause", "List{json}", "Rescan")
  * 
  * @param instrUart UART interface for incoming command messages
  */
 void instructionReceiverRTOS(Uart &instrUart);
 
-/**
- * File search function for locating songs by metadata
- * Constructs file paths using genre/artist/title hierarchy
- * Returns full path to binary song file if found
- * 
- * @param title Song title for file search
- * @param artist Artist name for directory navigation
- * @param genre Genre category for top-level directory
- * @return Full file path if found, nullptr if not found
- */
-const char* findFileSimple(const char* title, const char* artist, const char* genre);
-
 /**
  * Creates directory structure recursively for file storage
- * Thread-safe implementation with semaphore protection for SD access
+ * SD access goes through the SD server; directories already known to exist
+ * are answered from RAM, so only new genres/artists touch the card
  * Used during file transfer operations to ensure directory hierarchy exists
  * 
  * @param fullPath Complete file path including directory structure
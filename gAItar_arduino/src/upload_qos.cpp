@@ -0,0 +1,130 @@
+#include "upload_qos.h"
+#include "sd_server.h"
+#include <FreeRTOS_SAMD51.h>
+
+volatile bool uploadQosEnabled = true;
+volatile bool uploadQosSlackWait = true;
+
+// Playback side (written by the playback task)
+static volatile bool playbackActive = false;
+static volatile unsigned long nextDueMs = 0;
+static QosDeadlineStats deadlineStats = {0, 0, 0};
+
+// Upload side (file receiver task only)
+static uint8_t pending[UPLOAD_QOS_BUFFER_SIZE];
+static size_t pendingLen = 0;
+static uint32_t commitEstimateUs = UPLOAD_QOS_INITIAL_COMMIT_US;
+static uint32_t deferredCommits = 0;
+static uint32_t forcedCommits = 0;
+
+void qosNextEvent(unsigned long dueMs) {
+    nextDueMs = dueMs;
+    playbackActive = true;
+}
+
+void qosPlaybackStopped() {
+    playbackActive = false;
+}
+
+void qosRecordEvent(unsigned long dueMs) {
+    long late = (long)(millis() - dueMs);
+    deadlineStats.events++;
+    if (late > UPLOAD_QOS_MISS_MS) {
+        deadlineStats.missed++;
+    }
+    if (late > 0 && (uint32_t)late > deadlineStats.maxLateMs) {
+        deadlineStats.maxLateMs = late;
+    }
+}
+
+QosDeadlineStats qosTakeDeadlineStats() {
+    QosDeadlineStats stats = deadlineStats;
+    deadlineStats = {0, 0, 0};
+    return stats;
+}
+
+void qosReportDeadlines(Print& out) {
+    QosDeadlineStats stats = qosTakeDeadlineStats();
+    out.printf("Playback deadlines: %lu events, %lu missed (> %d ms late), worst %lu ms\n",
+               (unsigned long)stats.events, (unsigned long)stats.missed, UPLOAD_QOS_MISS_MS,
+               (unsigned long)stats.maxLateMs);
+    out.printf("Upload commits during playback: %lu in slack, %lu forced\n",
+               (unsigned long)deferredCommits, (unsigned long)forcedCommits);
+    deferredCommits = 0;
+    forcedCommits = 0;
+}
+
+/**
+ * True when a commit can run now without delaying the next playback event
+ */
+static bool slackAvailable() {
+    if (!uploadQosEnabled || !playbackActive || !uploadQosSlackWait) return true;
+    long slackMs = (long)(nextDueMs - millis());
+    return slackMs > 0 && (uint32_t)slackMs * 1000 >= commitEstimateUs + UPLOAD_QOS_MARGIN_US;
+}
+
+/**
+ * Writes and flushes the buffered bytes as one SD server request,
+ * updating the commit time estimate
+ */
+static bool commitPending(File& file) {
+    if (pendingLen == 0) return true;
+    unsigned long start = micros();
+    size_t written = sdWrite(SD_PRIORITY_UPLOAD, file, pending, pendingLen, true);
+    uint32_t took = micros() - start;
+    commitEstimateUs = (commitEstimateUs * 3 + took) / 4;
+
+    bool ok = written == pendingLen;
+    pendingLen = 0;
+    return ok;
+}
+
+/**
+ * Blocks the receiver until the slack allows a commit; the uploader is
+ * throttled meanwhile because the pending chunk is not acknowledged yet
+ */
+static void waitForSlack() {
+    unsigned long start = millis();
+    while (!slackAvailable()) {
+        if (millis() - start >= UPLOAD_QOS_MAX_DEFER_MS) {
+            forcedCommits++;
+            return;
+        }
+        vTaskDelay(1);
+    }
+    if (playbackActive) deferredCommits++;
+}
+
+size_t qosWrite(File& file, const uint8_t* data, size_t len, bool flush) {
+    if (!uploadQosEnabled || !playbackActive || len > UPLOAD_QOS_BUFFER_SIZE) {
+        if (!commitPending(file)) return 0;
+        return sdWrite(SD_PRIORITY_UPLOAD, file, data, len, flush);
+    }
+
+    if (pendingLen + len > UPLOAD_QOS_BUFFER_SIZE) {
+        waitForSlack();
+        if (!commitPending(file)) return 0;
+    }
+    memcpy(pending + pendingLen, data, len);
+    pendingLen += len;
+    return len;
+}
+
+bool qosPoll(File& file) {
+    if (pendingLen == 0) return true;
+    // Batch commits during playback so each flush buys a full buffer
+    bool due = !playbackActive || !uploadQosEnabled || pendingLen >= UPLOAD_QOS_BUFFER_SIZE / 2;
+    if (!due || !slackAvailable()) return true;
+    if (playbackActive) deferredCommits++;
+    return commitPending(file);
+}
+
+bool qosCommit(File& file) {
+    if (pendingLen == 0) return true;
+    waitForSlack();
+    return commitPending(file);
+}
+
+void qosDiscard() {
+    pendingLen = 0;
+}
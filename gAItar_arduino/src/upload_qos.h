@@ -0,0 +1,99 @@
+#ifndef UPLOAD_QOS_H
+#define UPLOAD_QOS_H
+
+#include <Arduino.h>
+#include <SdFat.h>
+
+/**
+ * Upload admission control during playback
+ * While a song is playing, upload writes are held in a RAM buffer and
+ * committed to the card (one write + flush) only when the slack before the
+ * next playback event covers the expected commit time. When the buffer is
+ * full the receiver blocks until such a gap appears, which delays its ACK
+ * and so throttles the ESP32 (bounded by UPLOAD_QOS_MAX_DEFER_MS, after
+ * which the commit is forced to stay inside the uploader's ACK timeout)
+ *
+ * Playback functions are called from the playback task, write functions
+ * from the file receiver task only
+ */
+
+#define UPLOAD_QOS_BUFFER_SIZE 2048        // Deferred upload bytes held in RAM
+#define UPLOAD_QOS_MARGIN_US 2000          // Slack required beyond the expected commit time
+#define UPLOAD_QOS_INITIAL_COMMIT_US 8000  // Commit time estimate before the first measurement
+#define UPLOAD_QOS_MAX_DEFER_MS 500        // Longest wait for slack (ESP32 ACK timeout is 2 s)
+#define UPLOAD_QOS_MISS_MS 2               // Lateness at which an event counts as a missed deadline
+
+extern volatile bool uploadQosEnabled;     // Admission control on/off (writes go straight to the card when off)
+extern volatile bool uploadQosSlackWait;   // Commits wait for slack (off: buffered writes commit as soon as they are due)
+
+/**
+ * Deadline statistics gathered by the playback task
+ */
+struct QosDeadlineStats {
+    uint32_t events;      // Events executed
+    uint32_t missed;      // Events later than UPLOAD_QOS_MISS_MS
+    uint32_t maxLateMs;   // Worst lateness seen
+};
+
+/**
+ * Publishes the deadline of the next loaded playback event
+ *
+ * @param dueMs millis() value at which the event is scheduled
+ */
+void qosNextEvent(unsigned long dueMs);
+
+/**
+ * Marks playback as stopped or paused so uploads write without deferral
+ */
+void qosPlaybackStopped();
+
+/**
+ * Records the lateness of an event that has just been executed
+ *
+ * @param dueMs millis() value at which the event was scheduled
+ */
+void qosRecordEvent(unsigned long dueMs);
+
+/**
+ * Returns and clears the deadline statistics
+ */
+QosDeadlineStats qosTakeDeadlineStats();
+
+/**
+ * Prints and clears the deadline statistics (called at the end of a song)
+ */
+void qosReportDeadlines(Print& out);
+
+/**
+ * Writes upload data, deferring it in RAM while playback is active
+ * May block waiting for slack when the buffer is full (flow control)
+ *
+ * @param file Destination file (opened through the SD server)
+ * @param data Bytes to write
+ * @param len Number of bytes
+ * @param flush Flush after a direct write (buffered data is always flushed on commit)
+ * @return len if the data was written or buffered, less on a write error
+ */
+size_t qosWrite(File& file, const uint8_t* data, size_t len, bool flush);
+
+/**
+ * Commits buffered data if playback is idle or the current slack allows it
+ * Called on every receiver pass
+ *
+ * @return false if a commit was attempted and failed
+ */
+bool qosPoll(File& file);
+
+/**
+ * Commits all buffered data before the file is closed, waiting for slack
+ *
+ * @return true if everything reached the card
+ */
+bool qosCommit(File& file);
+
+/**
+ * Drops buffered data of an aborted transfer
+ */
+void qosDiscard();
+
+#endif // UPLOAD_QOS_H
@@ -0,0 +1,160 @@
+#include "delta_sync.h"
+#include <stdlib.h>
+#include <string.h>
+
+uint32_t deltaWeakSum(const uint8_t* data, size_t len) {
+  uint32_t a = 0, b = 0;
+  for (size_t i = 0; i < len; i++) {
+    a += data[i];
+    b += (uint32_t)(len - i) * data[i];
+  }
+  return (a & 0xffff) | (b << 16);
+}
+
+uint32_t deltaStrongSum(const uint8_t* data, size_t len) {
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= data[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+size_t deltaMaxOps(size_t newLen) {
+  // Every match can be preceded by one literal run, plus a trailing literal
+  return 2 * (newLen / DELTA_BLOCK_SIZE) + 2;
+}
+
+// Appends a literal run, merging with a preceding literal
+static bool pushLiteral(DeltaOp* ops, size_t& count, size_t maxOps, size_t start, size_t end) {
+  if (end <= start) return true;
+  if (count && ops[count - 1].type == DELTA_LITERAL &&
+      ops[count - 1].start + ops[count - 1].length == start) {
+    ops[count - 1].length += end - start;
+    return true;
+  }
+  if (count >= maxOps) return false;
+  ops[count++] = {DELTA_LITERAL, (uint32_t)start, (uint32_t)(end - start)};
+  return true;
+}
+
+// Appends a block copy, extending the previous copy when blocks are consecutive
+static bool pushCopy(DeltaOp* ops, size_t& count, size_t maxOps, uint32_t block) {
+  if (count && ops[count - 1].type == DELTA_COPY &&
+      ops[count - 1].start + ops[count - 1].length == block) {
+    ops[count - 1].length++;
+    return true;
+  }
+  if (count >= maxOps) return false;
+  ops[count++] = {DELTA_COPY, block, 1};
+  return true;
+}
+
+size_t deltaPlan(const uint8_t* data, size_t len, const DeltaBlockSum* sums, size_t blockCount,
+                 DeltaOp* ops, size_t maxOps) {
+  size_t count = 0;
+  const size_t B = DELTA_BLOCK_SIZE;
+
+  if (blockCount == 0 || len < B) {
+    return pushLiteral(ops, count, maxOps, 0, len) ? count : 0;
+  }
+
+  // Open-addressed table of block indices keyed on the weak checksum
+  size_t tableSize = 1;
+  while (tableSize < blockCount * 2) tableSize <<= 1;
+  uint32_t* table = (uint32_t*)malloc(tableSize * sizeof(uint32_t));
+  if (!table) return 0;
+  memset(table, 0xff, tableSize * sizeof(uint32_t));
+  for (uint32_t i = 0; i < blockCount; i++) {
+    size_t slot = (sums[i].weak * 2654435761UL) & (tableSize - 1);
+    while (table[slot] != 0xffffffffUL) slot = (slot + 1) & (tableSize - 1);
+    table[slot] = i;
+  }
+
+  size_t pos = 0;
+  size_t literalStart = 0;
+  uint32_t expectedBlock = 0xffffffffUL;  // Next block after the last match
+  uint32_t a = 0, b = 0;
+  bool ok = true;
+
+  auto loadWindow = [&](size_t at) {
+    uint32_t weak = deltaWeakSum(data + at, B);
+    a = weak & 0xffff;
+    b = weak >> 16;
+  };
+  loadWindow(0);
+
+  while (ok && pos + B <= len) {
+    uint32_t weak = (a & 0xffff) | (b << 16);
+    uint32_t match = 0xffffffffUL;
+    uint32_t strong = 0;
+    bool strongReady = false;
+
+    // Sequential edits usually continue with the next old block
+    if (expectedBlock < blockCount && sums[expectedBlock].weak == weak) {
+      strong = deltaStrongSum(data + pos, B);
+      strongReady = true;
+      if (sums[expectedBlock].strong == strong) match = expectedBlock;
+    }
+    if (match == 0xffffffffUL) {
+      size_t slot = (weak * 2654435761UL) & (tableSize - 1);
+      while (table[slot] != 0xffffffffUL) {
+        uint32_t candidate = table[slot];
+        if (sums[candidate].weak == weak) {
+          if (!strongReady) {
+            strong = deltaStrongSum(data + pos, B);
+            strongReady = true;
+          }
+          if (sums[candidate].strong == strong) {
+            match = candidate;
+            break;
+          }
+        }
+        slot = (slot + 1) & (tableSize - 1);
+      }
+    }
+
+    if (match != 0xffffffffUL) {
+      ok = pushLiteral(ops, count, maxOps, literalStart, pos) &&
+           pushCopy(ops, count, maxOps, match);
+      pos += B;
+      literalStart = pos;
+      expectedBlock = match + 1;
+      if (pos + B <= len) loadWindow(pos);
+    } else {
+      // Roll the window forward by one byte
+      if (pos + B < len) {
+        uint8_t out = data[pos];
+        uint8_t in = data[pos + B];
+        a = (a - out + in) & 0xffff;
+        b = (b - B * out + a) & 0xffff;
+      }
+      pos++;
+    }
+  }
+
+  free(table);
+  if (ok) ok = pushLiteral(ops, count, maxOps, literalStart, len);
+  return ok ? count : 0;
+}
+
+size_t deltaLiteralBytes(const DeltaOp* ops, size_t opCount) {
+  size_t bytes = 0;
+  for (size_t i = 0; i < opCount; i++) {
+    if (ops[i].type == DELTA_LITERAL) bytes += ops[i].length;
+  }
+  return bytes;
+}
+
+size_t deltaWireBytes(const DeltaOp* ops, size_t opCount, size_t chunkSize) {
+  size_t bytes = 0;
+  for (size_t i = 0; i < opCount; i++) {
+    if (ops[i].type == DELTA_COPY) {
+      bytes += DELTA_COPY_LINE_BYTES;
+    } else {
+      size_t chunks = (ops[i].length + chunkSize - 1) / chunkSize;
+      bytes += ops[i].length + chunks * DELTA_CHUNK_LINE_BYTES;
+    }
+  }
+  return bytes;
+}
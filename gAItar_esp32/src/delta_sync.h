@@ -0,0 +1,73 @@
+#ifndef DELTA_SYNC_H
+#define DELTA_SYNC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * rsync-style delta planning for song uploads
+ * The Grand Central reports a weak rolling checksum and a strong checksum for
+ * every DELTA_BLOCK_SIZE block of the file it already stores at the upload path.
+ * The planner slides over the new file and emits COPY ops for blocks the
+ * receiver already has and LITERAL ops for bytes that must be transferred.
+ * Kept free of Arduino dependencies so it can be built and measured on host.
+ */
+
+#define DELTA_BLOCK_SIZE 128          // Matches the Grand Central chunk buffer
+#define DELTA_MAX_FILE_SIZE 131072    // Larger files are sent in full
+#define DELTA_CHUNK_LINE_BYTES 27     // "CHUNK:000:SIZE:64:CRC:0000\n"
+#define DELTA_COPY_LINE_BYTES 25      // "COPY:000:000:00:CRC:0000\n"
+
+struct DeltaBlockSum {
+  uint32_t weak;    // rsync rolling checksum (a | b << 16)
+  uint32_t strong;  // FNV-1a 32-bit
+};
+
+enum DeltaOpType : uint8_t {
+  DELTA_LITERAL,  // start = offset in new file, length = byte count
+  DELTA_COPY      // start = first old block, length = block count
+};
+
+struct DeltaOp {
+  DeltaOpType type;
+  uint32_t start;
+  uint32_t length;
+};
+
+uint32_t deltaWeakSum(const uint8_t* data, size_t len);
+uint32_t deltaStrongSum(const uint8_t* data, size_t len);
+
+/**
+ * Upper bound on the number of ops deltaPlan() can emit for a file
+ */
+size_t deltaMaxOps(size_t newLen);
+
+/**
+ * Builds the transfer plan for a new file against the receiver's block sums
+ *
+ * @param data New file contents
+ * @param len New file length
+ * @param sums Block sums of the receiver's existing file
+ * @param blockCount Number of entries in sums
+ * @param ops Output op list, at least deltaMaxOps(len) entries
+ * @param maxOps Capacity of ops
+ * @return Number of ops written, 0 if planning failed (send the file in full)
+ */
+size_t deltaPlan(const uint8_t* data, size_t len, const DeltaBlockSum* sums, size_t blockCount,
+                 DeltaOp* ops, size_t maxOps);
+
+/**
+ * Number of new-file bytes that a plan transfers as literals
+ */
+size_t deltaLiteralBytes(const DeltaOp* ops, size_t opCount);
+
+/**
+ * Estimated bytes a plan puts on the wire: literal chunks with their
+ * CHUNK lines, and one COPY line per copy op
+ * A single literal op over the whole file gives the cost of a full transfer
+ *
+ * @param chunkSize Largest literal chunk the sender writes
+ */
+size_t deltaWireBytes(const DeltaOp* ops, size_t opCount, size_t chunkSize);
+
+#endif
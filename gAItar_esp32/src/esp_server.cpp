@@ -5,58 +5,136 @@
 #include "SPIFFS.h"
 #include "uart.h"
 #include "globals.h"
+#include "song_cache.h"
+#include "song_search.h"
+#include "upload_stream.h"
+#include "upload_queue.h"
+#include "uart_tasks.h"
+#include "playback_clock.h"
+#include "midi_convert.h"
 
-AsyncWebSocket ws("/ws");
+/**
+ * /existing-songs request paused until the List reply with its id arrives
+ * Added by the web server task, completed by the status task
+ */
+struct PendingSongList {
+  uint8_t id;                        // 0 = free slot
+  unsigned long sentAt;
+  AsyncWebServerRequestPtr request;  // Expires if the client disconnects
+};
 
-void setupWebSocket(AsyncWebServer& server) {
-  ws.onEvent([](AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
-    if (type == WS_EVT_CONNECT) {
-      Serial.printf("WebSocket client #%u connected\n", client->id());
-    } else if (type == WS_EVT_DISCONNECT) {
-      Serial.printf("WebSocket client #%u disconnected\n", client->id());
-    }
-  });
-  
-  server.addHandler(&ws);
+static PendingSongList pendingSongLists[SONG_LIST_MAX_PENDING];
+static portMUX_TYPE pendingSongListsMux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t lastSongListId = 0;
+
+// Takes a request out of its slot; the pointer is moved so nothing is freed under the lock
+static AsyncWebServerRequestPtr takePendingSongList(PendingSongList &slot) {
+  AsyncWebServerRequestPtr request = std::move(slot.request);
+  slot.id = 0;
+  return request;
 }
 
+void completeSongList(uint8_t id, const JsonDocument *page) {
+  AsyncWebServerRequestPtr pending;
+  portENTER_CRITICAL(&pendingSongListsMux);
+  for (PendingSongList &slot : pendingSongLists) {
+    if (slot.id != 0 && slot.id == id) {
+      pending = takePendingSongList(slot);
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&pendingSongListsMux);
+
+  if (auto request = pending.lock()) {
+    if (page) {
+      String body;
+      serializeJson(*page, body);
+      request->send(200, "application/json", body);
+    } else {
+      request->send(502, "text/plain", "Incomplete response from Grand Central");
+    }
+  }
+}
 
-void notifyProgress(const String& stage, int percentage, const String& message) {
-  static unsigned long lastUpdate = 0;
-  static int lastPercentage = -1;
-  static String lastStage = "";
-  
+void expireSongLists() {
+  AsyncWebServerRequestPtr expired[SONG_LIST_MAX_PENDING];
   unsigned long now = millis();
-  
-  // Always send these critical messages regardless of throttling
-  bool isCritical = (percentage == 0 || percentage == 100 || 
-                     stage == "complete" || stage == "error" || 
-                     stage != lastStage);  // Always send when stage changes
-  
-  // Apply throttling only for non-critical updates
-  if (!isCritical && (now - lastUpdate < 100 || abs(percentage - lastPercentage) < 2)) {
-    return;
+  portENTER_CRITICAL(&pendingSongListsMux);
+  for (int i = 0; i < SONG_LIST_MAX_PENDING; i++) {
+    PendingSongList &slot = pendingSongLists[i];
+    if (slot.id != 0 && now - slot.sentAt > SONG_LIST_TIMEOUT_MS) {
+      expired[i] = takePendingSongList(slot);
+    }
+  }
+  portEXIT_CRITICAL(&pendingSongListsMux);
+
+  for (AsyncWebServerRequestPtr &pending : expired) {
+    if (auto request = pending.lock()) {
+      request->send(504, "text/plain", "No response from Grand Central");
+    }
   }
-  
-  lastUpdate = now;
-  lastPercentage = percentage;
-  lastStage = stage;
-  
-  JsonDocument doc;
-  doc["type"] = "upload_progress";
-  doc["stage"] = stage;
-  doc["percentage"] = percentage;
-  doc["message"] = message;
-  doc["timestamp"] = now;
-  
-  String jsonString;
-  serializeJson(doc, jsonString);
-  ws.textAll(jsonString);
-  doc.clear();
-  Serial.printf("Progress: %s - %d%% - %s\n", stage.c_str(), percentage, message.c_str());
+}
+
+// Upload job of a POST /upload-binary request, kept in its _tempObject
+struct UploadRequest {
+  uint16_t job;
+  bool failed;  // Queue was full or staging failed; the body is discarded
+};
+
+// Body of a /play, /skip or /shuffle request, kept in its _tempObject; the body
+// handler forwards it and leaves the verdict for the request handler, which
+// sends the only response
+struct CommandBody {
+  int status;     // HTTP status, 0 until the whole body is in
+  uint8_t data[]; // A body split over several fragments, collected
+};
+
+// Client of the streamed upload, whose TCP ACKs are held while the ring is
+// full (upload_stream.h); cleared on disconnect under the lock the resume hook takes
+static AsyncClient *streamClient = nullptr;
+static SemaphoreHandle_t streamClientLock = nullptr;
+
+/**
+ * Upload task: sends the held TCP ACKs, reopening the client's window
+ * AsyncTCP adds held segments to its count on its own task without a lock; a
+ * lost update leaves one segment unacknowledged or acknowledges bytes that
+ * were never held, and lwIP caps the window at one receive window either way
+ */
+static void resumeStreamClient() {
+  xSemaphoreTake(streamClientLock, portMAX_DELAY);
+  if (streamClient) streamClient->ack(SIZE_MAX);
+  xSemaphoreGive(streamClientLock);
+}
+
+// Claims the hook for client, or releases it if client still holds it
+static void setStreamClient(AsyncClient *client, bool claim) {
+  xSemaphoreTake(streamClientLock, portMAX_DELAY);
+  if (claim) {
+    streamClient = client;
+  } else if (streamClient == client) {
+    streamClient = nullptr;
+  }
+  xSemaphoreGive(streamClientLock);
+}
+
+/**
+ * SD card path from the upload form fields, or empty if one is missing
+ * (fields sent after the file are not known yet when the file part starts)
+ */
+static String uploadPathFromFields(AsyncWebServerRequest *request) {
+  static const char *const fields[] = {"genre", "artist", "title"};
+  String path;
+  for (const char *name : fields) {
+    if (!request->hasParam(name, true) || request->getParam(name, true)->value().isEmpty()) {
+      return String();
+    }
+    path += "/" + request->getParam(name, true)->value();
+  }
+  return path + ".bin";
 }
 
 void setupTestServer(AsyncWebServer& server) {
+  streamClientLock = xSemaphoreCreateMutex();
   // Handle preflight (CORS OPTIONS) requests globally
   setupWebSocket(server);
   DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
@@ -94,9 +172,26 @@ auto handleRequest = [](const String &label) {
             genre = request->getParam("genre", true)->value();
             Serial.printf("Genre: %s\n", genre.c_str());
         }
-        
-        filePath = "/" + genre + "/" + artist + "/" + title + ".bin";
-        
+
+        CommandBody *body = (CommandBody *)request->_tempObject;
+        if (body) {
+            if (body->status == 200) {
+                request->send(200, "text/plain", label + " command with body received");
+            } else if (body->status == 413) {
+                request->send(413, "text/plain", label + " command too long");
+            } else if (body->status == 503) {
+                request->send(503, "text/plain", "Instruction queue full");
+            } else {
+                request->send(400, "text/plain", label + " command body incomplete");
+            }
+            return;
+        }
+        // Form fields are parsed into params and never reach handleBody()
+        bool form = request->multipart() || request->contentType() == "application/x-www-form-urlencoded";
+        if (request->contentLength() > 0 && !form) {
+            request->send(503, "text/plain", "No memory for " + label + " command");
+            return;
+        }
         AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", label + " command received");
         request->send(response);
     };
@@ -108,106 +203,318 @@ auto handleRequest = [](const String &label) {
       AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", label + " command received");
       request->send(response);
       instructionToSAMD(reinterpret_cast<const uint8_t *>(label.c_str()), label.length());
+      if (label == "Pause") playbackClockPause();
     };
   };
 
+  // Forwards "[label]" + body as one instruction; the frame is gathered from
+  // the label and the body in place, so nothing is copied for one-fragment bodies
+  // The verdict is answered by handleRequest() once the request is complete
   auto handleBody = [](const String &label) {
-    return [label](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-      Serial.printf("[%s] Received %u bytes\n", label.c_str(), len);
-  
-      // Build full command: [label]:[data]
-      String labelPrefix = "[" + label + "]";
-      size_t prefixLen = labelPrefix.length();
-      size_t totalLen = prefixLen + len;
-  
-      // Allocate buffer to hold full message
-      uint8_t* fullMessage = new uint8_t[totalLen];
-  
-      // Copy label into the buffer
-      memcpy(fullMessage, labelPrefix.c_str(), prefixLen);
-  
-      // Append raw data after the label
-      memcpy(fullMessage + prefixLen, data, len);
-
-      Serial.print("Full message (ascii): ");
-      for (size_t i = 0; i < totalLen; i++) {
-        char c = fullMessage[i];
-        if (isPrintable(c)) {
-          Serial.print(c);
-        } else {
-          Serial.print(".");
-        }
+    String prefix = "[" + label + "]";
+    return [label, prefix](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+      if (index == 0) {
+        // Freed with the request; a body split over several fragments is collected in it
+        bool tooLong = prefix.length() + total > INSTRUCTION_MAX_PAYLOAD;
+        size_t capacity = tooLong || len == total ? 0 : total;
+        CommandBody *command = (CommandBody *)malloc(sizeof(CommandBody) + capacity);
+        request->_tempObject = command;
+        if (!command) return;
+        command->status = tooLong ? 413 : 0;
       }
-      Serial.println();
+      CommandBody *command = (CommandBody *)request->_tempObject;
+      if (!command || command->status) return;
 
-  
-      // Send to SAMD
-      instructionToSAMD(fullMessage, totalLen);
-  
-      // Clean up
-      delete[] fullMessage;
-  
-      // Respond to client
-      AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", label + " command with body received");
-      request->send(response);
+      const uint8_t *body = data;
+      if (len != total) {
+        memcpy(command->data + index, data, len);
+        if (index + len < total) return;
+        body = command->data;
+      }
+#if COMMAND_DEBUG
+      Serial.printf("[%s] Body (%u bytes): %.*s\n", label.c_str(), total, (int)total, (const char *)body);
+#endif
+
+      command->status = instructionToSAMD(prefix.c_str(), body, total) ? 200 : 503;
+      if (command->status == 200 && label == "Play") {
+        // Same path as the Grand Central builds from the body: /genre/artist/title.bin
+        JsonDocument doc;
+        if (!deserializeJson(doc, (const char *)body, total)) {
+          char path[128];
+          snprintf(path, sizeof(path), "/%s/%s/%s.bin", doc["genre"] | "", doc["artist"] | "", doc["title"] | "");
+          playbackClockPlay(path);
+        }
+      }
     };
   };
 
+  // Queues each file as its own upload job (upload_queue.h). The first job streams
+  // straight to the Grand Central when the form fields (genre, artist, title,
+  // file_size) come before it and the queue is empty; later ones are staged in
+  // their own SPIFFS file and sent in turn
   auto handleFile = [](const String &label){
     return [label](AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
       Serial.printf("Upload[%s]: index=%u, len=%u, final=%d\n", filename.c_str(), index, len, final);
   
       if (!index) {
-          request->_tempFile=SPIFFS.open("/temp", FILE_WRITE);  // Open file for writing
-          Serial.printf("Starting upload: %s\n", "/temp");
+          String path = uploadPathFromFields(request);
+          size_t size = request->hasParam("file_size", true) ? request->getParam("file_size", true)->value().toInt() : 0;
+          // With jobs ahead the body would sit in the ring and stall the connection, so only an idle queue streams
+          bool streamed = uploadQueueEmpty() && !path.isEmpty() && uploadStreamBegin(request, size, resumeStreamClient);
+          char staging[UPLOAD_QUEUE_STAGING_SIZE];
+          uint16_t job = uploadQueueAdd(path.c_str(), streamed, staging);
+          // Freed with the request; the completion handler answers with the job id
+          UploadRequest *upload = (UploadRequest *)malloc(sizeof(UploadRequest));
+          request->_tempObject = upload;
+          if (upload) *upload = {job, !job};
+          if (!job || !upload) {
+              Serial.println("Upload not queued, discarding body");
+              if (streamed) {
+                  uploadStreamAbort(); // The upload task fails the job
+              } else {
+                  uploadQueueAbandon(job);
+              }
+              return;
+          }
+          AsyncClient *client = request->client();
+          request->onDisconnect([job, client]() {
+              uploadQueueAbandon(job); // No effect once the body is whole
+              setStreamClient(client, false);
+          });
+          if (streamed) {
+              setStreamClient(client, true);
+              wakeUploadTask(); // The upload task starts sending while the body arrives
+              Serial.printf("Streaming upload job %u: %s (%u bytes)\n", job, path.c_str(), size);
+          } else {
+              request->_tempFile = SPIFFS.open(staging, FILE_WRITE);
+              Serial.printf("Staging upload job %u in %s\n", job, staging);
+              if (!request->_tempFile) {
+                  upload->failed = true;
+                  uploadQueueAbandon(job);
+                  return;
+              }
+          }
+          notifyProgress("queued", 0, path.c_str(), job);
+      }
+
+      UploadRequest *upload = (UploadRequest *)request->_tempObject;
+      if (!upload || upload->failed) {
+          return;
+      }
+      if (uploadStreamOwnedBy(request)) {
+          if (len && !uploadStreamWrite(request, data, len)) {
+              Serial.println("Upload stream aborted, discarding body");
+          }
+          // Never waits here: this task serves every connection. The ring stays
+          // full by closing the TCP window instead, until the upload task resumes it
+          if (uploadStreamHoldAcks(request)) request->client()->ackLater();
+          wakeUploadTask();
+          if (final) {
+              uploadStreamEnd(request);
+              Serial.printf("Upload body received: %s\n", filename.c_str());
+          }
+          return;
+      }
+      if (!request->_tempFile) {
+          return; // Stream was aborted or taken over; drop the rest of the body
       }
   
-      if (len) {
-          request->_tempFile.write(data, len); // Write incoming data to the file
-          Serial.printf("Writing %u bytes to %s\n", len, filename.c_str());
+      if (len && request->_tempFile.write(data, len) != len) {
+          Serial.printf("Staging job %u failed (SPIFFS full?), discarding body\n", upload->job);
+          request->_tempFile.close();
+          upload->failed = true;
+          uploadQueueAbandon(upload->job);
+          return;
       }
   
       if (final) {
           request->_tempFile.close();  // Close the file after upload
-          Serial.printf("Upload complete: %s\n", filename.c_str());
-          sendFile = true;
+          Serial.printf("Upload job %u staged: %s\n", upload->job, filename.c_str());
       }
   };
   };
 
-  auto handleGet = [](const String &label) {
-    return [label](AsyncWebServerRequest *request) {
-        Serial.println("Processing GET request: " + label);
-        // Send instruction to SAMD
-        instructionToSAMD(reinterpret_cast<const uint8_t *>(label.c_str()), label.length());
-
-        // Wait for response from SAMD
-        String uartResponse = "";
-        unsigned long startTime = millis();
-        while (millis() - startTime < 1000) { // 1-second timeout
-            if (instruction_uart.available()) {
-                uartResponse += instruction_uart.readString();
-            }
-        }
+  // Answers an upload once its body is in, releasing a staged job to the upload task
+  auto handleUploadDone = [](AsyncWebServerRequest *request) {
+    UploadRequest *upload = (UploadRequest *)request->_tempObject;
+    if (!upload || upload->failed) {
+      request->send(503, "text/plain", "Upload could not be queued");
+      return;
+    }
+    if (!uploadQueueReady(upload->job, uploadPathFromFields(request).c_str())) {
+      request->send(400, "text/plain", "Missing genre, artist or title");
+      return;
+    }
+    wakeUploadTask();
+    char reply[32];
+    snprintf(reply, sizeof(reply), "{\"job\":%u}", upload->job);
+    request->send(200, "application/json", reply);
+  };
 
-        if (uartResponse.isEmpty()) {
-            uartResponse = "NA";
-        }
-        Serial.println("uartResponse" + uartResponse);
-        // Send the UART response back to the HTTP request
-        AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", uartResponse);
-        request->send(response);
-    };
+  // Buffers a .mid file part; tracks are merged across the whole file, so it
+  // is only converted once the request is complete
+  auto handleMidiFile = [](AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
+    UploadMidi *midi = (UploadMidi *)request->_tempObject;
+    if (!index) {
+      if (midi) {
+        midi->status = 413; // A second file part
+        return;
+      }
+      // The multipart body is a little larger than the file, so it bounds the buffer
+      size_t capacity = min(request->contentLength(), (size_t)MIDI_CONVERT_MAX_SIZE);
+      midi = (UploadMidi *)malloc(sizeof(UploadMidi) + capacity);
+      if (!midi) {
+        // Remembered without the buffer, so the reply says why
+        Serial.printf("No memory to buffer %s (%u bytes)\n", filename.c_str(), capacity);
+        capacity = 0;
+        midi = (UploadMidi *)malloc(sizeof(UploadMidi));
+        if (!midi) return;
+      }
+      request->_tempObject = midi;
+      midi->length = 0;
+      midi->capacity = capacity;
+      midi->status = capacity ? 0 : 503;
+    }
+    if (!midi || midi->status) {
+      return;
+    }
+    if (len > midi->capacity - midi->length) {
+      Serial.printf("MIDI file %s larger than %u bytes, discarding\n", filename.c_str(), midi->capacity);
+      midi->status = 413;
+      return;
+    }
+    memcpy(midi->data + midi->length, data, len);
+    midi->length += len;
+  };
+
+  // Queues the buffered .mid; the upload task converts it to the song format
+  // (midi_convert.h) in the job's staging file, and reports a file that does not
+  // convert as that job's progress
+  auto handleMidiDone = [](AsyncWebServerRequest *request) {
+    UploadMidi *midi = (UploadMidi *)request->_tempObject;
+    if (!midi) {
+      request->send(400, "text/plain", "No MIDI file received");
+      return;
+    }
+    if (midi->status) {
+      request->send(midi->status, "text/plain", midi->status == 413 ? "MIDI file too large" : "No memory for the MIDI file");
+      return;
+    }
+    String path = uploadPathFromFields(request);
+    if (path.isEmpty()) {
+      request->send(400, "text/plain", "Missing genre, artist or title");
+      return;
+    }
+    uint16_t job = uploadQueueAddMidi(path.c_str(), midi);
+    if (!job) {
+      request->send(503, "text/plain", "Upload could not be queued");
+      return;
+    }
+    request->_tempObject = nullptr; // The queue frees the buffer
+
+    notifyProgress("queued", 0, path.c_str(), job);
+    wakeUploadTask();
+    char reply[32];
+    snprintf(reply, sizeof(reply), "{\"job\":%u}", job);
+    request->send(200, "application/json", reply);
+  };
+
+  // GET /existing-songs?offset=&limit=&genre=&artist=&title=
+  // Returns {"offset","total","songs":[...]} from the Grand Central catalog
+  // Served from the library cache when it is current; otherwise the request is
+  // paused and answered by the status task when the reply frame arrives
+  auto handleSongList = [](AsyncWebServerRequest *request) {
+    if (songCacheServe(request)) {
+      return;
+    }
+
+    // Slots are only claimed here (web server task), so a free one stays free
+    int slot = -1;
+    portENTER_CRITICAL(&pendingSongListsMux);
+    for (int i = 0; i < SONG_LIST_MAX_PENDING && slot < 0; i++) {
+      if (pendingSongLists[i].id == 0) slot = i;
+    }
+    portEXIT_CRITICAL(&pendingSongListsMux);
+    if (slot < 0) {
+      request->send(503, "text/plain", "Too many song list requests");
+      return;
+    }
+
+    // 0 marks a free slot, ids from SONG_CACHE_FIRST_LIST_ID belong to the library cache
+    if (++lastSongListId >= SONG_CACHE_FIRST_LIST_ID) lastSongListId = 1;
+    uint8_t id = lastSongListId;
+    uint8_t command[INSTRUCTION_MAX_PAYLOAD];
+    InstructionOpWriter op(command, sizeof(command), INSTRUCTION_OP_LIST);
+    op.u8(INSTRUCTION_ARG_REQUEST_ID, id);
+    static const struct { const char *name; uint8_t arg; } numberParams[] = {
+        {"offset", INSTRUCTION_ARG_OFFSET}, {"limit", INSTRUCTION_ARG_LIMIT}};
+    static const struct { const char *name; uint8_t arg; } textParams[] = {
+        {"genre", INSTRUCTION_ARG_GENRE}, {"artist", INSTRUCTION_ARG_ARTIST}, {"title", INSTRUCTION_ARG_TITLE}};
+    for (const auto &param : numberParams) {
+      if (request->hasParam(param.name)) {
+        op.u16(param.arg, request->getParam(param.name)->value().toInt());
+      }
+    }
+    for (const auto &param : textParams) {
+      if (request->hasParam(param.name) && !request->getParam(param.name)->value().isEmpty()) {
+        op.str(param.arg, request->getParam(param.name)->value().c_str());
+      }
+    }
+    Serial.printf("Processing song list request #%u (%u bytes)\n", id, op.length());
+
+    if (op.overflowed()) {
+      request->send(400, "text/plain", "Query too long");
+      return;
+    }
+
+    AsyncWebServerRequestPtr paused = request->pause();
+    portENTER_CRITICAL(&pendingSongListsMux);
+    pendingSongLists[slot].request = std::move(paused);
+    pendingSongLists[slot].sentAt = millis();
+    pendingSongLists[slot].id = id;
+    portEXIT_CRITICAL(&pendingSongListsMux);
+
+    instructionOpToSAMD(command, op.length());
   };
 
   // Routes
   server.on("/play", HTTP_POST, handleRequest("Play"), nullptr, handleBody("Play"));
   server.on("/pause", HTTP_POST, handlePauseRequest("Pause"), nullptr, nullptr);
+  server.on("/rescan", HTTP_POST, handlePauseRequest("Rescan"), nullptr, nullptr); // Rebuild SD song catalog
   server.on("/skip", HTTP_POST, handleRequest("Skip"), nullptr, handleBody("Skip"));
   server.on("/shuffle", HTTP_POST, handleRequest("Shuffle"), nullptr, handleBody("Shuffle"));
   //server.on("/upload", HTTP_POST, handleRequest("Upload"),handleFile("Upload"), nullptr); deprecated
-  server.on("/upload-binary", HTTP_POST, handleRequest("Upload-Binary"), handleFile("Upload"), nullptr);
-  server.on("/existing-songs", HTTP_GET, handleGet("List"));
+  server.on("/upload-binary", HTTP_POST, handleUploadDone, handleFile("Upload"), nullptr);
+  // Same form as /upload-binary with a .mid file, converted here instead of by the backend
+  server.on("/upload-midi", HTTP_POST, handleMidiDone, handleMidiFile, nullptr);
+  server.on("/upload-queue", HTTP_GET, [](AsyncWebServerRequest *request) {
+    AsyncResponseStream *response = request->beginResponseStream("text/plain");
+    reportUploadQueue(*response);
+    request->send(response);
+  });
+  server.on("/existing-songs", HTTP_GET, handleSongList);
+  server.on("/search", HTTP_GET, songSearchServe); // Answered from the search index, no UART traffic
+  server.on("/uart-stats", HTTP_GET, [](AsyncWebServerRequest *request) {
+    AsyncResponseStream *response = request->beginResponseStream("text/plain");
+    reportUartTaskStats(*response);
+    reportSamdInstructionStats(*response);
+    requestSamdInstructionStats(); // Answer arrives for the next request
+    request->send(response);
+  });
+  server.on("/ws-stats", HTTP_GET, [](AsyncWebServerRequest *request) {
+    AsyncResponseStream *response = request->beginResponseStream("text/plain");
+    reportWsNotifyStats(*response);
+    request->send(response);
+  });
+  // GET /playback-clock?hz= sets how often the position is broadcast while playing
+  server.on("/playback-clock", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (request->hasParam("hz")) {
+      playbackClockSetUpdateHz(request->getParam("hz")->value().toInt());
+    }
+    AsyncResponseStream *response = request->beginResponseStream("text/plain");
+    reportPlaybackClockStats(*response);
+    request->send(response);
+  });
   server.begin();
 }
 
@@ -227,42 +534,3 @@ void formatSPIFFS() {
     Serial.println("Failed to format SPIFFS.");
   }
 }
-
-// Add after the existing notifyProgress function
-void notifyPlaybackStatus(const String& jsonData) {
-  JsonDocument doc;
-  doc["type"] = "playback_status";
-  doc["timestamp"] = millis();
-  
-  // Parse the incoming JSON data from Grand Central
-  JsonDocument statusDoc;
-  DeserializationError error = deserializeJson(statusDoc, jsonData);
-  
-  if (!error) {
-    // Only forward the essential time data
-    if (!statusDoc["currentTime"].isNull()) {
-      doc["currentTime"] = statusDoc["currentTime"];
-    }
-    if (!statusDoc["totalTime"].isNull()) {
-      doc["totalTime"] = statusDoc["totalTime"];
-    }
-    
-    // ESP32 can calculate these derived values:
-    // - isPlaying = currentTime > 0 && currentTime < totalTime
-    // - isPaused = check if currentTime hasn't changed for a while
-    // - isFinished = currentTime >= totalTime
-    // - progress = (currentTime / totalTime) * 100
-    
-  } else {
-    // If JSON parsing fails, send raw data
-    doc["rawData"] = jsonData;
-  }
-  
-  String jsonString;
-  serializeJson(doc, jsonString);
-  ws.textAll(jsonString);
-  doc.clear();
-  statusDoc.clear();
-  
-  Serial.printf("Playback Status: %s\n", jsonData.c_str());
-}
\ No newline at end of file
@@ -2,16 +2,35 @@
 #define ESP_SERVER_H
 
 #include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+#include "ws_notify.h"
 
-void setupTestServer(AsyncWebServer &server);
+#define SONG_LIST_MAX_PENDING 4     // /existing-songs requests awaiting a Grand Central reply
+#define SONG_LIST_TIMEOUT_MS 5000   // Reply deadline, includes replies queued on the Grand Central
+
+#ifndef COMMAND_DEBUG
+#define COMMAND_DEBUG 0             // 1 logs every forwarded command body (build_flags = -DCOMMAND_DEBUG=1)
+#endif
 
-void setupWebSocket(AsyncWebServer &server);
+void setupTestServer(AsyncWebServer &server);
 
 void listSPIFFSFiles();
 
 void formatSPIFFS();
 
-void notifyProgress(const String& stage, int percentage, const String& message = ""); 
-void notifyPlaybackStatus(const String& jsonData);  // Add this
+/**
+ * Answers the /existing-songs request waiting for a List reply
+ * Called from the status task by the instruction UART reader
+ *
+ * @param id Request id echoed by the Grand Central
+ * @param page Parsed page ({"offset","total","songs"}), or nullptr if the frame was lost
+ */
+void completeSongList(uint8_t id, const JsonDocument *page);
+
+/**
+ * Fails /existing-songs requests whose reply did not arrive in time
+ * Called from the status task
+ */
+void expireSongLists();
 
 #endif
\ No newline at end of file
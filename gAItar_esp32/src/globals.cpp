@@ -1,4 +1 @@
 #include "globals.h"
-
-bool sendFile = false;
-String filePath = ""; // Path to the file to be sent
\ No newline at end of file
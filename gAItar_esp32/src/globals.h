@@ -3,8 +3,6 @@
 
 #include <Arduino.h>
 #include <ESPAsyncWebServer.h>
-extern bool sendFile;
-extern String filePath;
 
 
 #endif
\ No newline at end of file
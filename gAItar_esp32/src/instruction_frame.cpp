@@ -0,0 +1,97 @@
+#include "instruction_frame.h"
+
+uint8_t instructionCrc8(const uint8_t* data, size_t len, uint8_t crc) {
+  // Polynomial 0x07
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+uint16_t instructionCrc16(const uint8_t* data, size_t len, uint16_t crc) {
+  // CCITT polynomial 0x1021, a byte at a time without a table
+  for (size_t i = 0; i < len; i++) {
+    uint8_t x = (crc >> 8) ^ data[i];
+    x ^= x >> 4;
+    crc = (crc << 8) ^ ((uint16_t)x << 12) ^ ((uint16_t)x << 5) ^ x;
+  }
+  return crc;
+}
+
+uint16_t instructionFrameHeader(uint8_t* header, uint8_t flags, uint8_t seq, uint16_t length) {
+  header[0] = INSTRUCTION_FRAME_START;
+  header[1] = flags;
+  header[2] = seq;
+  header[3] = length;
+  header[4] = length >> 8;
+  header[5] = instructionCrc8(header + 1, 4);
+  return instructionCrc16(header + 1, INSTRUCTION_FRAME_HEADER_SIZE - 1);
+}
+
+void instructionAckReply(uint8_t* reply, uint8_t seq, uint8_t status) {
+  reply[0] = INSTRUCTION_ACK_START;
+  reply[1] = seq;
+  reply[2] = status;
+  reply[3] = instructionCrc8(reply + 1, 2);
+}
+
+bool instructionAckValid(const uint8_t* reply) {
+  return reply[0] == INSTRUCTION_ACK_START && instructionCrc8(reply + 1, 2) == reply[3];
+}
+
+void InstructionFrameDecoder::push(uint8_t b, InstructionFrameHandler& handler) {
+  if (filled == 0 && b != INSTRUCTION_FRAME_START) {
+    bytesSkipped++;
+    return;
+  }
+  buffer[filled++] = b;
+
+  if (filled == INSTRUCTION_FRAME_HEADER_SIZE) {
+    uint16_t length = buffer[3] | (buffer[4] << 8);
+    if (instructionCrc8(buffer + 1, 4) != buffer[5] || length > INSTRUCTION_MAX_PAYLOAD) {
+      headerErrors++;
+      rescan(handler);
+      return;
+    }
+    frameSize = INSTRUCTION_FRAME_OVERHEAD + length;
+  }
+  if (filled < INSTRUCTION_FRAME_HEADER_SIZE || filled < frameSize) return;
+
+  uint16_t length = frameSize - INSTRUCTION_FRAME_OVERHEAD;
+  uint16_t crc = instructionCrc16(buffer + 1, INSTRUCTION_FRAME_HEADER_SIZE - 1 + length);
+  uint16_t received = buffer[frameSize - 2] | (buffer[frameSize - 1] << 8);
+  if (crc != received) {
+    crcErrors++;
+    handler.onCorruptFrame(buffer[1], buffer[2]);
+    rescan(handler);
+    return;
+  }
+
+  frames++;
+  filled = 0;
+  frameSize = 0;
+  buffer[INSTRUCTION_FRAME_HEADER_SIZE + length] = '\0'; // Over the CRC, already checked
+  handler.onFrame(buffer[1], buffer[2], (char*)buffer + INSTRUCTION_FRAME_HEADER_SIZE, length);
+}
+
+void InstructionFrameDecoder::abandon(InstructionFrameHandler& handler) {
+  if (filled > 0) {
+    headerErrors += frameSize == 0;
+    crcErrors += frameSize != 0;
+    rescan(handler);
+  }
+}
+
+void InstructionFrameDecoder::rescan(InstructionFrameHandler& handler) {
+  // Re-feed everything after the rejected start byte. push() only writes
+  // below the index being read, so this works in place.
+  size_t count = filled;
+  filled = 0;
+  frameSize = 0;
+  for (size_t i = 1; i < count; i++) {
+    push(buffer[i], handler);
+  }
+}
@@ -0,0 +1,108 @@
+#ifndef INSTRUCTION_FRAME_H
+#define INSTRUCTION_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Framing of instructions from the ESP32 to the Grand Central
+ * The same file is in gAItar_esp32/src and gAItar_arduino/src (build_host.sh
+ * checks they match); kept free of Arduino dependencies so it can be built
+ * and fuzzed on host.
+ *
+ *   0xAA flags seq length(u16 LE) headerCheck payload crc(u16 LE)
+ *
+ * headerCheck is a CRC-8 of flags..length, so a stray 0xAA in line noise is
+ * rejected after six bytes instead of holding the receiver for a bogus
+ * payload length. crc is CRC-16/CCITT over everything after the start byte.
+ * When a frame fails either check the decoder rescans the bytes it had taken
+ * from just after the rejected start byte, so it locks onto the next frame
+ * already in the stream rather than losing it.
+ *
+ * A frame with INSTRUCTION_FLAG_ACK set is answered on the reply channel with
+ *   0xAC seq status check
+ * (check is the CRC-8 of seq and status). The sender retransmits under the
+ * same seq with INSTRUCTION_FLAG_RETRY set until it is acknowledged, and the
+ * receiver does not run a retransmit of the seq it last ran again.
+ */
+
+#define INSTRUCTION_FRAME_START 0xAA
+#define INSTRUCTION_FRAME_HEADER_SIZE 6
+#define INSTRUCTION_FRAME_CRC_SIZE 2
+#define INSTRUCTION_FRAME_OVERHEAD (INSTRUCTION_FRAME_HEADER_SIZE + INSTRUCTION_FRAME_CRC_SIZE)
+#define INSTRUCTION_MAX_PAYLOAD 512
+
+#define INSTRUCTION_FLAG_ACK 0x01    // Receiver answers with an ACK/NACK reply
+#define INSTRUCTION_FLAG_RETRY 0x02  // Retransmit of the previous seq
+#define INSTRUCTION_FLAG_BINARY 0x04 // Payload is a binary instruction (instruction_ops.h), not text
+
+#define INSTRUCTION_ACK_START 0xAC
+#define INSTRUCTION_ACK_SIZE 4
+#define INSTRUCTION_ACK_OK 0
+#define INSTRUCTION_NACK_CRC 1     // Header was intact, payload was not
+
+uint8_t instructionCrc8(const uint8_t* data, size_t len, uint8_t crc = 0);
+uint16_t instructionCrc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF);
+
+/**
+ * Fills the INSTRUCTION_FRAME_HEADER_SIZE header bytes
+ *
+ * @return CRC-16 so far; continue it over the payload with instructionCrc16()
+ */
+uint16_t instructionFrameHeader(uint8_t* header, uint8_t flags, uint8_t seq, uint16_t length);
+
+/**
+ * Fills an INSTRUCTION_ACK_SIZE reply
+ */
+void instructionAckReply(uint8_t* reply, uint8_t seq, uint8_t status);
+
+/**
+ * True if the reply's check byte matches
+ */
+bool instructionAckValid(const uint8_t* reply);
+
+/**
+ * Receiver side; receives what the decoder finds in the byte stream
+ */
+struct InstructionFrameHandler {
+  /**
+   * A frame passed both checks
+   * payload[length] is '\0' so text commands can be used in place
+   */
+  virtual void onFrame(uint8_t flags, uint8_t seq, char* payload, uint16_t length) = 0;
+
+  /**
+   * The header passed its check but the payload CRC did not
+   */
+  virtual void onCorruptFrame(uint8_t flags, uint8_t seq) {}
+};
+
+/**
+ * Incremental frame decoder; feed it every received byte
+ */
+class InstructionFrameDecoder {
+ public:
+  void push(uint8_t b, InstructionFrameHandler& handler);
+
+  /**
+   * Drops a frame that stopped arriving (the caller tracks the byte gap)
+   */
+  void abandon(InstructionFrameHandler& handler);
+
+  bool inFrame() const { return filled > 0; }
+
+  // Counters since start
+  uint32_t frames = 0;
+  uint32_t headerErrors = 0;
+  uint32_t crcErrors = 0;
+  uint32_t bytesSkipped = 0;   // Bytes outside any frame
+
+ private:
+  void rescan(InstructionFrameHandler& handler);
+
+  uint8_t buffer[INSTRUCTION_FRAME_OVERHEAD + INSTRUCTION_MAX_PAYLOAD];
+  size_t filled = 0;
+  size_t frameSize = 0;        // Known once the header is in
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef INSTRUCTION_OPS_H
+#define INSTRUCTION_OPS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Binary instructions carried in frames with INSTRUCTION_FLAG_BINARY set
+ * The same file is in gAItar_esp32/src and gAItar_arduino/src (build_host.sh
+ * checks they match).
+ *
+ *   op(u8) then arguments as type(u8) length(u8) value
+ *
+ * Integers are little-endian and must have exactly their size; strings
+ * include their terminating '\0' so the receiver uses them in place.
+ * Unknown argument types are skipped, so arguments can be added later
+ * without breaking older receivers.
+ *
+ * Frames without the flag carry the original text commands ("[Play]{json}",
+ * "Pause", "List{json}", "Rescan"), which are still accepted.
+ */
+
+#define INSTRUCTION_OP_PLAY 0x01    // PATH, or SONG_ID with optional GENERATION
+#define INSTRUCTION_OP_PAUSE 0x02
+#define INSTRUCTION_OP_RESUME 0x03
+#define INSTRUCTION_OP_SEEK 0x04    // POSITION
+#define INSTRUCTION_OP_RATE 0x05    // RATE
+#define INSTRUCTION_OP_STATS 0x06   // Answered with a STATS: line
+#define INSTRUCTION_OP_LIST 0x07    // REQUEST_ID OFFSET LIMIT GENRE ARTIST TITLE, all optional
+#define INSTRUCTION_OP_RESCAN 0x08
+
+#define INSTRUCTION_ARG_PATH 0x01        // string, "/genre/artist/title.bin"
+#define INSTRUCTION_ARG_SONG_ID 0x02     // u16, catalog slot
+#define INSTRUCTION_ARG_GENERATION 0x03  // u32, catalog generation the id was read from
+#define INSTRUCTION_ARG_POSITION 0x04    // u32, song position in ms
+#define INSTRUCTION_ARG_RATE 0x05        // u16, playback rate in percent
+#define INSTRUCTION_ARG_REQUEST_ID 0x06  // u8
+#define INSTRUCTION_ARG_OFFSET 0x07      // u16
+#define INSTRUCTION_ARG_LIMIT 0x08       // u16
+#define INSTRUCTION_ARG_GENRE 0x09       // string
+#define INSTRUCTION_ARG_ARTIST 0x0A      // string
+#define INSTRUCTION_ARG_TITLE 0x0B       // string
+
+/**
+ * Builds a binary instruction into a caller buffer
+ * Arguments that do not fit set the overflow flag instead of being written
+ */
+class InstructionOpWriter {
+ public:
+  InstructionOpWriter(uint8_t* buffer, size_t capacity, uint8_t op);
+
+  void u8(uint8_t type, uint8_t value);
+  void u16(uint8_t type, uint16_t value);
+  void u32(uint8_t type, uint32_t value);
+  void str(uint8_t type, const char* value);
+
+  size_t length() const { return used; }
+  bool overflowed() const { return overflow; }
+
+ private:
+  uint8_t* put(uint8_t type, size_t length);
+
+  uint8_t* buffer;
+  size_t capacity;
+  size_t used;
+  bool overflow = false;
+};
+
+/**
+ * One argument, pointing into the instruction payload
+ */
+struct InstructionArg {
+  uint8_t type;
+  uint8_t length;
+  const uint8_t* value;
+
+  // Each returns false if the argument does not have that form
+  bool asU8(uint8_t& out) const;
+  bool asU16(uint16_t& out) const;
+  bool asU32(uint32_t& out) const;
+  bool asString(const char*& out) const;
+};
+
+/**
+ * Walks the arguments of a binary instruction in place (no copies, no allocation)
+ */
+class InstructionOpReader {
+ public:
+  InstructionOpReader(const uint8_t* payload, size_t length);
+
+  /**
+   * 0 for an empty payload
+   */
+  uint8_t op() const { return length ? payload[0] : 0; }
+
+  /**
+   * Fetches the next argument
+   *
+   * @return false at the end, or if the arguments are truncated (see malformed())
+   */
+  bool next(InstructionArg& arg);
+
+  bool malformed() const { return bad; }
+
+ private:
+  const uint8_t* payload;
+  size_t length;
+  size_t position = 1;
+  bool bad = false;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#include "line_assembler.h"
+
+bool LineAssembler::push(uint8_t b) {
+  if (b != '\n') {
+    if (length < size - 1) {
+      buffer[length++] = b;
+    } else {
+      overflowed = true;
+    }
+    return false;
+  }
+
+  bool complete = !overflowed;
+  if (overflowed) overflows++;
+  while (length > 0 && (buffer[length - 1] == '\r' || buffer[length - 1] == ' ')) length--;
+  buffer[length] = '\0';
+  length = 0;
+  overflowed = false;
+  return complete;
+}
+
+const char *LineAssembler::read(Stream &in) {
+  while (in.available()) {
+    if (push(in.read())) return buffer;
+  }
+  return nullptr;
+}
@@ -0,0 +1,60 @@
+#ifndef LINE_ASSEMBLER_H
+#define LINE_ASSEMBLER_H
+
+#include <Arduino.h>
+
+/**
+ * Collects '\n'-terminated text lines from a UART into a fixed buffer
+ * Never waits for input: bytes are taken as they arrive and a line is handed
+ * out once its newline is in, so a partial line never stalls the caller and
+ * no String is allocated per message
+ * A line longer than the buffer is dropped whole (counted in overflows)
+ * rather than passed on cut short
+ */
+class LineAssembler {
+ public:
+  LineAssembler(char *buffer, size_t size) : buffer(buffer), size(size) {}
+
+  /**
+   * Adds one byte
+   *
+   * @return true if it completed a line, now in line()
+   */
+  bool push(uint8_t b);
+
+  /**
+   * Takes bytes from a stream up to the end of one line, leaving any bytes
+   * after it (such as a binary block that follows a reply) in the stream
+   *
+   * @return The completed line, or nullptr if none is complete yet
+   */
+  const char *read(Stream &in);
+
+  /**
+   * Last completed line, without '\r' or trailing spaces
+   */
+  char *line() { return buffer; }
+
+  /**
+   * True when no part of a line has been received (a binary frame may start here)
+   */
+  bool atLineStart() const { return length == 0 && !overflowed; }
+
+  /**
+   * Drops a partial line, e.g. before a new request whose reply must not be mixed with stale bytes
+   */
+  void reset() {
+    length = 0;
+    overflowed = false;
+  }
+
+  uint32_t overflows = 0;
+
+ private:
+  char *buffer;
+  size_t size;
+  size_t length = 0;
+  bool overflowed = false; // Current line did not fit; dropped at its newline
+};
+
+#endif
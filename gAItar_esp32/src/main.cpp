@@ -7,6 +7,10 @@
 #include "uart.h"
 #include "esp_server.h"
 #include "globals.h"
+#include "song_cache.h"
+#include "song_search.h"
+#include "uart_tasks.h"
+#include "upload_queue.h"
 
 const char* ssid = "PixelJ";  // Your WiFi SSID
 const char* password = "12345678";    // Your WiFi password
@@ -27,6 +31,10 @@ void setup() {
     return;
   }
   Serial.println("SPIFFS mounted successfully");
+  SPIFFS.remove("/temp"); // Staging file of the single-upload firmware
+  uploadQueueBegin();      // Unfinished uploads from before the reset
+  songSearchBegin();
+  songCacheBegin();
   
   WiFi.mode(WIFI_STA);  // Set WiFi to station mode
   
@@ -65,13 +73,11 @@ void setup() {
   Serial.printf("HTTP server started on: http://%s\n", WiFi.localIP().toString().c_str());
   
   setupUARTs();
-  listSPIFFSFiles();
-  Serial.println("Clearing files...");
-  formatSPIFFS();
+  startUartTasks();
   listSPIFFSFiles();
 }
 
 void loop() {
-    uploadToSAMD_state(sendFile, filePath);
-    handlePlaybackMessages();
+    // Uploads, status messages and instructions are handled by the UART tasks
+    vTaskDelete(NULL);
 }
\ No newline at end of file
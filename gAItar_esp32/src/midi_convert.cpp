@@ -0,0 +1,358 @@
+#include "midi_convert.h"
+#include <math.h>
+#include <string.h>
+
+#define MIDI_DEFAULT_TEMPO 500000  // us per quarter note until a set_tempo
+#define MIDI_PERCUSSION_CHANNEL 9
+#define MIDI_META_END_OF_TRACK 0x2F
+#define MIDI_META_SET_TEMPO 0x51
+#define MIDI_META_TIME_SIGNATURE 0x58
+#define MIDI_META_KEY_SIGNATURE 0x59
+
+// Open string notes, index = string number (6 = low E2)
+static const uint8_t openNotes[7] = {0, 64, 59, 55, 50, 45, 40};
+
+struct TrackRange {
+  const uint8_t* start;
+  const uint8_t* end;
+};
+
+struct MidiEvent {
+  uint8_t status;       // 0xFF for metas
+  uint8_t metaType;
+  const uint8_t* data;  // Data bytes after the status (and meta length)
+  uint32_t length;
+};
+
+/**
+ * Walks the events of one track, or the kept metas of all tracks back to back
+ * (the first track of the backend's stripped file, with each meta keeping the
+ * delta it had in its own track)
+ */
+struct TrackCursor {
+  const TrackRange* tracks;
+  uint8_t track;
+  uint8_t lastTrack;
+  bool metasOnly;
+  const uint8_t* pos;
+  uint8_t runningStatus;
+  uint32_t tick;        // Absolute tick of event
+  bool done;
+  MidiEvent event;
+};
+
+static inline uint16_t readBE16(const uint8_t* p) {
+  return (uint16_t)p[0] << 8 | p[1];
+}
+
+static inline uint32_t readBE32(const uint8_t* p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static bool readVarLen(const uint8_t*& pos, const uint8_t* end, uint32_t& value) {
+  value = 0;
+  for (int i = 0; i < 4; i++) {
+    if (pos >= end) return false;
+    uint8_t b = *pos++;
+    value = value << 7 | (b & 0x7F);
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+// Data bytes of a channel or system common message
+static uint8_t messageLength(uint8_t status) {
+  switch (status & 0xF0) {
+    case 0xC0:
+    case 0xD0:
+      return 1;
+    case 0xF0:
+      return status == 0xF2 ? 2 : (status == 0xF1 || status == 0xF3) ? 1 : 0;
+    default:
+      return 2;
+  }
+}
+
+static bool readEvent(const uint8_t*& pos, const uint8_t* end, uint8_t& runningStatus, uint32_t& delta,
+                      MidiEvent& event) {
+  if (!readVarLen(pos, end, delta) || pos >= end) return false;
+  uint8_t status = *pos;
+  if (status & 0x80) {
+    pos++;
+  } else {
+    if (!runningStatus) return false;
+    status = runningStatus;
+  }
+  event.status = status;
+  event.metaType = 0;
+
+  if (status == 0xFF) {
+    if (pos >= end) return false;
+    event.metaType = *pos++;
+  }
+  if (status == 0xFF || status == 0xF0 || status == 0xF7) {
+    if (status != 0xFF) runningStatus = 0;
+    if (!readVarLen(pos, end, event.length)) return false;
+  } else {
+    if (status < 0xF0) runningStatus = status;
+    event.length = messageLength(status);
+  }
+  if ((uint32_t)(end - pos) < event.length) return false;
+  event.data = pos;
+  pos += event.length;
+  return true;
+}
+
+static bool isKeptMeta(const MidiEvent& event) {
+  return event.status == 0xFF && (event.metaType == MIDI_META_SET_TEMPO || event.metaType == MIDI_META_TIME_SIGNATURE ||
+                                  event.metaType == MIDI_META_KEY_SIGNATURE);
+}
+
+static bool isNote(const MidiEvent& event) {
+  uint8_t type = event.status & 0xF0;
+  return event.status < 0xF0 && (type == 0x80 || type == 0x90);
+}
+
+// Moves to the next event; false on a malformed track
+static bool advance(TrackCursor& cursor) {
+  while (true) {
+    if (cursor.pos >= cursor.tracks[cursor.track].end) {
+      if (cursor.track >= cursor.lastTrack) {
+        cursor.done = true;
+        return true;
+      }
+      cursor.pos = cursor.tracks[++cursor.track].start;
+      cursor.runningStatus = 0;
+    }
+    uint32_t delta;
+    if (!readEvent(cursor.pos, cursor.tracks[cursor.track].end, cursor.runningStatus, delta, cursor.event)) {
+      return false;
+    }
+    if (cursor.metasOnly) {
+      if (!isKeptMeta(cursor.event)) continue;  // Not copied, so its delta is lost too
+      cursor.tick += delta;
+      return true;
+    }
+    cursor.tick += delta;
+    // End of track markers are dropped by the merge, their delta moving to the next event
+    if (cursor.event.status != 0xFF || cursor.event.metaType != MIDI_META_END_OF_TRACK) return true;
+  }
+}
+
+static bool startCursor(TrackCursor& cursor, const TrackRange* tracks, uint8_t first, uint8_t last, bool metasOnly) {
+  cursor.tracks = tracks;
+  cursor.track = first;
+  cursor.lastTrack = last;
+  cursor.metasOnly = metasOnly;
+  cursor.pos = tracks[first].start;
+  cursor.runningStatus = 0;
+  cursor.tick = 0;
+  cursor.done = false;
+  return advance(cursor);
+}
+
+// A track is melodic if its first note message is not on the percussion channel
+static bool isMelodic(const TrackRange& track, bool& melodic) {
+  const uint8_t* pos = track.start;
+  uint8_t runningStatus = 0;
+  uint32_t delta;
+  MidiEvent event;
+  melodic = false;
+  while (pos < track.end) {
+    if (!readEvent(pos, track.end, runningStatus, delta, event)) return false;
+    if (isNote(event)) {
+      melodic = (event.status & 0x0F) != MIDI_PERCUSSION_CHANNEL;
+      return true;
+    }
+  }
+  return true;
+}
+
+struct MidiLayout {
+  TrackRange tracks[MIDI_CONVERT_MAX_TRACKS];
+  uint8_t trackCount;
+  uint8_t melodicTracks[MIDI_CONVERT_MAX_TRACKS];
+  uint8_t melodicCount;
+  uint16_t ticksPerBeat;
+};
+
+// Finds the track chunks and which of them are melodic
+static MidiConvertError readLayout(const uint8_t* midi, size_t len, MidiLayout& layout) {
+  if (len < 14 || memcmp(midi, "MThd", 4) != 0 || readBE32(midi + 4) < 6 || readBE32(midi + 4) > len - 8) {
+    return MIDI_CONVERT_NOT_SMF;
+  }
+  uint16_t declaredTracks = readBE16(midi + 10);
+  layout.ticksPerBeat = readBE16(midi + 12);
+  if (layout.ticksPerBeat & 0x8000 || layout.ticksPerBeat == 0) return MIDI_CONVERT_SMPTE;
+
+  // Track chunks; other chunk types are skipped
+  layout.trackCount = 0;
+  const uint8_t* pos = midi + 8 + readBE32(midi + 4);
+  const uint8_t* end = midi + len;
+  while (layout.trackCount < declaredTracks && end - pos >= 8) {
+    uint32_t size = readBE32(pos + 4);
+    bool track = memcmp(pos, "MTrk", 4) == 0;
+    pos += 8;
+    if ((size_t)(end - pos) < size) return MIDI_CONVERT_BAD_TRACK;
+    if (track) {
+      if (layout.trackCount == MIDI_CONVERT_MAX_TRACKS) return MIDI_CONVERT_TOO_MANY_TRACKS;
+      layout.tracks[layout.trackCount++] = {pos, pos + size};
+    }
+    pos += size;
+  }
+
+  layout.melodicCount = 0;
+  for (uint8_t i = 0; i < layout.trackCount; i++) {
+    bool melodic;
+    if (!isMelodic(layout.tracks[i], melodic)) return MIDI_CONVERT_BAD_TRACK;
+    if (melodic) layout.melodicTracks[layout.melodicCount++] = i;
+  }
+  return MIDI_CONVERT_OK;
+}
+
+// One run over the merged tracks
+static MidiConvertError readNotes(const MidiLayout& layout, MidiNoteHandler handler, void* context) {
+  if (!layout.trackCount) return MIDI_CONVERT_OK;  // No tracks at all still makes a valid, empty song
+  TrackCursor cursors[MIDI_CONVERT_MAX_TRACKS + 1];
+  uint8_t cursorCount = 0;
+  if (!startCursor(cursors[cursorCount++], layout.tracks, 0, layout.trackCount - 1, true)) {
+    return MIDI_CONVERT_BAD_TRACK;
+  }
+  for (uint8_t i = 0; i < layout.melodicCount; i++) {
+    uint8_t t = layout.melodicTracks[i];
+    if (!startCursor(cursors[cursorCount++], layout.tracks, t, t, false)) return MIDI_CONVERT_BAD_TRACK;
+  }
+
+  uint32_t tempo = MIDI_DEFAULT_TEMPO;
+  uint32_t lastTick = 0;
+  double currentTime = 0.0;  // Seconds, summed per event exactly as mido does
+
+  while (true) {
+    // Earliest pending event; the first cursor wins ties, as in a stable sort of the tracks in order
+    TrackCursor* next = nullptr;
+    for (uint8_t i = 0; i < cursorCount; i++) {
+      if (!cursors[i].done && (!next || cursors[i].tick < next->tick)) next = &cursors[i];
+    }
+    if (!next) break;
+
+    const MidiEvent& event = next->event;
+    currentTime += (double)(next->tick - lastTick) * (tempo * 1e-6 / layout.ticksPerBeat);
+    lastTick = next->tick;
+
+    if (event.status == 0xFF) {
+      if (event.metaType == MIDI_META_SET_TEMPO && event.length >= 3) {
+        tempo = (uint32_t)event.data[0] << 16 | (uint32_t)event.data[1] << 8 | event.data[2];
+      }
+    } else if (isNote(event) && (event.status & 0x0F) != MIDI_PERCUSSION_CHANNEL) {
+      bool noteOn = (event.status & 0xF0) == 0x90 && event.data[1] > 0;
+      if (!handler((uint32_t)nearbyint(currentTime * 1000), event.data[0], noteOn, context)) {
+        return MIDI_CONVERT_WRITE_FAILED;
+      }
+    }
+    if (!advance(*next)) return MIDI_CONVERT_BAD_TRACK;
+  }
+  return MIDI_CONVERT_OK;
+}
+
+bool midiReadNotes(const uint8_t* midi, size_t len, MidiNoteHandler handler, void* context, MidiConvertError& error) {
+  MidiLayout layout;
+  error = readLayout(midi, len, layout);
+  if (error == MIDI_CONVERT_OK) error = readNotes(layout, handler, context);
+  return error == MIDI_CONVERT_OK;
+}
+
+struct ConvertState {
+  MidiConvertSink sink;
+  void* context;
+  uint32_t events;
+  uint32_t lastTime;
+  uint32_t notesDropped;
+  int8_t activeNotes[7];  // Note held on each string, -1 when free
+};
+
+static void startConvert(ConvertState& state, MidiConvertSink sink, void* context) {
+  state.sink = sink;
+  state.context = context;
+  state.events = 0;
+  state.lastTime = 0;
+  state.notesDropped = 0;
+  memset(state.activeNotes, -1, sizeof(state.activeNotes));
+}
+
+static bool emit(ConvertState& state, uint32_t time, uint8_t string, uint8_t fret) {
+  state.events++;
+  state.lastTime = time;
+  if (!state.sink) return true;
+  uint8_t event[MIDI_CONVERT_EVENT_SIZE] = {(uint8_t)(time >> 24), (uint8_t)(time >> 16), (uint8_t)(time >> 8),
+                                            (uint8_t)time, (uint8_t)(string << 5 | fret)};
+  return state.sink(event, sizeof(event), state.context);
+}
+
+// The backend's string assignment: the lowest free string that reaches the note
+static bool assignString(uint32_t time, uint8_t note, bool on, void* context) {
+  ConvertState& state = *(ConvertState*)context;
+  if (on) {
+    for (uint8_t s = 6; s >= 1; s--) {
+      int fret = (int)note - openNotes[s];
+      if (fret >= 0 && fret <= MIDI_CONVERT_MAX_FRET && state.activeNotes[s] < 0) {
+        state.activeNotes[s] = note;
+        return emit(state, time, s, fret);
+      }
+    }
+    state.notesDropped++;
+    return true;
+  }
+  for (uint8_t s = 6; s >= 1; s--) {
+    if (state.activeNotes[s] == note) {
+      state.activeNotes[s] = -1;
+      return emit(state, time, s, 31);
+    }
+  }
+  return true;
+}
+
+bool midiConvert(const uint8_t* midi, size_t len, MidiConvertSink sink, void* context, MidiConvertResult& result) {
+  memset(&result, 0, sizeof(result));
+  MidiLayout layout;
+  result.error = readLayout(midi, len, layout);
+  if (result.error != MIDI_CONVERT_OK) return false;
+  result.tracks = layout.melodicCount;
+
+  ConvertState state;
+  startConvert(state, nullptr, nullptr);
+  result.error = readNotes(layout, assignString, &state);
+  if (result.error == MIDI_CONVERT_OK && state.events > 0xFFFF) result.error = MIDI_CONVERT_TOO_MANY_EVENTS;
+  if (result.error != MIDI_CONVERT_OK) return false;
+  result.events = state.events;
+  result.notesDropped = state.notesDropped;
+  result.durationMs = state.lastTime / 1000 * 1000;  // The backend goes through "m:ss"
+  if (!sink) return true;
+
+  uint8_t header[MIDI_CONVERT_HEADER_SIZE] = {(uint8_t)(result.durationMs >> 24), (uint8_t)(result.durationMs >> 16),
+                                              (uint8_t)(result.durationMs >> 8), (uint8_t)result.durationMs,
+                                              (uint8_t)(result.events >> 8), (uint8_t)result.events};
+  if (!sink(header, sizeof(header), context)) {
+    result.error = MIDI_CONVERT_WRITE_FAILED;
+    return false;
+  }
+  startConvert(state, sink, context);
+  result.error = readNotes(layout, assignString, &state);
+  return result.error == MIDI_CONVERT_OK;
+}
+
+size_t midiConvertOutputSize(const MidiConvertResult& result) {
+  return MIDI_CONVERT_HEADER_SIZE + (size_t)result.events * MIDI_CONVERT_EVENT_SIZE;
+}
+
+const char* midiConvertErrorText(MidiConvertError error) {
+  switch (error) {
+    case MIDI_CONVERT_OK: return "ok";
+    case MIDI_CONVERT_NOT_SMF: return "not a Standard MIDI File";
+    case MIDI_CONVERT_SMPTE: return "SMPTE time division is not supported";
+    case MIDI_CONVERT_TOO_MANY_TRACKS: return "too many tracks";
+    case MIDI_CONVERT_BAD_TRACK: return "malformed track";
+    case MIDI_CONVERT_TOO_MANY_EVENTS: return "too many events for one song";
+    case MIDI_CONVERT_WRITE_FAILED: return "could not write the song";
+  }
+  return "unknown error";
+}
@@ -0,0 +1,90 @@
+#ifndef MIDI_CONVERT_H
+#define MIDI_CONVERT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Standard MIDI File to song .bin conversion, so /upload-midi needs no backend
+ * Follows the backend's process_midi_to_guitar_from_midi() and
+ * serialize_guitar_events_micro() rule for rule, so both produce the same bytes:
+ * - percussion tracks (first note on channel 10) are dropped; tempo, time and
+ *   key signature metas of every track are also gathered into a first track
+ * - tracks are merged by tick, earlier tracks first on ties
+ * - each note takes the lowest free string that reaches it within
+ *   MIDI_CONVERT_MAX_FRET, else it is dropped; a note off frees the first
+ *   string (low E first) holding that note
+ * - times are accumulated in seconds as doubles and rounded half to even
+ * Tracks are merged in place from the file buffer; nothing is allocated.
+ * Kept free of Arduino dependencies so it can be built and measured on host.
+ */
+
+#define MIDI_CONVERT_MAX_FRET 12          // Frets the fretting solenoids reach
+#define MIDI_CONVERT_MAX_TRACKS 32
+#define MIDI_CONVERT_MAX_SIZE 98304       // Largest .mid /upload-midi buffers
+#define MIDI_CONVERT_HEADER_SIZE 6        // Duration (4 BE) + event count (2 BE)
+#define MIDI_CONVERT_EVENT_SIZE 5         // Time (4 BE) + string << 5 | fret (31 = off)
+
+enum MidiConvertError : uint8_t {
+  MIDI_CONVERT_OK,
+  MIDI_CONVERT_NOT_SMF,          // No MThd header
+  MIDI_CONVERT_SMPTE,            // SMPTE time division is not supported
+  MIDI_CONVERT_TOO_MANY_TRACKS,
+  MIDI_CONVERT_BAD_TRACK,        // Truncated chunk or malformed event
+  MIDI_CONVERT_TOO_MANY_EVENTS,  // More than the 16-bit event count holds
+  MIDI_CONVERT_WRITE_FAILED      // The sink or note handler stopped the conversion
+};
+
+struct MidiConvertResult {
+  MidiConvertError error;
+  uint32_t durationMs;    // As written in the header: last event time cut to whole seconds
+  uint32_t events;
+  uint32_t notesDropped;  // No free string within reach
+  uint16_t tracks;        // Melodic tracks merged
+};
+
+/**
+ * Receives the .bin output in order: the header, then one call per event
+ *
+ * @return false to stop the conversion (MIDI_CONVERT_WRITE_FAILED)
+ */
+typedef bool (*MidiConvertSink)(const uint8_t* data, size_t len, void* context);
+
+/**
+ * Converts a whole .mid file held in memory
+ * Runs twice over the file, first to count events for the header, then to emit them
+ *
+ * @param midi File contents
+ * @param len File length
+ * @param sink Output writer, or nullptr to only fill in result
+ * @param context Passed to sink
+ * @param result Counts, and the error on failure
+ * @return true on success
+ */
+bool midiConvert(const uint8_t* midi, size_t len, MidiConvertSink sink, void* context, MidiConvertResult& result);
+
+/**
+ * Receives the notes of the melodic tracks, merged and timed as above
+ *
+ * @param timeMs Song time of the note on or off
+ * @param on Note on; note offs include note ons with velocity 0
+ * @return false to stop reading (MIDI_CONVERT_WRITE_FAILED)
+ */
+typedef bool (*MidiNoteHandler)(uint32_t timeMs, uint8_t note, bool on, void* context);
+
+/**
+ * Walks the notes of a .mid file without assigning strings, for other
+ * assignment engines (MCU_model/include/fret_optimizer.hpp)
+ *
+ * @return false on a malformed file, with the reason in error
+ */
+bool midiReadNotes(const uint8_t* midi, size_t len, MidiNoteHandler handler, void* context, MidiConvertError& error);
+
+/**
+ * Size of the .bin a successful conversion produced
+ */
+size_t midiConvertOutputSize(const MidiConvertResult& result);
+
+const char* midiConvertErrorText(MidiConvertError error);
+
+#endif
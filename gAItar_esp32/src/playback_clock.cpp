@@ -0,0 +1,191 @@
+#include "playback_clock.h"
+#include "ws_notify.h"
+
+// Clock state, moved by the async_tcp task (commands) and the status task (STATUS)
+static portMUX_TYPE clockMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t anchorPosition = 0;   // Song position at anchorAt
+static unsigned long anchorAt = 0;
+static int32_t correction = 0;        // STATUS error slewed in over correctionWindow (ms)
+static uint32_t correctionWindow = PLAYBACK_CLOCK_SLEW_MS;
+static uint16_t ratePercent = 100;
+static bool running = false;
+static uint32_t totalTime = 0;        // 0 until a STATUS for the song arrives
+static uint32_t lastStatusTime = 0;
+static char songPath[128] = "";
+static unsigned long commandAt = 0;
+static bool commandPending = false;   // STATUS inside the grace period is ignored
+static bool changed = false;          // Broadcast on the next loop even if not due
+
+static volatile unsigned updateHz = PLAYBACK_CLOCK_DEFAULT_HZ;
+static unsigned long lastUpdateAt = 0;  // Status task only
+
+// Since boot
+static uint32_t updates = 0;
+static uint32_t statusLines = 0;
+static uint32_t statusIgnored = 0;
+static uint32_t slews = 0;
+static uint32_t snaps = 0;
+static uint64_t errorTotal = 0;       // Sum of |error| over slews and snaps
+static uint32_t errorMax = 0;
+
+// Position at now; clockMux held
+static uint32_t positionAt(unsigned long now) {
+  int64_t position = anchorPosition;
+  if (running) {
+    int64_t elapsed = (int64_t)(now - anchorAt);
+    position += elapsed * ratePercent / 100;
+    position += elapsed >= correctionWindow ? correction : (int64_t)correction * elapsed / correctionWindow;
+  }
+  if (position < 0) position = 0;
+  if (totalTime && position > totalTime) position = totalTime;
+  return position;
+}
+
+// Moves the anchor to now with the correction so far folded in; clockMux held
+static void reanchor(unsigned long now) {
+  anchorPosition = positionAt(now);
+  anchorAt = now;
+  correction = 0;
+}
+
+static void setPosition(unsigned long now, uint32_t position) {
+  anchorPosition = position;
+  anchorAt = now;
+  correction = 0;
+}
+
+// clockMux held
+static void commandApplied(unsigned long now) {
+  commandAt = now;
+  commandPending = true;
+  changed = true;
+}
+
+void playbackClockStatus(uint32_t currentTime, uint32_t total) {
+  unsigned long now = millis();
+  portENTER_CRITICAL(&clockMux);
+  statusLines++;
+  if (commandPending && now - commandAt < PLAYBACK_CLOCK_GRACE_MS) {
+    // May have been sent before the command took effect
+    statusIgnored++;
+    portEXIT_CRITICAL(&clockMux);
+    return;
+  }
+  commandPending = false;
+
+  bool playing = currentTime > 0 && currentTime != lastStatusTime;
+  lastStatusTime = currentTime;
+  totalTime = total;
+  uint32_t predicted = positionAt(now);
+  int32_t error = (int32_t)(currentTime - predicted);
+  uint32_t absError = error < 0 ? -error : error;
+
+  if (running && playing) {
+    errorTotal += absError;
+    if (absError > errorMax) errorMax = absError;
+  }
+  if (running && playing && absError <= PLAYBACK_CLOCK_SNAP_MS) {
+    setPosition(now, predicted);
+    correction = error;
+    // Long enough that a negative correction leaves at least half speed, so the position never goes back
+    correctionWindow = max((uint32_t)PLAYBACK_CLOCK_SLEW_MS, 2 * absError * 100 / ratePercent);
+    slews++;
+  } else {
+    if (running && playing) snaps++;
+    setPosition(now, currentTime);
+  }
+  running = playing;
+  changed = true;
+  portEXIT_CRITICAL(&clockMux);
+}
+
+void playbackClockPlay(const char *path) {
+  unsigned long now = millis();
+  portENTER_CRITICAL(&clockMux);
+  reanchor(now);
+  bool resume = !running && anchorPosition > 0 && strcmp(path, songPath) == 0;
+  if (!resume) {
+    setPosition(now, 0);
+    totalTime = 0;
+    snprintf(songPath, sizeof(songPath), "%s", path);
+  }
+  running = true;
+  commandApplied(now);
+  portEXIT_CRITICAL(&clockMux);
+}
+
+void playbackClockPause() {
+  unsigned long now = millis();
+  portENTER_CRITICAL(&clockMux);
+  reanchor(now);
+  running = false;
+  commandApplied(now);
+  portEXIT_CRITICAL(&clockMux);
+}
+
+void playbackClockResume() {
+  unsigned long now = millis();
+  portENTER_CRITICAL(&clockMux);
+  reanchor(now);
+  running = anchorPosition > 0; // A stopped song is not resumed
+  commandApplied(now);
+  portEXIT_CRITICAL(&clockMux);
+}
+
+void playbackClockSeek(uint32_t position) {
+  unsigned long now = millis();
+  portENTER_CRITICAL(&clockMux);
+  setPosition(now, totalTime && position > totalTime ? totalTime : position);
+  commandApplied(now);
+  portEXIT_CRITICAL(&clockMux);
+}
+
+void playbackClockRate(uint16_t percent) {
+  if (percent < PLAYBACK_CLOCK_RATE_MIN || percent > PLAYBACK_CLOCK_RATE_MAX) return; // Rejected there too
+  unsigned long now = millis();
+  portENTER_CRITICAL(&clockMux);
+  reanchor(now);
+  ratePercent = percent;
+  commandApplied(now);
+  portEXIT_CRITICAL(&clockMux);
+}
+
+uint32_t playbackClockLoop() {
+  unsigned long now = millis();
+  unsigned hz = updateHz;
+  uint32_t interval = hz ? 1000 / hz : UINT32_MAX;
+
+  portENTER_CRITICAL(&clockMux);
+  bool playing = running;
+  bool due = changed || (playing && hz && now - lastUpdateAt >= interval);
+  uint32_t position = 0, total = totalTime;
+  if (due) {
+    position = positionAt(now);
+    changed = false;
+  }
+  portEXIT_CRITICAL(&clockMux);
+
+  if (!due) {
+    return playing && hz ? interval - (now - lastUpdateAt) : UINT32_MAX;
+  }
+  lastUpdateAt = now;
+  updates++;
+  notifyPlaybackPosition(position, total);
+  return playing ? interval : UINT32_MAX;
+}
+
+void playbackClockSetUpdateHz(unsigned hz) {
+  updateHz = min(hz, (unsigned)PLAYBACK_CLOCK_MAX_HZ);
+}
+
+void reportPlaybackClockStats(Print &out) {
+  portENTER_CRITICAL(&clockMux);
+  uint32_t lines = statusLines, ignored = statusIgnored, slewed = slews, snapped = snaps, worst = errorMax;
+  uint64_t errorSum = errorTotal;
+  portEXIT_CRITICAL(&clockMux);
+  uint32_t corrections = slewed + snapped ? slewed + snapped : 1;
+  out.printf("playback clock %u Hz, %lu position updates\n", updateHz, (unsigned long)updates);
+  out.printf("%lu STATUS lines (%lu ignored after commands), %lu slewed, %lu snapped, error avg %lu ms max %lu ms\n",
+             (unsigned long)lines, (unsigned long)ignored, (unsigned long)slewed, (unsigned long)snapped,
+             (unsigned long)(errorSum / corrections), (unsigned long)worst);
+}
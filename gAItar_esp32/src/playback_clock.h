@@ -0,0 +1,65 @@
+#ifndef PLAYBACK_CLOCK_H
+#define PLAYBACK_CLOCK_H
+
+#include <Arduino.h>
+
+/**
+ * Song position kept on the ESP32 between the Grand Central's STATUS lines
+ * STATUS only arrives once a second, so in between the position runs on
+ * millis() at the known playback rate and is broadcast to websocket clients
+ * at the update rate, without any extra traffic on the instruction UART
+ * - Each STATUS disciplines the clock: a small error is slewed out over at
+ *   least PLAYBACK_CLOCK_SLEW_MS so the position keeps moving forward, a
+ *   larger one (a seek from elsewhere, another song) is taken at once
+ * - A STATUS with currentTime 0 or unchanged since the last one means stopped
+ *   or paused, and freezes the clock
+ * - Commands forwarded to the Grand Central move the clock right away; STATUS
+ *   lines that may have crossed them are ignored for PLAYBACK_CLOCK_GRACE_MS
+ */
+
+#define PLAYBACK_CLOCK_DEFAULT_HZ 30   // Position broadcasts per second while playing
+#define PLAYBACK_CLOCK_MAX_HZ 60
+#define PLAYBACK_CLOCK_SLEW_MS 1000    // Shortest time a STATUS error is spread over
+#define PLAYBACK_CLOCK_SNAP_MS 500     // Larger errors are taken at once
+#define PLAYBACK_CLOCK_GRACE_MS 250    // Covers the instruction ACK retries
+#define PLAYBACK_CLOCK_RATE_MIN 25     // Same limits as setPlaybackRate() on the Grand Central
+#define PLAYBACK_CLOCK_RATE_MAX 400
+
+/**
+ * Disciplines the clock with the time fields of a STATUS line
+ * Called from the status task
+ */
+void playbackClockStatus(uint32_t currentTime, uint32_t totalTime);
+
+/**
+ * Command hints, called when the matching instruction is queued
+ * Play resumes when the paused song is requested again and restarts otherwise,
+ * as playSong() on the Grand Central does
+ */
+void playbackClockPlay(const char *path);
+void playbackClockPause();
+void playbackClockResume();
+void playbackClockSeek(uint32_t position);
+void playbackClockRate(uint16_t percent);
+
+/**
+ * Broadcasts the position when an update is due, or the clock was moved
+ * Called from the status task
+ *
+ * @return ms until the next update is due; UINT32_MAX while not playing
+ */
+uint32_t playbackClockLoop();
+
+/**
+ * Sets the broadcast rate while playing
+ *
+ * @param hz 0 to PLAYBACK_CLOCK_MAX_HZ; 0 broadcasts only on STATUS lines and commands
+ */
+void playbackClockSetUpdateHz(unsigned hz);
+
+/**
+ * Prints the update rate, STATUS corrections and the error they found
+ */
+void reportPlaybackClockStats(Print &out);
+
+#endif
@@ -0,0 +1,314 @@
+#include "song_cache.h"
+#include "uart.h"
+#include "song_search.h"
+#include "SPIFFS.h"
+#include "FS.h"
+#include <ArduinoJson.h>
+
+#define SONG_CACHE_MAGIC 0x42494c47UL  // "GLIB"
+
+/**
+ * SPIFFS mirror header, followed by entriesSize bytes of entries
+ */
+struct SongCacheFileHeader {
+  uint32_t magic;
+  uint32_t generation;
+  uint32_t entriesSize;
+  uint16_t songCount;
+  uint16_t reserved;
+};
+
+// Published library (read by the web server task, guarded by cacheMutex)
+static SemaphoreHandle_t cacheMutex = nullptr;
+static uint8_t *entries = nullptr;
+static size_t entriesSize = 0;
+static uint16_t songCount = 0;
+static uint32_t cachedGeneration = 0;
+static bool cacheValid = false;
+
+// Fill in progress (status task only)
+static uint8_t *fillData = nullptr;
+static size_t fillSize = 0;
+static size_t fillCapacity = 0;
+static uint16_t fillCount = 0;
+static uint16_t pageOffset = 0;
+static uint16_t pageCount = 0;
+static uint32_t fillGeneration = 0;
+static uint8_t fillId = SONG_CACHE_FIRST_LIST_ID;
+static bool filling = false;
+static bool pageOpen = false;           // Receiving a page of the current fill
+static unsigned long requestSentAt = 0;
+static unsigned long lastFailure = 0;
+static bool fillFailed = false;
+static volatile bool restartFill = false; // Set by songCacheInvalidate() from other tasks
+
+// Latest generation reported by the Grand Central
+static bool generationKnown = false;
+static uint32_t latestGeneration = 0;
+
+static void setValid(bool valid) {
+  xSemaphoreTake(cacheMutex, portMAX_DELAY);
+  cacheValid = valid;
+  xSemaphoreGive(cacheMutex);
+}
+
+/**
+ * Replaces the published library with a complete one
+ * Takes ownership of data (malloc'd)
+ */
+static void publish(uint8_t *data, size_t size, uint16_t count, uint32_t generation, bool valid) {
+  xSemaphoreTake(cacheMutex, portMAX_DELAY);
+  free(entries);
+  entries = data;
+  entriesSize = size;
+  songCount = count;
+  cachedGeneration = generation;
+  cacheValid = valid;
+  xSemaphoreGive(cacheMutex);
+  songSearchRebuild(data, size, count); // Only the status task and setup() publish, so data stays alive
+}
+
+// Checks that a buffer holds exactly count well-formed entries
+static bool entriesWellFormed(const uint8_t *data, size_t size, uint16_t count) {
+  size_t pos = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    if (pos >= size || data[pos] < 9) return false;
+    pos += 1 + data[pos];
+  }
+  return pos == size;
+}
+
+static void saveMirror() {
+  File file = SPIFFS.open(SONG_CACHE_PATH, FILE_WRITE);
+  if (!file) {
+    Serial.println("Failed to write library cache to SPIFFS");
+    return;
+  }
+  SongCacheFileHeader header = {SONG_CACHE_MAGIC, cachedGeneration, (uint32_t)entriesSize, songCount, 0};
+  bool ok = file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            file.write(entries, entriesSize) == entriesSize;
+  file.close();
+  if (!ok) {
+    SPIFFS.remove(SONG_CACHE_PATH);
+  }
+}
+
+void songCacheBegin() {
+  cacheMutex = xSemaphoreCreateMutex();
+
+  File file = SPIFFS.open(SONG_CACHE_PATH, FILE_READ);
+  if (!file) return;
+
+  SongCacheFileHeader header;
+  uint8_t *data = nullptr;
+  bool ok = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            header.magic == SONG_CACHE_MAGIC && header.entriesSize == file.size() - sizeof(header) &&
+            (data = (uint8_t *)malloc(header.entriesSize + 1)) != nullptr &&
+            file.read(data, header.entriesSize) == header.entriesSize &&
+            entriesWellFormed(data, header.entriesSize, header.songCount);
+  file.close();
+
+  if (!ok) {
+    free(data);
+    Serial.println("Library cache mirror unreadable, discarding");
+    SPIFFS.remove(SONG_CACHE_PATH);
+    return;
+  }
+
+  // Served right away; the first STATUS line confirms or refreshes it
+  publish(data, header.entriesSize, header.songCount, header.generation, true);
+  Serial.printf("Library cache loaded: %u songs, generation %08lx\n", header.songCount,
+                (unsigned long)header.generation);
+}
+
+static void requestPage(uint16_t offset) {
+  uint8_t command[16];
+  InstructionOpWriter op(command, sizeof(command), INSTRUCTION_OP_LIST);
+  op.u8(INSTRUCTION_ARG_REQUEST_ID, fillId);
+  op.u16(INSTRUCTION_ARG_OFFSET, offset);
+  op.u16(INSTRUCTION_ARG_LIMIT, SONG_CACHE_PAGE_SIZE);
+  instructionOpToSAMD(command, op.length());
+  requestSentAt = millis();
+}
+
+static void startFill() {
+  // New id per fill so replies to an abandoned fill are ignored
+  fillId = fillId == 0xFF ? SONG_CACHE_FIRST_LIST_ID : fillId + 1;
+  fillSize = 0;
+  fillCount = 0;
+  pageOpen = false;
+  filling = true;
+  requestPage(0);
+}
+
+static void failFill(const char *reason) {
+  Serial.printf("Library cache fill failed: %s\n", reason);
+  filling = false;
+  pageOpen = false;
+  fillFailed = true;
+  lastFailure = millis();
+}
+
+void songCacheLoop() {
+  if (restartFill) {
+    restartFill = false;
+    if (filling) startFill(); // Pages received so far may predate the change
+  }
+  if (filling) {
+    if (millis() - requestSentAt > SONG_CACHE_TIMEOUT_MS) {
+      failFill("no reply from Grand Central");
+    }
+    return;
+  }
+  if (cacheValid) return; // Only this task sets it true
+  if (fillFailed && millis() - lastFailure < SONG_CACHE_RETRY_MS) return;
+  startFill();
+}
+
+void songCacheInvalidate() {
+  setValid(false);
+  restartFill = true;
+}
+
+void songCacheCheckGeneration(uint32_t generation) {
+  generationKnown = true;
+  latestGeneration = generation;
+  if (cacheValid && generation != cachedGeneration) {
+    Serial.printf("Library changed on Grand Central (generation %08lx), refreshing cache\n",
+                  (unsigned long)generation);
+    setValid(false);
+  }
+}
+
+void songCacheBeginPage(uint8_t id, uint16_t offset) {
+  pageOpen = filling && id == fillId && offset == fillCount;
+  pageOffset = offset;
+  pageCount = 0;
+}
+
+void songCacheAddEntry(const uint8_t *entry, size_t len) {
+  if (!pageOpen) return;
+  if (fillSize + 1 + len > fillCapacity) {
+    size_t capacity = fillCapacity ? fillCapacity * 2 : 4096;
+    uint8_t *grown = (uint8_t *)realloc(fillData, capacity);
+    if (!grown) {
+      failFill("out of memory");
+      return;
+    }
+    fillData = grown;
+    fillCapacity = capacity;
+  }
+  fillData[fillSize++] = len;
+  memcpy(fillData + fillSize, entry, len);
+  fillSize += len;
+  fillCount++;
+  pageCount++;
+}
+
+void songCacheEndPage(uint16_t total, uint32_t generation) {
+  if (!pageOpen) return;
+  pageOpen = false;
+
+  if (pageOffset == 0) {
+    fillGeneration = generation;
+  } else if (generation != fillGeneration) {
+    startFill(); // Catalog changed between pages
+    return;
+  }
+
+  if (pageCount > 0 && fillCount < total) {
+    requestPage(fillCount);
+    return;
+  }
+
+  // Complete - hand the buffer over (shrunk to size) and mirror it
+  uint8_t *data = (uint8_t *)realloc(fillData, fillSize + 1);
+  publish(data ? data : fillData, fillSize, fillCount, generation,
+          !generationKnown || generation == latestGeneration);
+  fillData = nullptr;
+  fillCapacity = 0;
+  filling = false;
+  fillFailed = false;
+  saveMirror();
+  Serial.printf("Library cache filled: %u songs, generation %08lx\n", fillCount, (unsigned long)generation);
+}
+
+void songCacheAbortPage() {
+  if (pageOpen) {
+    failFill("incomplete List frame");
+  }
+}
+
+static bool prefixMatches(const char *field, uint8_t len, const String &prefix) {
+  return prefix.isEmpty() || (prefix.length() <= len && strncasecmp(field, prefix.c_str(), prefix.length()) == 0);
+}
+
+// Same rule as the Grand Central: case-insensitive prefix per path component
+static bool entryMatches(const uint8_t *entry, const String &genre, const String &artist, const String &title) {
+  if (genre.isEmpty() && artist.isEmpty() && title.isEmpty()) return true;
+  uint8_t genreLen = entry[7], artistLen = entry[8], titleLen = entry[9];
+  size_t pathLen = entry[0] - 9;
+  if (!genreLen || 3u + genreLen + artistLen + titleLen > pathLen) return false;
+
+  const char *genreField = (const char *)entry + 11;
+  const char *artistField = genreField + genreLen + 1;
+  const char *titleField = artistField + artistLen + 1;
+  return prefixMatches(genreField, genreLen, genre) && prefixMatches(artistField, artistLen, artist) &&
+         prefixMatches(titleField, titleLen, title);
+}
+
+static String requestParam(AsyncWebServerRequest *request, const char *name) {
+  return request->hasParam(name) ? request->getParam(name)->value() : String();
+}
+
+bool songCacheServe(AsyncWebServerRequest *request) {
+  if (!cacheMutex || xSemaphoreTake(cacheMutex, pdMS_TO_TICKS(100)) != pdTRUE) return false;
+  if (!cacheValid) {
+    xSemaphoreGive(cacheMutex);
+    return false;
+  }
+
+  // The body depends only on the URL and the catalog generation
+  char etag[12];
+  snprintf(etag, sizeof(etag), "\"%08lx\"", (unsigned long)cachedGeneration);
+  if (request->hasHeader("If-None-Match") && request->getHeader("If-None-Match")->value().indexOf(etag) >= 0) {
+    xSemaphoreGive(cacheMutex);
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("ETag", etag);
+    request->send(response);
+    return true;
+  }
+
+  long offset = requestParam(request, "offset").toInt();
+  long limit = request->hasParam("limit") ? requestParam(request, "limit").toInt() : SONG_CACHE_DEFAULT_LIMIT;
+  if (offset < 0) offset = 0;
+  if (limit <= 0) limit = SONG_CACHE_DEFAULT_LIMIT;
+  if (limit > SONG_CACHE_MAX_LIMIT) limit = SONG_CACHE_MAX_LIMIT;
+  String genre = requestParam(request, "genre");
+  String artist = requestParam(request, "artist");
+  String title = requestParam(request, "title");
+
+  JsonDocument page;
+  page["offset"] = offset;
+  JsonArray songs = page["songs"].to<JsonArray>();
+  long matched = 0;
+  for (size_t pos = 0; pos < entriesSize; pos += 1 + entries[pos]) {
+    const uint8_t *entry = entries + pos;
+    if (!entryMatches(entry, genre, artist, title)) continue;
+    if (matched >= offset && matched - offset < limit) {
+      addSongListEntry(songs, entry + 1, entry[0]);
+    }
+    matched++;
+  }
+  page["total"] = matched;
+  page["generation"] = cachedGeneration;
+  xSemaphoreGive(cacheMutex);
+
+  String body;
+  serializeJson(page, body);
+  AsyncWebServerResponse *response = request->beginResponse(200, "application/json", body);
+  response->addHeader("ETag", etag);
+  response->addHeader("Cache-Control", "no-cache"); // Browser revalidates and gets 304
+  request->send(response);
+  return true;
+}
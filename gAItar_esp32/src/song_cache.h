@@ -0,0 +1,70 @@
+#ifndef SONG_CACHE_H
+#define SONG_CACHE_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+/**
+ * Copy of the Grand Central song library kept in RAM and mirrored to SPIFFS
+ * Filled from the status task with paged List requests and tagged with the catalog
+ * generation the Grand Central reports; a different generation in a STATUS
+ * line (or a finished upload) marks it stale and starts a refill
+ * While valid, /existing-songs is answered from RAM with an ETag derived from
+ * the generation, so a revalidating browser gets 304 without any UART traffic
+ *
+ * Entries are kept in List frame layout (see songIndexList() on the Grand
+ * Central): len(u8) duration(u32) events(u16) genreLen artistLen titleLen path
+ */
+
+#define SONG_CACHE_PATH "/library.bin"   // SPIFFS mirror, loaded at boot
+#define SONG_CACHE_FIRST_LIST_ID 0xF0    // List request ids 0xF0-0xFF belong to cache fills
+#define SONG_CACHE_PAGE_SIZE 200         // Songs per List request (Grand Central maximum)
+#define SONG_CACHE_TIMEOUT_MS 5000       // Reply deadline per page
+#define SONG_CACHE_RETRY_MS 2000         // Wait before retrying a failed fill
+#define SONG_CACHE_DEFAULT_LIMIT 50      // Same paging defaults as the Grand Central
+#define SONG_CACHE_MAX_LIMIT 200
+
+/**
+ * Loads the SPIFFS mirror, if any
+ * Called once from setup() after SPIFFS is mounted
+ */
+void songCacheBegin();
+
+/**
+ * Starts or continues a fill when the cache is stale
+ * Called from the status task
+ */
+void songCacheLoop();
+
+/**
+ * Marks the cache stale (the catalog is known to have changed)
+ * Safe from any task; a fill in progress restarts on the next songCacheLoop()
+ */
+void songCacheInvalidate();
+
+/**
+ * Compares the generation reported by the Grand Central with the cached one
+ *
+ * @param generation Catalog generation from a STATUS line
+ */
+void songCacheCheckGeneration(uint32_t generation);
+
+/**
+ * Answers GET /existing-songs from RAM (200 with ETag, or 304)
+ * Called from the web server task
+ *
+ * @return false if the cache is stale and the request was not answered
+ */
+bool songCacheServe(AsyncWebServerRequest *request);
+
+/**
+ * List frame callbacks for frames with an id from SONG_CACHE_FIRST_LIST_ID up
+ * Called from the status task by the instruction UART reader; frames that do not
+ * belong to the current fill are ignored
+ */
+void songCacheBeginPage(uint8_t id, uint16_t offset);
+void songCacheAddEntry(const uint8_t *entry, size_t len);
+void songCacheEndPage(uint16_t total, uint32_t generation);
+void songCacheAbortPage();
+
+#endif
@@ -0,0 +1,305 @@
+#include "song_search.h"
+#include "uart.h"
+#include <ArduinoJson.h>
+#include <algorithm>
+
+#define SONG_ENTRY_META 9  // duration(u32) events(u16) genreLen artistLen titleLen
+
+/**
+ * One word of a title or artist, pointing into the entry pool
+ */
+struct SearchKey {
+  uint16_t song;   // Index into songOffsets
+  uint8_t start;   // Offset of the word in the song path
+  uint8_t length;  // Bytes from the word to the end of its field
+};
+
+/**
+ * Songs and their keys; a rebuild fills a fresh one and swaps it in
+ */
+struct SearchIndex {
+  uint8_t *pool;          // Entries in List frame layout, each prefixed with its length
+  size_t poolSize;
+  size_t poolCapacity;
+  uint32_t *songOffsets;  // Offset of each song's entry in pool
+  size_t songCount;
+  size_t songCapacity;
+  SearchKey *keys;        // Sorted case-insensitively by text
+  size_t keyCount;
+  size_t keyCapacity;
+};
+
+// Current index (written by the status and upload tasks, read by the web server task, guarded by searchMutex)
+static SemaphoreHandle_t searchMutex = nullptr;
+static SearchIndex current = {};
+static bool indexReady = false;
+
+template <typename T>
+static bool growArray(T *&array, size_t &capacity, size_t needed, size_t initial) {
+  if (needed <= capacity) return true;
+  size_t grown = capacity ? capacity : initial;
+  while (grown < needed) grown *= 2;
+  T *resized = (T *)realloc(array, grown * sizeof(T));
+  if (!resized) return false;
+  array = resized;
+  capacity = grown;
+  return true;
+}
+
+static void freeIndex(SearchIndex &index) {
+  free(index.pool);
+  free(index.songOffsets);
+  free(index.keys);
+  index = {};
+}
+
+static const uint8_t *songEntry(const SearchIndex &index, size_t song) {
+  return index.pool + index.songOffsets[song];
+}
+
+static const char *songPath(const uint8_t *entry) {
+  return (const char *)entry + 1 + SONG_ENTRY_META;
+}
+
+static const char *keyText(const SearchIndex &index, const SearchKey &key) {
+  return songPath(songEntry(index, key.song)) + key.start;
+}
+
+// Case-insensitive three-way compare; a shorter string sorts before its extensions
+static int compareFolded(const char *a, size_t aLen, const char *b, size_t bLen) {
+  size_t n = aLen < bLen ? aLen : bLen;
+  for (size_t i = 0; i < n; i++) {
+    int diff = tolower((uint8_t)a[i]) - tolower((uint8_t)b[i]);
+    if (diff) return diff;
+  }
+  return (aLen > bLen) - (aLen < bLen);
+}
+
+static void sortKeys(SearchIndex &index, size_t from) {
+  auto less = [&index](const SearchKey &x, const SearchKey &y) {
+    int order = compareFolded(keyText(index, x), x.length, keyText(index, y), y.length);
+    return order ? order < 0 : x.song < y.song;
+  };
+  std::sort(index.keys + from, index.keys + index.keyCount, less);
+  if (from > 0) {
+    std::inplace_merge(index.keys, index.keys + from, index.keys + index.keyCount, less);
+  }
+}
+
+// One key per word; words start the field or follow a '_'
+static bool addFieldKeys(SearchIndex &index, uint16_t song, const char *path, uint8_t start, uint8_t length) {
+  for (uint8_t i = 0; i < length; i++) {
+    bool wordStart = (i == 0 || path[start + i - 1] == '_') && path[start + i] != '_';
+    if (!wordStart) continue;
+    if (!growArray(index.keys, index.keyCapacity, index.keyCount + 1, 1024)) return false;
+    index.keys[index.keyCount++] = {song, (uint8_t)(start + i), (uint8_t)(length - i)};
+  }
+  return true;
+}
+
+// Appends the keys of one song (none if its path is not "/genre/artist/title")
+static bool addSongKeys(SearchIndex &index, uint16_t song) {
+  const uint8_t *entry = songEntry(index, song);
+  uint8_t genreLen = entry[7], artistLen = entry[8], titleLen = entry[9];
+  size_t pathLen = entry[0] - SONG_ENTRY_META;
+  if (!genreLen || 3u + genreLen + artistLen + titleLen > pathLen) return true;
+
+  const char *path = songPath(entry);
+  return addFieldKeys(index, song, path, 2 + genreLen, artistLen) &&
+         addFieldKeys(index, song, path, 3 + genreLen + artistLen, titleLen);
+}
+
+void songSearchBegin() {
+  searchMutex = xSemaphoreCreateMutex();
+}
+
+void songSearchRebuild(const uint8_t *entries, size_t size, uint16_t count) {
+  unsigned long start = micros();
+  SearchIndex fresh = {};
+  bool ok = growArray(fresh.pool, fresh.poolCapacity, size + 1, size + 1) &&
+            growArray(fresh.songOffsets, fresh.songCapacity, count + 1, count + 1);
+  if (ok) {
+    memcpy(fresh.pool, entries, size);
+    fresh.poolSize = size;
+    for (size_t pos = 0; ok && pos < size && fresh.songCount < count; pos += 1 + entries[pos]) {
+      fresh.songOffsets[fresh.songCount] = pos;
+      ok = addSongKeys(fresh, fresh.songCount);
+      fresh.songCount++;
+    }
+  }
+  if (!ok) {
+    freeIndex(fresh);
+    Serial.println("Out of memory building the search index");
+    return;
+  }
+  sortKeys(fresh, 0);
+
+  xSemaphoreTake(searchMutex, portMAX_DELAY);
+  SearchIndex old = current;
+  current = fresh;
+  indexReady = true;
+  xSemaphoreGive(searchMutex);
+  freeIndex(old);
+  Serial.printf("Search index built: %u songs, %u keys in %lu us\n", (unsigned)fresh.songCount,
+                (unsigned)fresh.keyCount, micros() - start);
+}
+
+/**
+ * Fills in the genre/artist/title lengths the Grand Central would record
+ * (same rule as setRecordPath() in song_index.cpp)
+ */
+static void splitSongPath(const char *path, uint8_t &genreLen, uint8_t &artistLen, uint8_t &titleLen) {
+  genreLen = artistLen = titleLen = 0;
+  const char *genre = path + 1;
+  const char *artist = strchr(genre, '/');
+  const char *title = artist ? strchr(artist + 1, '/') : nullptr;
+  if (path[0] != '/' || !title || strchr(title + 1, '/')) return;
+  const char *ext = strrchr(title + 1, '.');
+  const char *titleEnd = ext ? ext : title + 1 + strlen(title + 1);
+
+  genreLen = artist - genre;
+  artistLen = title - artist - 1;
+  titleLen = titleEnd - title - 1;
+}
+
+void songSearchAdd(const String &path, uint32_t duration, uint16_t events) {
+  size_t pathLen = path.length();
+  if (pathLen == 0 || pathLen + SONG_ENTRY_META > 255) return;
+
+  uint8_t entry[256];
+  entry[0] = pathLen + SONG_ENTRY_META;
+  entry[1] = duration;
+  entry[2] = duration >> 8;
+  entry[3] = duration >> 16;
+  entry[4] = duration >> 24;
+  entry[5] = events;
+  entry[6] = events >> 8;
+  splitSongPath(path.c_str(), entry[7], entry[8], entry[9]);
+  memcpy(entry + 1 + SONG_ENTRY_META, path.c_str(), pathLen);
+
+  xSemaphoreTake(searchMutex, portMAX_DELAY);
+  if (!indexReady) {
+    xSemaphoreGive(searchMutex); // The first cache fill will include it
+    return;
+  }
+
+  // Re-uploaded song: same path, so only the header fields change
+  for (size_t song = 0; song < current.songCount; song++) {
+    uint8_t *existing = current.pool + current.songOffsets[song];
+    if (existing[0] == entry[0] && memcmp(existing + 1 + SONG_ENTRY_META, path.c_str(), pathLen) == 0) {
+      memcpy(existing + 1, entry + 1, 6);
+      xSemaphoreGive(searchMutex);
+      return;
+    }
+  }
+
+  size_t firstNewKey = current.keyCount;
+  bool ok = current.songCount < UINT16_MAX &&
+            growArray(current.pool, current.poolCapacity, current.poolSize + 1 + entry[0], 4096) &&
+            growArray(current.songOffsets, current.songCapacity, current.songCount + 1, 256);
+  if (ok) {
+    memcpy(current.pool + current.poolSize, entry, 1 + entry[0]);
+    current.songOffsets[current.songCount] = current.poolSize;
+    current.poolSize += 1 + entry[0];
+    ok = addSongKeys(current, current.songCount);
+    current.songCount++;
+  }
+  if (ok) {
+    sortKeys(current, firstNewKey); // Merge the new keys into place
+  } else {
+    current.keyCount = firstNewKey; // Song stays listed but unsearchable until the next rebuild
+    Serial.println("Out of memory adding song to the search index");
+  }
+  xSemaphoreGive(searchMutex);
+}
+
+static bool fieldStartsWith(const char *field, uint8_t len, const String &prefix) {
+  return prefix.isEmpty() || (prefix.length() <= len && strncasecmp(field, prefix.c_str(), prefix.length()) == 0);
+}
+
+static bool filtersMatch(const uint8_t *entry, const String &genre, const String &artist) {
+  if (genre.isEmpty() && artist.isEmpty()) return true;
+  uint8_t genreLen = entry[7], artistLen = entry[8], titleLen = entry[9];
+  size_t pathLen = entry[0] - SONG_ENTRY_META;
+  if (!genreLen || 3u + genreLen + artistLen + titleLen > pathLen) return false;
+
+  const char *path = songPath(entry);
+  return fieldStartsWith(path + 1, genreLen, genre) && fieldStartsWith(path + 2 + genreLen, artistLen, artist);
+}
+
+// Marks every song with a key starting with query
+static void markMatches(const char *query, size_t queryLen, uint8_t *matches) {
+  const SearchKey *first = std::lower_bound(
+      current.keys, current.keys + current.keyCount, query, [queryLen](const SearchKey &key, const char *q) {
+        return compareFolded(keyText(current, key), key.length, q, queryLen) < 0;
+      });
+  for (const SearchKey *key = first; key < current.keys + current.keyCount; key++) {
+    if (key->length < queryLen || compareFolded(keyText(current, *key), queryLen, query, queryLen) != 0) break;
+    matches[key->song >> 3] |= 1 << (key->song & 7);
+  }
+}
+
+static String requestParam(AsyncWebServerRequest *request, const char *name) {
+  return request->hasParam(name) ? request->getParam(name)->value() : String();
+}
+
+void songSearchServe(AsyncWebServerRequest *request) {
+  String query = requestParam(request, "q");
+  query.trim();
+  query.replace(' ', '_'); // Stored names use '_' between words
+  if (query.length() > SONG_SEARCH_MAX_QUERY) query = query.substring(0, SONG_SEARCH_MAX_QUERY);
+  String genre = requestParam(request, "genre");
+  String artist = requestParam(request, "artist");
+  long offset = requestParam(request, "offset").toInt();
+  long limit = request->hasParam("limit") ? requestParam(request, "limit").toInt() : SONG_SEARCH_DEFAULT_LIMIT;
+  if (offset < 0) offset = 0;
+  if (limit <= 0) limit = SONG_SEARCH_DEFAULT_LIMIT;
+  if (limit > SONG_SEARCH_MAX_LIMIT) limit = SONG_SEARCH_MAX_LIMIT;
+
+  if (!searchMutex || xSemaphoreTake(searchMutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+    request->send(503, "text/plain", "Search index busy");
+    return;
+  }
+  if (!indexReady) {
+    xSemaphoreGive(searchMutex);
+    request->send(503, "text/plain", "Song library not loaded yet");
+    return;
+  }
+
+  unsigned long start = micros();
+  uint8_t *matches = nullptr;
+  if (!query.isEmpty()) {
+    matches = (uint8_t *)calloc((current.songCount + 7) / 8 + 1, 1);
+    if (!matches) {
+      xSemaphoreGive(searchMutex);
+      request->send(503, "text/plain", "Out of memory");
+      return;
+    }
+    markMatches(query.c_str(), query.length(), matches);
+  }
+
+  // Library order, like /existing-songs
+  JsonDocument page;
+  page["offset"] = offset;
+  JsonArray songs = page["songs"].to<JsonArray>();
+  long matched = 0;
+  for (size_t song = 0; song < current.songCount; song++) {
+    if (matches && !(matches[song >> 3] & (1 << (song & 7)))) continue;
+    const uint8_t *entry = songEntry(current, song);
+    if (!filtersMatch(entry, genre, artist)) continue;
+    if (matched >= offset && matched - offset < limit) {
+      addSongListEntry(songs, entry + 1, entry[0]);
+    }
+    matched++;
+  }
+  page["total"] = matched;
+  unsigned long took = micros() - start;
+  xSemaphoreGive(searchMutex);
+  free(matches);
+
+  String body;
+  serializeJson(page, body);
+  AsyncWebServerResponse *response = request->beginResponse(200, "application/json", body);
+  response->addHeader("Server-Timing", "search;dur=" + String(took / 1000.0, 3));
+  request->send(response);
+}
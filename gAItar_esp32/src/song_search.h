@@ -0,0 +1,51 @@
+#ifndef SONG_SEARCH_H
+#define SONG_SEARCH_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+/**
+ * Prefix index over song titles and artists behind GET /search
+ * Every word of a title or artist (words are separated by '_', as the upload
+ * page builds paths) is a key, and keys are kept sorted case-insensitively,
+ * so a query is one binary search plus a walk over the matching run
+ * Rebuilt from the library cache whenever it is published, and extended as
+ * soon as an upload finishes so a new song is found before the cache refills
+ */
+
+#define SONG_SEARCH_DEFAULT_LIMIT 20
+#define SONG_SEARCH_MAX_LIMIT 200
+#define SONG_SEARCH_MAX_QUERY 64     // Longer queries are truncated
+
+/**
+ * Creates the index lock
+ * Called once from setup() before songCacheBegin()
+ */
+void songSearchBegin();
+
+/**
+ * Replaces the index with the given library
+ * Called from the status task (and setup()) when the library cache is published
+ *
+ * @param entries Entries in List frame layout, each prefixed with its length
+ */
+void songSearchRebuild(const uint8_t *entries, size_t size, uint16_t count);
+
+/**
+ * Adds or updates one song after an upload, without a rebuild
+ *
+ * @param path SD card path ("/genre/artist/title.bin")
+ * @param duration Song length in ms from the song header
+ * @param events Event count from the song header
+ */
+void songSearchAdd(const String &path, uint32_t duration, uint16_t events);
+
+/**
+ * Answers GET /search?q=&genre=&artist=&offset=&limit=
+ * q matches the start of any word of the title or artist; genre and artist
+ * are case-insensitive prefixes like on /existing-songs
+ * Called from the web server task
+ */
+void songSearchServe(AsyncWebServerRequest *request);
+
+#endif
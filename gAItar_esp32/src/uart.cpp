@@ -1,139 +1,441 @@
 #include "uart.h"
 #include "esp_server.h"
+#include "delta_sync.h"
+#include "song_cache.h"
+#include "song_search.h"
+#include "upload_stream.h"
+#include "upload_queue.h"
+#include "uart_tasks.h"
+#include "line_assembler.h"
+#include "midi_convert.h"
 #include "SPIFFS.h"
 #include "FS.h"
 
 HardwareSerial& instruction_uart = Serial1; 
 HardwareSerial& upload_uart = Serial2; 
 
+// Reply lines on the upload UART (ACK:..., ERROR:...), shared by both upload paths
+static char uploadReplyBuffer[96];
+static LineAssembler uploadReplies(uploadReplyBuffer, sizeof(uploadReplyBuffer));
+
+// Text lines on the instruction UART, read by the status task
+static char instructionLineBuffer[192]; // Longest line is a STATS: reply
+static LineAssembler instructionLines(instructionLineBuffer, sizeof(instructionLineBuffer));
+
 
 void setupUARTs() {
+    instruction_uart.setRxBufferSize(1024); // Room for a song list page while the web task is busy
     instruction_uart.begin(BAUDRATE, SERIAL_8N1, INSTR_RX, INSTR_TX);
     upload_uart.begin(BAUDRATE, SERIAL_8N1, UPLOAD_RX, UPLOAD_TX);
 }
 
 void instructionToSAMD(const uint8_t* data, size_t length) {
-  instruction_uart.write(0xAA); // Start byte
-  instruction_uart.write(length);
-  instruction_uart.write(data, length);
+  instructionToSAMD("", data, length);
+}
+
+bool instructionToSAMD(const char* prefix, const uint8_t* data, size_t length) {
+  // Whole frames go through the TX task's queue, so senders never interleave
+  FrameSegment segments[] = {{(const uint8_t *)prefix, strlen(prefix)}, {data, length}};
+  return queueInstructionFrame(segments, 2, INSTRUCTION_FLAG_ACK);
 }
 
+bool instructionOpToSAMD(const uint8_t* op, size_t length) {
+  FrameSegment segment = {op, length};
+  return queueInstructionFrame(&segment, 1, INSTRUCTION_FLAG_ACK | INSTRUCTION_FLAG_BINARY);
+}
 
-void uploadToSAMD_chunk(bool &sendFile, const String &filePath) {
-  if (!sendFile) return;
+// Last STATS: line, written by the status task and read by the web server
+static char samdStats[192] = "";
+static portMUX_TYPE samdStatsMux = portMUX_INITIALIZER_UNLOCKED;
 
-  File file = SPIFFS.open(filePath, FILE_READ);
-  if (!file) {
-    Serial.println("Failed to open file for reading");
-    sendFile = false;
-    return;
+void requestSamdInstructionStats() {
+  uint8_t op = INSTRUCTION_OP_STATS;
+  instructionOpToSAMD(&op, 1);
+}
+
+void reportSamdInstructionStats(Print &out) {
+  char stats[sizeof(samdStats)];
+  portENTER_CRITICAL(&samdStatsMux);
+  memcpy(stats, samdStats, sizeof(stats));
+  portEXIT_CRITICAL(&samdStatsMux);
+  out.printf("Grand Central instructions: %s\n", stats[0] ? stats : "no STATS reply yet");
+  out.printf("Overlong lines dropped: %lu instruction, %lu upload\n", (unsigned long)instructionLines.overflows,
+             (unsigned long)uploadReplies.overflows);
+}
+
+// Copies a slice of a list entry into a JSON field (ArduinoJson stores its own copy)
+static void setListField(JsonObject song, const char *key, const char *data, size_t len) {
+  char field[256];
+  len = len < sizeof(field) ? len : sizeof(field) - 1;
+  memcpy(field, data, len);
+  field[len] = '\0';
+  song[key] = (const char *)field;
+}
+
+void addSongListEntry(JsonArray songs, const uint8_t *entry, size_t len) {
+  const char *path = (const char *)entry + 9;
+  size_t pathLen = len - 9;
+  uint8_t genreLen = entry[6], artistLen = entry[7], titleLen = entry[8];
+  JsonObject song = songs.add<JsonObject>();
+  setListField(song, "path", path, pathLen);
+  song["duration"] = (uint32_t)entry[0] | ((uint32_t)entry[1] << 8) | ((uint32_t)entry[2] << 16) | ((uint32_t)entry[3] << 24);
+  song["events"] = entry[4] | (entry[5] << 8);
+  if (genreLen && 3u + genreLen + artistLen + titleLen <= pathLen) {
+    setListField(song, "genre", path + 1, genreLen);
+    setListField(song, "artist", path + 2 + genreLen, artistLen);
+    setListField(song, "title", path + 3 + genreLen + artistLen, titleLen);
   }
+}
+
+static void handleInstructionLine(const char *line) {
+  if (strncmp(line, "STATUS:", 7) == 0) {
+    notifyPlaybackStatus(line + 7); // JSON part after "STATUS:"
+  } else if (strncmp(line, "STATS:", 6) == 0) {
+    portENTER_CRITICAL(&samdStatsMux);
+    snprintf(samdStats, sizeof(samdStats), "%s", line + 6);
+    portEXIT_CRITICAL(&samdStatsMux);
+  } else if (strncmp(line, "ERROR:", 6) == 0) {
+    Serial.printf("Grand Central error: %s\n", line + 6);
+    notifyProgress("error", 0, line + 6);
+  }
+}
 
-  size_t fileSize = file.size();
-  String header = "START:" + filePath + "SIZE:" + String(fileSize) + "\n";
-  upload_uart.print(header);  // Send header
+enum InstructionRxState {
+  RX_LINE,         // Text lines (STATUS:...)
+  RX_LIST_HEADER,  // 'L' id offset(u16)
+  RX_LIST_LENGTH,  // Entry length, 0 ends the list
+  RX_LIST_ENTRY,
+  RX_LIST_TRAILER, // total(u16) generation(u32)
+  RX_ACK           // seq status check (instruction_frame.h)
+};
 
-  const size_t chunkSize = 64;
-  uint8_t buffer[chunkSize];
-  uint16_t chunkId = 0;
+// List replies still owed by the Grand Central (TX task adds, status task settles)
+static volatile uint8_t listRepliesOwed = 0;
+static volatile unsigned long listActivityAt = 0;
 
-  while (file.available()) {
-    size_t len = file.read(buffer, chunkSize);
-
-    // Send CHUNK metadata
-    upload_uart.printf("CHUNK:%u:SIZE:%u\n", chunkId, len);
-    upload_uart.write(buffer, len);
-
-    // Wait for ACK with timeout
-    unsigned long startTime = millis();
-    bool ackReceived = false;
-    while (millis() - startTime < 1000) {
-      if (upload_uart.available()) {
-        String ack = upload_uart.readStringUntil('\n');
-        if (ack == ("ACK:" + String(chunkId))) {
-          ackReceived = true;
+void songListRequested() {
+  if (!songListReplyInFlight()) listRepliesOwed = 0; // Earlier ones never came
+  listActivityAt = millis();
+  listRepliesOwed++;
+}
+
+bool songListReplyInFlight() {
+  return listRepliesOwed > 0 && millis() - listActivityAt < SONG_LIST_IDLE_MS;
+}
+
+static void songListReplyEnded() {
+  if (listRepliesOwed > 0) listRepliesOwed--;
+}
+
+static void failSongListFrame(uint8_t id) {
+  if (id >= SONG_CACHE_FIRST_LIST_ID) {
+    songCacheAbortPage();
+  } else {
+    completeSongList(id, nullptr);
+  }
+}
+
+/**
+ * Reads everything the Grand Central sent on the instruction UART without blocking
+ * Text lines (STATUS:, STATS:, ERROR:), binary List frames (see songIndexList()
+ * on the Grand Central) and instruction ACKs share the channel; a frame starts
+ * with SONG_LIST_START or INSTRUCTION_ACK_START at the start of a line
+ * A List frame is matched by the id it echoes to its HTTP request (completeSongList())
+ * or to the library cache fill (ids from SONG_CACHE_FIRST_LIST_ID)
+ */
+void handlePlaybackMessages() {
+  static InstructionRxState state = RX_LINE;
+  LineAssembler &lines = instructionLines;
+  static uint8_t field[255];
+  static size_t fieldLen = 0;
+  static size_t fieldNeed = 0;
+  static unsigned long lastByteTime = 0;
+  static uint8_t listId = 0;
+  static JsonDocument page;
+
+  // A frame that stops arriving fails its request instead of eating later lines
+  if (state != RX_LINE && millis() - lastByteTime > SONG_LIST_BYTE_TIMEOUT) {
+    if (state != RX_ACK) {
+      failSongListFrame(listId);
+      songListReplyEnded();
+    }
+    page.clear();
+    state = RX_LINE;
+  }
+
+  while (instruction_uart.available()) {
+    uint8_t b = instruction_uart.read();
+    lastByteTime = millis();
+    if (state != RX_LINE && state != RX_ACK) listActivityAt = lastByteTime;
+
+    if (state == RX_LINE) {
+      if (b == SONG_LIST_START && lines.atLineStart()) {
+        listActivityAt = lastByteTime;
+        state = RX_LIST_HEADER;
+        fieldLen = 0;
+        fieldNeed = 4;
+      } else if (b == INSTRUCTION_ACK_START && lines.atLineStart()) {
+        state = RX_ACK;
+        fieldLen = 0;
+        fieldNeed = INSTRUCTION_ACK_SIZE - 1;
+      } else if (lines.push(b)) {
+        handleInstructionLine(lines.line());
+      }
+      continue;
+    }
+
+    if (state == RX_LIST_LENGTH) {
+      if (b == 0) {
+        state = RX_LIST_TRAILER;
+        fieldNeed = 6;
+      } else if (b < 9) {
+        failSongListFrame(listId); // Corrupt frame
+        songListReplyEnded();
+        page.clear();
+        state = RX_LINE;
+      } else {
+        state = RX_LIST_ENTRY;
+        fieldNeed = b;
+      }
+      fieldLen = 0;
+      continue;
+    }
+
+    field[fieldLen++] = b;
+    if (fieldLen < fieldNeed) continue;
+
+    switch (state) {
+      case RX_LIST_HEADER:
+        if (field[0] != 'L') {
+          songListReplyEnded();
+          state = RX_LINE;
           break;
         }
+        listId = field[1];
+        page.clear();
+        if (listId >= SONG_CACHE_FIRST_LIST_ID) {
+          songCacheBeginPage(listId, field[2] | (field[3] << 8));
+        } else {
+          page["offset"] = field[2] | (field[3] << 8);
+          page["songs"].to<JsonArray>();
+        }
+        state = RX_LIST_LENGTH;
+        break;
+      case RX_LIST_ENTRY:
+        if (listId >= SONG_CACHE_FIRST_LIST_ID) {
+          songCacheAddEntry(field, fieldLen);
+        } else {
+          addSongListEntry(page["songs"].as<JsonArray>(), field, fieldLen);
+        }
+        state = RX_LIST_LENGTH;
+        break;
+      case RX_LIST_TRAILER: {
+        uint16_t total = field[0] | (field[1] << 8);
+        uint32_t generation = (uint32_t)field[2] | ((uint32_t)field[3] << 8) |
+                              ((uint32_t)field[4] << 16) | ((uint32_t)field[5] << 24);
+        if (listId >= SONG_CACHE_FIRST_LIST_ID) {
+          songCacheEndPage(total, generation);
+        } else {
+          page["total"] = total;
+          page["generation"] = generation;
+          completeSongList(listId, &page);
+        }
+        songListReplyEnded();
+        page.clear();
+        state = RX_LINE;
+        break;
       }
+      case RX_ACK: {
+        uint8_t reply[INSTRUCTION_ACK_SIZE] = {INSTRUCTION_ACK_START, field[0], field[1], field[2]};
+        if (instructionAckValid(reply)) {
+          instructionAckReceived(reply[1], reply[2]);
+        }
+        state = RX_LINE;
+        break;
+      }
+      default:
+        state = RX_LINE;
+        break;
     }
+  }
+}
 
-    if (!ackReceived) {
-      Serial.printf("Timeout or missing ACK for chunk %u\n", chunkId);
-      file.close();
-      sendFile = false;
-      return;
-    }
+// FNV-1a 64-bit content hash, must match songHashUpdate() on the Grand Central
+#define CONTENT_HASH_SEED 0xcbf29ce484222325ULL
+
+static uint64_t hashUpdate(uint64_t hash, const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    hash ^= data[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static uint64_t hashFileContents(File &file) {
+  uint64_t hash = CONTENT_HASH_SEED;
+  uint8_t buffer[256];
+  file.seek(0);
+  while (file.available()) {
+    size_t len = file.read(buffer, sizeof(buffer));
+    hash = hashUpdate(hash, buffer, len);
+  }
+  file.seek(0);
+  return hash;
+}
 
-    chunkId++;
+// A streamed upload has no hash yet, so it is announced without one (no dedup or delta)
+// and its hash follows the last chunk
+static String uploadHeader(const char *filePath, size_t fileSize, uint64_t hash, bool hashKnown, bool offerDelta) {
+  if (!hashKnown) {
+    return String("START:") + filePath + ":SIZE:" + String(fileSize);
   }
+  char hashHex[17];
+  snprintf(hashHex, sizeof(hashHex), "%016llx", (unsigned long long)hash);
+  return String("START:") + filePath + ":SIZE:" + String(fileSize) + ":HASH:" + hashHex +
+         (offerDelta ? ":DELTA" : "");
+}
+
+// Upload lines end in :CRC:<hex>, a CRC-16 of the line text before it and of any
+// data that follows; the Grand Central ignores a line that fails it, so the reply
+// timeout resends just that line (and its chunk data)
+static void sendUploadLine(const char *text, const uint8_t *data = nullptr, size_t length = 0) {
+  uint16_t crc = instructionCrc16((const uint8_t *)text, strlen(text));
+  if (length) crc = instructionCrc16(data, length, crc);
+  upload_uart.printf("%s:CRC:%04x\n", text, crc);
+  if (length) upload_uart.write(data, length);
+}
+
+static void sendChunk(uint16_t id, const uint8_t *data, size_t length) {
+  char line[32];
+  snprintf(line, sizeof(line), "CHUNK:%u:SIZE:%u", id, (unsigned)length);
+  sendUploadLine(line, data, length);
+}
+
+static void sendCopy(uint16_t id, uint32_t block, uint32_t count) {
+  char line[40];
+  snprintf(line, sizeof(line), "COPY:%u:%u:%u", id, (unsigned)block, (unsigned)count);
+  sendUploadLine(line);
+}
+
+// Content hash of a streamed upload, after its last chunk
+static void sendHashLine(uint64_t hash) {
+  char line[24];
+  snprintf(line, sizeof(line), "HASH:%016llx", (unsigned long long)hash);
+  sendUploadLine(line);
+}
 
-  // Notify end of file
-  upload_uart.print("DONE\n");
+// Delta upload session buffers (allocated per upload, released on completion)
+static uint8_t* deltaData = nullptr;        // Whole new file
+static DeltaBlockSum* deltaSums = nullptr;  // Block sums of the Grand Central's copy
+static DeltaOp* deltaOps = nullptr;         // Planned COPY / LITERAL ops
 
-  file.close();
-  Serial.println("File sent to Grand Central");
+static void endDeltaSession() {
+  free(deltaData);
+  free(deltaSums);
+  free(deltaOps);
+  deltaData = nullptr;
+  deltaSums = nullptr;
+  deltaOps = nullptr;
+}
+
+// Loads the staged file into RAM so it can be planned against block sums
+static bool beginDeltaSession(File &file, size_t fileSize) {
+  endDeltaSession();
+  if (fileSize > DELTA_MAX_FILE_SIZE) return false;
+  deltaData = (uint8_t*)malloc(fileSize);
+  if (!deltaData) return false;
+  file.seek(0);
+  bool ok = file.read(deltaData, fileSize) == fileSize;
+  file.seek(0);
+  if (!ok) endDeltaSession();
+  return ok;
+}
 
-  if (SPIFFS.remove(filePath)) {
-    Serial.println("File deleted from ESP32 SPIFFS.");
+// Makes the uploaded song searchable right away from its header (4 + 2 bytes, big-endian)
+static void indexUploadedSong(File &file, bool streamed, const char *filePath) {
+  uint8_t header[6];
+  if (streamed) {
+    if (!uploadStreamSongHeader(header, sizeof(header))) return;
   } else {
-    Serial.println("Failed to delete the file from ESP32 SPIFFS.");
+    file.seek(0);
+    if (file.read(header, sizeof(header)) != sizeof(header)) return;
   }
+  uint32_t duration = ((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16) | ((uint32_t)header[2] << 8) | header[3];
+  songSearchAdd(filePath, duration, (header[4] << 8) | header[5]);
+}
 
-  sendFile = false;
+static bool writeSongToFile(const uint8_t *data, size_t len, void *context) {
+  return ((File *)context)->write(data, len) == len;
 }
-void uploadToSAMD(bool &sendFile, const String &filePath) {
-  if (sendFile) {
-    File file = SPIFFS.open(filePath, FILE_READ);
-    
-    if (!file) {
-      Serial.println("Failed to open file for reading");
-      sendFile = false;
-      return;
-    }
-    size_t fileSize = file.size();
-
-    //header for file transfer
-    String header = "START:" + filePath + "SIZE:" + String(fileSize) + "\n";
-    upload_uart.print(header); // Send header to Grand Central
-    const size_t bufferSize = 512;
-    uint8_t buffer[bufferSize];
-    while (file.available()) {
-      size_t len = file.read(buffer, bufferSize);
-      size_t written = 0;
-      while (written < len) {
-        if (upload_uart.availableForWrite()) {
-          written += upload_uart.write(buffer + written, len - written);
-        }
-      }
-    }
 
-    file.close();
-    Serial.println("File sent to Grand Central");
-    if (SPIFFS.remove(filePath)) {
-      Serial.println("File deleted from ESP32 SPIFFS.");
-    } else {
-      Serial.println("Failed to delete the file from ESP32 SPIFFS.");
-    }
-    sendFile = false; // Reset flag after successful send
+/**
+ * Converts a job's buffered .mid into its staging file, then frees the buffer
+ *
+ * @return nullptr, or why the song could not be staged
+ */
+static const char *stageMidiJob(UploadJob &job) {
+  unsigned long start = millis();
+  MidiConvertResult result;
+  File staged = SPIFFS.open(job.staging, FILE_WRITE);
+  bool converted = staged && midiConvert(job.midi->data, job.midi->length, writeSongToFile, &staged, result);
+  if (staged) staged.close();
+  size_t midiLength = job.midi->length;
+  uploadQueueMidiStaged(job);
+  if (!converted) {
+    static char error[64]; // Upload task only
+    snprintf(error, sizeof(error), "MIDI conversion failed - %s",
+             staged ? midiConvertErrorText(result.error) : "could not write the song");
+    return error;
   }
+  Serial.printf("Converted %u byte MIDI for job %u: %lu events, %lu notes dropped, %lu ms\n", midiLength, job.id,
+                (unsigned long)result.events, (unsigned long)result.notesDropped, millis() - start);
+  char note[64];
+  snprintf(note, sizeof(note), "MIDI converted: %lu events, %lu notes dropped", (unsigned long)result.events,
+           (unsigned long)result.notesDropped);
+  notifyProgress("transfer", 0, note, job.id);
+  return nullptr;
 }
 
-void handlePlaybackMessages() {
-  if (instruction_uart.available()) {
-    String message = instruction_uart.readStringUntil('\n');
-    message.trim();
-    
-    // Check if this is a status message
-    if (message.startsWith("STATUS:")) {
-      // Extract JSON part after "STATUS:"
-      String jsonData = message.substring(7);  // Remove "STATUS:" prefix
-      notifyPlaybackStatus(jsonData);
-    }
-    // You can add other message types here as needed
-    // else if (message.startsWith("ERROR:")) {
-    //   // Handle error messages
-    // }
+/**
+ * Opens a job's body and works out its header fields
+ * A .mid body is converted first; a staged body is hashed and offered for
+ * delta unless the Grand Central already rejected it once; a streamed one is
+ * hashed as it is sent
+ *
+ * @return nullptr, or why the job cannot be sent
+ */
+static const char *openUploadJob(UploadJob &job, File &file, size_t &fileSize, uint64_t &fileHash, bool &offerDelta) {
+  if (job.streamed) {
+    fileSize = uploadStreamSize();
+    fileHash = CONTENT_HASH_SEED;
+    offerDelta = false;
+    return nullptr;
+  }
+  if (job.midi) {
+    const char *error = stageMidiJob(job);
+    if (error) return error;
   }
+  file = SPIFFS.open(job.staging, FILE_READ);
+  if (!file) {
+    Serial.printf("Failed to open file: %s\n", job.staging);
+    return "Failed to open file";
+  }
+  fileSize = file.size();
+  fileHash = hashFileContents(file);
+  offerDelta = job.resends == 0 && beginDeltaSession(file, fileSize);
+  return nullptr;
+}
+
+// Job being sent by uploadToSAMD_state()
+static UploadJob uploadJob;
+static bool catalogChanged = false;     // A job finished since the library cache was last invalidated
+
+static void jobProgress(const char *stage, int percentage, const char *message) {
+  notifyProgress(stage, percentage, message, uploadJob.id);
+}
+
+static void finishUploadJob() {
+  uploadQueueFinish(uploadJob);
 }
 
 enum UploadState{
@@ -143,10 +445,13 @@ enum UploadState{
   WAIT_HEADER_ACK,
   SEND_CHUNK,
   WAIT_CHUNK_ACK,
+  WAIT_BLOCK_SUMS,
+  SEND_DELTA,
+  WAIT_CONFIRM,
   CLEANUP
 };
 
-void uploadToSAMD_state(bool &sendFile, const String &filePath) {
+bool uploadToSAMD_state() {
   static UploadState state = IDLE;
   static File file;
   static size_t fileSize = 0;
@@ -157,146 +462,450 @@ void uploadToSAMD_state(bool &sendFile, const String &filePath) {
   static size_t lastChunkSize = 0;
   static const int MAX_RETRIES = 10;
   static const int TIMEOUT = 2000; //  2 second timeout for ACK
+  static const int MAX_RESENDS = 3; // Whole-file resends after the Grand Central rejects the content
   static int retryCount = 0;
-  static const String tempPath = "/temp";
+  static uint64_t fileHash = 0;   // Streamed uploads hash the body as it is sent
+
+  // Delta transfer state
+  static bool deltaOffered = false;
+  static bool deltaMode = false;
+  static size_t sumBlocks = 0;
+  static size_t sumBytesReceived = 0;
+  static size_t deltaOpCount = 0;
+  static size_t deltaOpIndex = 0;
+  static size_t deltaOpOffset = 0;     // Bytes of the current literal op already sent
+  static size_t deltaBytesCovered = 0; // New-file bytes accounted for by sent ops
+  static bool lastWasCopy = false;
+  static uint32_t lastCopyBlock = 0;
+  static uint32_t lastCopyCount = 0;
+
+  // Streaming mode: the body comes from the HTTP ring buffer instead of /temp
+  static bool streaming = false;
+  bool waitingForBody = false;
+
+  // Next job, whose header is sent as soon as this job's last chunk or hash is out:
+  // the Grand Central keeps its input after a verdict and reads the header next,
+  // so back-to-back jobs do not wait a header round trip each
+  static bool nextSent = false;
+  static UploadJob nextJob;
+  static File nextFile;
+  static size_t nextSize = 0;
+  static uint64_t nextHash = 0;
+  static bool nextDelta = false;
+  static const char *heldReply = nullptr; // Next job's header reply, read while waiting for a verdict
+
+  auto sendNextHeader = [&]() {
+    endDeltaSession(); // This job's ops are all out; the next job may plan its own
+    if (nextSent || !uploadQueueNext(nextJob)) return;
+    if (const char *error = openUploadJob(nextJob, nextFile, nextSize, nextHash, nextDelta)) {
+      notifyProgress("transfer", 0, error, nextJob.id);
+      uploadQueueFinish(nextJob);
+      return;
+    }
+    sendUploadLine(uploadHeader(nextJob.path, nextSize, nextHash, !nextJob.streamed, nextDelta).c_str());
+    nextSent = true;
+  };
+
+  // Once a job has ended, carries on with the job whose header went out early
+  auto takeNextJob = [&]() {
+    if (!nextSent) {
+      state = IDLE;
+      return;
+    }
+    nextSent = false;
+    uploadJob = nextJob;
+    file = nextFile;
+    nextFile = File();
+    fileSize = nextSize;
+    fileHash = nextHash;
+    deltaOffered = nextDelta;
+    streaming = uploadJob.streamed;
+    deltaMode = false;
+    lastWasCopy = false;
+    chunkId = 0;
+    retryCount = 0;
+    jobProgress("transfer", 5, "Header sent, waiting for Grand Central...");
+    ackStartTime = millis();
+    state = WAIT_HEADER_ACK;
+  };
+
+  // A staged job whose verdict never arrived is offered again: its hash gets
+  // a HAVE reply if the Grand Central did store it
+  auto verdictLost = [&]() {
+    file.close();
+    if (!streaming && uploadJob.resends < MAX_RESENDS){
+      uploadJob.resends++;
+      uploadQueueRetry(uploadJob);
+    }else{
+      jobProgress("transfer", 0, "Transfer failed - no verification from guitar");
+      uploadStreamAbort();
+      finishUploadJob();
+    }
+    takeNextJob();
+  };
 
   switch (state){
     case IDLE:
-      if (sendFile){
+      if (uploadQueueNext(uploadJob)){
         state = OPEN_FILE;
+      }else if (catalogChanged){
+        // Once the queue has run dry, so a batch refills the library cache once
+        catalogChanged = false;
+        songCacheInvalidate();
       }
       break;
     
     case OPEN_FILE:
+      // Late replies to the previous job (duplicate ACKs, a failed job's errors) must not
+      // be read as this job's header reply; nothing of this job is in flight yet
       while (upload_uart.available()) {
         upload_uart.read();
       }
-      file = SPIFFS.open(tempPath, FILE_READ);
-      if (!file){
-        Serial.println("Failed to open file: " + tempPath);
-        notifyProgress("transfer", 0, "Failed to open file");
-        sendFile = false;
-        state = IDLE;
-        return;
-      }
-      fileSize = file.size();
+      uploadReplies.reset();
+      streaming = uploadJob.streamed;
+      lastWasCopy = false; // A chunk retry must never replay the previous job's COPY
+      deltaMode = false;
       chunkId = 0;
       retryCount = 0;
-      notifyProgress("transfer", 0, "File opened, preparing transfer..."); 
+      if (const char *error = openUploadJob(uploadJob, file, fileSize, fileHash, deltaOffered)){
+        jobProgress("transfer", 0, error);
+        finishUploadJob();
+        state = IDLE;
+        break;
+      }
+      jobProgress("transfer", 0, streaming ? "Streaming upload, preparing transfer..."
+                                           : "File opened, preparing transfer...");
       state = SEND_HEADER;
       break;
 
     case SEND_HEADER:{
-      String header = "START:" + filePath + ":SIZE:"
-      + String(fileSize) + "\n";
+      String header = uploadHeader(uploadJob.path, fileSize, fileHash, !streaming, deltaOffered);
       Serial.println("Sending header: " + header);
-      notifyProgress("transfer", 5, "Sending header to Grand Central...");
-      upload_uart.print(header); // Send header to Grand Central
+      jobProgress("transfer", 5, "Sending header to Grand Central...");
+      sendUploadLine(header.c_str()); // Send header to Grand Central
       ackStartTime = millis();
       retryCount = 0;
       state = WAIT_HEADER_ACK;
       break;
     }
 
-    case WAIT_HEADER_ACK:
-      if (upload_uart.available()){
-        String ack = upload_uart.readStringUntil('\n');
-        //Serial.println("Received Ack: " + ack);
-        ack.trim(); // Remove any trailing whitespace
-        if (ack.indexOf("ACK:START:SIZE:") != -1){
-          size_t recvdSize = ack.substring(String("ACK:START:SIZE:").length()).toInt();
+    case WAIT_HEADER_ACK:{
+      // One line at a time: after a DELTA reply the block sums follow as raw bytes
+      const char *ack = heldReply ? heldReply : uploadReplies.read(upload_uart);
+      const char *fields;
+      heldReply = nullptr;
+      if (ack){
+        if (strstr(ack, "ACK:START:HAVE:")){
+          // Grand Central already stores identical content - nothing to transfer
+          Serial.println("Content already on Grand Central, skipping transfer");
+          jobProgress("transfer", 100, "Song already on guitar, transfer skipped");
+          endDeltaSession();
+          state = CLEANUP;
+        }else if ((fields = strstr(ack, "ACK:START:DELTA:"))){
+          // Existing file on the Grand Central - block sums follow as raw bytes
+          char *end;
+          size_t recvdSize = strtoul(fields + strlen("ACK:START:DELTA:"), &end, 10);
+          sumBlocks = *end == ':' ? strtoul(end + 1, nullptr, 10) : 0;
+          if (recvdSize == fileSize){
+            deltaMode = true;
+            deltaSums = (DeltaBlockSum*)malloc(sumBlocks * sizeof(DeltaBlockSum));
+            sumBytesReceived = 0;
+            ackStartTime = millis();
+            jobProgress("transfer", 10, "Comparing with song on guitar...");
+            state = WAIT_BLOCK_SUMS;
+          }else{
+            // Garbled reply (or header): the header timeout sends the header again
+            Serial.printf("Header ACK size mismatch: expected %u, got %u\n", fileSize, recvdSize);
+            jobProgress("transfer", 5, "Header size mismatch, retrying...");
+          }
+        }else if ((fields = strstr(ack, "ACK:START:SIZE:"))){
+          size_t recvdSize = strtoul(fields + strlen("ACK:START:SIZE:"), nullptr, 10);
           if (recvdSize == fileSize){
-            notifyProgress("transfer", 10, "Header acknowledged, starting chunk transfer...");
+            jobProgress("transfer", 10, "Header acknowledged, starting chunk transfer...");
+            endDeltaSession(); // Full transfer streams from SPIFFS
             state = SEND_CHUNK;
           }else{
+            // Garbled reply (or header): the header timeout sends the header again
             Serial.printf("Header ACK size mismatch: expected %u, got %u\n", fileSize, recvdSize);
-            notifyProgress("transfer", 0, "Header size mismatch error");
-            file.close();
-            sendFile = false;
-            state = IDLE;
+            jobProgress("transfer", 5, "Header size mismatch, retrying...");
           }
         }else{
-          Serial.printf("Unexpected header ACK: %s\n", ack.c_str());
-          notifyProgress("transfer", 0, "Unexpected header response");
+          Serial.printf("Unexpected header ACK: %s\n", ack);
+          jobProgress("transfer", 0, "Unexpected header response");
         }
       }else if (millis() - ackStartTime > TIMEOUT){
         if (++retryCount <= MAX_RETRIES){
           Serial.println("Header ACK timeout, retrying...");
-          notifyProgress("transfer", 5, "Header timeout, retrying...");
-          String header = "START:" + filePath + ":SIZE:" + String(fileSize) + "\n";
-          upload_uart.print(header); // Resend header to Grand Central
+          jobProgress("transfer", 5, "Header timeout, retrying...");
+          // Stale bytes (block sums after a garbled DELTA reply) must not prefix the next reply
+          while (upload_uart.available()) {
+            upload_uart.read();
+          }
+          uploadReplies.reset();
+          String header = uploadHeader(uploadJob.path, fileSize, fileHash, !streaming, deltaOffered);
+          sendUploadLine(header.c_str()); // Resend header to Grand Central
           ackStartTime = millis();
         }else{
           Serial.println("Retries exceeded aborting ...");
-          notifyProgress("transfer", 0, "Transfer failed - too many retries");
+          jobProgress("transfer", 0, "Transfer failed - too many retries");
           file.close();
-          sendFile = false;
+          endDeltaSession();
+          uploadStreamAbort();
+          finishUploadJob();
           state = IDLE;
       }
     } 
     break;
+    }
 
     case SEND_CHUNK:
-      while(upload_uart.available()) upload_uart.read(); // Clear any available data
-      if (file.available()){
-        lastChunkSize = file.read(buffer, chunkSize);
-        upload_uart.printf("CHUNK:%u:SIZE:%u\n", chunkId, lastChunkSize);
+      // No drain here: the verdict may already follow the last chunk ACK, and
+      // WAIT_CHUNK_ACK / WAIT_CONFIRM skip stray lines themselves
+      if (streaming && uploadStreamAvailable() < chunkSize && !uploadStreamReceived()){
+        // Waiting for more of the HTTP body
+        waitingForBody = true;
+        if (uploadStreamFailed()){
+          Serial.println("Upload stream ended early, aborting...");
+          jobProgress("transfer", 0, "Transfer failed - upload interrupted");
+          uploadStreamAbort();
+          finishUploadJob();
+          state = IDLE;
+        }
+        break;
+      }
+      if (streaming ? uploadStreamAvailable() > 0 : file.available()){
+        lastChunkSize = streaming ? uploadStreamRead(buffer, chunkSize) : file.read(buffer, chunkSize);
+        if (streaming) fileHash = hashUpdate(fileHash, buffer, lastChunkSize);
+        lastWasCopy = false;
+        sendChunk(chunkId, buffer, lastChunkSize);
   // Only update progress every 10 chunks or at significant milestones
         if (chunkId % 5 == 0 || chunkId == 0) {
           int progress = 10 + ((chunkId * chunkSize * 80) / fileSize);
           progress = min(progress, 90);
-          notifyProgress("transfer", progress, "Transferring chunk " + String(chunkId + 1) + "...");
+          char note[40];
+          snprintf(note, sizeof(note), "Transferring chunk %u...", chunkId + 1);
+          jobProgress("transfer", progress, note);
         }
-        upload_uart.write(buffer, lastChunkSize);
         ackStartTime = millis();
         retryCount = 0;
         state = WAIT_CHUNK_ACK;
       }else{
-        Serial.println("All chunks sent, waiting for final ACK...");
-        notifyProgress("transfer", 99, "All chunks sent, waiting for confirmation...");
-        state = CLEANUP;
+        Serial.println("All chunks sent, waiting for verification...");
+        jobProgress("transfer", 99, "All chunks sent, waiting for verification...");
+        if (streaming) sendHashLine(fileHash);
+        sendNextHeader();
+        ackStartTime = millis();
+        retryCount = 0;
+        state = WAIT_CONFIRM;
       }
       break;
 
-    case WAIT_CHUNK_ACK:
-      while(upload_uart.available()){
-        String ack = upload_uart.readStringUntil('\n');
-        // Serial.println("Received chunk ACK: " + ack);
-        ack.trim(); // Remove any trailing whitespace
-        if (ack == ("ACK:CHUNK:" + String(chunkId))){
+    case WAIT_CHUNK_ACK:{
+      char expected[24];
+      snprintf(expected, sizeof(expected), "ACK:CHUNK:%u", chunkId);
+      while (const char *ack = uploadReplies.read(upload_uart)){
+        if (strcmp(ack, expected) == 0){
           chunkId++;
           retryCount = 0;
-          state = SEND_CHUNK;
+          state = deltaMode ? SEND_DELTA : SEND_CHUNK;
+          break;
         }
-      }if (millis() - ackStartTime > TIMEOUT){
+      }
+      if (state == WAIT_CHUNK_ACK && millis() - ackStartTime > TIMEOUT){
         if (++retryCount <= MAX_RETRIES){
           Serial.printf("Chunk ACK timeout for chunk %u, retrying...\n", chunkId);
-          upload_uart.printf("CHUNK:%u:SIZE:%u\n", chunkId, lastChunkSize);
-          upload_uart.write(buffer, lastChunkSize);
+          if (lastWasCopy){
+            sendCopy(chunkId, lastCopyBlock, lastCopyCount);
+          }else{
+            sendChunk(chunkId, buffer, lastChunkSize);
+          }
           ackStartTime = millis();
         }else{
         Serial.printf("Retries exceeded for chunk %u, aborting...\n", chunkId);
-        notifyProgress("transfer", 0, "Transfer failed - chunk timeout");
+        jobProgress("transfer", 0, "Transfer failed - chunk timeout");
         file.close();
-        sendFile = false;
+        endDeltaSession();
+        uploadStreamAbort();
+        finishUploadJob();
         state = IDLE;
       }
     } break;
+    }
 
-    case CLEANUP:
-      file.close();
-      Serial.println("File sent to Grand Central");
-      notifyProgress("transfer", 100, "Transfer complete!");
-      if (SPIFFS.remove(tempPath)){
-        Serial.println("File deleted from ESP32 SPIFFS.");
-        notifyProgress("complete", 100, "Upload complete!");
+    case WAIT_BLOCK_SUMS:
+      // Collect 8 raw bytes per block (weak, strong; little-endian)
+      while (upload_uart.available() && sumBytesReceived < sumBlocks * sizeof(DeltaBlockSum)){
+        uint8_t b = upload_uart.read();
+        if (deltaSums) ((uint8_t*)deltaSums)[sumBytesReceived] = b;
+        sumBytesReceived++;
+        ackStartTime = millis();
+      }
+      if (sumBytesReceived >= sumBlocks * sizeof(DeltaBlockSum)){
+        size_t maxOps = deltaMaxOps(fileSize);
+        deltaOps = (DeltaOp*)malloc(maxOps * sizeof(DeltaOp));
+        deltaOpCount = 0;
+        if (deltaOps && deltaSums){
+          deltaOpCount = deltaPlan(deltaData, fileSize, deltaSums, sumBlocks, deltaOps, maxOps);
+        }
+        if (deltaOps){
+          // Planning failed, or the plan costs no less than the whole file
+          // (many short literal runs) - send everything as one literal run
+          DeltaOp whole = {DELTA_LITERAL, 0, (uint32_t)fileSize};
+          if (deltaOpCount == 0 ||
+              deltaWireBytes(deltaOps, deltaOpCount, chunkSize) >= deltaWireBytes(&whole, 1, chunkSize)){
+            deltaOps[0] = whole;
+            deltaOpCount = 1;
+          }
+        }
+        if (!deltaOps){
+          Serial.println("Delta plan allocation failed, aborting...");
+          jobProgress("transfer", 0, "Transfer failed - out of memory");
+          file.close();
+          endDeltaSession();
+          finishUploadJob();
+          state = IDLE;
+          break;
+        }
+        size_t literalBytes = deltaLiteralBytes(deltaOps, deltaOpCount);
+        Serial.printf("Delta plan: %u ops, %u of %u bytes to send\n", deltaOpCount, literalBytes, fileSize);
+        char note[64];
+        snprintf(note, sizeof(note), "Sending %u changed bytes of %u...", (unsigned)literalBytes, (unsigned)fileSize);
+        jobProgress("transfer", 10, note);
+        deltaOpIndex = 0;
+        deltaOpOffset = 0;
+        deltaBytesCovered = 0;
+        state = SEND_DELTA;
+      }else if (millis() - ackStartTime > TIMEOUT){
+        // Bytes of the sums were lost - the song is offered again, in full (no delta on a resend)
+        Serial.println("Block sum timeout, resending full file");
+        file.close();
+        endDeltaSession();
+        if (uploadJob.resends < MAX_RESENDS){
+          jobProgress("transfer", 5, "Block checksums incomplete, resending full song...");
+          uploadJob.resends++;
+          uploadQueueRetry(uploadJob);
+        }else{
+          jobProgress("transfer", 0, "Transfer failed - block checksum timeout");
+          finishUploadJob();
+        }
+        state = IDLE;
+      }
+      break;
+
+    case SEND_DELTA:
+      if (deltaOpIndex < deltaOpCount){
+        const DeltaOp &op = deltaOps[deltaOpIndex];
+        if (op.type == DELTA_COPY){
+          lastWasCopy = true;
+          lastCopyBlock = op.start;
+          lastCopyCount = op.length;
+          sendCopy(chunkId, lastCopyBlock, lastCopyCount);
+          deltaBytesCovered += op.length * DELTA_BLOCK_SIZE;
+          deltaOpIndex++;
+        }else{
+          lastWasCopy = false;
+          lastChunkSize = min(chunkSize, (size_t)(op.length - deltaOpOffset));
+          memcpy(buffer, deltaData + op.start + deltaOpOffset, lastChunkSize);
+          sendChunk(chunkId, buffer, lastChunkSize);
+          deltaOpOffset += lastChunkSize;
+          deltaBytesCovered += lastChunkSize;
+          if (deltaOpOffset >= op.length){
+            deltaOpIndex++;
+            deltaOpOffset = 0;
+          }
+        }
+        if (chunkId % 5 == 0) {
+          int progress = 10 + (int)((deltaBytesCovered * 80) / fileSize);
+          jobProgress("transfer", min(progress, 90), "Transferring changes...");
+        }
+        ackStartTime = millis();
+        retryCount = 0;
+        state = WAIT_CHUNK_ACK;
       }else{
-        Serial.println("Failed to delete the file from ESP32 SPIFFS.");
+        jobProgress("transfer", 99, "All changes sent, waiting for verification...");
+        sendNextHeader();
+        ackStartTime = millis();
+        retryCount = 0;
+        state = WAIT_CONFIRM;
       }
+      break;
 
-      sendFile = false; // Reset flag after successful send
-      state = IDLE;
+    case WAIT_CONFIRM:
+      // The Grand Central stores the song only if its content hash matches
+      if (const char *reply = uploadReplies.read(upload_uart)){
+        if (strcmp(reply, "ACK:DONE") == 0 || strcmp(reply, "ACK:DELTA:OK") == 0){
+          state = CLEANUP;
+        }else if (strncmp(reply, "ERROR:", 6) == 0 && !streaming && uploadJob.resends < MAX_RESENDS){
+          // Content did not verify (or the receiver gave up on it) - send the whole file again
+          // without delta, after the job whose header is already out
+          Serial.printf("%s, resending full file\n", reply);
+          jobProgress("transfer", 5, strcmp(reply, "ERROR:DELTA_MISMATCH") == 0
+                                         ? "Delta verification failed, resending full song..."
+                                         : "Song did not arrive intact, resending...");
+          file.close();
+          uploadJob.resends++;
+          uploadQueueRetry(uploadJob);
+          takeNextJob();
+        }else if (nextSent && strncmp(reply, "ACK:START:", 10) == 0){
+          // The Grand Central already answers the next header, so this job's verdict was lost
+          Serial.println("Verdict lost, offering the song again");
+          heldReply = reply;
+          verdictLost();
+        }else if (strncmp(reply, "ERROR:", 6) == 0){
+          Serial.printf("Upload rejected: %s\n", reply);
+          jobProgress("transfer", 0, "Transfer failed - song did not verify on guitar");
+          file.close();
+          uploadStreamAbort();
+          finishUploadJob();
+          takeNextJob();
+        }
+        // Anything else is a late duplicate ACK
+      }else if (millis() - ackStartTime > TIMEOUT){
+        if (++retryCount <= MAX_RETRIES){
+          // The hash line or the verdict was lost: the Grand Central answers
+          // the hash or the last chunk again with the verdict
+          if (streaming){
+            sendHashLine(fileHash);
+          }else if (lastWasCopy){
+            sendCopy(chunkId - 1, lastCopyBlock, lastCopyCount);
+          }else{
+            sendChunk(chunkId - 1, buffer, lastChunkSize);
+          }
+          ackStartTime = millis();
+        }else{
+          Serial.println("Upload confirmation timeout");
+          verdictLost();
+        }
+      }
+      break;
+
+    case CLEANUP:
+      indexUploadedSong(file, streaming, uploadJob.path);
+      file.close();
+      Serial.printf("File sent to Grand Central: %s\n", uploadJob.path);
+      jobProgress("transfer", 100, "Transfer complete!");
+      catalogChanged = true; // The Grand Central catalog has changed
+      if (streaming){
+        uploadStreamClose();
+      }
+      jobProgress("complete", 100, "Upload complete!");
+      finishUploadJob(); // Also deletes the staging file
+      takeNextJob();
       break;
     }
+
+  // These states need an event: a reply from the Grand Central, more body, or a new upload
+  switch (state){
+    case IDLE:
+      return !uploadQueueActive() && !catalogChanged;
+    case SEND_CHUNK:
+      return waitingForBody;
+    case WAIT_HEADER_ACK:
+    case WAIT_CHUNK_ACK:
+    case WAIT_BLOCK_SUMS:
+    case WAIT_CONFIRM:
+      return !upload_uart.available(); // Replies are taken a line at a time
+    default:
+      return false;
   }
-      
\ No newline at end of file
+}
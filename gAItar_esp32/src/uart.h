@@ -1,13 +1,19 @@
 #ifndef UART_H
 #define UART_H
 #include <Arduino.h>
+#include <ArduinoJson.h>
 #include "globals.h"
+#include "instruction_frame.h"
+#include "instruction_ops.h"
 
 #define INSTR_RX 22
 #define INSTR_TX 23
 #define UPLOAD_RX 16
 #define UPLOAD_TX 17
 #define BAUDRATE 115200
+#define SONG_LIST_START 0xAB   // First byte of a List response frame from the Grand Central
+#define SONG_LIST_BYTE_TIMEOUT 200 // Gap that abandons a List frame in progress (ms)
+#define SONG_LIST_IDLE_MS 500      // A List reply owed this long without a byte no longer delays ACKs
 
 extern HardwareSerial& instruction_uart;
 extern HardwareSerial& upload_uart;
@@ -16,9 +22,57 @@ extern HardwareSerial& upload_uart;
 
 void setupUARTs();
 void instructionToSAMD(const uint8_t* instruction, size_t length);
-void uploadToSAMD(bool &sendFile,const String &filePath);
-void uploadToSAMD_chunk(bool &sendFile, const String &filePath);
-void uploadToSAMD_state(bool &sendFile, const String &filePath);
+/**
+ * Sends prefix + data as one instruction without copying them together first
+ * Framed and retransmitted until acknowledged by the TX task (instruction_frame.h)
+ *
+ * @return false if it is longer than INSTRUCTION_MAX_PAYLOAD or the TX queue stayed full
+ */
+bool instructionToSAMD(const char* prefix, const uint8_t* data, size_t length);
+/**
+ * Sends a binary instruction built with InstructionOpWriter (instruction_ops.h)
+ *
+ * @return false if it is longer than INSTRUCTION_MAX_PAYLOAD or the TX queue stayed full
+ */
+bool instructionOpToSAMD(const uint8_t* op, size_t length);
+/**
+ * Asks the Grand Central for its instruction counters (a STATS: line)
+ */
+void requestSamdInstructionStats();
+/**
+ * Prints the last STATS: line received from the Grand Central and the
+ * number of overlong lines dropped on both UARTs
+ */
+void reportSamdInstructionStats(Print &out);
+/**
+ * One step of the upload state machine
+ * Sends the jobs of the upload queue (upload_queue.h) one after another
+ *
+ * @return true if the next step needs an event (UART reply, more streamed
+ *         body, or a new upload); false to call again right away
+ */
+bool uploadToSAMD_state();
 void handlePlaybackMessages();
+
+/**
+ * Notes that the Grand Central acknowledged a List request and owes its reply
+ * Called by the TX task
+ */
+void songListRequested();
+
+/**
+ * True while a List reply is owed and its bytes keep coming; the Grand Central
+ * sends it inline, so the ACK of any later instruction follows it
+ */
+bool songListReplyInFlight();
+
+/**
+ * Appends one List frame entry to a JSON songs array
+ * Entry layout: duration(u32) events(u16) genreLen artistLen titleLen path
+ *
+ * @param entry Entry bytes following the length byte
+ * @param len Entry length (at least 9)
+ */
+void addSongListEntry(JsonArray songs, const uint8_t *entry, size_t len);
 // Add this function declaration
 #endif
\ No newline at end of file
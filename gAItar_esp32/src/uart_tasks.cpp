@@ -0,0 +1,267 @@
+#include "uart_tasks.h"
+#include <freertos/ringbuf.h>
+#include "uart.h"
+#include "esp_server.h"
+#include "song_cache.h"
+#include "ws_notify.h"
+#include "playback_clock.h"
+#include "upload_queue.h"
+#include "globals.h"
+#include "instruction_frame.h"
+
+/**
+ * Timing of one task, cumulative since boot
+ * Latency counts from the event (UART data, queued frame) to the task handling it
+ */
+struct UartTaskStats {
+  const char *name;
+  TaskHandle_t handle;
+  volatile uint32_t eventAt;  // micros() of the oldest unhandled event, 0 if none
+  uint32_t wakes;             // Runs caused by an event
+  uint32_t runs;              // All runs, including timeout checks
+  uint32_t latencyMaxUs;
+  uint64_t latencyTotalUs;
+  uint32_t busyMaxUs;
+  uint64_t busyTotalUs;
+};
+
+enum UartTaskId {
+  UPLOAD_TASK,
+  STATUS_TASK,
+  INSTRUCTION_TX_TASK,
+  UART_TASK_COUNT
+};
+
+static UartTaskStats taskStats[UART_TASK_COUNT] = {
+  {"upload"}, {"status"}, {"instruction tx"}
+};
+
+/**
+ * Instruction waiting for the TX task: this header, then the payload
+ * (framed when sent, so a retransmit sends the same item again)
+ */
+struct InstructionFrame {
+  uint32_t queuedAt;
+  uint8_t flags;
+  uint16_t length;
+  const uint8_t *data() const { return (const uint8_t *)(this + 1); }
+};
+
+static RingbufHandle_t instructionRing = nullptr;
+
+// Reply the TX task is waiting for; written by the status task
+static volatile int awaitedSeq = -1;
+static volatile uint8_t ackStatus = INSTRUCTION_ACK_OK;
+
+// Instruction delivery since boot
+static uint32_t instructionsAcked = 0;
+static uint32_t instructionsRetransmitted = 0;
+static uint32_t instructionsNacked = 0;
+static uint32_t instructionsFailed = 0;
+static uint32_t ackWaitsExtended = 0;   // ACK waits that sat out a List reply
+
+static void noteEvent(UartTaskStats &stats) {
+  if (stats.eventAt == 0) stats.eventAt = micros() | 1; // 0 means no event
+}
+
+static void notifyTask(UartTaskId id) {
+  UartTaskStats &stats = taskStats[id];
+  if (!stats.handle) return;
+  noteEvent(stats);
+  xTaskNotifyGive(stats.handle);
+}
+
+static void recordLatency(UartTaskStats &stats, uint32_t latency) {
+  stats.wakes++;
+  stats.latencyTotalUs += latency;
+  if (latency > stats.latencyMaxUs) stats.latencyMaxUs = latency;
+}
+
+// Starts timing a run; counts the wake latency if an event caused it
+static uint32_t beginRun(UartTaskStats &stats) {
+  uint32_t now = micros();
+  uint32_t eventAt = stats.eventAt;
+  if (eventAt) {
+    stats.eventAt = 0;
+    recordLatency(stats, now - eventAt);
+  }
+  return now;
+}
+
+static void endRun(UartTaskStats &stats, uint32_t start) {
+  uint32_t busy = micros() - start;
+  stats.runs++;
+  stats.busyTotalUs += busy;
+  if (busy > stats.busyMaxUs) stats.busyMaxUs = busy;
+}
+
+static void uploadTask(void *) {
+  UartTaskStats &stats = taskStats[UPLOAD_TASK];
+  for (;;) {
+    uint32_t start = beginRun(stats);
+    // Step until the state machine needs a reply, more body, or a new upload
+    while (!uploadToSAMD_state()) {
+    }
+    endRun(stats, start);
+    ulTaskNotifyTake(pdTRUE, uploadQueueActive() ? pdMS_TO_TICKS(UPLOAD_TASK_WAIT_MS) : portMAX_DELAY);
+  }
+}
+
+static void statusTask(void *) {
+  UartTaskStats &stats = taskStats[STATUS_TASK];
+  uint32_t wait = STATUS_TASK_WAIT_MS;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+    uint32_t start = beginRun(stats);
+    handlePlaybackMessages();
+    expireSongLists();
+    songCacheLoop();
+    wsNotifyLoop();
+    // Woken early for the next interpolated position update
+    wait = min((uint32_t)STATUS_TASK_WAIT_MS, playbackClockLoop());
+    endRun(stats, start);
+  }
+}
+
+// Header, payload and CRC go into the driver's TX ring as three writes
+static void writeInstructionFrame(uint8_t flags, uint8_t seq, const uint8_t *payload, uint16_t length) {
+  uint8_t header[INSTRUCTION_FRAME_HEADER_SIZE];
+  uint16_t crc = instructionCrc16(payload, length, instructionFrameHeader(header, flags, seq, length));
+  uint8_t trailer[INSTRUCTION_FRAME_CRC_SIZE] = {(uint8_t)crc, (uint8_t)(crc >> 8)};
+  instruction_uart.write(header, sizeof(header));
+  instruction_uart.write(payload, length);
+  instruction_uart.write(trailer, sizeof(trailer));
+}
+
+// Sends one instruction, retransmitting until it is acknowledged
+static void sendInstruction(const InstructionFrame &frame, uint8_t seq) {
+  if (!(frame.flags & INSTRUCTION_FLAG_ACK)) {
+    writeInstructionFrame(frame.flags, seq, frame.data(), frame.length);
+    return;
+  }
+  // Wire time at 10 bits per byte, on top of the reply deadline
+  TickType_t wait = pdMS_TO_TICKS(INSTRUCTION_ACK_TIMEOUT_MS +
+                                  (frame.length + INSTRUCTION_FRAME_OVERHEAD) * 10000UL / BAUDRATE);
+  bool list = (frame.flags & INSTRUCTION_FLAG_BINARY) && frame.length && frame.data()[0] == INSTRUCTION_OP_LIST;
+  for (int attempt = 0; attempt <= INSTRUCTION_ACK_RETRIES; attempt++) {
+    ulTaskNotifyTake(pdTRUE, 0); // Drop a late reply to an earlier attempt
+    awaitedSeq = seq;
+    // The flag lets the Grand Central tell a retransmit from a new instruction
+    uint8_t flags = attempt ? (frame.flags | INSTRUCTION_FLAG_RETRY) : frame.flags;
+    writeInstructionFrame(flags, seq, frame.data(), frame.length);
+    if (attempt) instructionsRetransmitted++;
+
+    bool replied = ulTaskNotifyTake(pdTRUE, wait) > 0;
+    // The ACK queues behind a List reply still being sent: wait for it rather than retransmit
+    if (!replied && songListReplyInFlight()) {
+      ackWaitsExtended++;
+      while (!replied && songListReplyInFlight()) replied = ulTaskNotifyTake(pdTRUE, wait) > 0;
+      if (!replied) replied = ulTaskNotifyTake(pdTRUE, wait) > 0; // The ACK's own time after the reply
+    }
+    if (replied && ackStatus == INSTRUCTION_ACK_OK) {
+      awaitedSeq = -1;
+      instructionsAcked++;
+      if (list) songListRequested(); // The reply follows its ACK
+      return;
+    }
+    if (replied) instructionsNacked++;
+  }
+  awaitedSeq = -1;
+  instructionsFailed++;
+  Serial.printf("Instruction %u not acknowledged, giving up\n", seq);
+}
+
+static void instructionTxTask(void *) {
+  UartTaskStats &stats = taskStats[INSTRUCTION_TX_TASK];
+  uint8_t seq = esp_random();     // Unrelated to any seq from before a restart
+  for (;;) {
+    size_t size;
+    const InstructionFrame *frame = (const InstructionFrame *)xRingbufferReceive(instructionRing, &size, portMAX_DELAY);
+    if (!frame) continue;
+    uint32_t start = micros();
+    recordLatency(stats, start - frame->queuedAt);
+    sendInstruction(*frame, seq++);
+    vRingbufferReturnItem(instructionRing, (void *)frame); // Space is freed once delivery is settled
+    endRun(stats, start);
+  }
+}
+
+void instructionAckReceived(uint8_t seq, uint8_t status) {
+  TaskHandle_t tx = taskStats[INSTRUCTION_TX_TASK].handle;
+  if (!tx || awaitedSeq != seq) return; // Duplicate or late reply
+  ackStatus = status;
+  xTaskNotifyGive(tx);
+}
+
+void startUartTasks() {
+  instructionRing = xRingbufferCreate(INSTRUCTION_RING_SIZE, RINGBUF_TYPE_NOSPLIT);
+  xTaskCreatePinnedToCore(instructionTxTask, "instrTx", INSTRUCTION_TX_TASK_STACK, nullptr,
+                          INSTRUCTION_TX_TASK_PRIORITY, &taskStats[INSTRUCTION_TX_TASK].handle, UART_TASK_CORE);
+  xTaskCreatePinnedToCore(statusTask, "statusRx", STATUS_TASK_STACK, nullptr, STATUS_TASK_PRIORITY,
+                          &taskStats[STATUS_TASK].handle, UART_TASK_CORE);
+  xTaskCreatePinnedToCore(uploadTask, "upload", UPLOAD_TASK_STACK, nullptr, UPLOAD_TASK_PRIORITY,
+                          &taskStats[UPLOAD_TASK].handle, UART_TASK_CORE);
+
+  // Driver receive events (FIFO threshold or line idle) wake the reader
+  instruction_uart.onReceive([]() { notifyTask(STATUS_TASK); });
+  upload_uart.onReceive([]() { notifyTask(UPLOAD_TASK); });
+}
+
+void wakeUploadTask() {
+  notifyTask(UPLOAD_TASK);
+}
+
+bool queueInstructionFrame(const FrameSegment *segments, size_t count, uint8_t flags) {
+  size_t length = 0;
+  for (size_t i = 0; i < count; i++) length += segments[i].length;
+  if (length > INSTRUCTION_MAX_PAYLOAD) return false;
+  if (!instructionRing) {
+    // No TX task yet: the segments go out as they are
+    uint8_t header[INSTRUCTION_FRAME_HEADER_SIZE];
+    uint16_t crc = instructionFrameHeader(header, flags & ~INSTRUCTION_FLAG_ACK, 0, length);
+    instruction_uart.write(header, sizeof(header));
+    for (size_t i = 0; i < count; i++) {
+      instruction_uart.write(segments[i].data, segments[i].length);
+      crc = instructionCrc16(segments[i].data, segments[i].length, crc);
+    }
+    uint8_t trailer[INSTRUCTION_FRAME_CRC_SIZE] = {(uint8_t)crc, (uint8_t)(crc >> 8)};
+    instruction_uart.write(trailer, sizeof(trailer));
+    return true;
+  }
+
+  // Reserve space for this payload and gather the segments into it
+  void *item;
+  if (xRingbufferSendAcquire(instructionRing, &item, sizeof(InstructionFrame) + length,
+                             pdMS_TO_TICKS(INSTRUCTION_QUEUE_WAIT_MS)) != pdTRUE) {
+    Serial.println("Instruction queue full, dropping frame");
+    return false;
+  }
+  InstructionFrame *frame = (InstructionFrame *)item;
+  frame->queuedAt = micros();
+  frame->flags = flags;
+  frame->length = length;
+  uint8_t *out = (uint8_t *)(frame + 1);
+  for (size_t i = 0; i < count; i++) {
+    memcpy(out, segments[i].data, segments[i].length);
+    out += segments[i].length;
+  }
+  xRingbufferSendComplete(instructionRing, item);
+  return true;
+}
+
+void reportUartTaskStats(Print &out) {
+  for (const UartTaskStats &stats : taskStats) {
+    uint32_t wakes = stats.wakes ? stats.wakes : 1;
+    uint32_t runs = stats.runs ? stats.runs : 1;
+    out.printf("%s: %lu wakes, latency avg %lu us max %lu us; %lu runs, busy avg %lu us max %lu us; stack free %u\n",
+               stats.name, (unsigned long)stats.wakes, (unsigned long)(stats.latencyTotalUs / wakes),
+               (unsigned long)stats.latencyMaxUs, (unsigned long)stats.runs, (unsigned long)(stats.busyTotalUs / runs),
+               (unsigned long)stats.busyMaxUs,
+               stats.handle ? (unsigned)uxTaskGetStackHighWaterMark(stats.handle) : 0);
+  }
+  out.printf("instructions: %lu acknowledged, %lu retransmitted, %lu NACKed, %lu given up; "
+             "%lu ACK waits extended for List replies\n",
+             (unsigned long)instructionsAcked, (unsigned long)instructionsRetransmitted,
+             (unsigned long)instructionsNacked, (unsigned long)instructionsFailed,
+             (unsigned long)ackWaitsExtended);
+}
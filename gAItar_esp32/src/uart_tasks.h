@@ -0,0 +1,75 @@
+#ifndef UART_TASKS_H
+#define UART_TASKS_H
+
+#include <Arduino.h>
+
+/**
+ * FreeRTOS tasks that own the Grand Central UARTs, pinned to the app core
+ * (WiFi runs on the other one)
+ * - upload: runs uploadToSAMD_state() over the upload queue, woken by upload
+ *   UART data and by the web server when an upload is queued or more body arrives
+ * - status: reads the instruction UART (STATUS lines, List frames), woken by
+ *   its receive events; also expires song list requests, fills the library cache
+ *   and broadcasts the interpolated playback position (playback_clock.h)
+ * - instruction TX: frames queued instructions (instruction_frame.h) and
+ *   retransmits them until the Grand Central acknowledges them; instructions
+ *   wait in a ring buffer of variable-length items, read and sent in place
+ * A blocked read in one task no longer holds up the others
+ */
+
+#define UART_TASK_CORE 1                 // APP_CPU
+#define UPLOAD_TASK_PRIORITY 3
+#define STATUS_TASK_PRIORITY 3
+#define INSTRUCTION_TX_TASK_PRIORITY 4
+#define UPLOAD_TASK_STACK 8192           // Also converts queued .mid files (midi_convert.h)
+#define STATUS_TASK_STACK 8192
+#define INSTRUCTION_TX_TASK_STACK 4096
+#define UPLOAD_TASK_WAIT_MS 20           // Longest upload wait between timeout checks
+#define STATUS_TASK_WAIT_MS 50           // Longest status wait between timeout checks
+#define INSTRUCTION_RING_SIZE 4096       // Queued instruction bytes (each item adds a header)
+#define INSTRUCTION_QUEUE_WAIT_MS 100    // Longest a sender waits for ring space
+#define INSTRUCTION_ACK_TIMEOUT_MS 100   // ACK wait after the frame has left the UART (extended while a List reply arrives)
+#define INSTRUCTION_ACK_RETRIES 3        // Retransmits before an instruction is given up
+
+/**
+ * Creates the tasks and hooks the UART receive events
+ * Called once from setup() after setupUARTs()
+ */
+void startUartTasks();
+
+/**
+ * Wakes the upload task (upload queued, or more streamed body available)
+ */
+void wakeUploadTask();
+
+/**
+ * Part of an instruction frame, so callers need not copy the parts together
+ */
+struct FrameSegment {
+  const uint8_t *data;
+  size_t length;
+};
+
+/**
+ * Queues one instruction for the TX task, gathering the payload segments
+ * straight into ring buffer space sized to the payload
+ * Falls back to a direct write (without ACK wait) before the tasks are started
+ *
+ * @param flags INSTRUCTION_FLAG_* for the frame
+ * @return false if the payload is too long or the queue stayed full
+ */
+bool queueInstructionFrame(const FrameSegment *segments, size_t count, uint8_t flags);
+
+/**
+ * Hands an ACK/NACK reply to the TX task
+ * Called from the status task by the instruction UART reader
+ */
+void instructionAckReceived(uint8_t seq, uint8_t status);
+
+/**
+ * Prints wake latency (event to task running), busy time and stack headroom per task,
+ * and instruction delivery counts
+ */
+void reportUartTaskStats(Print &out);
+
+#endif
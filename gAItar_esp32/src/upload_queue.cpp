@@ -0,0 +1,198 @@
+#include "upload_queue.h"
+#include "SPIFFS.h"
+
+struct UploadSlot {
+  UploadJobState state;
+  uint16_t id;
+  uint32_t order;   // Arrival order, oldest is sent first
+  bool streamed;
+  uint8_t resends;
+  UploadMidi *midi;
+  char path[UPLOAD_QUEUE_PATH_SIZE];
+};
+
+// Jobs are added and completed by the web server task and taken and freed by
+// the upload task; each holds the lock only to change slot fields
+static portMUX_TYPE queueMux = portMUX_INITIALIZER_UNLOCKED;
+static UploadSlot slots[UPLOAD_QUEUE_LENGTH];
+static uint16_t lastId = 0;
+static uint32_t lastOrder = 0;
+
+static void stagingPath(int slot, char *out) {
+  snprintf(out, UPLOAD_QUEUE_STAGING_SIZE, "/upload%d", slot);
+}
+
+// Slot of a job, or -1; queueMux held
+static int findSlot(uint16_t id) {
+  for (int i = 0; i < UPLOAD_QUEUE_LENGTH; i++) {
+    if (slots[i].state != UPLOAD_JOB_FREE && slots[i].id == id) return i;
+  }
+  return -1;
+}
+
+void uploadQueueBegin() {
+  char staging[UPLOAD_QUEUE_STAGING_SIZE];
+  for (int i = 0; i < UPLOAD_QUEUE_LENGTH; i++) {
+    stagingPath(i, staging);
+    if (SPIFFS.exists(staging)) SPIFFS.remove(staging);
+  }
+}
+
+// Takes a free slot for a new job; returns its slot or -1
+static int addJob(const char *path, UploadJobState state, bool streamed, UploadMidi *midi, uint16_t &id) {
+  int slot = -1;
+  portENTER_CRITICAL(&queueMux);
+  for (int i = 0; i < UPLOAD_QUEUE_LENGTH && slot < 0; i++) {
+    if (slots[i].state == UPLOAD_JOB_FREE) slot = i;
+  }
+  if (slot >= 0) {
+    if (++lastId == 0) lastId = 1; // 0 means no job
+    id = lastId;
+    UploadSlot &s = slots[slot];
+    s.state = state;
+    s.id = id;
+    s.order = ++lastOrder;
+    s.streamed = streamed;
+    s.resends = 0;
+    s.midi = midi;
+    snprintf(s.path, sizeof(s.path), "%s", path);
+  }
+  portEXIT_CRITICAL(&queueMux);
+  return slot;
+}
+
+uint16_t uploadQueueAdd(const char *path, bool streamed, char *staging) {
+  uint16_t id = 0;
+  int slot = addJob(path, streamed ? UPLOAD_JOB_READY : UPLOAD_JOB_RECEIVING, streamed, nullptr, id);
+  if (slot >= 0) stagingPath(slot, staging);
+  return id;
+}
+
+uint16_t uploadQueueAddMidi(const char *path, UploadMidi *midi) {
+  uint16_t id = 0;
+  addJob(path, UPLOAD_JOB_READY, false, midi, id);
+  return id;
+}
+
+bool uploadQueueReady(uint16_t id, const char *path) {
+  bool ready = true;
+  int dropped = -1;
+  portENTER_CRITICAL(&queueMux);
+  int slot = findSlot(id);
+  if (slot >= 0 && slots[slot].state == UPLOAD_JOB_RECEIVING) {
+    UploadSlot &s = slots[slot];
+    if (!s.path[0]) snprintf(s.path, sizeof(s.path), "%s", path);
+    ready = s.path[0] != '\0';
+    s.state = ready ? UPLOAD_JOB_READY : UPLOAD_JOB_FREE;
+    if (!ready) dropped = slot;
+  }
+  portEXIT_CRITICAL(&queueMux);
+  if (dropped >= 0) {
+    char staging[UPLOAD_QUEUE_STAGING_SIZE];
+    stagingPath(dropped, staging);
+    SPIFFS.remove(staging);
+  }
+  return ready;
+}
+
+void uploadQueueAbandon(uint16_t id) {
+  int dropped = -1;
+  portENTER_CRITICAL(&queueMux);
+  int slot = findSlot(id);
+  if (slot >= 0 && slots[slot].state == UPLOAD_JOB_RECEIVING) {
+    slots[slot].state = UPLOAD_JOB_FREE;
+    dropped = slot;
+  }
+  portEXIT_CRITICAL(&queueMux);
+  if (dropped >= 0) {
+    char staging[UPLOAD_QUEUE_STAGING_SIZE];
+    stagingPath(dropped, staging);
+    SPIFFS.remove(staging);
+  }
+}
+
+bool uploadQueueNext(UploadJob &job) {
+  int next = -1;
+  portENTER_CRITICAL(&queueMux);
+  for (int i = 0; i < UPLOAD_QUEUE_LENGTH; i++) {
+    if (slots[i].state == UPLOAD_JOB_READY && (next < 0 || slots[i].order < slots[next].order)) next = i;
+  }
+  if (next >= 0) {
+    UploadSlot &s = slots[next];
+    s.state = UPLOAD_JOB_SENDING;
+    job.id = s.id;
+    job.streamed = s.streamed;
+    job.resends = s.resends;
+    job.midi = s.midi;
+    memcpy(job.path, s.path, sizeof(job.path));
+  }
+  portEXIT_CRITICAL(&queueMux);
+  if (next >= 0) stagingPath(next, job.staging);
+  return next >= 0;
+}
+
+void uploadQueueMidiStaged(UploadJob &job) {
+  portENTER_CRITICAL(&queueMux);
+  int slot = findSlot(job.id);
+  if (slot >= 0) slots[slot].midi = nullptr;
+  portEXIT_CRITICAL(&queueMux);
+  free(job.midi);
+  job.midi = nullptr;
+}
+
+void uploadQueueRetry(const UploadJob &job) {
+  portENTER_CRITICAL(&queueMux);
+  int slot = findSlot(job.id);
+  if (slot >= 0) {
+    slots[slot].state = UPLOAD_JOB_READY; // Keeps its order, so it is taken next
+    slots[slot].resends = job.resends;
+  }
+  portEXIT_CRITICAL(&queueMux);
+}
+
+void uploadQueueFinish(const UploadJob &job) {
+  if (!job.streamed) SPIFFS.remove(job.staging);
+  UploadMidi *midi = nullptr;
+  portENTER_CRITICAL(&queueMux);
+  int slot = findSlot(job.id);
+  if (slot >= 0) {
+    slots[slot].state = UPLOAD_JOB_FREE;
+    midi = slots[slot].midi;
+    slots[slot].midi = nullptr;
+  }
+  portEXIT_CRITICAL(&queueMux);
+  free(midi); // Never converted
+}
+
+bool uploadQueueEmpty() {
+  bool empty = true;
+  portENTER_CRITICAL(&queueMux);
+  for (const UploadSlot &s : slots) empty &= s.state == UPLOAD_JOB_FREE;
+  portEXIT_CRITICAL(&queueMux);
+  return empty;
+}
+
+bool uploadQueueActive() {
+  bool active = false;
+  portENTER_CRITICAL(&queueMux);
+  for (const UploadSlot &s : slots) active |= s.state == UPLOAD_JOB_READY || s.state == UPLOAD_JOB_SENDING;
+  portEXIT_CRITICAL(&queueMux);
+  return active;
+}
+
+void reportUploadQueue(Print &out) {
+  static const char *const stateNames[] = {"free", "receiving", "ready", "sending"};
+  UploadSlot copy[UPLOAD_QUEUE_LENGTH];
+  portENTER_CRITICAL(&queueMux);
+  memcpy(copy, slots, sizeof(copy));
+  portEXIT_CRITICAL(&queueMux);
+
+  int jobs = 0;
+  for (const UploadSlot &s : copy) {
+    if (s.state == UPLOAD_JOB_FREE) continue;
+    out.printf("job %u: %s%s %s\n", s.id, stateNames[s.state], s.streamed ? " (streamed)" : (s.midi ? " (MIDI)" : ""),
+               s.path[0] ? s.path : "(path not known yet)");
+    jobs++;
+  }
+  out.printf("%d of %d slots in use\n", jobs, UPLOAD_QUEUE_LENGTH);
+}
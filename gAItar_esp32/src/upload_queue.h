@@ -0,0 +1,122 @@
+#ifndef UPLOAD_QUEUE_H
+#define UPLOAD_QUEUE_H
+
+#include <Arduino.h>
+
+/**
+ * Bounded queue of uploads waiting for the Grand Central
+ * Each job has its own id, SD card path and staging: the HTTP body is streamed
+ * through the upload stream ring (upload_stream.h) when the job has the queue
+ * to itself, otherwise it is written to a SPIFFS file of the job's slot, so an
+ * upload arriving mid-transfer waits its turn instead of overwriting another
+ * The web server task adds jobs and marks their bodies complete; the upload
+ * task takes ready jobs oldest first and sends them back to back (uart.cpp)
+ */
+
+#define UPLOAD_QUEUE_LENGTH 12          // A playlist of ten songs and a couple more
+#define UPLOAD_QUEUE_PATH_SIZE 128
+#define UPLOAD_QUEUE_STAGING_SIZE 16    // "/upload<slot>"
+
+enum UploadJobState : uint8_t {
+  UPLOAD_JOB_FREE,
+  UPLOAD_JOB_RECEIVING,  // Body still being staged in SPIFFS
+  UPLOAD_JOB_READY,      // Waiting for the upload task (streamed jobs start here)
+  UPLOAD_JOB_SENDING
+};
+
+/**
+ * .mid file buffered in RAM by POST /upload-midi, one allocation with its data
+ * The upload task converts it into the job's staging file (midi_convert.h)
+ */
+struct UploadMidi {
+  size_t length;
+  size_t capacity;
+  int status;       // HTTP status once receiving it failed (413, 503), else 0
+  uint8_t data[];
+};
+
+/**
+ * Copy of a job handed to the upload task
+ */
+struct UploadJob {
+  uint16_t id;
+  bool streamed;
+  uint8_t resends;  // Times the Grand Central rejected the content so far
+  UploadMidi *midi; // Still to be converted into the staging file, or nullptr
+  char path[UPLOAD_QUEUE_PATH_SIZE];
+  char staging[UPLOAD_QUEUE_STAGING_SIZE];  // SPIFFS file of a staged body
+};
+
+/**
+ * Removes staging files left by a restart
+ * Called once from setup() after SPIFFS is mounted
+ */
+void uploadQueueBegin();
+
+/**
+ * Adds a job for an upload whose body is starting
+ * Called from the web server task
+ *
+ * @param path SD card path, or empty if the form fields follow the file (see uploadQueueReady())
+ * @param streamed The body goes through the upload stream; otherwise it is written to the staging file
+ * @param staging Receives the SPIFFS staging path (UPLOAD_QUEUE_STAGING_SIZE bytes)
+ * @return Job id, or 0 if the queue is full
+ */
+uint16_t uploadQueueAdd(const char *path, bool streamed, char *staging);
+
+/**
+ * Adds a job for a .mid file that is already in RAM; it is ready right away
+ * Called from the web server task
+ *
+ * @param midi Owned by the queue if the job is added, freed once converted or dropped
+ * @return Job id, or 0 if the queue is full
+ */
+uint16_t uploadQueueAddMidi(const char *path, UploadMidi *midi);
+
+/**
+ * Marks a staged body complete so the upload task can send it
+ * Called from the web server task
+ *
+ * @param path Fills in the path if it was not known when the body started
+ * @return false if the job still has no path (it is dropped)
+ */
+bool uploadQueueReady(uint16_t id, const char *path);
+
+/**
+ * Drops a job whose body did not arrive whole (client gone, SPIFFS full)
+ * Jobs that already left UPLOAD_JOB_RECEIVING are not affected
+ */
+void uploadQueueAbandon(uint16_t id);
+
+/**
+ * Takes the oldest ready job (upload task)
+ *
+ * @return false if no job is ready
+ */
+bool uploadQueueNext(UploadJob &job);
+
+/**
+ * Frees a job's .mid buffer once it is converted into the staging file (upload task)
+ */
+void uploadQueueMidiStaged(UploadJob &job);
+
+/**
+ * Puts a job the Grand Central rejected back in the queue, ahead of newer
+ * jobs, keeping its staging file and job.resends (upload task)
+ */
+void uploadQueueRetry(const UploadJob &job);
+
+/**
+ * Frees a sent or failed job, its staging file and any .mid buffer (upload task)
+ */
+void uploadQueueFinish(const UploadJob &job);
+
+bool uploadQueueEmpty();   // No jobs at all (a new upload may stream)
+bool uploadQueueActive();  // A job is ready or being sent (the upload task should keep polling)
+
+/**
+ * Prints each job: id, state and path
+ */
+void reportUploadQueue(Print &out);
+
+#endif
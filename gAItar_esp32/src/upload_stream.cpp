@@ -0,0 +1,189 @@
+#include "upload_stream.h"
+
+#define STREAM_HEADER_CAPTURE 8  // Leading body bytes kept for the song index
+
+static_assert(UPLOAD_STREAM_TCP_WINDOW < UPLOAD_STREAM_BUFFER_SIZE, "The ring must hold more than one TCP window");
+
+enum UploadStreamState {
+  STREAM_IDLE,
+  STREAM_RECEIVING,
+  STREAM_ABORTED
+};
+
+// Shared between the web server task and the upload task; counters only change under streamMux
+static portMUX_TYPE streamMux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t ring[UPLOAD_STREAM_BUFFER_SIZE];
+static UploadStreamState streamState = STREAM_IDLE;
+static bool readerBusy = false;          // Claimed until the upload task closes or aborts it
+static const void *streamOwner = nullptr;
+static size_t streamSize = 0;
+static size_t written = 0;               // Body bytes accepted into the ring
+static size_t taken = 0;                 // Body bytes read out by the upload task
+static unsigned long lastWriteMs = 0;
+static bool acksHeld = false;            // The writer holds TCP ACKs until a window is free
+static void (*resumeWriter)() = nullptr;
+static uint8_t songHeader[STREAM_HEADER_CAPTURE];
+
+bool uploadStreamBegin(const void *owner, size_t size, void (*resume)()) {
+  if (size == 0) return false;
+  portENTER_CRITICAL(&streamMux);
+  bool claimed = !readerBusy;
+  if (claimed) {
+    readerBusy = true;
+    streamState = STREAM_RECEIVING;
+    streamOwner = owner;
+    streamSize = size;
+    written = 0;
+    taken = 0;
+    lastWriteMs = millis();
+    acksHeld = false;
+    resumeWriter = resume;
+  }
+  portEXIT_CRITICAL(&streamMux);
+  return claimed;
+}
+
+bool uploadStreamOwnedBy(const void *owner) {
+  portENTER_CRITICAL(&streamMux);
+  bool owned = streamState != STREAM_IDLE && streamOwner == owner;
+  portEXIT_CRITICAL(&streamMux);
+  return owned;
+}
+
+size_t uploadStreamPush(const void *owner, const uint8_t *data, size_t len) {
+  portENTER_CRITICAL(&streamMux);
+  bool open = streamState == STREAM_RECEIVING && streamOwner == owner;
+  if (open && written + len > streamSize) {
+    streamState = STREAM_ABORTED; // Body longer than announced
+    open = false;
+  }
+  size_t start = written;
+  size_t space = UPLOAD_STREAM_BUFFER_SIZE - (written - taken);
+  portEXIT_CRITICAL(&streamMux);
+  if (!open) return 0;
+
+  // Only this task writes the free part of the ring, so copy outside the lock
+  size_t count = len < space ? len : space;
+  size_t pos = start % UPLOAD_STREAM_BUFFER_SIZE;
+  size_t first = min(count, (size_t)(UPLOAD_STREAM_BUFFER_SIZE - pos));
+  memcpy(ring + pos, data, first);
+  memcpy(ring, data + first, count - first);
+  if (start < STREAM_HEADER_CAPTURE) {
+    memcpy(songHeader + start, data, min(count, (size_t)(STREAM_HEADER_CAPTURE - start)));
+  }
+
+  portENTER_CRITICAL(&streamMux);
+  written += count;
+  if (count) lastWriteMs = millis();
+  portEXIT_CRITICAL(&streamMux);
+  return count;
+}
+
+bool uploadStreamWrite(const void *owner, const uint8_t *data, size_t len) {
+  size_t count = uploadStreamPush(owner, data, len);
+  if (count == len) return true;
+  portENTER_CRITICAL(&streamMux);
+  bool open = streamState == STREAM_RECEIVING && streamOwner == owner;
+  if (open) streamState = STREAM_ABORTED; // More than one window beyond the held ACKs
+  portEXIT_CRITICAL(&streamMux);
+  return false;
+}
+
+bool uploadStreamHoldAcks(const void *owner) {
+  portENTER_CRITICAL(&streamMux);
+  bool hold = streamState == STREAM_RECEIVING && streamOwner == owner &&
+              UPLOAD_STREAM_BUFFER_SIZE - (written - taken) < UPLOAD_STREAM_TCP_WINDOW;
+  if (hold) acksHeld = true;
+  portEXIT_CRITICAL(&streamMux);
+  return hold;
+}
+
+// Reader side: hands the held ACKs back once they are safe to send (or no longer matter)
+static void resumeIfRoom(bool aborted) {
+  portENTER_CRITICAL(&streamMux);
+  bool resume = acksHeld && (aborted || UPLOAD_STREAM_BUFFER_SIZE - (written - taken) >= UPLOAD_STREAM_TCP_WINDOW);
+  if (resume) acksHeld = false;
+  void (*hook)() = resumeWriter;
+  portEXIT_CRITICAL(&streamMux);
+  if (resume && hook) hook();
+}
+
+void uploadStreamEnd(const void *owner) {
+  portENTER_CRITICAL(&streamMux);
+  if (streamState == STREAM_RECEIVING && streamOwner == owner && written != streamSize) {
+    streamState = STREAM_ABORTED; // Body shorter than announced
+  }
+  portEXIT_CRITICAL(&streamMux);
+}
+
+bool uploadStreamActive() {
+  portENTER_CRITICAL(&streamMux);
+  bool active = readerBusy;
+  portEXIT_CRITICAL(&streamMux);
+  return active;
+}
+
+size_t uploadStreamSize() {
+  return streamSize;
+}
+
+size_t uploadStreamAvailable() {
+  portENTER_CRITICAL(&streamMux);
+  size_t available = written - taken;
+  portEXIT_CRITICAL(&streamMux);
+  return available;
+}
+
+bool uploadStreamReceived() {
+  portENTER_CRITICAL(&streamMux);
+  bool received = streamState == STREAM_RECEIVING && written == streamSize;
+  portEXIT_CRITICAL(&streamMux);
+  return received;
+}
+
+bool uploadStreamFailed() {
+  portENTER_CRITICAL(&streamMux);
+  bool failed = streamState == STREAM_ABORTED ||
+                (written < streamSize && millis() - lastWriteMs > UPLOAD_STREAM_IDLE_MS);
+  portEXIT_CRITICAL(&streamMux);
+  return failed;
+}
+
+size_t uploadStreamRead(uint8_t *buffer, size_t len) {
+  size_t available = uploadStreamAvailable();
+  size_t count = len < available ? len : available;
+  size_t pos = taken % UPLOAD_STREAM_BUFFER_SIZE;
+  size_t first = min(count, (size_t)(UPLOAD_STREAM_BUFFER_SIZE - pos));
+  memcpy(buffer, ring + pos, first);
+  memcpy(buffer + first, ring, count - first);
+
+  portENTER_CRITICAL(&streamMux);
+  taken += count;
+  portEXIT_CRITICAL(&streamMux);
+  resumeIfRoom(false);
+  return count;
+}
+
+bool uploadStreamSongHeader(uint8_t *header, size_t len) {
+  if (len > STREAM_HEADER_CAPTURE || written < len) return false;
+  memcpy(header, songHeader, len);
+  return true;
+}
+
+void uploadStreamAbort() {
+  portENTER_CRITICAL(&streamMux);
+  if (readerBusy) {
+    streamState = STREAM_ABORTED; // Owner keeps the stream so its remaining body is dropped
+    readerBusy = false;
+  }
+  portEXIT_CRITICAL(&streamMux);
+  resumeIfRoom(true);
+}
+
+void uploadStreamClose() {
+  portENTER_CRITICAL(&streamMux);
+  streamState = STREAM_IDLE;
+  streamOwner = nullptr;
+  readerBusy = false;
+  portEXIT_CRITICAL(&streamMux);
+}
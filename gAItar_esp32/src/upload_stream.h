@@ -0,0 +1,96 @@
+#ifndef UPLOAD_STREAM_H
+#define UPLOAD_STREAM_H
+
+#include <Arduino.h>
+
+/**
+ * Ring buffer carrying an upload's HTTP body straight to the upload state
+ * machine, so the UART transfer runs while the body is still arriving and
+ * nothing is staged in SPIFFS
+ * The web server task writes, the upload task reads. The writer never waits:
+ * once less than a TCP receive window is free it holds the TCP ACKs of what
+ * it wrote, so the client can send at most one more window (which still fits),
+ * and the reader resumes the writer when a window is free again
+ * Only one stream at a time; a second upload falls back to SPIFFS staging
+ */
+
+#define UPLOAD_STREAM_BUFFER_SIZE 16384
+#define UPLOAD_STREAM_IDLE_MS 10000       // Body gap after which the reader gives up
+#ifdef CONFIG_LWIP_TCP_WND_DEFAULT
+#define UPLOAD_STREAM_TCP_WINDOW CONFIG_LWIP_TCP_WND_DEFAULT
+#else
+#define UPLOAD_STREAM_TCP_WINDOW 5744     // lwIP's default receive window
+#endif
+
+/**
+ * Claims the stream for one request
+ * Called by the web server task when the file part starts
+ *
+ * @param owner Request the body belongs to
+ * @param size File size announced by the client
+ * @param resume Called by the upload task once the held TCP ACKs can be sent
+ *        (see uploadStreamHoldAcks()), and when the stream is aborted
+ * @return false if a stream is already running (use SPIFFS staging instead)
+ */
+bool uploadStreamBegin(const void *owner, size_t size, void (*resume)() = nullptr);
+
+/**
+ * True if owner's body is being streamed (data after an abort is still owned, and dropped)
+ */
+bool uploadStreamOwnedBy(const void *owner);
+
+/**
+ * Copies as much as fits without waiting
+ *
+ * @return Bytes accepted (0 once the stream is aborted)
+ */
+size_t uploadStreamPush(const void *owner, const uint8_t *data, size_t len);
+
+/**
+ * Copies all of data without waiting
+ * It always fits while the writer holds its TCP ACKs as uploadStreamHoldAcks() says
+ *
+ * @return false if the stream was aborted (or data did not fit, which aborts it);
+ *         the rest of the body should be discarded
+ */
+bool uploadStreamWrite(const void *owner, const uint8_t *data, size_t len);
+
+/**
+ * True if the TCP segment just written must not be acknowledged yet: less
+ * than UPLOAD_STREAM_TCP_WINDOW of the ring is free. The resume hook runs
+ * once that much is free again
+ */
+bool uploadStreamHoldAcks(const void *owner);
+
+/**
+ * Marks the body complete; aborts if it differs from the announced size
+ */
+void uploadStreamEnd(const void *owner);
+
+// Reader side (upload task)
+bool uploadStreamActive();          // A stream is waiting to be sent
+size_t uploadStreamSize();          // Announced file size
+size_t uploadStreamAvailable();     // Bytes buffered
+bool uploadStreamReceived();        // Whole body is in (buffered or read)
+bool uploadStreamFailed();          // Aborted, or no body bytes for UPLOAD_STREAM_IDLE_MS
+size_t uploadStreamRead(uint8_t *buffer, size_t len);
+
+/**
+ * Copies the first bytes of the body (the song header) for the song index
+ *
+ * @return false if fewer than len bytes were streamed
+ */
+bool uploadStreamSongHeader(uint8_t *header, size_t len);
+
+/**
+ * Drops the stream after a failed transfer; the writer discards what follows
+ * (held TCP ACKs are resumed so the rest of the body can arrive)
+ */
+void uploadStreamAbort();
+
+/**
+ * Releases the stream after a finished transfer
+ */
+void uploadStreamClose();
+
+#endif
@@ -0,0 +1,87 @@
+#include "ws_commands.h"
+#include "esp_server.h"
+#include "uart.h"
+#include "uart_tasks.h"
+#include "playback_clock.h"
+
+// Receive-to-queued timing since boot (async_tcp task only)
+static uint32_t commands = 0;
+static uint32_t commandsFailed = 0;
+static uint64_t queueTotalUs = 0;
+static uint32_t queueMaxUs = 0;
+
+// Translates one client frame into a binary instruction (instruction_ops.h)
+static uint8_t forwardCommand(uint8_t op, const uint8_t *payload, size_t payloadLength) {
+  static uint8_t command[INSTRUCTION_MAX_PAYLOAD]; // async_tcp task only
+
+  switch (op) {
+    case 'P': {
+      // The payload already is the PATH argument value, so it goes into the frame as it is
+      const char *path = (const char *)payload;
+      if (payloadLength < 2 || path[0] != '/' || strnlen(path, payloadLength) != payloadLength - 1) {
+        return WS_COMMAND_UNKNOWN;
+      }
+      if (payloadLength > UINT8_MAX) return WS_COMMAND_TOO_LONG;
+      uint8_t head[] = {INSTRUCTION_OP_PLAY, INSTRUCTION_ARG_PATH, (uint8_t)payloadLength};
+      FrameSegment segments[] = {{head, sizeof(head)}, {payload, payloadLength}};
+      if (!queueInstructionFrame(segments, 2, INSTRUCTION_FLAG_ACK | INSTRUCTION_FLAG_BINARY)) {
+        return WS_COMMAND_BUSY;
+      }
+      playbackClockPlay(path);
+      return WS_COMMAND_OK;
+    }
+    case 'S': {
+      if (payloadLength != 4) return WS_COMMAND_UNKNOWN;
+      uint32_t position;
+      memcpy(&position, payload, 4); // Little-endian on both ends
+      InstructionOpWriter seek(command, sizeof(command), INSTRUCTION_OP_SEEK);
+      seek.u32(INSTRUCTION_ARG_POSITION, position);
+      if (!instructionOpToSAMD(command, seek.length())) return WS_COMMAND_BUSY;
+      playbackClockSeek(position);
+      return WS_COMMAND_OK;
+    }
+    case 'T': {
+      if (payloadLength != 2) return WS_COMMAND_UNKNOWN;
+      uint16_t rate;
+      memcpy(&rate, payload, 2);
+      InstructionOpWriter tempo(command, sizeof(command), INSTRUCTION_OP_RATE);
+      tempo.u16(INSTRUCTION_ARG_RATE, rate);
+      if (!instructionOpToSAMD(command, tempo.length())) return WS_COMMAND_BUSY;
+      playbackClockRate(rate);
+      return WS_COMMAND_OK;
+    }
+    case 'p': command[0] = INSTRUCTION_OP_PAUSE; break;
+    case 'r': command[0] = INSTRUCTION_OP_RESUME; break;
+    case 'R': command[0] = INSTRUCTION_OP_RESCAN; break;
+    default: return WS_COMMAND_UNKNOWN;
+  }
+  if (!instructionOpToSAMD(command, 1)) return WS_COMMAND_BUSY;
+  if (op == 'p') playbackClockPause();
+  if (op == 'r') playbackClockResume();
+  return WS_COMMAND_OK;
+}
+
+void handleWsCommand(AsyncWebSocketClient *client, const uint8_t *data, size_t len) {
+  uint32_t start = micros();
+  uint8_t id = len >= 2 ? data[1] : 0;
+  uint8_t result = len >= 2 ? forwardCommand(data[0], data + 2, len - 2) : WS_COMMAND_UNKNOWN;
+
+  uint32_t elapsed = micros() - start;
+  commands++;
+  if (result != WS_COMMAND_OK) commandsFailed++;
+  queueTotalUs += elapsed;
+  if (elapsed > queueMaxUs) queueMaxUs = elapsed;
+
+  uint8_t reply[] = {'A', id, result};
+  client->binary(reply, sizeof(reply));
+#if COMMAND_DEBUG
+  Serial.printf("WS command '%c' #%u from client #%u: result %u in %lu us\n", len ? data[0] : '?', id,
+                client->id(), result, (unsigned long)elapsed);
+#endif
+}
+
+void reportWsCommandStats(Print &out) {
+  uint32_t count = commands ? commands : 1;
+  out.printf("%lu commands (%lu failed), receive to queued avg %lu us max %lu us\n", (unsigned long)commands,
+             (unsigned long)commandsFailed, (unsigned long)(queueTotalUs / count), (unsigned long)queueMaxUs);
+}
@@ -0,0 +1,40 @@
+#ifndef WS_COMMANDS_H
+#define WS_COMMANDS_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+/**
+ * Transport commands from the UI over /ws, so a button press skips the
+ * connection setup and request parsing of POST /play and /pause
+ *
+ * Client frames (binary): op(u8) id(u8) payload
+ *   'P' play    payload: the song path "/genre/artist/title.bin" with its '\0'
+ *               (at most 255 bytes), copied into the PATH argument unchanged
+ *   'p' pause
+ *   'r' resume
+ *   'S' seek    payload: position in ms (u32 LE)
+ *   'T' rate    payload: playback rate in percent (u16 LE, 25-400)
+ *   'R' rescan
+ * Each is forwarded as a binary instruction (instruction_ops.h)
+ * Reply (binary): 'A' id(u8) result(u8), sent once the instruction is
+ * queued for the Grand Central
+ */
+
+#define WS_COMMAND_OK 0
+#define WS_COMMAND_UNKNOWN 1    // Unknown op or short frame
+#define WS_COMMAND_TOO_LONG 2   // Payload does not fit an instruction frame
+#define WS_COMMAND_BUSY 3       // Instruction queue stayed full
+
+/**
+ * Forwards one command frame to the Grand Central and acknowledges it
+ * Called from the async_tcp task for complete binary messages
+ */
+void handleWsCommand(AsyncWebSocketClient *client, const uint8_t *data, size_t len);
+
+/**
+ * Prints command count and time from receiving a command to queueing its frame
+ */
+void reportWsCommandStats(Print &out);
+
+#endif
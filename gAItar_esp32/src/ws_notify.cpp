@@ -0,0 +1,470 @@
+#include "ws_notify.h"
+#include "playback_clock.h"
+#include "song_cache.h"
+#include "ws_commands.h"
+#include <memory>
+#include <vector>
+
+AsyncWebSocket ws("/ws");
+
+enum NotifyKind {
+  NOTIFY_PROGRESS,
+  NOTIFY_STATUS,
+  NOTIFY_KIND_COUNT
+};
+
+/**
+ * Latest message of one kind, as text and binary frames
+ * Frames are built only for formats some client uses, and kept until the
+ * next message so backed-up clients get them without another copy
+ */
+struct NotifyMessage {
+  char text[WS_NOTIFY_MESSAGE_SIZE];
+  size_t textLength;
+  uint8_t binary[WS_NOTIFY_MESSAGE_SIZE];
+  size_t binaryLength;
+  AsyncWebSocketSharedBuffer textFrame;
+  AsyncWebSocketSharedBuffer binaryFrame;
+  bool sent;  // Holds a message still worth sending to a skipped client
+};
+
+struct NotifyClient {
+  uint32_t id;        // 0 = free slot
+  bool binary;        // Wants binary frames
+  uint8_t pending;    // NotifyKind bits skipped while the client was backed up
+  uint32_t finalSeq;  // Next final progress message the client has not had
+};
+
+// Slots are changed by the async_tcp task (connect, disconnect, format) and
+// the notifying tasks; only plain fields are touched under clientsMux
+static portMUX_TYPE clientsMux = portMUX_INITIALIZER_UNLOCKED;
+static NotifyClient clients[WS_NOTIFY_MAX_CLIENTS];
+
+// Serializes broadcasts between the upload and status tasks
+static SemaphoreHandle_t notifyMutex = nullptr;
+static NotifyMessage messages[NOTIFY_KIND_COUNT];
+static uint16_t progressJob = 0;  // Job of messages[NOTIFY_PROGRESS]
+
+// Complete and error messages, which every client gets once per job; the
+// last WS_NOTIFY_FINAL_QUEUE are kept for clients that are backed up
+static NotifyMessage finals[WS_NOTIFY_FINAL_QUEUE];
+static uint32_t finalCount = 0;
+
+// Broadcast timing and frame counts since boot
+static uint32_t broadcasts = 0;
+static uint32_t framesBuilt = 0;
+static uint32_t framesSent = 0;
+static uint32_t framesCoalesced = 0;
+static uint32_t finalsLost = 0;
+static uint64_t broadcastTotalUs = 0;
+static uint32_t broadcastMaxUs = 0;
+static uint32_t broadcastClientsMax = 0;
+
+static void addClient(AsyncWebSocketClient *client) {
+  bool added = false;
+  portENTER_CRITICAL(&clientsMux);
+  for (NotifyClient &slot : clients) {
+    if (slot.id == 0) {
+      // A new client catches up on playback status with the next wsNotifyLoop()
+      slot = {client->id(), false, (uint8_t)(1 << NOTIFY_STATUS), finalCount};
+      added = true;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&clientsMux);
+  if (!added) {
+    Serial.printf("WebSocket client #%u rejected, too many clients\n", client->id());
+    client->close();
+  }
+}
+
+static void removeClient(uint32_t id) {
+  portENTER_CRITICAL(&clientsMux);
+  for (NotifyClient &slot : clients) {
+    if (slot.id == id) slot.id = 0;
+  }
+  portEXIT_CRITICAL(&clientsMux);
+}
+
+static void setClientFormat(uint32_t id, bool binary) {
+  portENTER_CRITICAL(&clientsMux);
+  for (NotifyClient &slot : clients) {
+    if (slot.id == id) slot.binary = binary;
+  }
+  portEXIT_CRITICAL(&clientsMux);
+}
+
+// Text messages set the notification format, binary ones are commands (ws_commands.h)
+static void handleClientMessage(AsyncWebSocketClient *client, void *arg, const uint8_t *data, size_t len) {
+  AwsFrameInfo *info = (AwsFrameInfo *)arg;
+  if (!info->final || info->index != 0 || info->len != len) return; // Commands fit one frame
+  if (info->opcode == WS_BINARY) {
+    handleWsCommand(client, data, len);
+  } else if (info->opcode != WS_TEXT) {
+    return;
+  } else if (len == 13 && memcmp(data, "format:binary", 13) == 0) {
+    setClientFormat(client->id(), true);
+  } else if (len == 11 && memcmp(data, "format:json", 11) == 0) {
+    setClientFormat(client->id(), false);
+  }
+}
+
+void setupWebSocket(AsyncWebServer& server) {
+  notifyMutex = xSemaphoreCreateMutex();
+  ws.onEvent([](AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
+    if (type == WS_EVT_CONNECT) {
+      Serial.printf("WebSocket client #%u connected\n", client->id());
+      addClient(client);
+    } else if (type == WS_EVT_DISCONNECT) {
+      Serial.printf("WebSocket client #%u disconnected\n", client->id());
+      removeClient(client->id());
+    } else if (type == WS_EVT_DATA) {
+      handleClientMessage(client, arg, data, len);
+    }
+  });
+
+  server.addHandler(&ws);
+}
+
+// Copies the slot table so clients can be sent to outside clientsMux
+static size_t snapshotClients(NotifyClient *copy) {
+  size_t count = 0;
+  portENTER_CRITICAL(&clientsMux);
+  for (const NotifyClient &slot : clients) {
+    if (slot.id != 0) copy[count++] = slot;
+  }
+  portEXIT_CRITICAL(&clientsMux);
+  return count;
+}
+
+static void setPending(uint32_t id, NotifyKind kind, bool pending) {
+  uint8_t bit = 1 << kind;
+  portENTER_CRITICAL(&clientsMux);
+  for (NotifyClient &slot : clients) {
+    if (slot.id == id) slot.pending = pending ? (slot.pending | bit) : (slot.pending & ~bit);
+  }
+  portEXIT_CRITICAL(&clientsMux);
+}
+
+static void setFinalSeq(uint32_t id, uint32_t seq) {
+  portENTER_CRITICAL(&clientsMux);
+  for (NotifyClient &slot : clients) {
+    if (slot.id == id) slot.finalSeq = seq;
+  }
+  portEXIT_CRITICAL(&clientsMux);
+}
+
+static AsyncWebSocketSharedBuffer &frameFor(NotifyMessage &message, bool binary) {
+  AsyncWebSocketSharedBuffer &frame = binary ? message.binaryFrame : message.textFrame;
+  if (!frame) {
+    const uint8_t *data = binary ? message.binary : (const uint8_t *)message.text;
+    size_t length = binary ? message.binaryLength : message.textLength;
+    frame = std::make_shared<std::vector<uint8_t>>(data, data + length);
+    framesBuilt++;
+  }
+  return frame;
+}
+
+/**
+ * Sends the latest message of a kind to one client, or marks it pending if
+ * the client is backed up
+ */
+static void sendToClient(const NotifyClient &slot, NotifyKind kind) {
+  AsyncWebSocketClient *client = ws.client(slot.id);
+  if (!client || client->status() != WS_CONNECTED) return;
+  if (slot.binary && messages[kind].binaryLength == 0) {
+    setPending(slot.id, kind, false); // No binary form (raw status data)
+    return;
+  }
+  if (client->queueLen() >= WS_NOTIFY_MAX_BACKLOG) {
+    setPending(slot.id, kind, true);
+    framesCoalesced++;
+    return;
+  }
+  AsyncWebSocketSharedBuffer &frame = frameFor(messages[kind], slot.binary);
+  if (slot.binary ? client->binary(frame) : client->text(frame)) {
+    framesSent++;
+  }
+  setPending(slot.id, kind, false);
+}
+
+/**
+ * Sends a client the final messages it has not had yet, oldest first
+ * These skip the WS_NOTIFY_MAX_BACKLOG limit, and wait only while the
+ * library's queue is full
+ */
+static void sendFinals(const NotifyClient &slot) {
+  uint32_t seq = slot.finalSeq;
+  if (seq == finalCount) return;
+  AsyncWebSocketClient *client = ws.client(slot.id);
+  if (!client || client->status() != WS_CONNECTED) return;
+  if (finalCount - seq > WS_NOTIFY_FINAL_QUEUE) {
+    finalsLost += finalCount - seq - WS_NOTIFY_FINAL_QUEUE;
+    seq = finalCount - WS_NOTIFY_FINAL_QUEUE;
+  }
+  for (; seq != finalCount && !client->queueIsFull(); seq++) {
+    AsyncWebSocketSharedBuffer &frame = frameFor(finals[seq % WS_NOTIFY_FINAL_QUEUE], slot.binary);
+    if (slot.binary ? client->binary(frame) : client->text(frame)) {
+      framesSent++;
+    }
+  }
+  setFinalSeq(slot.id, seq);
+}
+
+static void recordBroadcast(uint32_t start, size_t count) {
+  uint32_t elapsed = micros() - start;
+  broadcasts++;
+  broadcastTotalUs += elapsed;
+  if (elapsed > broadcastMaxUs) broadcastMaxUs = elapsed;
+  if (count > broadcastClientsMax) broadcastClientsMax = count;
+}
+
+// Sends a freshly formatted message to every client; caller holds notifyMutex
+static void broadcast(NotifyKind kind) {
+  uint32_t start = micros();
+  NotifyMessage &message = messages[kind];
+  message.textFrame.reset();
+  message.binaryFrame.reset();
+  message.sent = true;
+
+  NotifyClient targets[WS_NOTIFY_MAX_CLIENTS];
+  size_t count = snapshotClients(targets);
+  for (size_t i = 0; i < count; i++) {
+    if (kind == NOTIFY_PROGRESS) sendFinals(targets[i]); // Earlier verdicts go first
+    sendToClient(targets[i], kind);
+  }
+  recordBroadcast(start, count);
+}
+
+// Sends the newest final message to every client; caller holds notifyMutex
+static void broadcastFinal() {
+  uint32_t start = micros();
+  NotifyClient targets[WS_NOTIFY_MAX_CLIENTS];
+  size_t count = snapshotClients(targets);
+  for (size_t i = 0; i < count; i++) {
+    sendFinals(targets[i]);
+  }
+  recordBroadcast(start, count);
+}
+
+void wsNotifyLoop() {
+  if (!notifyMutex) return;
+  NotifyClient targets[WS_NOTIFY_MAX_CLIENTS];
+  size_t count = snapshotClients(targets);
+  bool anyPending = false;
+  for (size_t i = 0; i < count; i++) {
+    anyPending |= targets[i].pending != 0 || targets[i].finalSeq != finalCount;
+  }
+  if (!anyPending) return;
+
+  xSemaphoreTake(notifyMutex, portMAX_DELAY);
+  count = snapshotClients(targets);
+  for (size_t i = 0; i < count; i++) {
+    sendFinals(targets[i]);
+    for (int kind = 0; kind < NOTIFY_KIND_COUNT; kind++) {
+      if (!(targets[i].pending & (1 << kind))) continue;
+      if (messages[kind].sent) {
+        sendToClient(targets[i], (NotifyKind)kind);
+      } else {
+        setPending(targets[i].id, (NotifyKind)kind, false);
+      }
+    }
+  }
+  xSemaphoreGive(notifyMutex);
+}
+
+// Appends s as a JSON string body (without quotes), truncating to fit
+static size_t appendJsonEscaped(char *out, size_t pos, size_t size, const char *s) {
+  for (; *s && pos + 7 < size; s++) {
+    uint8_t c = *s;
+    if (c == '"' || c == '\\') {
+      out[pos++] = '\\';
+      out[pos++] = c;
+    } else if (c < 0x20) {
+      pos += snprintf(out + pos, size - pos, "\\u%04x", c);
+    } else {
+      out[pos++] = c;
+    }
+  }
+  out[pos] = '\0';
+  return pos;
+}
+
+// Appends printf output, clamped to the buffer
+static size_t appendFormat(char *out, size_t pos, size_t size, const char *format, ...) {
+  if (pos >= size - 1) return pos;
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(out + pos, size - pos, format, args);
+  va_end(args);
+  if (written < 0) return pos;
+  return min(pos + (size_t)written, size - 1);
+}
+
+static void putU32(uint8_t *out, uint32_t value) {
+  out[0] = value;
+  out[1] = value >> 8;
+  out[2] = value >> 16;
+  out[3] = value >> 24;
+}
+
+static WsProgressStage stageCode(const char *stage) {
+  if (strcmp(stage, "transfer") == 0) return WS_STAGE_TRANSFER;
+  if (strcmp(stage, "complete") == 0) return WS_STAGE_COMPLETE;
+  if (strcmp(stage, "error") == 0) return WS_STAGE_ERROR;
+  return WS_STAGE_OTHER;
+}
+
+// Fills a progress message; notifyMutex held
+static void formatProgress(NotifyMessage &progress, const char *stage, WsProgressStage code, int percentage,
+                           const char *message, unsigned long now, uint16_t job) {
+  size_t size = sizeof(progress.text);
+  size_t pos = appendFormat(progress.text, 0, size, "{\"type\":\"upload_progress\",\"stage\":\"");
+  pos = appendJsonEscaped(progress.text, pos, size, stage);
+  pos = appendFormat(progress.text, pos, size, "\",\"percentage\":%d,\"message\":\"", percentage);
+  pos = appendJsonEscaped(progress.text, pos, size, message);
+  pos = appendFormat(progress.text, pos, size, "\",\"timestamp\":%lu", now);
+  if (job) pos = appendFormat(progress.text, pos, size, ",\"job\":%u", job);
+  progress.textLength = appendFormat(progress.text, pos, size, "}");
+
+  size_t messageLength = min(strlen(message), sizeof(progress.binary) - 9);
+  progress.binary[0] = 'P';
+  progress.binary[1] = code;
+  progress.binary[2] = constrain(percentage, 0, 100);
+  putU32(progress.binary + 3, now);
+  progress.binary[7] = job;
+  progress.binary[8] = job >> 8;
+  memcpy(progress.binary + 9, message, messageLength);
+  progress.binaryLength = 9 + messageLength;
+}
+
+void notifyProgress(const char *stage, int percentage, const char *message, uint16_t job) {
+  static unsigned long lastUpdate = 0;
+  static int lastPercentage = -1;
+  static WsProgressStage lastStage = WS_STAGE_OTHER;
+  static uint16_t lastJob = 0;
+
+  unsigned long now = millis();
+  WsProgressStage code = stageCode(stage);
+
+  // Always send these critical messages regardless of throttling
+  bool isCritical = (percentage == 0 || percentage == 100 ||
+                     code == WS_STAGE_COMPLETE || code == WS_STAGE_ERROR ||
+                     code != lastStage ||  // Always send when stage changes
+                     job != lastJob);      // or when another upload reports
+
+  // Apply throttling only for non-critical updates
+  if (!isCritical && (now - lastUpdate < 100 || abs(percentage - lastPercentage) < 2)) {
+    return;
+  }
+
+  lastUpdate = now;
+  lastPercentage = percentage;
+  lastStage = code;
+  lastJob = job;
+  Serial.printf("Progress: job %u %s - %d%% - %s\n", job, stage, percentage, message);
+  if (!notifyMutex) return;
+
+  xSemaphoreTake(notifyMutex, portMAX_DELAY);
+  if (code == WS_STAGE_COMPLETE || code == WS_STAGE_ERROR) {
+    NotifyMessage &verdict = finals[finalCount % WS_NOTIFY_FINAL_QUEUE];
+    verdict.textFrame.reset();
+    verdict.binaryFrame.reset();
+    formatProgress(verdict, stage, code, percentage, message, now, job);
+    finalCount++;
+    if (progressJob == job) {
+      messages[NOTIFY_PROGRESS].sent = false; // The verdict supersedes the job's last percentage
+    }
+    broadcastFinal();
+  } else {
+    formatProgress(messages[NOTIFY_PROGRESS], stage, code, percentage, message, now, job);
+    progressJob = job;
+    broadcast(NOTIFY_PROGRESS);
+  }
+  xSemaphoreGive(notifyMutex);
+}
+
+/**
+ * Reads an unsigned number field from a flat JSON object
+ * The Grand Central's STATUS lines are printf-generated, so a scan is enough
+ */
+static bool jsonUnsignedField(const char *json, const char *key, uint32_t &value) {
+  size_t keyLength = strlen(key);
+  for (const char *p = strchr(json, '"'); p; p = strchr(p + 1, '"')) {
+    if (strncmp(p + 1, key, keyLength) != 0 || p[1 + keyLength] != '"') continue;
+    const char *colon = p + 2 + keyLength;
+    while (*colon == ' ') colon++;
+    if (*colon != ':') continue;
+    char *end;
+    unsigned long parsed = strtoul(colon + 1, &end, 10);
+    if (end == colon + 1) return false;
+    value = parsed;
+    return true;
+  }
+  return false;
+}
+
+// Fills the status message; notifyMutex held
+static void setStatusMessage(unsigned long now, bool hasCurrent, uint32_t currentTime, bool hasTotal,
+                             uint32_t totalTime, const char *raw) {
+  NotifyMessage &status = messages[NOTIFY_STATUS];
+  size_t size = sizeof(status.text);
+  size_t pos = appendFormat(status.text, 0, size, "{\"type\":\"playback_status\",\"timestamp\":%lu", now);
+  if (hasCurrent) pos = appendFormat(status.text, pos, size, ",\"currentTime\":%lu", (unsigned long)currentTime);
+  if (hasTotal) pos = appendFormat(status.text, pos, size, ",\"totalTime\":%lu", (unsigned long)totalTime);
+  if (!hasCurrent && !hasTotal) {
+    // Not a time update, forward the raw data
+    pos = appendFormat(status.text, pos, size, ",\"rawData\":\"");
+    pos = appendJsonEscaped(status.text, pos, size - 2, raw);
+    pos = appendFormat(status.text, pos, size, "\"");
+  }
+  status.textLength = appendFormat(status.text, pos, size, "}");
+
+  status.binary[0] = 'S';
+  putU32(status.binary + 1, currentTime);
+  putU32(status.binary + 5, totalTime);
+  putU32(status.binary + 9, now);
+  status.binaryLength = (hasCurrent || hasTotal) ? 13 : 0;
+}
+
+void notifyPlaybackStatus(const char *json) {
+  uint32_t currentTime = 0, totalTime = 0, generation = 0;
+  bool hasCurrent = jsonUnsignedField(json, "currentTime", currentTime);
+  bool hasTotal = jsonUnsignedField(json, "totalTime", totalTime);
+  if (jsonUnsignedField(json, "gen", generation)) {
+    songCacheCheckGeneration(generation);
+  }
+  Serial.printf("Playback Status: %s\n", json);
+  if (hasCurrent && hasTotal) {
+    playbackClockStatus(currentTime, totalTime); // Broadcast by playbackClockLoop()
+    return;
+  }
+  if (!notifyMutex) return;
+
+  xSemaphoreTake(notifyMutex, portMAX_DELAY);
+  setStatusMessage(millis(), hasCurrent, currentTime, hasTotal, totalTime, json);
+  broadcast(NOTIFY_STATUS);
+  xSemaphoreGive(notifyMutex);
+}
+
+void notifyPlaybackPosition(uint32_t currentTime, uint32_t totalTime) {
+  if (!notifyMutex) return;
+  xSemaphoreTake(notifyMutex, portMAX_DELAY);
+  setStatusMessage(millis(), true, currentTime, true, totalTime, nullptr);
+  broadcast(NOTIFY_STATUS);
+  xSemaphoreGive(notifyMutex);
+}
+
+void reportWsNotifyStats(Print &out) {
+  uint32_t count = broadcasts ? broadcasts : 1;
+  out.printf("%lu broadcasts, avg %lu us max %lu us, up to %lu clients\n", (unsigned long)broadcasts,
+             (unsigned long)(broadcastTotalUs / count), (unsigned long)broadcastMaxUs,
+             (unsigned long)broadcastClientsMax);
+  out.printf("%lu frames built, %lu sent, %lu coalesced, %lu final messages lost\n",
+             (unsigned long)framesBuilt, (unsigned long)framesSent, (unsigned long)framesCoalesced,
+             (unsigned long)finalsLost);
+  out.printf("heap free %lu, min free %lu\n", (unsigned long)ESP.getFreeHeap(),
+             (unsigned long)ESP.getMinFreeHeap());
+  reportWsCommandStats(out);
+  reportPlaybackClockStats(out);
+}
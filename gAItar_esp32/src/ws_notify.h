@@ -0,0 +1,74 @@
+#ifndef WS_NOTIFY_H
+#define WS_NOTIFY_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+/**
+ * Websocket notifications (upload progress and playback status) on /ws
+ * Messages are formatted into static buffers, and one frame per format is
+ * shared by every client a broadcast goes to
+ * Clients get JSON text by default; a client that sends "format:binary"
+ * gets the compact frames below instead ("format:json" switches back)
+ * Percentages and playback status are latest-state: a client with
+ * WS_NOTIFY_MAX_BACKLOG frames still queued is skipped, and gets the newest
+ * message once it drains. Complete and error messages reach every client
+ * once per job, in order, even while it is backed up
+ * Binary messages from clients are transport commands (ws_commands.h)
+ *
+ * Binary frames (little-endian):
+ *   'P' stage(u8) percentage(u8) timestamp(u32) job(u16) message (UTF-8, rest of frame)
+ *   'S' currentTime(u32) totalTime(u32) timestamp(u32)
+ */
+
+#define WS_NOTIFY_MAX_CLIENTS 8       // Same as the library's DEFAULT_MAX_WS_CLIENTS
+#define WS_NOTIFY_MAX_BACKLOG 2       // Queued frames above which a client is skipped
+#define WS_NOTIFY_MESSAGE_SIZE 256    // Longest formatted message
+#define WS_NOTIFY_FINAL_QUEUE 8       // Complete/error messages kept for backed-up clients
+
+// Stage byte of a binary progress frame
+enum WsProgressStage : uint8_t {
+  WS_STAGE_OTHER,
+  WS_STAGE_TRANSFER,
+  WS_STAGE_COMPLETE,
+  WS_STAGE_ERROR
+};
+
+void setupWebSocket(AsyncWebServer &server);
+
+/**
+ * Broadcasts upload progress; unimportant steps are throttled
+ * Called from the upload task, and from the web server task when an upload is queued
+ *
+ * @param job Upload queue job id (upload_queue.h), 0 when not about one upload
+ */
+void notifyProgress(const char *stage, int percentage, const char *message = "", uint16_t job = 0);
+
+/**
+ * Handles a Grand Central STATUS line: the time fields go to the playback
+ * clock (playback_clock.h), anything else is broadcast as raw data
+ * Called from the status task by the instruction UART reader
+ *
+ * @param json JSON part after "STATUS:"
+ */
+void notifyPlaybackStatus(const char *json);
+
+/**
+ * Broadcasts a playback position as a status message
+ * Called from the status task by the playback clock
+ */
+void notifyPlaybackPosition(uint32_t currentTime, uint32_t totalTime);
+
+/**
+ * Sends the final messages and latest states to clients that were skipped while backed up
+ * Called from the status task
+ */
+void wsNotifyLoop();
+
+/**
+ * Prints broadcast count, time per broadcast, frames sent and coalesced, and heap,
+ * followed by the command and playback clock stats
+ */
+void reportWsNotifyStats(Print &out);
+
+#endif